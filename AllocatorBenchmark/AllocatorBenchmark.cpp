@@ -0,0 +1,166 @@
+// Compares b2ConcurrentBlockAllocator with b2BlockAllocator.
+//
+// Each run keeps a window of live blocks of random sizes and replaces one
+// block per operation, which is roughly what creating and destroying
+// contacts does. The single-threaded runs show what the thread-safe path
+// costs when it is not needed. The multi-threaded runs compare it with the
+// only way to share a b2BlockAllocator, a lock around every call, and also
+// free every block on a different thread than the one that allocated it.
+//
+// Usage: AllocatorBenchmark [threads] [operations per thread]
+
+#include <Box2D/Box2D.h>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+static const int32 k_liveBlocks = 4096;
+
+struct Block
+{
+	void* p;
+	int32 size;
+};
+
+// Deterministic sizes so that every allocator sees the same sequence.
+static int32 RandomSize(uint32* seed)
+{
+	*seed = *seed * 1664525u + 1013904223u;
+	// Most requests are contacts, fixtures and bodies, a few are larger.
+	return 16 + (int32)((*seed >> 8) % (b2_maxBlockSize - 16));
+}
+
+// Serializes a b2BlockAllocator.
+class LockedBlockAllocator
+{
+public:
+	void* Allocate(int32 size)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_allocator.Allocate(size);
+	}
+
+	void Free(void* p, int32 size)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_allocator.Free(p, size);
+	}
+
+private:
+	std::mutex m_mutex;
+	b2BlockAllocator m_allocator;
+};
+
+template <typename Allocator>
+static void Churn(Allocator* allocator, Block* blocks, int32 operations,
+				  uint32 seed)
+{
+	for (int32 i = 0; i < operations; ++i)
+	{
+		Block& block = blocks[i % k_liveBlocks];
+		if (block.p)
+		{
+			allocator->Free(block.p, block.size);
+		}
+		block.size = RandomSize(&seed);
+		block.p = allocator->Allocate(block.size);
+	}
+}
+
+template <typename Allocator>
+static void FreeAll(Allocator* allocator, Block* blocks)
+{
+	for (int32 i = 0; i < k_liveBlocks; ++i)
+	{
+		if (blocks[i].p)
+		{
+			allocator->Free(blocks[i].p, blocks[i].size);
+			blocks[i].p = NULL;
+		}
+	}
+}
+
+template <typename Allocator>
+static float32 RunSingle(Allocator* allocator, int32 operations)
+{
+	Block* blocks = (Block*)calloc(k_liveBlocks, sizeof(Block));
+	Churn(allocator, blocks, k_liveBlocks, 1);
+	b2Timer timer;
+	Churn(allocator, blocks, operations, 2);
+	float32 ms = timer.GetMilliseconds();
+	FreeAll(allocator, blocks);
+	free(blocks);
+	return ms;
+}
+
+// Every thread churns its own window, then frees the window of its
+// neighbour.
+template <typename Allocator>
+static float32 RunThreaded(Allocator* allocator, int32 threadCount,
+						   int32 operations)
+{
+	Block* blocks = (Block*)calloc(threadCount * k_liveBlocks, sizeof(Block));
+	std::thread* threads = new std::thread[threadCount];
+	b2Timer timer;
+	for (int32 t = 0; t < threadCount; ++t)
+	{
+		threads[t] = std::thread(Churn<Allocator>, allocator,
+								 blocks + t * k_liveBlocks, operations,
+								 (uint32)t + 1);
+	}
+	for (int32 t = 0; t < threadCount; ++t)
+	{
+		threads[t].join();
+	}
+	for (int32 t = 0; t < threadCount; ++t)
+	{
+		Block* neighbour = blocks + ((t + 1) % threadCount) * k_liveBlocks;
+		threads[t] = std::thread(FreeAll<Allocator>, allocator, neighbour);
+	}
+	for (int32 t = 0; t < threadCount; ++t)
+	{
+		threads[t].join();
+	}
+	float32 ms = timer.GetMilliseconds();
+	delete [] threads;
+	free(blocks);
+	return ms;
+}
+
+int main(int argc, char** argv)
+{
+	int32 threadCount = argc > 1 ? atoi(argv[1]) :
+		(int32)std::thread::hardware_concurrency();
+	threadCount = b2Clamp(threadCount, 1, b2_maxThreads);
+	int32 operations = argc > 2 ? atoi(argv[2]) : 4000000;
+
+	printf("%d operations per thread, %d live blocks per thread\n\n",
+		   operations, k_liveBlocks);
+
+	{
+		b2BlockAllocator blockAllocator;
+		b2ConcurrentBlockAllocator concurrentAllocator;
+		float32 block = RunSingle(&blockAllocator, operations);
+		float32 concurrent = RunSingle(&concurrentAllocator, operations);
+		printf("1 thread\n");
+		printf("  b2BlockAllocator            %8.1f ms %6.1f ns/op\n",
+			   block, 1e6f * block / operations);
+		printf("  b2ConcurrentBlockAllocator  %8.1f ms %6.1f ns/op\n\n",
+			   concurrent, 1e6f * concurrent / operations);
+	}
+
+	{
+		LockedBlockAllocator lockedAllocator;
+		b2ConcurrentBlockAllocator concurrentAllocator;
+		float32 locked =
+			RunThreaded(&lockedAllocator, threadCount, operations);
+		float32 concurrent =
+			RunThreaded(&concurrentAllocator, threadCount, operations);
+		printf("%d threads, cross-thread frees\n", threadCount);
+		printf("  locked b2BlockAllocator     %8.1f ms\n", locked);
+		printf("  b2ConcurrentBlockAllocator  %8.1f ms\n", concurrent);
+	}
+
+	return 0;
+}
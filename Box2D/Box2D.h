@@ -31,6 +31,10 @@
 #include <Box2D/Common/b2Draw.h>
 #include <Box2D/Common/b2Stat.h>
 #include <Box2D/Common/b2Timer.h>
+#include <Box2D/Common/b2ThreadPool.h>
+#include <Box2D/Common/b2Trace.h>
+#include <Box2D/Common/b2ConcurrentBlockAllocator.h>
+#include <Box2D/Common/b2Deinterleave.h>
 
 #include <Box2D/Collision/Shapes/b2CircleShape.h>
 #include <Box2D/Collision/Shapes/b2EdgeShape.h>
@@ -44,9 +48,12 @@
 
 #include <Box2D/Dynamics/b2Body.h>
 #include <Box2D/Dynamics/b2Fixture.h>
+#include <Box2D/Dynamics/b2ChainOutline.h>
 #include <Box2D/Dynamics/b2WorldCallbacks.h>
 #include <Box2D/Dynamics/b2TimeStep.h>
 #include <Box2D/Dynamics/b2World.h>
+#include <Box2D/Dynamics/b2FixedTimeStepper.h>
+#include <Box2D/Dynamics/b2SimulationCache.h>
 
 #include <Box2D/Dynamics/Contacts/b2Contact.h>
 
@@ -62,6 +69,7 @@
 #include <Box2D/Dynamics/Joints/b2WeldJoint.h>
 #include <Box2D/Dynamics/Joints/b2WheelJoint.h>
 
+#include <Box2D/Particle/b2DistanceField.h>
 #include <Box2D/Particle/b2Particle.h>
 #include <Box2D/Particle/b2ParticleGroup.h>
 
@@ -17,6 +17,7 @@
 */
 
 #include <Box2D/Collision/b2BroadPhase.h>
+#include <Box2D/Common/b2Snapshot.h>
 
 b2BroadPhase::b2BroadPhase()
 {
@@ -29,6 +30,12 @@ b2BroadPhase::b2BroadPhase()
 	m_moveCapacity = 16;
 	m_moveCount = 0;
 	m_moveBuffer = (int32*)b2Alloc(m_moveCapacity * sizeof(int32));
+
+	m_queryProxyId = e_nullProxy;
+	m_queryTreeFlag = 0;
+
+	m_pairHashing = false;
+	m_threadPool = NULL;
 }
 
 b2BroadPhase::~b2BroadPhase()
@@ -37,9 +44,19 @@ b2BroadPhase::~b2BroadPhase()
 	b2Free(m_pairBuffer);
 }
 
-int32 b2BroadPhase::CreateProxy(const b2AABB& aabb, void* userData)
+int32 b2BroadPhase::CreateProxy(const b2AABB& aabb, void* userData, bool isStatic)
 {
-	int32 proxyId = m_tree.CreateProxy(aabb, userData);
+	int32 proxyId;
+	if (isStatic)
+	{
+		proxyId = m_staticTree.CreateProxy(aabb, userData);
+		b2Assert((proxyId & e_staticProxyFlag) == 0);
+		proxyId |= e_staticProxyFlag;
+	}
+	else
+	{
+		proxyId = m_tree.CreateProxy(aabb, userData);
+	}
 	++m_proxyCount;
 	BufferMove(proxyId);
 	return proxyId;
@@ -49,12 +66,27 @@ void b2BroadPhase::DestroyProxy(int32 proxyId)
 {
 	UnBufferMove(proxyId);
 	--m_proxyCount;
-	m_tree.DestroyProxy(proxyId);
+	if (IsStaticProxy(proxyId))
+	{
+		m_staticTree.DestroyProxy(proxyId & ~e_staticProxyFlag);
+	}
+	else
+	{
+		m_tree.DestroyProxy(proxyId);
+	}
 }
 
 void b2BroadPhase::MoveProxy(int32 proxyId, const b2AABB& aabb, const b2Vec2& displacement)
 {
-	bool buffer = m_tree.MoveProxy(proxyId, aabb, displacement);
+	bool buffer;
+	if (IsStaticProxy(proxyId))
+	{
+		buffer = m_staticTree.MoveProxy(proxyId & ~e_staticProxyFlag, aabb, displacement);
+	}
+	else
+	{
+		buffer = m_tree.MoveProxy(proxyId, aabb, displacement);
+	}
 	if (buffer)
 	{
 		BufferMove(proxyId);
@@ -95,12 +127,26 @@ void b2BroadPhase::UnBufferMove(int32 proxyId)
 // This is called from b2DynamicTree::Query when we are gathering pairs.
 bool b2BroadPhase::QueryCallback(int32 proxyId)
 {
+	proxyId |= m_queryTreeFlag;
+
 	// A proxy cannot form a pair with itself.
 	if (proxyId == m_queryProxyId)
 	{
 		return true;
 	}
 
+	AddPair(b2Min(proxyId, m_queryProxyId), b2Max(proxyId, m_queryProxyId));
+
+	return true;
+}
+
+void b2BroadPhase::AddPair(int32 proxyIdA, int32 proxyIdB)
+{
+	if (m_pairHashing && m_pairSet.Add(proxyIdA, proxyIdB) == false)
+	{
+		return;
+	}
+
 	// Grow the pair buffer as needed.
 	if (m_pairCount == m_pairCapacity)
 	{
@@ -111,9 +157,248 @@ bool b2BroadPhase::QueryCallback(int32 proxyId)
 		b2Free(oldBuffer);
 	}
 
-	m_pairBuffer[m_pairCount].proxyIdA = b2Min(proxyId, m_queryProxyId);
-	m_pairBuffer[m_pairCount].proxyIdB = b2Max(proxyId, m_queryProxyId);
+	m_pairBuffer[m_pairCount].proxyIdA = proxyIdA;
+	m_pairBuffer[m_pairCount].proxyIdB = proxyIdB;
 	++m_pairCount;
+}
+
+/// Gathers the pairs of one moved proxy into a range's pair buffer.
+struct b2BroadPhaseRangeQuery
+{
+	bool QueryCallback(int32 proxyId)
+	{
+		proxyId |= treeFlag;
+		if (proxyId != queryProxyId)
+		{
+			pairs->Append(b2Min(proxyId, queryProxyId),
+						  b2Max(proxyId, queryProxyId));
+		}
+		return true;
+	}
+
+	b2PairBuffer* pairs;
+	int32 queryProxyId;
+	int32 treeFlag;
+};
+
+void b2BroadPhase::QueryMovedProxiesTask(int32 begin, int32 end,
+										 int32 rangeIndex, void* context)
+{
+	b2BroadPhase* broadPhase = (b2BroadPhase*)context;
+	b2BroadPhaseRangeQuery query;
+	query.pairs = &broadPhase->m_rangePairs[rangeIndex];
+	for (int32 i = begin; i < end; ++i)
+	{
+		query.queryProxyId = broadPhase->m_moveBuffer[i];
+		if (query.queryProxyId == e_nullProxy)
+		{
+			continue;
+		}
+
+		const b2AABB& fatAABB = broadPhase->GetFatAABB(query.queryProxyId);
+		query.treeFlag = 0;
+		broadPhase->m_tree.Query(&query, fatAABB);
+		if (IsStaticProxy(query.queryProxyId) == false)
+		{
+			query.treeFlag = e_staticProxyFlag;
+			broadPhase->m_staticTree.Query(&query, fatAABB);
+		}
+	}
+}
+
+void b2BroadPhase::QueryMovedProxies()
+{
+	// Small batches are not worth waking the workers for.
+	static const int32 k_minProxiesPerRange = 32;
+
+	int32 threadCount = m_threadPool->GetThreadCount();
+	for (int32 i = 0; i < threadCount; ++i)
+	{
+		m_rangePairs[i].count = 0;
+	}
+
+	m_threadPool->ParallelFor(m_moveCount, k_minProxiesPerRange,
+							  QueryMovedProxiesTask, this);
+
+	// Merge the ranges in order so pairs come out as in a serial query.
+	for (int32 i = 0; i < threadCount; ++i)
+	{
+		const b2PairBuffer& pairs = m_rangePairs[i];
+		for (int32 j = 0; j < pairs.count; ++j)
+		{
+			AddPair(pairs.pairs[j].proxyIdA, pairs.pairs[j].proxyIdB);
+		}
+	}
+}
+
+b2MemoryUsage b2BroadPhase::GetMemoryUsage() const
+{
+	b2MemoryUsage usage = m_tree.GetMemoryUsage();
+	b2MemoryUsage staticUsage = m_staticTree.GetMemoryUsage();
+	usage.used += staticUsage.used;
+	usage.reserved += staticUsage.reserved;
+
+	int32 bufferBytes = m_moveCapacity * (int32)sizeof(int32) +
+		m_pairCapacity * (int32)sizeof(b2Pair) + m_pairSet.GetCapacityBytes();
+	for (int32 i = 0; i < b2_maxThreads; ++i)
+	{
+		bufferBytes += m_rangePairs[i].capacity * (int32)sizeof(b2Pair);
+	}
+	usage.used += bufferBytes;
+	usage.reserved += bufferBytes;
+
+	// The trees and buffers only grow, apart from the pair set which is
+	// small next to the trees.
+	usage.peak = usage.reserved;
+	return usage;
+}
 
+void b2BroadPhase::SaveSnapshot(b2SnapshotWriter* writer) const
+{
+	m_tree.SaveSnapshot(writer);
+	m_staticTree.SaveSnapshot(writer);
+	writer->Write(m_proxyCount);
+	writer->Write(m_moveCount);
+	writer->WriteArray(m_moveBuffer, m_moveCount);
+}
+
+void b2BroadPhase::RestoreSnapshot(b2SnapshotReader* reader)
+{
+	m_tree.RestoreSnapshot(reader);
+	m_staticTree.RestoreSnapshot(reader);
+	reader->Read(&m_proxyCount);
+	int32 moveCount = reader->Read<int32>();
+	if (moveCount > m_moveCapacity)
+	{
+		b2Free(m_moveBuffer);
+		m_moveCapacity = moveCount;
+		m_moveBuffer = (int32*)b2Alloc(m_moveCapacity * sizeof(int32));
+	}
+	m_moveCount = moveCount;
+	reader->ReadArray(m_moveBuffer, m_moveCount);
+}
+
+void b2PairBuffer::Append(int32 proxyIdA, int32 proxyIdB)
+{
+	if (count == capacity)
+	{
+		b2Pair* oldPairs = pairs;
+		capacity = capacity ? 2 * capacity : 64;
+		pairs = (b2Pair*)b2Alloc(capacity * sizeof(b2Pair));
+		if (oldPairs)
+		{
+			memcpy(pairs, oldPairs, count * sizeof(b2Pair));
+			b2Free(oldPairs);
+		}
+	}
+
+	pairs[count].proxyIdA = proxyIdA;
+	pairs[count].proxyIdB = proxyIdB;
+	++count;
+}
+
+// Marks an empty slot. Proxy ids are never negative, so no pair maps to it.
+static const uint64 b2_emptyPairKey = ~(uint64)0;
+
+static inline uint64 b2PairKey(int32 proxyIdA, int32 proxyIdB)
+{
+	return ((uint64)(uint32)proxyIdA << 32) | (uint32)proxyIdB;
+}
+
+static inline uint32 b2PairHash(uint64 key)
+{
+	// Fibonacci hashing spreads the sequential ids over the table.
+	return (uint32)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+b2PairSet::b2PairSet()
+{
+	m_keys = NULL;
+	m_capacity = 0;
+	m_count = 0;
+	Resize(256);
+}
+
+b2PairSet::~b2PairSet()
+{
+	b2Free(m_keys);
+}
+
+void b2PairSet::Clear()
+{
+	// Give back memory after a burst, e.g. an explosion, has passed.
+	if (m_capacity > 256 && 8 * m_count < m_capacity)
+	{
+		int32 capacity = m_capacity / 2;
+		b2Free(m_keys);
+		m_keys = NULL;
+		m_count = 0;
+		Resize(capacity);
+		return;
+	}
+
+	memset(m_keys, 0xFF, m_capacity * sizeof(uint64));
+	m_count = 0;
+}
+
+bool b2PairSet::Add(int32 proxyIdA, int32 proxyIdB)
+{
+	b2Assert(0 <= proxyIdA && proxyIdA < proxyIdB);
+
+	// Keep the load factor at or below one half.
+	if (2 * (m_count + 1) > m_capacity)
+	{
+		Resize(2 * m_capacity);
+	}
+
+	uint64 key = b2PairKey(proxyIdA, proxyIdB);
+	uint32 mask = (uint32)m_capacity - 1;
+	uint32 index = b2PairHash(key) & mask;
+	while (m_keys[index] != b2_emptyPairKey)
+	{
+		if (m_keys[index] == key)
+		{
+			return false;
+		}
+		index = (index + 1) & mask;
+	}
+
+	m_keys[index] = key;
+	++m_count;
 	return true;
 }
+
+void b2PairSet::Resize(int32 capacity)
+{
+	b2Assert((capacity & (capacity - 1)) == 0);
+	uint64* oldKeys = m_keys;
+	int32 oldCapacity = m_capacity;
+
+	m_capacity = capacity;
+	m_keys = (uint64*)b2Alloc(m_capacity * sizeof(uint64));
+	memset(m_keys, 0xFF, m_capacity * sizeof(uint64));
+
+	if (oldKeys == NULL)
+	{
+		return;
+	}
+
+	// Reinsert the existing keys.
+	uint32 mask = (uint32)m_capacity - 1;
+	for (int32 i = 0; i < oldCapacity; ++i)
+	{
+		uint64 key = oldKeys[i];
+		if (key == b2_emptyPairKey)
+		{
+			continue;
+		}
+
+		uint32 index = b2PairHash(key) & mask;
+		while (m_keys[index] != b2_emptyPairKey)
+		{
+			index = (index + 1) & mask;
+		}
+		m_keys[index] = key;
+	}
+	b2Free(oldKeys);
+}
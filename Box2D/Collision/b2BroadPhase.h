@@ -22,6 +22,7 @@
 #include <Box2D/Common/b2Settings.h>
 #include <Box2D/Collision/b2Collision.h>
 #include <Box2D/Collision/b2DynamicTree.h>
+#include <Box2D/Common/b2ThreadPool.h>
 #include <algorithm>
 
 struct b2Pair
@@ -30,6 +31,47 @@ struct b2Pair
 	int32 proxyIdB;
 };
 
+/// A growable array of pairs.
+struct b2PairBuffer
+{
+	b2PairBuffer() : pairs(NULL), count(0), capacity(0) {}
+	~b2PairBuffer() { if (pairs) b2Free(pairs); }
+
+	void Append(int32 proxyIdA, int32 proxyIdB);
+
+	b2Pair* pairs;
+	int32 count;
+	int32 capacity;
+};
+
+/// An open-addressing hash set of pairs. This drops duplicate pairs as
+/// they are found so the pair buffer does not need to be sorted. The set
+/// only holds the pairs of one UpdatePairs call: it does not remember pairs
+/// across steps, so it never hides the pairs of a proxy.
+class b2PairSet
+{
+public:
+	b2PairSet();
+	~b2PairSet();
+
+	/// Remove all pairs. Storage is kept unless it is mostly unused.
+	void Clear();
+
+	/// Add a pair with proxyIdA < proxyIdB.
+	/// @return false if the pair is already in the set.
+	bool Add(int32 proxyIdA, int32 proxyIdB);
+
+	/// Get the number of bytes held by the table.
+	int32 GetCapacityBytes() const { return m_capacity * (int32)sizeof(uint64); }
+
+private:
+	void Resize(int32 capacity);
+
+	uint64* m_keys;
+	int32 m_capacity;
+	int32 m_count;
+};
+
 /// The broad-phase is used for computing pairs and performing volume queries and ray casts.
 /// This broad-phase does not persist pairs. Instead, this reports potentially new pairs.
 /// It is up to the client to consume the new pairs and to track subsequent overlap.
@@ -39,15 +81,18 @@ public:
 
 	enum
 	{
-		e_nullProxy = -1
+		e_nullProxy = -1,
+		/// Set on the ids of proxies that live in the static tree.
+		e_staticProxyFlag = 0x40000000
 	};
 
 	b2BroadPhase();
 	~b2BroadPhase();
 
 	/// Create a proxy with an initial AABB. Pairs are not reported until
-	/// UpdatePairs is called.
-	int32 CreateProxy(const b2AABB& aabb, void* userData);
+	/// UpdatePairs is called. Static proxies are kept in a separate tree
+	/// that is never refit by moving proxies and never paired with itself.
+	int32 CreateProxy(const b2AABB& aabb, void* userData, bool isStatic = false);
 
 	/// Destroy a proxy. It is up to the client to remove any pairs.
 	void DestroyProxy(int32 proxyId);
@@ -65,16 +110,38 @@ public:
 	/// Get user data from a proxy. Returns NULL if the id is invalid.
 	void* GetUserData(int32 proxyId) const;
 
+	/// Set the user data of a proxy.
+	void SetUserData(int32 proxyId, void* userData);
+
+	/// Is proxyId the id of a proxy in either tree? This accepts any id.
+	bool IsProxy(int32 proxyId) const;
+
 	/// Test overlap of fat AABBs.
 	bool TestOverlap(int32 proxyIdA, int32 proxyIdB) const;
 
 	/// Get the number of proxies.
 	int32 GetProxyCount() const;
 
+	/// Is this proxy stored in the static tree?
+	static bool IsStaticProxy(int32 proxyId);
+
 	/// Update the pairs. This results in pair callbacks. This can only add pairs.
 	template <typename T>
 	void UpdatePairs(T* callback);
 
+	/// Drop duplicate pairs with a hash set while the trees are queried,
+	/// instead of sorting the pair buffer. Pairs are then reported in the
+	/// order they are found rather than sorted by proxy id.
+	void SetPairHashing(bool flag);
+
+	/// Is pair hashing enabled?
+	bool GetPairHashing() const;
+
+	/// Query the trees for moved proxies on this pool. Pairs found by each
+	/// range are merged in order, so the result matches a serial update.
+	/// b2Alloc must be thread safe. Pass NULL to query on the calling thread.
+	void SetThreadPool(b2ThreadPool* threadPool);
+
 	/// Query an AABB for overlapping proxies. The callback class
 	/// is called for each proxy that overlaps the supplied AABB.
 	template <typename T>
@@ -90,20 +157,54 @@ public:
 	template <typename T>
 	void RayCast(T* callback, const b2RayCastInput& input) const;
 
-	/// Get the height of the embedded tree.
+	/// Ray-cast a packet of rays against the proxies in a single traversal
+	/// of each tree. See b2DynamicTree::RayCastPacket.
+	template <typename T>
+	void RayCastPacket(T* callback, b2RayCastInput* inputs, int32 count) const;
+
+	/// Get the height of the embedded trees.
 	int32 GetTreeHeight() const;
 
-	/// Get the balance of the embedded tree.
+	/// Get the balance of the embedded trees.
 	int32 GetTreeBalance() const;
 
-	/// Get the quality metric of the embedded tree.
+	/// Get the quality metric of the dynamic tree.
 	float32 GetTreeQuality() const;
 
+	/// Get the quality metric of the static tree.
+	float32 GetStaticTreeQuality() const;
+
+	/// Get the memory held by the trees and the pair and move buffers.
+	b2MemoryUsage GetMemoryUsage() const;
+
+	/// Rebuild the static tree with a binned SAH build. Call this after
+	/// creating a large amount of static geometry. Proxy ids are preserved.
+	void RebuildStaticTree();
+
+	/// Rebuild both the static and the dynamic tree with a binned SAH build.
+	void RebuildTrees();
+
+	/// Defer linking static proxies into the static tree until
+	/// EndStaticBatch, which rebuilds it in one pass when there are many.
+	/// Nothing may query the broad-phase in between.
+	void BeginStaticBatch();
+
+	/// Build the static tree from the proxies created in the batch.
+	void EndStaticBatch();
+
 	/// Shift the world origin. Useful for large worlds.
 	/// The shift formula is: position -= newOrigin
 	/// @param newOrigin the new origin with respect to the old origin
 	void ShiftOrigin(const b2Vec2& newOrigin);
 
+	/// Write the trees and the move buffer to a snapshot.
+	void SaveSnapshot(b2SnapshotWriter* writer) const;
+
+	/// Replace the trees and the move buffer with ones read from a
+	/// snapshot. The user data of every proxy is NULL and must be set
+	/// again.
+	void RestoreSnapshot(b2SnapshotReader* reader);
+
 private:
 
 	friend class b2DynamicTree;
@@ -113,7 +214,15 @@ private:
 
 	bool QueryCallback(int32 proxyId);
 
+	const b2DynamicTree& GetTree(int32 proxyId) const;
+
+	void AddPair(int32 proxyIdA, int32 proxyIdB);
+	void QueryMovedProxies();
+	static void QueryMovedProxiesTask(int32 begin, int32 end, int32 rangeIndex,
+									  void* context);
+
 	b2DynamicTree m_tree;
+	b2DynamicTree m_staticTree;
 
 	int32 m_proxyCount;
 
@@ -126,6 +235,50 @@ private:
 	int32 m_pairCount;
 
 	int32 m_queryProxyId;
+	int32 m_queryTreeFlag;
+
+	bool m_pairHashing;
+	b2PairSet m_pairSet;
+
+	b2ThreadPool* m_threadPool;
+	b2PairBuffer m_rangePairs[b2_maxThreads];
+};
+
+/// Adapts tree callbacks so the client sees broad-phase proxy ids and so a
+/// query or ray-cast can continue from one tree into the next.
+template <typename T>
+struct b2BroadPhaseTreeCallback
+{
+	bool QueryCallback(int32 proxyId)
+	{
+		proceed = callback->QueryCallback(proxyId | treeFlag);
+		return proceed;
+	}
+
+	float32 RayCastCallback(const b2RayCastInput& input, int32 proxyId)
+	{
+		float32 value = callback->RayCastCallback(input, proxyId | treeFlag);
+		if (value == 0.0f)
+		{
+			proceed = false;
+		}
+		else if (value > 0.0f)
+		{
+			maxFraction = value;
+		}
+		return value;
+	}
+
+	float32 RayCastCallback(const b2RayCastInput& input, int32 proxyId,
+							int32 rayIndex)
+	{
+		return callback->RayCastCallback(input, proxyId | treeFlag, rayIndex);
+	}
+
+	T* callback;
+	int32 treeFlag;
+	bool proceed;
+	float32 maxFraction;
 };
 
 /// This is used to sort pairs.
@@ -144,21 +297,48 @@ inline bool b2PairLessThan(const b2Pair& pair1, const b2Pair& pair2)
 	return false;
 }
 
+inline bool b2BroadPhase::IsStaticProxy(int32 proxyId)
+{
+	return proxyId != e_nullProxy && (proxyId & e_staticProxyFlag) != 0;
+}
+
+inline const b2DynamicTree& b2BroadPhase::GetTree(int32 proxyId) const
+{
+	return IsStaticProxy(proxyId) ? m_staticTree : m_tree;
+}
+
 inline void* b2BroadPhase::GetUserData(int32 proxyId) const
 {
-	return m_tree.GetUserData(proxyId);
+	return GetTree(proxyId).GetUserData(proxyId & ~e_staticProxyFlag);
+}
+
+inline bool b2BroadPhase::IsProxy(int32 proxyId) const
+{
+	return GetTree(proxyId).IsProxy(proxyId & ~e_staticProxyFlag);
+}
+
+inline void b2BroadPhase::SetUserData(int32 proxyId, void* userData)
+{
+	if (IsStaticProxy(proxyId))
+	{
+		m_staticTree.SetUserData(proxyId & ~e_staticProxyFlag, userData);
+	}
+	else
+	{
+		m_tree.SetUserData(proxyId, userData);
+	}
 }
 
 inline bool b2BroadPhase::TestOverlap(int32 proxyIdA, int32 proxyIdB) const
 {
-	const b2AABB& aabbA = m_tree.GetFatAABB(proxyIdA);
-	const b2AABB& aabbB = m_tree.GetFatAABB(proxyIdB);
+	const b2AABB& aabbA = GetFatAABB(proxyIdA);
+	const b2AABB& aabbB = GetFatAABB(proxyIdB);
 	return b2TestOverlap(aabbA, aabbB);
 }
 
 inline const b2AABB& b2BroadPhase::GetFatAABB(int32 proxyId) const
 {
-	return m_tree.GetFatAABB(proxyId);
+	return GetTree(proxyId).GetFatAABB(proxyId & ~e_staticProxyFlag);
 }
 
 inline int32 b2BroadPhase::GetProxyCount() const
@@ -168,12 +348,12 @@ inline int32 b2BroadPhase::GetProxyCount() const
 
 inline int32 b2BroadPhase::GetTreeHeight() const
 {
-	return m_tree.GetHeight();
+	return b2Max(m_tree.GetHeight(), m_staticTree.GetHeight());
 }
 
 inline int32 b2BroadPhase::GetTreeBalance() const
 {
-	return m_tree.GetMaxBalance();
+	return b2Max(m_tree.GetMaxBalance(), m_staticTree.GetMaxBalance());
 }
 
 inline float32 b2BroadPhase::GetTreeQuality() const
@@ -181,32 +361,107 @@ inline float32 b2BroadPhase::GetTreeQuality() const
 	return m_tree.GetAreaRatio();
 }
 
+inline void b2BroadPhase::SetPairHashing(bool flag)
+{
+	m_pairHashing = flag;
+}
+
+inline bool b2BroadPhase::GetPairHashing() const
+{
+	return m_pairHashing;
+}
+
+inline void b2BroadPhase::SetThreadPool(b2ThreadPool* threadPool)
+{
+	m_threadPool = threadPool;
+}
+
+inline float32 b2BroadPhase::GetStaticTreeQuality() const
+{
+	return m_staticTree.GetAreaRatio();
+}
+
+inline void b2BroadPhase::RebuildStaticTree()
+{
+	m_staticTree.RebuildTopDown();
+}
+
+inline void b2BroadPhase::RebuildTrees()
+{
+	m_tree.RebuildTopDown();
+	m_staticTree.RebuildTopDown();
+}
+
+inline void b2BroadPhase::BeginStaticBatch()
+{
+	m_staticTree.BeginBulkInsert();
+}
+
+inline void b2BroadPhase::EndStaticBatch()
+{
+	m_staticTree.EndBulkInsert();
+}
+
 template <typename T>
 void b2BroadPhase::UpdatePairs(T* callback)
 {
-	// Reset pair buffer
+	// Reset pair buffer. The pair set starts empty as well: it only drops
+	// pairs found twice in this update. Proxies created since the last
+	// update are in the move buffer, so their pairs are found now, not a
+	// step later.
 	m_pairCount = 0;
+	if (m_pairHashing)
+	{
+		m_pairSet.Clear();
+	}
 
 	// Perform tree queries for all moving proxies.
-	for (int32 i = 0; i < m_moveCount; ++i)
+	if (m_threadPool)
+	{
+		QueryMovedProxies();
+	}
+	else
 	{
-		m_queryProxyId = m_moveBuffer[i];
-		if (m_queryProxyId == e_nullProxy)
+		for (int32 i = 0; i < m_moveCount; ++i)
 		{
-			continue;
-		}
+			m_queryProxyId = m_moveBuffer[i];
+			if (m_queryProxyId == e_nullProxy)
+			{
+				continue;
+			}
+
+			// We have to query the tree with the fat AABB so that
+			// we don't fail to create a pair that may touch later.
+			const b2AABB& fatAABB = GetFatAABB(m_queryProxyId);
 
-		// We have to query the tree with the fat AABB so that
-		// we don't fail to create a pair that may touch later.
-		const b2AABB& fatAABB = m_tree.GetFatAABB(m_queryProxyId);
+			// Query tree, create pairs and add them pair buffer.
+			m_queryTreeFlag = 0;
+			m_tree.Query(this, fatAABB);
 
-		// Query tree, create pairs and add them pair buffer.
-		m_tree.Query(this, fatAABB);
+			// Static proxies never pair with each other.
+			if (IsStaticProxy(m_queryProxyId) == false)
+			{
+				m_queryTreeFlag = e_staticProxyFlag;
+				m_staticTree.Query(this, fatAABB);
+			}
+		}
 	}
 
 	// Reset move buffer
 	m_moveCount = 0;
 
+	if (m_pairHashing)
+	{
+		// The pair set already removed the duplicates.
+		for (int32 i = 0; i < m_pairCount; ++i)
+		{
+			const b2Pair* pair = m_pairBuffer + i;
+			callback->AddPair(GetUserData(pair->proxyIdA),
+							  GetUserData(pair->proxyIdB));
+		}
+		return;
+	}
+
 	// Sort the pair buffer to expose duplicates.
 	std::sort(m_pairBuffer, m_pairBuffer + m_pairCount, b2PairLessThan);
 
@@ -215,8 +470,8 @@ void b2BroadPhase::UpdatePairs(T* callback)
 	while (i < m_pairCount)
 	{
 		b2Pair* primaryPair = m_pairBuffer + i;
-		void* userDataA = m_tree.GetUserData(primaryPair->proxyIdA);
-		void* userDataB = m_tree.GetUserData(primaryPair->proxyIdB);
+		void* userDataA = GetUserData(primaryPair->proxyIdA);
+		void* userDataB = GetUserData(primaryPair->proxyIdB);
 
 		callback->AddPair(userDataA, userDataB);
 		++i;
@@ -240,18 +495,56 @@ void b2BroadPhase::UpdatePairs(T* callback)
 template <typename T>
 inline void b2BroadPhase::Query(T* callback, const b2AABB& aabb) const
 {
-	m_tree.Query(callback, aabb);
+	b2BroadPhaseTreeCallback<T> wrapper;
+	wrapper.callback = callback;
+	wrapper.treeFlag = 0;
+	wrapper.proceed = true;
+	m_tree.Query(&wrapper, aabb);
+
+	if (wrapper.proceed)
+	{
+		wrapper.treeFlag = e_staticProxyFlag;
+		m_staticTree.Query(&wrapper, aabb);
+	}
 }
 
 template <typename T>
 inline void b2BroadPhase::RayCast(T* callback, const b2RayCastInput& input) const
 {
-	m_tree.RayCast(callback, input);
+	b2BroadPhaseTreeCallback<T> wrapper;
+	wrapper.callback = callback;
+	wrapper.treeFlag = 0;
+	wrapper.proceed = true;
+	wrapper.maxFraction = input.maxFraction;
+	m_tree.RayCast(&wrapper, input);
+
+	if (wrapper.proceed)
+	{
+		// Continue with the segment clipped by hits in the dynamic tree.
+		b2RayCastInput staticInput = input;
+		staticInput.maxFraction = wrapper.maxFraction;
+		wrapper.treeFlag = e_staticProxyFlag;
+		m_staticTree.RayCast(&wrapper, staticInput);
+	}
+}
+
+template <typename T>
+inline void b2BroadPhase::RayCastPacket(T* callback, b2RayCastInput* inputs,
+										int32 count) const
+{
+	// Rays clipped in the dynamic tree stay clipped in the static tree.
+	b2BroadPhaseTreeCallback<T> wrapper;
+	wrapper.callback = callback;
+	wrapper.treeFlag = 0;
+	m_tree.RayCastPacket(&wrapper, inputs, count);
+	wrapper.treeFlag = e_staticProxyFlag;
+	m_staticTree.RayCastPacket(&wrapper, inputs, count);
 }
 
 inline void b2BroadPhase::ShiftOrigin(const b2Vec2& newOrigin)
 {
 	m_tree.ShiftOrigin(newOrigin);
+	m_staticTree.ShiftOrigin(newOrigin);
 }
 
 #endif
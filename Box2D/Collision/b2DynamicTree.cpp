@@ -18,6 +18,7 @@
 */
 
 #include <Box2D/Collision/b2DynamicTree.h>
+#include <Box2D/Common/b2Snapshot.h>
 #include <memory.h>
 #include <string.h>
 
@@ -43,12 +44,18 @@ b2DynamicTree::b2DynamicTree()
 	m_path = 0;
 
 	m_insertionCount = 0;
+
+	m_bulkInsert = false;
+	m_bulkLeaves = NULL;
+	m_bulkLeafCount = 0;
+	m_bulkLeafCapacity = 0;
 }
 
 b2DynamicTree::~b2DynamicTree()
 {
 	// This frees the entire tree in one shot.
 	b2Free(m_nodes);
+	b2Free(m_bulkLeaves);
 }
 
 // Allocate a node from the pool. Grow the pool if necessary.
@@ -115,7 +122,25 @@ int32 b2DynamicTree::CreateProxy(const b2AABB& aabb, void* userData)
 	m_nodes[proxyId].userData = userData;
 	m_nodes[proxyId].height = 0;
 
-	InsertLeaf(proxyId);
+	if (m_bulkInsert)
+	{
+		// Linked by EndBulkInsert(). Until then the leaf keeps its place in
+		// m_bulkLeaves in child2, which leaves do not use otherwise.
+		if (m_bulkLeafCount == m_bulkLeafCapacity)
+		{
+			int32* oldLeaves = m_bulkLeaves;
+			m_bulkLeafCapacity = b2Max(2 * m_bulkLeafCapacity, 64);
+			m_bulkLeaves = (int32*)b2Alloc(m_bulkLeafCapacity * sizeof(int32));
+			memcpy(m_bulkLeaves, oldLeaves, m_bulkLeafCount * sizeof(int32));
+			b2Free(oldLeaves);
+		}
+		m_nodes[proxyId].child2 = m_bulkLeafCount;
+		m_bulkLeaves[m_bulkLeafCount++] = proxyId;
+	}
+	else
+	{
+		InsertLeaf(proxyId);
+	}
 
 	return proxyId;
 }
@@ -125,13 +150,27 @@ void b2DynamicTree::DestroyProxy(int32 proxyId)
 	b2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
 	b2Assert(m_nodes[proxyId].IsLeaf());
 
-	RemoveLeaf(proxyId);
+	// A leaf created in the current bulk insert is not linked yet.
+	int32 bulkIndex = m_nodes[proxyId].child2;
+	if (bulkIndex != b2_nullNode)
+	{
+		b2Assert(m_bulkInsert);
+		b2Assert(m_bulkLeaves[bulkIndex] == proxyId);
+		int32 lastLeaf = m_bulkLeaves[--m_bulkLeafCount];
+		m_bulkLeaves[bulkIndex] = lastLeaf;
+		m_nodes[lastLeaf].child2 = bulkIndex;
+	}
+	else
+	{
+		RemoveLeaf(proxyId);
+	}
 	FreeNode(proxyId);
 }
 
 bool b2DynamicTree::MoveProxy(int32 proxyId, const b2AABB& aabb, const b2Vec2& displacement)
 {
 	b2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
+	b2Assert(!m_bulkInsert);
 
 	b2Assert(m_nodes[proxyId].IsLeaf());
 
@@ -556,6 +595,50 @@ float32 b2DynamicTree::GetAreaRatio() const
 	return totalArea / rootArea;
 }
 
+b2MemoryUsage b2DynamicTree::GetMemoryUsage() const
+{
+	b2MemoryUsage usage;
+	usage.used = m_nodeCount * (int32)sizeof(b2TreeNode);
+	usage.reserved = m_nodeCapacity * (int32)sizeof(b2TreeNode);
+	usage.peak = usage.reserved;
+	return usage;
+}
+
+void b2DynamicTree::SaveSnapshot(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_root);
+	writer->Write(m_nodeCount);
+	writer->Write(m_nodeCapacity);
+	writer->Write(m_freeList);
+	writer->Write(m_path);
+	writer->Write(m_insertionCount);
+	writer->WriteArray(m_nodes, m_nodeCapacity);
+}
+
+void b2DynamicTree::RestoreSnapshot(b2SnapshotReader* reader)
+{
+	reader->Read(&m_root);
+	reader->Read(&m_nodeCount);
+	int32 nodeCapacity = reader->Read<int32>();
+	reader->Read(&m_freeList);
+	reader->Read(&m_path);
+	reader->Read(&m_insertionCount);
+	b2Assert(nodeCapacity > 0);
+	if (nodeCapacity != m_nodeCapacity)
+	{
+		b2Free(m_nodes);
+		m_nodeCapacity = nodeCapacity;
+		m_nodes = (b2TreeNode*)b2Alloc(m_nodeCapacity * sizeof(b2TreeNode));
+	}
+	reader->ReadArray(m_nodes, m_nodeCapacity);
+
+	// The saved pointers are meaningless here.
+	for (int32 i = 0; i < m_nodeCapacity; ++i)
+	{
+		m_nodes[i].userData = NULL;
+	}
+}
+
 // Compute the height of a sub-tree.
 int32 b2DynamicTree::ComputeHeight(int32 nodeId) const
 {
@@ -574,6 +657,11 @@ int32 b2DynamicTree::ComputeHeight(int32 nodeId) const
 
 int32 b2DynamicTree::ComputeHeight() const
 {
+	if (m_root == b2_nullNode)
+	{
+		return 0;
+	}
+
 	int32 height = ComputeHeight(m_root);
 	return height;
 }
@@ -773,6 +861,242 @@ void b2DynamicTree::RebuildBottomUp()
 	B2_DEBUG_STATEMENT(Validate());
 }
 
+void b2DynamicTree::RebuildTopDown()
+{
+	// Leaves of a bulk insert are not reachable from the root, so look at
+	// the node pool rather than the root. The rebuild links them, so they
+	// are no longer pending. A bulk insert in progress goes on with the
+	// proxies created from now on.
+	for (int32 i = 0; i < m_bulkLeafCount; ++i)
+	{
+		m_nodes[m_bulkLeaves[i]].child2 = b2_nullNode;
+	}
+	m_bulkLeafCount = 0;
+
+	if (m_nodeCount == 0)
+	{
+		m_root = b2_nullNode;
+		return;
+	}
+
+	int32* leaves = (int32*)b2Alloc(m_nodeCount * sizeof(int32));
+	b2Vec2* centers = (b2Vec2*)b2Alloc(m_nodeCount * sizeof(b2Vec2));
+	int32 count = 0;
+
+	// Build array of leaves. Free the rest. The build below allocates
+	// exactly as many internal nodes as are freed here, so the node pool
+	// never grows.
+	for (int32 i = 0; i < m_nodeCapacity; ++i)
+	{
+		if (m_nodes[i].height < 0)
+		{
+			// free node in pool
+			continue;
+		}
+
+		if (m_nodes[i].IsLeaf())
+		{
+			m_nodes[i].parent = b2_nullNode;
+			leaves[count] = i;
+			centers[count] = m_nodes[i].aabb.GetCenter();
+			++count;
+		}
+		else
+		{
+			FreeNode(i);
+		}
+	}
+
+	if (count > 0)
+	{
+		m_root = BuildTopDown(leaves, centers, count, 0);
+		m_nodes[m_root].parent = b2_nullNode;
+	}
+	else
+	{
+		m_root = b2_nullNode;
+	}
+
+	b2Free(centers);
+	b2Free(leaves);
+
+	B2_DEBUG_STATEMENT(Validate());
+}
+
+void b2DynamicTree::BeginBulkInsert()
+{
+	b2Assert(!m_bulkInsert);
+	m_bulkInsert = true;
+}
+
+void b2DynamicTree::EndBulkInsert()
+{
+	b2Assert(m_bulkInsert);
+	m_bulkInsert = false;
+
+	// A rebuild visits every leaf, so it only pays off when a good part of
+	// them are new.
+	if (4 * m_bulkLeafCount >= m_nodeCount)
+	{
+		RebuildTopDown();
+	}
+	else
+	{
+		for (int32 i = 0; i < m_bulkLeafCount; ++i)
+		{
+			m_nodes[m_bulkLeaves[i]].child2 = b2_nullNode;
+			InsertLeaf(m_bulkLeaves[i]);
+		}
+		m_bulkLeafCount = 0;
+	}
+}
+
+// Splits deeper than this halve the range instead of using the SAH, so that
+// the recursion depth stays below this plus log2 of the leaf count even when
+// the SAH keeps splitting off a few leaves.
+static const int32 b2_maxTopDownSahDepth = 32;
+
+// An empty box that any box can be combined with.
+static b2AABB b2EmptyAABB()
+{
+	b2AABB aabb;
+	aabb.lowerBound.Set(b2_maxFloat, b2_maxFloat);
+	aabb.upperBound.Set(-b2_maxFloat, -b2_maxFloat);
+	return aabb;
+}
+
+// Recursively split a range of leaves with a binned SAH and return the index
+// of the subtree root. Leaves are partitioned in place.
+int32 b2DynamicTree::BuildTopDown(int32* leaves, b2Vec2* centers, int32 count,
+								  int32 depth)
+{
+	b2Assert(count > 0);
+	b2Assert(depth <= b2_maxTopDownSahDepth + 32);
+	if (count == 1)
+	{
+		return leaves[0];
+	}
+
+	// Bound the leaf centers to choose the split axis.
+	b2Vec2 lower = centers[0];
+	b2Vec2 upper = centers[0];
+	for (int32 i = 1; i < count; ++i)
+	{
+		lower = b2Min(lower, centers[i]);
+		upper = b2Max(upper, centers[i]);
+	}
+
+	b2Vec2 extent = upper - lower;
+	int32 axis = extent.x >= extent.y ? 0 : 1;
+	float32 axisMin = axis == 0 ? lower.x : lower.y;
+	float32 axisExtent = axis == 0 ? extent.x : extent.y;
+
+	// Coincident centers cannot be told apart, nor binned, so they are
+	// split in half, as are the ranges below the SAH depth limit.
+	int32 leftCount = count / 2;
+	if (axisExtent > b2_epsilon && depth < b2_maxTopDownSahDepth)
+	{
+		const int32 k_binCount = 16;
+		int32 binCounts[k_binCount];
+		b2AABB binAABBs[k_binCount];
+		for (int32 i = 0; i < k_binCount; ++i)
+		{
+			binCounts[i] = 0;
+			binAABBs[i] = b2EmptyAABB();
+		}
+
+		// Drop each leaf into a bin along the split axis.
+		float32 binScale = k_binCount * (1.0f - b2_epsilon) / axisExtent;
+		for (int32 i = 0; i < count; ++i)
+		{
+			float32 c = axis == 0 ? centers[i].x : centers[i].y;
+			int32 bin = b2Min((int32)((c - axisMin) * binScale), k_binCount - 1);
+			binAABBs[bin].Combine(m_nodes[leaves[i]].aabb);
+			++binCounts[bin];
+		}
+
+		// Sweep from the right to get the cost of every right-hand side.
+		float32 rightCosts[k_binCount];
+		int32 rightTotal = 0;
+		b2AABB rightAABB = b2EmptyAABB();
+		for (int32 i = k_binCount - 1; i > 0; --i)
+		{
+			if (binCounts[i] > 0)
+			{
+				rightAABB.Combine(binAABBs[i]);
+				rightTotal += binCounts[i];
+			}
+			rightCosts[i] = rightTotal * (rightTotal > 0 ? rightAABB.GetPerimeter() : 0.0f);
+		}
+
+		// Sweep from the left and pick the cheapest split plane.
+		float32 bestCost = b2_maxFloat;
+		int32 bestBin = -1;
+		int32 leftTotal = 0;
+		b2AABB leftAABB = b2EmptyAABB();
+		for (int32 i = 0; i < k_binCount - 1; ++i)
+		{
+			if (binCounts[i] > 0)
+			{
+				leftAABB.Combine(binAABBs[i]);
+				leftTotal += binCounts[i];
+			}
+
+			if (leftTotal == 0 || leftTotal == count)
+			{
+				continue;
+			}
+
+			float32 cost = leftTotal * leftAABB.GetPerimeter() + rightCosts[i + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestBin = i;
+			}
+		}
+
+		if (bestBin >= 0)
+		{
+			// Partition the leaves about the chosen plane.
+			int32 i = 0;
+			int32 j = count - 1;
+			while (i <= j)
+			{
+				float32 c = axis == 0 ? centers[i].x : centers[i].y;
+				int32 bin = b2Min((int32)((c - axisMin) * binScale), k_binCount - 1);
+				if (bin <= bestBin)
+				{
+					++i;
+				}
+				else
+				{
+					b2Swap(leaves[i], leaves[j]);
+					b2Swap(centers[i], centers[j]);
+					--j;
+				}
+			}
+			leftCount = i;
+		}
+	}
+
+	b2Assert(0 < leftCount && leftCount < count);
+
+	int32 child1 = BuildTopDown(leaves, centers, leftCount, depth + 1);
+	int32 child2 = BuildTopDown(leaves + leftCount, centers + leftCount, count - leftCount, depth + 1);
+
+	int32 parentIndex = AllocateNode();
+	b2TreeNode* parent = m_nodes + parentIndex;
+	parent->child1 = child1;
+	parent->child2 = child2;
+	parent->height = 1 + b2Max(m_nodes[child1].height, m_nodes[child2].height);
+	parent->aabb.Combine(m_nodes[child1].aabb, m_nodes[child2].aabb);
+
+	m_nodes[child1].parent = parentIndex;
+	m_nodes[child2].parent = parentIndex;
+
+	return parentIndex;
+}
+
 void b2DynamicTree::ShiftOrigin(const b2Vec2& newOrigin)
 {
 	// Build array of leaves. Free the rest.
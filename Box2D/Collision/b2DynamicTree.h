@@ -22,6 +22,9 @@
 #include <Box2D/Collision/b2Collision.h>
 #include <Box2D/Common/b2GrowableStack.h>
 
+class b2SnapshotWriter;
+class b2SnapshotReader;
+
 #define b2_nullNode (-1)
 
 /// A node in the dynamic tree. The client does not interact with this directly.
@@ -61,6 +64,12 @@ struct b2TreeNode
 class b2DynamicTree
 {
 public:
+	enum
+	{
+		/// The maximum number of rays in a packet for RayCastPacket.
+		e_maxRayPacketSize = 32
+	};
+
 	/// Constructing the tree initializes the node pool.
 	b2DynamicTree();
 
@@ -83,6 +92,13 @@ public:
 	/// @return the proxy user data or 0 if the id is invalid.
 	void* GetUserData(int32 proxyId) const;
 
+	/// Set proxy user data.
+	void SetUserData(int32 proxyId, void* userData);
+
+	/// Is proxyId the id of a proxy in this tree? Unlike the other
+	/// accessors this accepts any id, e.g. one read from a snapshot.
+	bool IsProxy(int32 proxyId) const;
+
 	/// Get the fat AABB for a proxy.
 	const b2AABB& GetFatAABB(int32 proxyId) const;
 
@@ -101,6 +117,18 @@ public:
 	template <typename T>
 	void RayCast(T* callback, const b2RayCastInput& input) const;
 
+	/// Ray-cast a packet of rays against the tree in a single traversal.
+	/// Nodes are visited once for all the rays that overlap them, which is
+	/// much cheaper than separate ray-casts when the rays are coherent, e.g.
+	/// a fan of rays from one point.
+	/// The callback is called as RayCastCallback(input, proxyId, rayIndex)
+	/// and returns a new max fraction for that ray as in RayCast.
+	/// @param inputs up to e_maxRayPacketSize rays. Each max fraction is
+	/// lowered in place as the callback clips its ray.
+	/// @param count the number of rays in the packet.
+	template <typename T>
+	void RayCastPacket(T* callback, b2RayCastInput* inputs, int32 count) const;
+
 	/// Validate this tree. For testing.
 	void Validate() const;
 
@@ -115,14 +143,43 @@ public:
 	/// Get the ratio of the sum of the node areas to the root area.
 	float32 GetAreaRatio() const;
 
+	/// Get the memory held by the node pool. The node pool never shrinks,
+	/// so the peak is the current reservation.
+	b2MemoryUsage GetMemoryUsage() const;
+
 	/// Build an optimal tree. Very expensive. For testing.
 	void RebuildBottomUp();
 
+	/// Rebuild the tree top-down from its current leaves using a binned surface
+	/// area heuristic. This runs in O(n log n) and gives much better trees than
+	/// incremental insertion for large sets of proxies that rarely move, such as
+	/// static level geometry. Proxy ids are preserved. During a bulk insert
+	/// this also links the proxies created so far.
+	void RebuildTopDown();
+
+	/// Stop linking proxies into the tree as they are created. When many
+	/// were, EndBulkInsert rebuilds the tree top-down in one pass, which is
+	/// much cheaper and gives a better tree than inserting them one at a
+	/// time; a few are inserted as usual. The tree must not be queried,
+	/// ray-cast or have proxies moved in between.
+	void BeginBulkInsert();
+
+	/// Link the proxies created since BeginBulkInsert into the tree.
+	void EndBulkInsert();
+
 	/// Shift the world origin. Useful for large worlds.
 	/// The shift formula is: position -= newOrigin
 	/// @param newOrigin the new origin with respect to the old origin
 	void ShiftOrigin(const b2Vec2& newOrigin);
 
+	/// Write the node pool to a snapshot.
+	void SaveSnapshot(b2SnapshotWriter* writer) const;
+
+	/// Replace the tree with one read from a snapshot. Proxy ids are
+	/// preserved but the user data of every leaf is NULL and must be set
+	/// again.
+	void RestoreSnapshot(b2SnapshotReader* reader);
+
 private:
 
 	int32 AllocateNode();
@@ -136,6 +193,8 @@ private:
 	int32 ComputeHeight() const;
 	int32 ComputeHeight(int32 nodeId) const;
 
+	int32 BuildTopDown(int32* leaves, b2Vec2* centers, int32 count, int32 depth);
+
 	void ValidateStructure(int32 index) const;
 	void ValidateMetrics(int32 index) const;
 
@@ -151,6 +210,12 @@ private:
 	uint32 m_path;
 
 	int32 m_insertionCount;
+
+	/// Leaves created since BeginBulkInsert, not linked into the tree yet.
+	bool m_bulkInsert;
+	int32* m_bulkLeaves;
+	int32 m_bulkLeafCount;
+	int32 m_bulkLeafCapacity;
 };
 
 inline void* b2DynamicTree::GetUserData(int32 proxyId) const
@@ -159,6 +224,19 @@ inline void* b2DynamicTree::GetUserData(int32 proxyId) const
 	return m_nodes[proxyId].userData;
 }
 
+inline void b2DynamicTree::SetUserData(int32 proxyId, void* userData)
+{
+	b2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
+	m_nodes[proxyId].userData = userData;
+}
+
+inline bool b2DynamicTree::IsProxy(int32 proxyId) const
+{
+	// Free nodes have a height of -1 and internal nodes a positive one.
+	return 0 <= proxyId && proxyId < m_nodeCapacity &&
+		m_nodes[proxyId].height == 0;
+}
+
 inline const b2AABB& b2DynamicTree::GetFatAABB(int32 proxyId) const
 {
 	b2Assert(0 <= proxyId && proxyId < m_nodeCapacity);
@@ -168,6 +246,7 @@ inline const b2AABB& b2DynamicTree::GetFatAABB(int32 proxyId) const
 template <typename T>
 inline void b2DynamicTree::Query(T* callback, const b2AABB& aabb) const
 {
+	b2Assert(!m_bulkInsert);
 	b2GrowableStack<int32, 256> stack;
 	stack.Push(m_root);
 
@@ -203,6 +282,7 @@ inline void b2DynamicTree::Query(T* callback, const b2AABB& aabb) const
 template <typename T>
 inline void b2DynamicTree::RayCast(T* callback, const b2RayCastInput& input) const
 {
+	b2Assert(!m_bulkInsert);
 	b2Vec2 p1 = input.p1;
 	b2Vec2 p2 = input.p2;
 	b2Vec2 r = p2 - p1;
@@ -286,4 +366,139 @@ inline void b2DynamicTree::RayCast(T* callback, const b2RayCastInput& input) con
 	}
 }
 
+/// A node to visit with the rays of a packet that may hit it.
+struct b2RayPacketNode
+{
+	int32 nodeId;
+	uint32 rayMask;
+};
+
+template <typename T>
+inline void b2DynamicTree::RayCastPacket(T* callback, b2RayCastInput* inputs,
+										 int32 count) const
+{
+	b2Assert(!m_bulkInsert);
+	b2Assert(0 <= count && count <= e_maxRayPacketSize);
+
+	// Per ray separating axis and segment bounding box, as in RayCast.
+	b2Vec2 v[e_maxRayPacketSize];
+	b2Vec2 abs_v[e_maxRayPacketSize];
+	b2AABB segmentAABBs[e_maxRayPacketSize];
+	uint32 activeMask = 0;
+	for (int32 i = 0; i < count; ++i)
+	{
+		const b2RayCastInput& input = inputs[i];
+		b2Vec2 r = input.p2 - input.p1;
+		if (r.LengthSquared() <= 0.0f || input.maxFraction <= 0.0f)
+		{
+			continue;
+		}
+		r.Normalize();
+		v[i] = b2Cross(1.0f, r);
+		abs_v[i] = b2Abs(v[i]);
+
+		b2Vec2 t = input.p1 + input.maxFraction * (input.p2 - input.p1);
+		segmentAABBs[i].lowerBound = b2Min(input.p1, t);
+		segmentAABBs[i].upperBound = b2Max(input.p1, t);
+		activeMask |= 1u << i;
+	}
+
+	if (activeMask == 0 || m_root == b2_nullNode)
+	{
+		return;
+	}
+
+	b2GrowableStack<b2RayPacketNode, 256> stack;
+	b2RayPacketNode rootEntry;
+	rootEntry.nodeId = m_root;
+	rootEntry.rayMask = activeMask;
+	stack.Push(rootEntry);
+
+	while (stack.GetCount() > 0)
+	{
+		b2RayPacketNode entry = stack.Pop();
+		uint32 rayMask = entry.rayMask & activeMask;
+		if (rayMask == 0)
+		{
+			continue;
+		}
+
+		const b2TreeNode* node = m_nodes + entry.nodeId;
+		b2Vec2 c = node->aabb.GetCenter();
+		b2Vec2 h = node->aabb.GetExtents();
+
+		// Keep the rays that overlap this node.
+		uint32 hitMask = 0;
+		for (int32 i = 0; i < count; ++i)
+		{
+			uint32 bit = 1u << i;
+			if ((rayMask & bit) == 0)
+			{
+				continue;
+			}
+
+			if (b2TestOverlap(node->aabb, segmentAABBs[i]) == false)
+			{
+				continue;
+			}
+
+			// Separating axis for segment (Gino, p80).
+			// |dot(v, p1 - c)| > dot(|v|, h)
+			float32 separation = b2Abs(b2Dot(v[i], inputs[i].p1 - c)) -
+				b2Dot(abs_v[i], h);
+			if (separation > 0.0f)
+			{
+				continue;
+			}
+
+			hitMask |= bit;
+		}
+
+		if (hitMask == 0)
+		{
+			continue;
+		}
+
+		if (node->IsLeaf() == false)
+		{
+			b2RayPacketNode child;
+			child.rayMask = hitMask;
+			child.nodeId = node->child1;
+			stack.Push(child);
+			child.nodeId = node->child2;
+			stack.Push(child);
+			continue;
+		}
+
+		for (int32 i = 0; i < count; ++i)
+		{
+			uint32 bit = 1u << i;
+			if ((hitMask & bit) == 0)
+			{
+				continue;
+			}
+
+			b2RayCastInput& input = inputs[i];
+			float32 value = callback->RayCastCallback(input, entry.nodeId, i);
+
+			if (value == 0.0f)
+			{
+				// The client has terminated this ray.
+				input.maxFraction = 0.0f;
+				activeMask &= ~bit;
+				continue;
+			}
+
+			if (value > 0.0f)
+			{
+				// Update segment bounding box.
+				input.maxFraction = value;
+				b2Vec2 t = input.p1 + value * (input.p2 - input.p1);
+				segmentAABBs[i].lowerBound = b2Min(input.p1, t);
+				segmentAABBs[i].upperBound = b2Max(input.p1, t);
+			}
+		}
+	}
+}
+
 #endif
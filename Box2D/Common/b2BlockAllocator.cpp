@@ -18,8 +18,12 @@
 */
 
 #include <Box2D/Common/b2BlockAllocator.h>
+#include <Box2D/Common/b2ConcurrentBlockAllocator.h>
+#include <Box2D/Common/b2Math.h>
+#include <algorithm>
 #include <limits.h>
 #include <memory.h>
+#include <mutex>
 #include <stddef.h>
 #include <string.h>
 #include <new> // For placement new
@@ -42,53 +46,55 @@ int32 b2BlockAllocator::s_blockSizes[b2_blockSizes] =
 	640,	// 13
 };
 uint8 b2BlockAllocator::s_blockSizeLookup[b2_maxBlockSize + 1];
-bool b2BlockAllocator::s_blockSizeLookupInitialized;
-
-struct b2Chunk
-{
-	int32 blockSize;
-	b2Block* blocks;
-};
-
-struct b2Block
-{
-	b2Block* next;
-};
+static std::once_flag b2_blockSizeLookupOnce;
 
 b2BlockAllocator::b2BlockAllocator()
 {
-	b2Assert((uint32)b2_blockSizes < UCHAR_MAX);
-
+	m_concurrent = NULL;
 	m_chunkSpace = b2_chunkArrayIncrement;
 	m_chunkCount = 0;
+	m_peakChunkCount = 0;
+	m_blockBytes = 0;
+	m_giantBytes = 0;
+	m_peakGiantBytes = 0;
 	m_chunks = (b2Chunk*)b2Alloc(m_chunkSpace * sizeof(b2Chunk));
 
 	memset(m_chunks, 0, m_chunkSpace * sizeof(b2Chunk));
 	memset(m_freeLists, 0, sizeof(m_freeLists));
 
-	if (s_blockSizeLookupInitialized == false)
+	InitializeBlockSizeLookup();
+}
+
+void b2BlockAllocator::InitializeBlockSizeLookup()
+{
+	// Allocators may be created on several threads at once.
+	std::call_once(b2_blockSizeLookupOnce, FillBlockSizeLookup);
+}
+
+void b2BlockAllocator::FillBlockSizeLookup()
+{
+	b2Assert((uint32)b2_blockSizes < UCHAR_MAX);
+
+	int32 j = 0;
+	for (int32 i = 1; i <= b2_maxBlockSize; ++i)
 	{
-		int32 j = 0;
-		for (int32 i = 1; i <= b2_maxBlockSize; ++i)
+		b2Assert(j < b2_blockSizes);
+		if (i <= s_blockSizes[j])
 		{
-			b2Assert(j < b2_blockSizes);
-			if (i <= s_blockSizes[j])
-			{
-				s_blockSizeLookup[i] = (uint8)j;
-			}
-			else
-			{
-				++j;
-				s_blockSizeLookup[i] = (uint8)j;
-			}
+			s_blockSizeLookup[i] = (uint8)j;
+		}
+		else
+		{
+			++j;
+			s_blockSizeLookup[i] = (uint8)j;
 		}
-
-		s_blockSizeLookupInitialized = true;
 	}
 }
 
 b2BlockAllocator::~b2BlockAllocator()
 {
+	SetThreadSafe(false);
+
 	for (int32 i = 0; i < m_chunkCount; ++i)
 	{
 		b2Free(m_chunks[i].blocks);
@@ -97,8 +103,34 @@ b2BlockAllocator::~b2BlockAllocator()
 	b2Free(m_chunks);
 }
 
+void b2BlockAllocator::SetThreadSafe(bool flag)
+{
+	if (flag == IsThreadSafe())
+	{
+		return;
+	}
+
+	if (flag)
+	{
+		b2Assert(m_chunkCount == 0 && GetNumGiantAllocations() == 0);
+		void* mem = b2Alloc(sizeof(b2ConcurrentBlockAllocator));
+		m_concurrent = new (mem) b2ConcurrentBlockAllocator;
+	}
+	else
+	{
+		m_concurrent->~b2ConcurrentBlockAllocator();
+		b2Free(m_concurrent);
+		m_concurrent = NULL;
+	}
+}
+
 uint32 b2BlockAllocator::GetNumGiantAllocations() const
 {
+	if (m_concurrent)
+	{
+		return m_concurrent->GetNumGiantAllocations();
+	}
+
 	return m_giants.GetList().GetLength();
 }
 
@@ -109,13 +141,21 @@ void* b2BlockAllocator::Allocate(int32 size)
 
 	b2Assert(0 < size);
 
+	if (m_concurrent)
+	{
+		return m_concurrent->Allocate(size);
+	}
+
 	if (size > b2_maxBlockSize)
 	{
+		m_giantBytes += size;
+		m_peakGiantBytes = b2Max(m_peakGiantBytes, m_giantBytes);
 		return m_giants.Allocate(size);
 	}
 
 	int32 index = s_blockSizeLookup[size];
 	b2Assert(0 <= index && index < b2_blockSizes);
+	m_blockBytes += s_blockSizes[index];
 
 	if (m_freeLists[index])
 	{
@@ -155,6 +195,7 @@ void* b2BlockAllocator::Allocate(int32 size)
 
 		m_freeLists[index] = chunk->blocks->next;
 		++m_chunkCount;
+		m_peakChunkCount = b2Max(m_peakChunkCount, m_chunkCount);
 
 		return chunk->blocks;
 	}
@@ -169,14 +210,22 @@ void b2BlockAllocator::Free(void* p, int32 size)
 
 	b2Assert(0 < size);
 
+	if (m_concurrent)
+	{
+		m_concurrent->Free(p, size);
+		return;
+	}
+
 	if (size > b2_maxBlockSize)
 	{
+		m_giantBytes -= size;
 		m_giants.Free(p);
 		return;
 	}
 
 	int32 index = s_blockSizeLookup[size];
 	b2Assert(0 <= index && index < b2_blockSizes);
+	m_blockBytes -= s_blockSizes[index];
 
 #if B2_ASSERT_ENABLED
 	// Verify the memory address and size is valid.
@@ -213,6 +262,12 @@ void b2BlockAllocator::Free(void* p, int32 size)
 
 void b2BlockAllocator::Clear()
 {
+	if (m_concurrent)
+	{
+		m_concurrent->Clear();
+		return;
+	}
+
 	for (int32 i = 0; i < m_chunkCount; ++i)
 	{
 		b2Free(m_chunks[i].blocks);
@@ -222,4 +277,141 @@ void b2BlockAllocator::Clear()
 	memset(m_chunks, 0, m_chunkSpace * sizeof(b2Chunk));
 
 	memset(m_freeLists, 0, sizeof(m_freeLists));
+	m_blockBytes = 0;
+}
+
+static bool b2ChunkLessThan(const b2Chunk* a, const b2Chunk* b)
+{
+	return a->blocks < b->blocks;
+}
+
+// Find the chunk containing a block in an array of chunks sorted by address.
+static b2Chunk* b2FindChunk(b2Chunk** sorted, int32 count, const b2Block* block)
+{
+	int32 low = 0;
+	int32 high = count - 1;
+	while (low < high)
+	{
+		int32 mid = (low + high + 1) >> 1;
+		if ((const int8*)sorted[mid]->blocks <= (const int8*)block)
+		{
+			low = mid;
+		}
+		else
+		{
+			high = mid - 1;
+		}
+	}
+	b2Assert((const int8*)sorted[low]->blocks <= (const int8*)block &&
+			 (const int8*)block < (const int8*)sorted[low]->blocks + b2_chunkSize);
+	return sorted[low];
+}
+
+void b2BlockAllocator::Trim()
+{
+	if (m_concurrent)
+	{
+		m_concurrent->Trim();
+		return;
+	}
+
+	int32 chunkCount = TrimChunks(m_chunks, m_chunkCount, m_freeLists);
+	memset(m_chunks + chunkCount, 0,
+		   (m_chunkCount - chunkCount) * sizeof(b2Chunk));
+	m_chunkCount = chunkCount;
+}
+
+int32 b2BlockAllocator::TrimChunks(b2Chunk* chunks, int32 chunkCount,
+								   b2Block** freeLists)
+{
+	if (chunkCount == 0)
+	{
+		return 0;
+	}
+
+	// Count the free blocks in each chunk.
+	b2Chunk** sorted = (b2Chunk**)b2Alloc(chunkCount * sizeof(b2Chunk*));
+	for (int32 i = 0; i < chunkCount; ++i)
+	{
+		sorted[i] = chunks + i;
+	}
+	std::sort(sorted, sorted + chunkCount, b2ChunkLessThan);
+
+	int32* freeCounts = (int32*)b2Alloc(chunkCount * sizeof(int32));
+	memset(freeCounts, 0, chunkCount * sizeof(int32));
+	for (int32 i = 0; i < b2_blockSizes; ++i)
+	{
+		for (b2Block* block = freeLists[i]; block; block = block->next)
+		{
+			b2Chunk* chunk = b2FindChunk(sorted, chunkCount, block);
+			++freeCounts[chunk - chunks];
+		}
+	}
+
+	// Drop the blocks of empty chunks from the free lists.
+	for (int32 i = 0; i < b2_blockSizes; ++i)
+	{
+		b2Block** link = &freeLists[i];
+		while (*link)
+		{
+			b2Chunk* chunk = b2FindChunk(sorted, chunkCount, *link);
+			if (freeCounts[chunk - chunks] == b2_chunkSize / chunk->blockSize)
+			{
+				*link = (*link)->next;
+			}
+			else
+			{
+				link = &(*link)->next;
+			}
+		}
+	}
+
+	// Release the empty chunks and compact the chunk array.
+	int32 count = 0;
+	for (int32 i = 0; i < chunkCount; ++i)
+	{
+		b2Chunk* chunk = chunks + i;
+		if (freeCounts[i] == b2_chunkSize / chunk->blockSize)
+		{
+			b2Free(chunk->blocks);
+		}
+		else
+		{
+			chunks[count++] = *chunk;
+		}
+	}
+
+	b2Free(freeCounts);
+	b2Free(sorted);
+	return count;
+}
+
+b2MemoryUsage b2BlockAllocator::GetBlockUsage() const
+{
+	if (m_concurrent)
+	{
+		return m_concurrent->GetBlockUsage();
+	}
+
+	b2MemoryUsage usage;
+	usage.used = m_blockBytes;
+	usage.reserved = m_chunkCount * b2_chunkSize +
+		m_chunkSpace * (int32)sizeof(b2Chunk);
+	usage.peak = m_peakChunkCount * b2_chunkSize +
+		m_chunkSpace * (int32)sizeof(b2Chunk);
+	return usage;
+}
+
+b2MemoryUsage b2BlockAllocator::GetGiantUsage() const
+{
+	if (m_concurrent)
+	{
+		return m_concurrent->GetGiantUsage();
+	}
+
+	b2MemoryUsage usage;
+	usage.used = m_giantBytes;
+	usage.reserved = m_giantBytes;
+	usage.peak = m_peakGiantBytes;
+	return usage;
 }
@@ -27,18 +27,36 @@ const int32 b2_maxBlockSize = 640;
 const int32 b2_blockSizes = 14;
 const int32 b2_chunkArrayIncrement = 128;
 
-struct b2Block;
-struct b2Chunk;
+class b2ConcurrentBlockAllocator;
+
+struct b2Block
+{
+	b2Block* next;
+};
+
+struct b2Chunk
+{
+	int32 blockSize;
+	b2Block* blocks;
+};
 
 /// This is a small object allocator used for allocating small
 /// objects that persist for more than one time step.
 /// See: http://www.codeproject.com/useritems/Small_Block_Allocator.asp
 class b2BlockAllocator
 {
+	friend class b2ConcurrentBlockAllocator;
+
 public:
 	b2BlockAllocator();
 	~b2BlockAllocator();
 
+	/// Route all requests through a b2ConcurrentBlockAllocator so that
+	/// this allocator may be used from several threads at once. This can
+	/// only be changed while nothing is allocated.
+	void SetThreadSafe(bool flag);
+	bool IsThreadSafe() const;
+
 	/// Allocate memory. This uses b2Alloc if the size is larger than b2_maxBlockSize.
 	void* Allocate(int32 size);
 
@@ -47,13 +65,43 @@ public:
 
 	void Clear();
 
+	/// Release chunks in which every block is free. This is O(n log n) in
+	/// the number of free blocks, so call it sparingly.
+	void Trim();
+
 	/// Returns the number of allocations larger than the max block size.
 	uint32 GetNumGiantAllocations() const;
 
+	/// Get the memory held in chunks for small blocks.
+	b2MemoryUsage GetBlockUsage() const;
+
+	/// Get the memory held by allocations larger than the max block size.
+	b2MemoryUsage GetGiantUsage() const;
+
 private:
+	// Fill s_blockSizeLookup on first use.
+	static void InitializeBlockSizeLookup();
+	static void FillBlockSizeLookup();
+
+	// Release the chunks of an array in which every block is in one of the
+	// free lists, drop their blocks from the lists and compact the array.
+	// Returns the new number of chunks.
+	static int32 TrimChunks(b2Chunk* chunks, int32 chunkCount,
+							b2Block** freeLists);
+
+	// Set when thread-safe, in which case nothing below is used.
+	b2ConcurrentBlockAllocator* m_concurrent;
+
 	b2Chunk* m_chunks;
 	int32 m_chunkCount;
 	int32 m_chunkSpace;
+	int32 m_peakChunkCount;
+
+	// Bytes in blocks currently handed out, rounded up to the block size.
+	int32 m_blockBytes;
+
+	int32 m_giantBytes;
+	int32 m_peakGiantBytes;
 
 	b2Block* m_freeLists[b2_blockSizes];
 
@@ -62,7 +110,11 @@ private:
 
 	static int32 s_blockSizes[b2_blockSizes];
 	static uint8 s_blockSizeLookup[b2_maxBlockSize + 1];
-	static bool s_blockSizeLookupInitialized;
 };
 
+inline bool b2BlockAllocator::IsThreadSafe() const
+{
+	return m_concurrent != NULL;
+}
+
 #endif
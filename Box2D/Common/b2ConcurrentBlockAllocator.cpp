@@ -0,0 +1,538 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <Box2D/Common/b2ConcurrentBlockAllocator.h>
+#include <Box2D/Common/b2Math.h>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <string.h>
+#include <thread>
+
+// Number of allocators for which a thread finds its cache without locking.
+static const int32 b2_cacheSlotCount = 4;
+
+// The blocks owned by one thread.
+struct b2BlockCache
+{
+	b2Block* freeLists[b2_blockSizes];
+	int32 freeCounts[b2_blockSizes];
+
+	// Bytes allocated minus bytes freed through this cache. Only the owning
+	// thread writes it.
+	std::atomic<int32> blockBytes;
+
+	// The owning thread, or no thread once it has exited.
+	std::thread::id thread;
+	b2BlockCache* next;
+};
+
+struct b2ConcurrentBlockPool
+{
+	// Identifies the pool in the thread-local cache slots. Unlike the
+	// address of the pool, it is never reused.
+	uint32 serial;
+
+	// Number of blocks moved between a cache and the pool at once.
+	int32 batchCounts[b2_blockSizes];
+
+	// Guards everything below.
+	std::mutex mutex;
+
+	b2Chunk* chunks;
+	int32 chunkCount;
+	int32 chunkSpace;
+	int32 peakChunkCount;
+
+	b2Block* freeLists[b2_blockSizes];
+	int32 freeCounts[b2_blockSizes];
+
+	b2BlockCache* caches;
+	int32 cacheCount;
+
+	// Link in the list of live pools. Guarded by s_poolsMutex.
+	b2ConcurrentBlockPool* nextPool;
+
+	// Record giant allocations--ones bigger than the max block size
+	b2TrackedBlockAllocator giants;
+	int32 giantBytes;
+	int32 peakGiantBytes;
+};
+
+struct b2BlockCacheSlot
+{
+	uint32 serial;
+	b2BlockCache* cache;
+};
+
+// Hands the caches of an exiting thread back to their pools, so that the
+// blocks they hold can be allocated by other threads.
+struct b2BlockCacheOwner
+{
+	b2BlockCacheOwner() : registered(false) {}
+	~b2BlockCacheOwner();
+	bool registered;
+};
+
+static std::atomic<uint32> s_poolSerial(0);
+static thread_local b2BlockCacheSlot t_cacheSlots[b2_cacheSlotCount];
+static thread_local int32 t_nextCacheSlot;
+static thread_local b2BlockCacheOwner t_cacheOwner;
+
+// The live pools, visited by exiting threads.
+static std::mutex s_poolsMutex;
+static b2ConcurrentBlockPool* s_pools = NULL;
+
+// Move the blocks of a cache to its pool. The caller holds the pool's mutex.
+static void b2FlushCache(b2ConcurrentBlockPool* pool, b2BlockCache* cache)
+{
+	for (int32 i = 0; i < b2_blockSizes; ++i)
+	{
+		b2Block* first = cache->freeLists[i];
+		if (first == NULL)
+		{
+			continue;
+		}
+
+		b2Block* last = first;
+		while (last->next)
+		{
+			last = last->next;
+		}
+		last->next = pool->freeLists[i];
+		pool->freeLists[i] = first;
+		pool->freeCounts[i] += cache->freeCounts[i];
+
+		cache->freeLists[i] = NULL;
+		cache->freeCounts[i] = 0;
+	}
+}
+
+b2BlockCacheOwner::~b2BlockCacheOwner()
+{
+	if (registered == false)
+	{
+		return;
+	}
+
+	// The cache is kept, with its count of bytes in use, for the next thread
+	// that needs one. Blocks allocated by this thread stay valid.
+	const std::thread::id thread = std::this_thread::get_id();
+	std::lock_guard<std::mutex> poolsLock(s_poolsMutex);
+	for (b2ConcurrentBlockPool* pool = s_pools; pool; pool = pool->nextPool)
+	{
+		std::lock_guard<std::mutex> lock(pool->mutex);
+		for (b2BlockCache* cache = pool->caches; cache; cache = cache->next)
+		{
+			if (cache->thread == thread)
+			{
+				b2FlushCache(pool, cache);
+				cache->thread = std::thread::id();
+				break;
+			}
+		}
+	}
+}
+
+b2ConcurrentBlockAllocator::b2ConcurrentBlockAllocator()
+{
+	b2BlockAllocator::InitializeBlockSizeLookup();
+
+	void* mem = b2Alloc(sizeof(b2ConcurrentBlockPool));
+	m_pool = new (mem) b2ConcurrentBlockPool;
+	m_pool->serial = ++s_poolSerial;
+	for (int32 i = 0; i < b2_blockSizes; ++i)
+	{
+		// A quarter of a chunk keeps the lock rare without letting idle
+		// threads hoard many blocks.
+		int32 blockCount = b2_chunkSize / b2BlockAllocator::s_blockSizes[i];
+		m_pool->batchCounts[i] = b2Max(blockCount / 4, 16);
+	}
+
+	m_pool->chunkSpace = b2_chunkArrayIncrement;
+	m_pool->chunkCount = 0;
+	m_pool->peakChunkCount = 0;
+	m_pool->chunks = (b2Chunk*)b2Alloc(m_pool->chunkSpace * sizeof(b2Chunk));
+	memset(m_pool->chunks, 0, m_pool->chunkSpace * sizeof(b2Chunk));
+	memset(m_pool->freeLists, 0, sizeof(m_pool->freeLists));
+	memset(m_pool->freeCounts, 0, sizeof(m_pool->freeCounts));
+
+	m_pool->caches = NULL;
+	m_pool->cacheCount = 0;
+
+	m_pool->giantBytes = 0;
+	m_pool->peakGiantBytes = 0;
+
+	std::lock_guard<std::mutex> poolsLock(s_poolsMutex);
+	m_pool->nextPool = s_pools;
+	s_pools = m_pool;
+}
+
+b2ConcurrentBlockAllocator::~b2ConcurrentBlockAllocator()
+{
+	{
+		std::lock_guard<std::mutex> poolsLock(s_poolsMutex);
+		b2ConcurrentBlockPool** link = &s_pools;
+		while (*link != m_pool)
+		{
+			link = &(*link)->nextPool;
+		}
+		*link = m_pool->nextPool;
+	}
+
+	for (int32 i = 0; i < m_pool->chunkCount; ++i)
+	{
+		b2Free(m_pool->chunks[i].blocks);
+	}
+	b2Free(m_pool->chunks);
+
+	while (m_pool->caches)
+	{
+		b2BlockCache* cache = m_pool->caches;
+		m_pool->caches = cache->next;
+		cache->~b2BlockCache();
+		b2Free(cache);
+	}
+
+	m_pool->~b2ConcurrentBlockPool();
+	b2Free(m_pool);
+}
+
+b2BlockCache* b2ConcurrentBlockAllocator::GetCache()
+{
+	const uint32 serial = m_pool->serial;
+	for (int32 i = 0; i < b2_cacheSlotCount; ++i)
+	{
+		if (t_cacheSlots[i].serial == serial)
+		{
+			return t_cacheSlots[i].cache;
+		}
+	}
+
+	// Make sure the thread hands its caches back when it exits.
+	t_cacheOwner.registered = true;
+
+	// Take over the cache of a thread that has exited, if there is one.
+	const std::thread::id thread = std::this_thread::get_id();
+	b2BlockCache* cache;
+	{
+		std::lock_guard<std::mutex> lock(m_pool->mutex);
+		b2BlockCache* orphan = NULL;
+		cache = m_pool->caches;
+		while (cache && cache->thread != thread)
+		{
+			if (cache->thread == std::thread::id())
+			{
+				orphan = cache;
+			}
+			cache = cache->next;
+		}
+
+		if (cache == NULL && orphan)
+		{
+			cache = orphan;
+			cache->thread = thread;
+		}
+		else if (cache == NULL)
+		{
+			void* mem = b2Alloc(sizeof(b2BlockCache));
+			cache = new (mem) b2BlockCache;
+			memset(cache->freeLists, 0, sizeof(cache->freeLists));
+			memset(cache->freeCounts, 0, sizeof(cache->freeCounts));
+			cache->blockBytes.store(0, std::memory_order_relaxed);
+			cache->thread = thread;
+			cache->next = m_pool->caches;
+			m_pool->caches = cache;
+			++m_pool->cacheCount;
+		}
+	}
+
+	b2BlockCacheSlot& slot = t_cacheSlots[t_nextCacheSlot];
+	t_nextCacheSlot = (t_nextCacheSlot + 1) % b2_cacheSlotCount;
+	slot.serial = serial;
+	slot.cache = cache;
+	return cache;
+}
+
+void* b2ConcurrentBlockAllocator::Allocate(int32 size)
+{
+	if (size == 0)
+		return NULL;
+
+	b2Assert(0 < size);
+
+	if (size > b2_maxBlockSize)
+	{
+		std::lock_guard<std::mutex> lock(m_pool->mutex);
+		m_pool->giantBytes += size;
+		m_pool->peakGiantBytes =
+			b2Max(m_pool->peakGiantBytes, m_pool->giantBytes);
+		return m_pool->giants.Allocate(size);
+	}
+
+	int32 index = b2BlockAllocator::s_blockSizeLookup[size];
+	b2Assert(0 <= index && index < b2_blockSizes);
+
+	b2BlockCache* cache = GetCache();
+	b2Block* block = cache->freeLists[index];
+	if (block == NULL)
+	{
+		block = Refill(cache, index);
+	}
+	cache->freeLists[index] = block->next;
+	--cache->freeCounts[index];
+
+	cache->blockBytes.store(
+		cache->blockBytes.load(std::memory_order_relaxed) +
+		b2BlockAllocator::s_blockSizes[index], std::memory_order_relaxed);
+	return block;
+}
+
+void b2ConcurrentBlockAllocator::Free(void* p, int32 size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+
+	b2Assert(0 < size);
+
+	if (size > b2_maxBlockSize)
+	{
+		std::lock_guard<std::mutex> lock(m_pool->mutex);
+		m_pool->giantBytes -= size;
+		m_pool->giants.Free(p);
+		return;
+	}
+
+	int32 index = b2BlockAllocator::s_blockSizeLookup[size];
+	b2Assert(0 <= index && index < b2_blockSizes);
+	int32 blockSize = b2BlockAllocator::s_blockSizes[index];
+
+#if B2_ASSERT_ENABLED
+	// Verify the memory address and size is valid.
+	{
+		std::lock_guard<std::mutex> lock(m_pool->mutex);
+		bool found = false;
+		for (int32 i = 0; i < m_pool->chunkCount; ++i)
+		{
+			b2Chunk* chunk = m_pool->chunks + i;
+			if ((int8*)chunk->blocks <= (int8*)p &&
+				(int8*)p + blockSize <= (int8*)chunk->blocks + b2_chunkSize)
+			{
+				b2Assert(chunk->blockSize == blockSize);
+				found = true;
+			}
+		}
+		b2Assert(found);
+	}
+#endif // B2_ASSERT_ENABLED
+
+#if DEBUG
+	memset(p, 0xfd, blockSize);
+#endif
+
+	// The block goes to the freeing thread, whichever thread allocated it.
+	b2BlockCache* cache = GetCache();
+	b2Block* block = (b2Block*)p;
+	block->next = cache->freeLists[index];
+	cache->freeLists[index] = block;
+
+	cache->blockBytes.store(
+		cache->blockBytes.load(std::memory_order_relaxed) - blockSize,
+		std::memory_order_relaxed);
+
+	// Hand a batch back once the cache holds two, so that blocks freed by
+	// one thread and allocated by another keep flowing through the pool.
+	if (++cache->freeCounts[index] >= 2 * m_pool->batchCounts[index])
+	{
+		Release(cache, index);
+	}
+}
+
+b2Block* b2ConcurrentBlockAllocator::Refill(b2BlockCache* cache, int32 index)
+{
+	b2Assert(cache->freeLists[index] == NULL);
+	b2ConcurrentBlockPool* pool = m_pool;
+	const int32 batchCount = pool->batchCounts[index];
+
+	std::lock_guard<std::mutex> lock(pool->mutex);
+	if (pool->freeLists[index] == NULL)
+	{
+		// Carve a new chunk into the pool.
+		if (pool->chunkCount == pool->chunkSpace)
+		{
+			b2Chunk* oldChunks = pool->chunks;
+			pool->chunkSpace += b2_chunkArrayIncrement;
+			pool->chunks = (b2Chunk*)b2Alloc(pool->chunkSpace * sizeof(b2Chunk));
+			memcpy(pool->chunks, oldChunks, pool->chunkCount * sizeof(b2Chunk));
+			memset(pool->chunks + pool->chunkCount, 0, b2_chunkArrayIncrement * sizeof(b2Chunk));
+			b2Free(oldChunks);
+		}
+
+		b2Chunk* chunk = pool->chunks + pool->chunkCount;
+		chunk->blocks = (b2Block*)b2Alloc(b2_chunkSize);
+#if DEBUG
+		memset(chunk->blocks, 0xcd, b2_chunkSize);
+#endif
+		int32 blockSize = b2BlockAllocator::s_blockSizes[index];
+		chunk->blockSize = blockSize;
+		int32 blockCount = b2_chunkSize / blockSize;
+		b2Assert(blockCount * blockSize <= b2_chunkSize);
+		for (int32 i = 0; i < blockCount - 1; ++i)
+		{
+			b2Block* block = (b2Block*)((int8*)chunk->blocks + blockSize * i);
+			b2Block* next = (b2Block*)((int8*)chunk->blocks + blockSize * (i + 1));
+			block->next = next;
+		}
+		b2Block* last = (b2Block*)((int8*)chunk->blocks + blockSize * (blockCount - 1));
+		last->next = NULL;
+
+		pool->freeLists[index] = chunk->blocks;
+		pool->freeCounts[index] = blockCount;
+		++pool->chunkCount;
+		pool->peakChunkCount = b2Max(pool->peakChunkCount, pool->chunkCount);
+	}
+
+	// Take up to one batch.
+	b2Block* first = pool->freeLists[index];
+	b2Block* last = first;
+	int32 count = 1;
+	while (count < batchCount && last->next)
+	{
+		last = last->next;
+		++count;
+	}
+	pool->freeLists[index] = last->next;
+	pool->freeCounts[index] -= count;
+	last->next = NULL;
+
+	cache->freeLists[index] = first;
+	cache->freeCounts[index] = count;
+	return first;
+}
+
+void b2ConcurrentBlockAllocator::Release(b2BlockCache* cache, int32 index)
+{
+	const int32 batchCount = m_pool->batchCounts[index];
+	b2Assert(cache->freeCounts[index] >= batchCount);
+
+	// Split the batch off outside of the lock.
+	b2Block* first = cache->freeLists[index];
+	b2Block* last = first;
+	for (int32 i = 1; i < batchCount; ++i)
+	{
+		last = last->next;
+	}
+	cache->freeLists[index] = last->next;
+	cache->freeCounts[index] -= batchCount;
+
+	std::lock_guard<std::mutex> lock(m_pool->mutex);
+	last->next = m_pool->freeLists[index];
+	m_pool->freeLists[index] = first;
+	m_pool->freeCounts[index] += batchCount;
+}
+
+void b2ConcurrentBlockAllocator::Flush()
+{
+	// Locked, as an exiting thread may flush its cache at any time.
+	std::lock_guard<std::mutex> lock(m_pool->mutex);
+	for (b2BlockCache* cache = m_pool->caches; cache; cache = cache->next)
+	{
+		b2FlushCache(m_pool, cache);
+	}
+}
+
+void b2ConcurrentBlockAllocator::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_pool->mutex);
+	for (int32 i = 0; i < m_pool->chunkCount; ++i)
+	{
+		b2Free(m_pool->chunks[i].blocks);
+	}
+
+	m_pool->chunkCount = 0;
+	memset(m_pool->chunks, 0, m_pool->chunkSpace * sizeof(b2Chunk));
+
+	memset(m_pool->freeLists, 0, sizeof(m_pool->freeLists));
+	memset(m_pool->freeCounts, 0, sizeof(m_pool->freeCounts));
+	for (b2BlockCache* cache = m_pool->caches; cache; cache = cache->next)
+	{
+		memset(cache->freeLists, 0, sizeof(cache->freeLists));
+		memset(cache->freeCounts, 0, sizeof(cache->freeCounts));
+		cache->blockBytes.store(0, std::memory_order_relaxed);
+	}
+}
+
+void b2ConcurrentBlockAllocator::Trim()
+{
+	std::lock_guard<std::mutex> lock(m_pool->mutex);
+	for (b2BlockCache* cache = m_pool->caches; cache; cache = cache->next)
+	{
+		b2FlushCache(m_pool, cache);
+	}
+
+	int32 chunkCount = b2BlockAllocator::TrimChunks(
+		m_pool->chunks, m_pool->chunkCount, m_pool->freeLists);
+	memset(m_pool->chunks + chunkCount, 0,
+		   (m_pool->chunkCount - chunkCount) * sizeof(b2Chunk));
+	m_pool->chunkCount = chunkCount;
+
+	for (int32 i = 0; i < b2_blockSizes; ++i)
+	{
+		int32 count = 0;
+		for (b2Block* block = m_pool->freeLists[i]; block; block = block->next)
+		{
+			++count;
+		}
+		m_pool->freeCounts[i] = count;
+	}
+}
+
+uint32 b2ConcurrentBlockAllocator::GetNumGiantAllocations() const
+{
+	std::lock_guard<std::mutex> lock(m_pool->mutex);
+	return m_pool->giants.GetList().GetLength();
+}
+
+b2MemoryUsage b2ConcurrentBlockAllocator::GetBlockUsage() const
+{
+	std::lock_guard<std::mutex> lock(m_pool->mutex);
+	b2MemoryUsage usage;
+	usage.used = 0;
+	for (b2BlockCache* cache = m_pool->caches; cache; cache = cache->next)
+	{
+		usage.used += cache->blockBytes.load(std::memory_order_relaxed);
+	}
+
+	int32 overhead = m_pool->chunkSpace * (int32)sizeof(b2Chunk) +
+		m_pool->cacheCount * (int32)sizeof(b2BlockCache);
+	usage.reserved = m_pool->chunkCount * b2_chunkSize + overhead;
+	usage.peak = m_pool->peakChunkCount * b2_chunkSize + overhead;
+	return usage;
+}
+
+b2MemoryUsage b2ConcurrentBlockAllocator::GetGiantUsage() const
+{
+	std::lock_guard<std::mutex> lock(m_pool->mutex);
+	b2MemoryUsage usage;
+	usage.used = m_pool->giantBytes;
+	usage.reserved = m_pool->giantBytes;
+	usage.peak = m_pool->peakGiantBytes;
+	return usage;
+}
@@ -0,0 +1,83 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#ifndef B2_CONCURRENT_BLOCK_ALLOCATOR_H
+#define B2_CONCURRENT_BLOCK_ALLOCATOR_H
+
+#include <Box2D/Common/b2BlockAllocator.h>
+
+struct b2BlockCache;
+struct b2ConcurrentBlockPool;
+
+/// A small object allocator that may be used from several threads at once.
+/// It has the same size classes as b2BlockAllocator. Each thread allocates
+/// from and frees to its own cache of blocks, so the common case takes no
+/// lock. Caches trade batches of blocks with a shared pool, which carves
+/// them out of b2_chunkSize chunks. A block may be freed by another thread
+/// than the one that allocated it. When a thread exits, e.g. a b2ThreadPool
+/// worker, its caches go back to the pool.
+/// Usually this is enabled through b2BlockAllocator::SetThreadSafe().
+class b2ConcurrentBlockAllocator
+{
+public:
+	b2ConcurrentBlockAllocator();
+	~b2ConcurrentBlockAllocator();
+
+	/// Allocate memory. This uses b2Alloc if the size is larger than b2_maxBlockSize.
+	void* Allocate(int32 size);
+
+	/// Free memory. This uses b2Free if the size is larger than b2_maxBlockSize.
+	void Free(void* p, int32 size);
+
+	/// Move the blocks held by the thread caches back to the shared pool.
+	/// This must not run concurrently with any other call.
+	void Flush();
+
+	/// Free all chunks. This must not run concurrently with any other call.
+	void Clear();
+
+	/// Release chunks in which every block is free. This must not run
+	/// concurrently with any other call.
+	void Trim();
+
+	/// Returns the number of allocations larger than the max block size.
+	uint32 GetNumGiantAllocations() const;
+
+	/// Get the memory held in chunks and thread caches for small blocks.
+	b2MemoryUsage GetBlockUsage() const;
+
+	/// Get the memory held by allocations larger than the max block size.
+	b2MemoryUsage GetGiantUsage() const;
+
+private:
+	b2ConcurrentBlockAllocator(const b2ConcurrentBlockAllocator&);
+	b2ConcurrentBlockAllocator& operator=(const b2ConcurrentBlockAllocator&);
+
+	// Get the calling thread's cache, creating it on first use.
+	b2BlockCache* GetCache();
+
+	// Fill an empty cache list from the pool, carving a new chunk if the
+	// pool has no blocks of the size class left. Returns the first block.
+	b2Block* Refill(b2BlockCache* cache, int32 index);
+
+	// Move one batch of blocks from a cache list to the pool.
+	void Release(b2BlockCache* cache, int32 index);
+
+	b2ConcurrentBlockPool* m_pool;
+};
+
+#endif
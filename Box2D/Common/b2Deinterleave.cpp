@@ -0,0 +1,119 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#include <Box2D/Common/b2Deinterleave.h>
+
+#if defined(__AVX__)
+#define B2_DEINTERLEAVE_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define B2_DEINTERLEAVE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define B2_DEINTERLEAVE_NEON
+#include <arm_neon.h>
+#endif
+
+void b2Deinterleave(const b2Vec2* vectors, int32 count, float32* x,
+					float32* y)
+{
+	const float32* in = &vectors->x;
+	int32 i = 0;
+
+#if defined(B2_DEINTERLEAVE_AVX)
+	// Swap the middle halves of two blocks of four vectors, so that each
+	// 128-bit lane holds four consecutive vectors, then split the lanes.
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 a = _mm256_loadu_ps(in + 2 * i);
+		__m256 b = _mm256_loadu_ps(in + 2 * i + 8);
+		__m256 low = _mm256_permute2f128_ps(a, b, 0x20);
+		__m256 high = _mm256_permute2f128_ps(a, b, 0x31);
+		_mm256_storeu_ps(x + i,
+			_mm256_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm256_storeu_ps(y + i,
+			_mm256_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+#elif defined(B2_DEINTERLEAVE_SSE2)
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 a = _mm_loadu_ps(in + 2 * i);
+		__m128 b = _mm_loadu_ps(in + 2 * i + 4);
+		_mm_storeu_ps(x + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(y + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+#elif defined(B2_DEINTERLEAVE_NEON)
+	for (; i + 4 <= count; i += 4)
+	{
+		float32x4x2_t xy = vld2q_f32(in + 2 * i);
+		vst1q_f32(x + i, xy.val[0]);
+		vst1q_f32(y + i, xy.val[1]);
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		x[i] = in[2 * i];
+		y[i] = in[2 * i + 1];
+	}
+}
+
+void b2Interleave(const float32* x, const float32* y, int32 count,
+				  b2Vec2* vectors)
+{
+	float32* out = &vectors->x;
+	int32 i = 0;
+
+#if defined(B2_DEINTERLEAVE_AVX)
+	// Unpacking works within 128-bit lanes, so the lanes of the results
+	// are put back in order before storing.
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 a = _mm256_loadu_ps(x + i);
+		__m256 b = _mm256_loadu_ps(y + i);
+		__m256 low = _mm256_unpacklo_ps(a, b);
+		__m256 high = _mm256_unpackhi_ps(a, b);
+		_mm256_storeu_ps(out + 2 * i,
+			_mm256_permute2f128_ps(low, high, 0x20));
+		_mm256_storeu_ps(out + 2 * i + 8,
+			_mm256_permute2f128_ps(low, high, 0x31));
+	}
+#elif defined(B2_DEINTERLEAVE_SSE2)
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 a = _mm_loadu_ps(x + i);
+		__m128 b = _mm_loadu_ps(y + i);
+		_mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(a, b));
+		_mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(a, b));
+	}
+#elif defined(B2_DEINTERLEAVE_NEON)
+	for (; i + 4 <= count; i += 4)
+	{
+		float32x4x2_t xy;
+		xy.val[0] = vld1q_f32(x + i);
+		xy.val[1] = vld1q_f32(y + i);
+		vst2q_f32(out + 2 * i, xy);
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		out[2 * i] = x[i];
+		out[2 * i + 1] = y[i];
+	}
+}
@@ -0,0 +1,36 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#ifndef B2_DEINTERLEAVE_H
+#define B2_DEINTERLEAVE_H
+
+#include <Box2D/Common/b2Math.h>
+
+/// Split an array of vectors into an array of x and an array of y, e.g. to
+/// hand particle positions or velocities to an API that takes one array
+/// per channel. Uses AVX, SSE2 or NEON shuffles when the compiler targets
+/// them. The output arrays need no particular alignment.
+void b2Deinterleave(const b2Vec2* vectors, int32 count, float32* x,
+					float32* y);
+
+/// Merge an array of x and an array of y into an array of vectors, the
+/// reverse of b2Deinterleave(), e.g. to create particles from data that
+/// comes in one array per channel.
+void b2Interleave(const float32* x, const float32* y, int32 count,
+				  b2Vec2* vectors);
+
+#endif
@@ -100,6 +100,25 @@ public:
 		Reserve(newCapacity);
 	}
 
+	/// Reallocate the buffer so that its capacity matches its count,
+	/// releasing it entirely when empty.
+	void Shrink()
+	{
+		if (count == 0)
+		{
+			Free();
+			return;
+		}
+		if (count == capacity)
+			return;
+
+		T* newData = (T*) allocator->Allocate(sizeof(T) * count);
+		memcpy(newData, data, sizeof(T) * count);
+		allocator->Free(data, sizeof(T) * capacity);
+		capacity = count;
+		data = newData;
+	}
+
 	void Free()
 	{
 		if (data == NULL)
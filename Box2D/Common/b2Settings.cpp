@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <atomic>
 
 b2Version b2_version = {2, 3, 0};
 
@@ -44,7 +45,11 @@ const char *b2_liquidFunVersionString =
 	LIQUIDFUN_STRING(LIQUIDFUN_VERSION_MINOR) "."
 	LIQUIDFUN_STRING(LIQUIDFUN_VERSION_REVISION);
 
-static int32 b2_numAllocs = 0;
+// Process-wide counts, shared by every world and thread. Atomic since
+// worker threads of a b2ThreadPool, or worlds stepped on other threads, may
+// allocate.
+static std::atomic<int32> b2_numAllocs(0);
+static std::atomic<uint32> b2_allocCount(0);
 
 // Initialize default allocator.
 static b2AllocFunction b2_allocCallback = b2AllocDefault;
@@ -93,6 +98,7 @@ void b2SetAllocFreeCallbacks(b2AllocFunction allocCallback,
 void* b2Alloc(int32 size)
 {
 	b2_numAllocs++;
+	b2_allocCount.fetch_add(1, std::memory_order_relaxed);
 	return b2_allocCallback(size, b2_callbackData);
 }
 
@@ -112,6 +118,11 @@ int32 b2GetNumAllocs()
 	return b2_numAllocs;
 }
 
+uint32 b2GetAllocCount()
+{
+	return b2_allocCount.load(std::memory_order_relaxed);
+}
+
 // You can modify this to use your logging facility.
 void b2Log(const char* string, ...)
 {
@@ -166,6 +166,7 @@ typedef unsigned long long uint64;
 
 /// A symbolic constant that stands for particle allocation error.
 #define b2_invalidParticleIndex		(-1)
+#define b2_invalidParticleId		(-1)
 
 #ifdef B2_USE_16_BIT_PARTICLE_INDICES
 #define b2_maxParticleIndex			0x7FFF
@@ -209,6 +210,17 @@ typedef unsigned long long uint64;
 
 // Memory Allocation
 
+/// Memory held by an allocator or subsystem, in bytes.
+struct b2MemoryUsage
+{
+	/// Bytes handed out to callers.
+	int32 used;
+	/// Bytes obtained from b2Alloc, including space that is not in use.
+	int32 reserved;
+	/// Largest value of 'reserved' since creation.
+	int32 peak;
+};
+
 /// Implement this function to use your own memory allocator.
 void* b2Alloc(int32 size);
 
@@ -236,6 +248,14 @@ void b2SetNumAllocs(const int32 numAllocs);
 /// Get number of calls to b2Alloc minus number of calls to b2Free.
 int32 b2GetNumAllocs();
 
+/// Get the total number of calls to b2Alloc. Unlike b2GetNumAllocs() this
+/// never decreases, so it can be used to detect allocations in a section of
+/// code that also frees what it allocates.
+/// Like b2GetNumAllocs(), this is a single count for the whole process, not
+/// per world or per thread: it includes the allocations of every thread
+/// and every world.
+uint32 b2GetAllocCount();
+
 /// Logging function.
 void b2Log(const char* string, ...);
 
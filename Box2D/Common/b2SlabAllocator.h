@@ -171,7 +171,7 @@ public:
 			const uint8* const slabItemEnd = (uint8*)slab->GetItemEnd();
 
 			// Count all free items that are owned by the current slab.
-			uint8 freeItems = 0;
+			uint32 freeItems = 0;
 			bool empty = false;
 			for (b2IntrusiveListNode* itemNode = freeItemList.GetNext();
 				 itemNode != freeItemListTerminator;
@@ -179,7 +179,7 @@ public:
 			{
 				const uint8* itemNodeAddress = (uint8*)itemNode;
 				if (itemNodeAddress >= slabItemStart &&
-					itemNodeAddress <= slabItemEnd)
+					itemNodeAddress < slabItemEnd)
 				{
 					++freeItems;
 					if (slab->GetNumberOfItems() == freeItems)
@@ -203,6 +203,29 @@ public:
 		return m_freeList;
 	}
 
+	/// Get the number of bytes held by slabs and the number of those bytes
+	/// occupied by allocated items.  The peak is the reserved size, callers
+	/// that need a high-water mark have to track it across FreeEmptySlabs().
+	b2MemoryUsage GetMemoryUsage() const
+	{
+		b2MemoryUsage usage;
+		usage.reserved = 0;
+		const b2TypedIntrusiveListNode<b2TrackedBlock>& slabList =
+			m_slabs.GetList();
+		for (const b2TrackedBlock* block = slabList.GetNext();
+			 block != slabList.GetTerminator(); block = block->GetNext())
+		{
+			const Slab* const slab = (const Slab*)block->GetMemory();
+			usage.reserved += (int32)(sizeof(Slab) +
+									  sizeof(T) * slab->GetNumberOfItems());
+		}
+		const int32 freeItems =
+			(int32)m_freeList.GetFreeList()->GetFreeList().GetLength();
+		usage.used = usage.reserved - freeItems * (int32)sizeof(T);
+		usage.peak = usage.reserved;
+		return usage;
+	}
+
 private:
 	/// Destroy all objects in a slab and free the slab.
 	void FreeSlab(Slab * const slab)
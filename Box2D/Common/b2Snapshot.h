@@ -0,0 +1,138 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#ifndef B2_SNAPSHOT_H
+#define B2_SNAPSHOT_H
+
+#include <Box2D/Common/b2Settings.h>
+#include <string.h>
+
+/// Appends plain data to a snapshot buffer. Writes past the capacity are
+/// counted but dropped, so a NULL buffer measures the size of a snapshot.
+class b2SnapshotWriter
+{
+public:
+	b2SnapshotWriter(void* buffer, int32 capacity)
+	{
+		m_buffer = (uint8*)buffer;
+		m_capacity = buffer ? capacity : 0;
+		m_size = 0;
+	}
+
+	void Write(const void* data, int32 size)
+	{
+		if (size > 0 && m_size + size <= m_capacity)
+		{
+			memcpy(m_buffer + m_size, data, size);
+		}
+		m_size += size;
+	}
+
+	template <typename T> void Write(const T& value)
+	{
+		Write(&value, (int32)sizeof(T));
+	}
+
+	template <typename T> void WriteArray(const T* data, int32 count)
+	{
+		Write(data, count * (int32)sizeof(T));
+	}
+
+	/// Overwrite a value written earlier, e.g. a size in a header.
+	template <typename T> void Patch(int32 offset, const T& value)
+	{
+		if (offset + (int32)sizeof(T) <= m_capacity)
+		{
+			memcpy(m_buffer + offset, &value, sizeof(T));
+		}
+	}
+
+	/// Get the number of bytes written so far, including dropped ones.
+	int32 GetSize() const { return m_size; }
+
+private:
+	uint8* m_buffer;
+	int32 m_capacity;
+	int32 m_size;
+};
+
+/// Reads plain data back from a snapshot buffer. Reads past the end fail,
+/// return zeroed data and leave the reader invalid.
+class b2SnapshotReader
+{
+public:
+	b2SnapshotReader(const void* data, int32 size)
+	{
+		m_data = (const uint8*)data;
+		m_size = data ? size : 0;
+		m_offset = 0;
+		m_valid = true;
+	}
+
+	bool Read(void* data, int32 size)
+	{
+		if (!m_valid || size < 0 || size > m_size - m_offset)
+		{
+			m_valid = false;
+			if (size > 0)
+			{
+				memset(data, 0, size);
+			}
+			return false;
+		}
+		if (size > 0)
+		{
+			memcpy(data, m_data + m_offset, size);
+			m_offset += size;
+		}
+		return true;
+	}
+
+	template <typename T> T Read()
+	{
+		T value;
+		Read(&value, (int32)sizeof(T));
+		return value;
+	}
+
+	template <typename T> void Read(T* value)
+	{
+		Read((void*)value, (int32)sizeof(T));
+	}
+
+	template <typename T> void ReadArray(T* data, int32 count)
+	{
+		Read((void*)data, count * (int32)sizeof(T));
+	}
+
+	/// Is every read so far within the buffer.
+	bool IsValid() const { return m_valid; }
+
+	/// Mark the snapshot as corrupt. Later reads fail.
+	void Invalidate() { m_valid = false; }
+
+	/// Get the number of bytes not read yet.
+	int32 GetRemaining() const { return m_size - m_offset; }
+
+private:
+	const uint8* m_data;
+	int32 m_size;
+	int32 m_offset;
+	bool m_valid;
+};
+
+#endif
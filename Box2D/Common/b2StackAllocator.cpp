@@ -22,35 +22,105 @@
 
 b2StackAllocator::b2StackAllocator()
 {
+	m_chunks = NULL;
+	m_chunkCount = 0;
+	m_chunkCapacity = 0;
+	m_chunk = -1;
 	m_index = 0;
 	m_allocation = 0;
 	m_maxAllocation = 0;
+	m_peakCapacity = 0;
+	m_entries = m_entryArray;
 	m_entryCount = 0;
+	m_entryCapacity = b2_maxStackEntries;
 }
 
 b2StackAllocator::~b2StackAllocator()
 {
-	b2Assert(m_index == 0);
+	b2Assert(m_allocation == 0);
 	b2Assert(m_entryCount == 0);
+
+	for (int32 i = 0; i < m_chunkCount; ++i)
+	{
+		b2Free(m_chunks[i].data);
+	}
+	b2Free(m_chunks);
+	if (m_entries != m_entryArray)
+	{
+		b2Free(m_entries);
+	}
+}
+
+void b2StackAllocator::NextChunk(int32 size)
+{
+	++m_chunk;
+	m_index = 0;
+
+	if (m_chunk < m_chunkCount)
+	{
+		b2StackChunk* chunk = m_chunks + m_chunk;
+		if (chunk->capacity >= size)
+		{
+			return;
+		}
+
+		// Too small, replace it.
+		b2Free(chunk->data);
+		chunk->capacity = b2Max(size, 2 * chunk->capacity);
+		chunk->data = (char*)b2Alloc(chunk->capacity);
+		m_peakCapacity = b2Max(m_peakCapacity, GetCapacity());
+		return;
+	}
+
+	if (m_chunkCount == m_chunkCapacity)
+	{
+		b2StackChunk* oldChunks = m_chunks;
+		m_chunkCapacity = m_chunkCapacity ? 2 * m_chunkCapacity : 4;
+		m_chunks = (b2StackChunk*)b2Alloc(
+			m_chunkCapacity * sizeof(b2StackChunk));
+		if (oldChunks)
+		{
+			memcpy(m_chunks, oldChunks, m_chunkCount * sizeof(b2StackChunk));
+			b2Free(oldChunks);
+		}
+	}
+
+	// Each new chunk is at least as large as everything before it, so the
+	// number of chunks stays logarithmic in the peak usage.
+	b2StackChunk* chunk = m_chunks + m_chunkCount;
+	chunk->capacity = b2Max(b2Max(size, b2_stackSize), GetCapacity());
+	chunk->data = (char*)b2Alloc(chunk->capacity);
+	++m_chunkCount;
+	m_peakCapacity = b2Max(m_peakCapacity, GetCapacity());
 }
 
 void* b2StackAllocator::Allocate(int32 size)
 {
-	b2Assert(m_entryCount < b2_maxStackEntries);
+	if (m_entryCount == m_entryCapacity)
+	{
+		b2StackEntry* oldEntries = m_entries;
+		m_entryCapacity *= 2;
+		m_entries = (b2StackEntry*)b2Alloc(
+			m_entryCapacity * sizeof(b2StackEntry));
+		memcpy(m_entries, oldEntries, m_entryCount * sizeof(b2StackEntry));
+		if (oldEntries != m_entryArray)
+		{
+			b2Free(oldEntries);
+		}
+	}
+
 	const int32 roundedSize = (size + ALIGN_MASK) & ~ALIGN_MASK;
 	b2StackEntry* entry = m_entries + m_entryCount;
 	entry->size = roundedSize;
-	if (m_index + roundedSize > b2_stackSize)
+	entry->previousChunk = m_chunk;
+	entry->previousIndex = m_index;
+	if (m_chunk < 0 || m_index + roundedSize > m_chunks[m_chunk].capacity)
 	{
-		entry->data = (char*)b2Alloc(roundedSize);
-		entry->usedMalloc = true;
-	}
-	else
-	{
-		entry->data = m_data + m_index;
-		entry->usedMalloc = false;
-		m_index += roundedSize;
+		NextChunk(roundedSize);
 	}
+	entry->chunk = m_chunk;
+	entry->data = m_chunks[m_chunk].data + m_index;
+	m_index += roundedSize;
 
 	m_allocation += roundedSize;
 	m_maxAllocation = b2Max(m_maxAllocation, m_allocation);
@@ -65,31 +135,27 @@ void* b2StackAllocator::Reallocate(void* p, int32 size)
 	b2StackEntry* entry = m_entries + m_entryCount - 1;
 	b2Assert(p == entry->data);
 	B2_NOT_USED(p);
-	int32 incrementSize = size - entry->size;
+	const int32 roundedSize = (size + ALIGN_MASK) & ~ALIGN_MASK;
+	int32 incrementSize = roundedSize - entry->size;
 	if (incrementSize > 0)
 	{
-		if (entry->usedMalloc)
+		if (m_index + incrementSize > m_chunks[m_chunk].capacity)
 		{
-			void* data = b2Alloc(size);
-			memcpy(data, entry->data, entry->size);
-			b2Free(entry->data);
-			entry->data = (char*)data;
-		}
-		else if (m_index + incrementSize > b2_stackSize)
-		{
-			void* data = b2Alloc(size);
-			memcpy(data, entry->data, entry->size);
-			m_index -= entry->size;
-			entry->data = (char*)data;
-			entry->usedMalloc = true;
+			// Move the entry to the start of the next chunk.
+			char* oldData = entry->data;
+			NextChunk(roundedSize);
+			entry->chunk = m_chunk;
+			entry->data = m_chunks[m_chunk].data;
+			memcpy(entry->data, oldData, entry->size);
+			m_index = roundedSize;
 		}
 		else
 		{
 			m_index += incrementSize;
-			m_allocation += incrementSize;
-			m_maxAllocation = b2Max(m_maxAllocation, m_allocation);
 		}
-		entry->size = size;
+		entry->size = roundedSize;
+		m_allocation += incrementSize;
+		m_maxAllocation = b2Max(m_maxAllocation, m_allocation);
 	}
 
 	return entry->data;
@@ -100,21 +166,52 @@ void b2StackAllocator::Free(void* p)
 	b2Assert(m_entryCount > 0);
 	b2StackEntry* entry = m_entries + m_entryCount - 1;
 	b2Assert(p == entry->data);
-	if (entry->usedMalloc)
-	{
-		b2Free(p);
-	}
-	else
-	{
-		m_index -= entry->size;
-	}
+	B2_NOT_USED(p);
+	m_chunk = entry->previousChunk;
+	m_index = entry->previousIndex;
 	m_allocation -= entry->size;
 	--m_entryCount;
+}
 
-	p = NULL;
+void b2StackAllocator::Reset()
+{
+	b2Assert(m_entryCount == 0);
+	if (m_chunkCount > 1)
+	{
+		int32 capacity = b2Max(m_maxAllocation, b2_stackSize);
+		for (int32 i = 0; i < m_chunkCount; ++i)
+		{
+			b2Free(m_chunks[i].data);
+		}
+		m_chunks[0].capacity = capacity;
+		m_chunks[0].data = (char*)b2Alloc(capacity);
+		m_chunkCount = 1;
+		m_peakCapacity = b2Max(m_peakCapacity, capacity);
+	}
+	m_chunk = -1;
+	m_index = 0;
 }
 
 int32 b2StackAllocator::GetMaxAllocation() const
 {
 	return m_maxAllocation;
 }
+
+b2MemoryUsage b2StackAllocator::GetUsage() const
+{
+	b2MemoryUsage usage;
+	usage.used = m_allocation;
+	usage.reserved = GetCapacity();
+	usage.peak = m_peakCapacity;
+	return usage;
+}
+
+int32 b2StackAllocator::GetCapacity() const
+{
+	int32 capacity = 0;
+	for (int32 i = 0; i < m_chunkCount; ++i)
+	{
+		capacity += m_chunks[i].capacity;
+	}
+	return capacity;
+}
@@ -28,12 +28,27 @@ struct b2StackEntry
 {
 	char* data;
 	int32 size;
-	bool usedMalloc;
+	int32 chunk;
+	// Position of the allocator before this entry was allocated.
+	int32 previousChunk;
+	int32 previousIndex;
+};
+
+struct b2StackChunk
+{
+	char* data;
+	int32 capacity;
 };
 
 // This is a stack allocator used for fast per step allocations.
 // You must nest allocate/free pairs. The code will assert
 // if you try to interleave multiple allocate/free pairs.
+//
+// Memory is carved out of a list of chunks. When the current chunk is
+// full another one is added, so large requests never fall back to
+// individual heap allocations. Reset() merges the chunks into one that
+// covers the high-water mark, so once the per step usage has peaked no
+// further heap allocations are made.
 class b2StackAllocator
 {
 public:
@@ -47,18 +62,40 @@ public:
 	void* Reallocate(void* p, int32 size);
 	void Free(void* p);
 
+	/// Start a new frame. All allocations must have been freed. If the last
+	/// frames needed more than one chunk, the chunks are replaced by a
+	/// single chunk large enough for the high-water mark.
+	void Reset();
+
+	/// Get the largest number of bytes that have been allocated at once.
 	int32 GetMaxAllocation() const;
 
+	/// Get the number of bytes reserved by the chunks.
+	int32 GetCapacity() const;
+
+	/// Get the memory held by this allocator.
+	b2MemoryUsage GetUsage() const;
+
 private:
 
-	char m_data[b2_stackSize];
+	// Move to the next chunk, making sure it can hold size bytes.
+	void NextChunk(int32 size);
+
+	b2StackChunk* m_chunks;
+	int32 m_chunkCount;
+	int32 m_chunkCapacity;
+
+	int32 m_chunk;
 	int32 m_index;
 
 	int32 m_allocation;
 	int32 m_maxAllocation;
+	int32 m_peakCapacity;
 
-	b2StackEntry m_entries[b2_maxStackEntries];
+	b2StackEntry* m_entries;
+	b2StackEntry m_entryArray[b2_maxStackEntries];
 	int32 m_entryCount;
+	int32 m_entryCapacity;
 };
 
 #endif
@@ -0,0 +1,155 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#include <Box2D/Common/b2ThreadPool.h>
+#include <Box2D/Common/b2Math.h>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+
+struct b2ThreadPoolWorkers
+{
+	std::thread threads[b2_maxThreads - 1];
+	std::mutex mutex;
+	std::condition_variable start;
+	std::condition_variable done;
+
+	// The current loop. Written under the mutex before generation is bumped.
+	b2ParallelTask* task;
+	void* context;
+	int32 count;
+	int32 rangeCount;
+	int32 rangeSize;
+
+	// Ranges still to be claimed and ranges still running.
+	int32 nextRange;
+	int32 pendingRanges;
+
+	uint32 generation;
+	bool quit;
+};
+
+// Claim and run ranges of the current loop until none are left.
+static void b2RunRanges(b2ThreadPoolWorkers* w,
+						std::unique_lock<std::mutex>& lock)
+{
+	while (w->nextRange < w->rangeCount)
+	{
+		int32 range = w->nextRange++;
+		int32 begin = range * w->rangeSize;
+		int32 end = b2Min(begin + w->rangeSize, w->count);
+		lock.unlock();
+		w->task(begin, end, range, w->context);
+		lock.lock();
+		if (--w->pendingRanges == 0)
+		{
+			w->done.notify_one();
+		}
+	}
+}
+
+static void b2WorkerMain(b2ThreadPoolWorkers* w)
+{
+	std::unique_lock<std::mutex> lock(w->mutex);
+	uint32 generation = w->generation;
+	for (;;)
+	{
+		while (w->quit == false && w->generation == generation)
+		{
+			w->start.wait(lock);
+		}
+		if (w->quit)
+		{
+			return;
+		}
+		generation = w->generation;
+		b2RunRanges(w, lock);
+	}
+}
+
+b2ThreadPool::b2ThreadPool(int32 threadCount)
+{
+	m_threadCount = b2Clamp(threadCount, 1, b2_maxThreads);
+	m_workers = new (b2Alloc(sizeof(b2ThreadPoolWorkers))) b2ThreadPoolWorkers;
+	m_workers->task = NULL;
+	m_workers->context = NULL;
+	m_workers->count = 0;
+	m_workers->rangeCount = 0;
+	m_workers->rangeSize = 0;
+	m_workers->nextRange = 0;
+	m_workers->pendingRanges = 0;
+	m_workers->generation = 0;
+	m_workers->quit = false;
+
+	for (int32 i = 1; i < m_threadCount; ++i)
+	{
+		m_workers->threads[i - 1] = std::thread(b2WorkerMain, m_workers);
+	}
+}
+
+b2ThreadPool::~b2ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_workers->mutex);
+		m_workers->quit = true;
+	}
+	m_workers->start.notify_all();
+	for (int32 i = 1; i < m_threadCount; ++i)
+	{
+		m_workers->threads[i - 1].join();
+	}
+	m_workers->~b2ThreadPoolWorkers();
+	b2Free(m_workers);
+}
+
+void b2ThreadPool::ParallelFor(int32 count, int32 minRange,
+							   b2ParallelTask* task, void* context)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+
+	minRange = b2Max(minRange, 1);
+	int32 rangeCount = b2Min(m_threadCount, (count + minRange - 1) / minRange);
+	if (rangeCount <= 1)
+	{
+		// Not worth waking the workers.
+		task(0, count, 0, context);
+		return;
+	}
+
+	b2ThreadPoolWorkers* w = m_workers;
+	std::unique_lock<std::mutex> lock(w->mutex);
+	b2Assert(w->pendingRanges == 0);
+	w->task = task;
+	w->context = context;
+	w->count = count;
+	w->rangeSize = (count + rangeCount - 1) / rangeCount;
+	w->rangeCount = (count + w->rangeSize - 1) / w->rangeSize;
+	w->nextRange = 0;
+	w->pendingRanges = w->rangeCount;
+	++w->generation;
+	w->start.notify_all();
+
+	b2RunRanges(w, lock);
+	while (w->pendingRanges > 0)
+	{
+		w->done.wait(lock);
+	}
+}
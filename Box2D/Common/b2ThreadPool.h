@@ -0,0 +1,65 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#ifndef B2_THREAD_POOL_H
+#define B2_THREAD_POOL_H
+
+#include <Box2D/Common/b2Settings.h>
+
+/// The maximum number of threads, including the calling thread, in a
+/// b2ThreadPool.
+#define b2_maxThreads 32
+
+/// A task run over the sub-range [begin, end) of a parallel loop.
+/// rangeIndex is in [0, b2ThreadPool::GetThreadCount()) and numbers the
+/// ranges in loop order. Each range runs on exactly one thread, so the
+/// index can select per-thread scratch data, and merging that data in
+/// index order gives the same result as a serial loop.
+typedef void b2ParallelTask(int32 begin, int32 end, int32 rangeIndex,
+							void* context);
+
+struct b2ThreadPoolWorkers;
+
+/// A fixed set of worker threads used to split loops across cores.
+/// The pool is owned by the client and may be shared by several worlds,
+/// as long as they do not step at the same time.
+class b2ThreadPool
+{
+public:
+	/// Create the pool. threadCount includes the calling thread, so a
+	/// value of 1 creates no worker threads.
+	explicit b2ThreadPool(int32 threadCount);
+	~b2ThreadPool();
+
+	/// Get the number of threads, including the calling thread.
+	int32 GetThreadCount() const { return m_threadCount; }
+
+	/// Run task over [0, count) split into at most GetThreadCount() ranges
+	/// of at least minRange items. The calling thread takes part and this
+	/// returns once every range is done. Calls must not be nested.
+	void ParallelFor(int32 count, int32 minRange, b2ParallelTask* task,
+					 void* context);
+
+private:
+	b2ThreadPool(const b2ThreadPool&);
+	b2ThreadPool& operator=(const b2ThreadPool&);
+
+	int32 m_threadCount;
+	b2ThreadPoolWorkers* m_workers;
+};
+
+#endif
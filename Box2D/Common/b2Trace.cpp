@@ -0,0 +1,193 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#include <Box2D/Common/b2Trace.h>
+#include <stdio.h>
+
+#if B2_ENABLE_TRACE
+
+#include <Box2D/Common/b2Math.h>
+#include <Box2D/Common/b2Timer.h>
+#include <atomic>
+#include <new>
+
+struct b2TraceEvent
+{
+	const char* name;
+	float64 begin;
+	float64 duration;
+};
+
+// Ring buffer owned by at most one thread at a time. Buffers are never
+// freed; when a thread exits its buffer is released for reuse by the next
+// thread that records an event.
+struct b2TraceBuffer
+{
+	b2TraceEvent events[b2_traceBufferCapacity];
+	std::atomic<uint64> writeIndex;
+	// Events before this index have been discarded by b2TraceClear().
+	std::atomic<uint64> clearIndex;
+	std::atomic<bool> owned;
+	int32 threadId;
+	b2TraceBuffer* next;
+};
+
+// Clock shared by all threads. Times are in microseconds since startup.
+static b2Timer s_traceEpoch;
+static std::atomic<b2TraceBuffer*> s_traceBuffers(NULL);
+static std::atomic<int32> s_traceBufferCount(0);
+
+static inline float64 b2TraceNow()
+{
+	return 1000.0 * s_traceEpoch.GetMilliseconds();
+}
+
+static b2TraceBuffer* b2TraceAcquireBuffer()
+{
+	// Reuse a buffer released by a thread that has exited.
+	for (b2TraceBuffer* buffer = s_traceBuffers.load(std::memory_order_acquire);
+		 buffer; buffer = buffer->next)
+	{
+		bool owned = false;
+		if (buffer->owned.compare_exchange_strong(owned, true))
+		{
+			return buffer;
+		}
+	}
+
+	b2TraceBuffer* buffer = (b2TraceBuffer*)b2Alloc(sizeof(b2TraceBuffer));
+	new (&buffer->writeIndex) std::atomic<uint64>(0);
+	new (&buffer->clearIndex) std::atomic<uint64>(0);
+	new (&buffer->owned) std::atomic<bool>(true);
+	buffer->threadId = s_traceBufferCount.fetch_add(1);
+	buffer->next = s_traceBuffers.load(std::memory_order_relaxed);
+	while (!s_traceBuffers.compare_exchange_weak(buffer->next, buffer,
+		std::memory_order_release, std::memory_order_relaxed))
+	{
+	}
+	return buffer;
+}
+
+// Releases the calling thread's buffer when the thread exits.
+class b2TraceBufferOwner
+{
+public:
+	b2TraceBufferOwner() : m_buffer(b2TraceAcquireBuffer()) {}
+	~b2TraceBufferOwner()
+	{
+		m_buffer->owned.store(false, std::memory_order_release);
+	}
+
+	b2TraceBuffer* m_buffer;
+};
+
+static inline b2TraceBuffer* b2TraceGetBuffer()
+{
+	static thread_local b2TraceBufferOwner owner;
+	return owner.m_buffer;
+}
+
+b2TraceScope::b2TraceScope(const char* name)
+{
+	m_name = name;
+	m_begin = b2TraceNow();
+}
+
+b2TraceScope::~b2TraceScope()
+{
+	float64 end = b2TraceNow();
+	b2TraceBuffer* buffer = b2TraceGetBuffer();
+	uint64 index = buffer->writeIndex.load(std::memory_order_relaxed);
+	b2TraceEvent& e = buffer->events[index & (b2_traceBufferCapacity - 1)];
+	e.name = m_name;
+	e.begin = m_begin;
+	e.duration = end - m_begin;
+	buffer->writeIndex.store(index + 1, std::memory_order_release);
+}
+
+bool b2TraceDumpChromeJson(const char* fileName)
+{
+	FILE* file = fopen(fileName, "w");
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (b2TraceBuffer* buffer = s_traceBuffers.load(std::memory_order_acquire);
+		 buffer; buffer = buffer->next)
+	{
+		uint64 end = buffer->writeIndex.load(std::memory_order_acquire);
+		uint64 begin = end > b2_traceBufferCapacity ?
+			end - b2_traceBufferCapacity : 0;
+		begin = b2Max(begin, buffer->clearIndex.load(std::memory_order_relaxed));
+		for (uint64 i = begin; i < end; ++i)
+		{
+			b2TraceEvent e = buffer->events[i & (b2_traceBufferCapacity - 1)];
+
+			// Skip the event if the owner has wrapped around and may have
+			// overwritten it while it was being copied.
+			std::atomic_thread_fence(std::memory_order_acquire);
+			uint64 written = buffer->writeIndex.load(std::memory_order_relaxed);
+			if (written - i >= b2_traceBufferCapacity)
+			{
+				continue;
+			}
+
+			fprintf(file,
+				"%s{\"name\":\"%s\",\"cat\":\"Box2D\",\"ph\":\"X\","
+				"\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%d}",
+				first ? "" : ",\n", e.name, e.begin, e.duration,
+				buffer->threadId);
+			first = false;
+		}
+	}
+	fprintf(file, "\n]}\n");
+
+	return fclose(file) == 0;
+}
+
+void b2TraceClear()
+{
+	for (b2TraceBuffer* buffer = s_traceBuffers.load(std::memory_order_acquire);
+		 buffer; buffer = buffer->next)
+	{
+		buffer->clearIndex.store(
+			buffer->writeIndex.load(std::memory_order_acquire),
+			std::memory_order_relaxed);
+	}
+}
+
+#else
+
+bool b2TraceDumpChromeJson(const char* fileName)
+{
+	FILE* file = fopen(fileName, "w");
+	if (file == NULL)
+	{
+		return false;
+	}
+	fprintf(file, "{\"traceEvents\":[]}\n");
+	return fclose(file) == 0;
+}
+
+void b2TraceClear()
+{
+}
+
+#endif // B2_ENABLE_TRACE
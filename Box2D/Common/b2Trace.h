@@ -0,0 +1,76 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef B2_TRACE_H
+#define B2_TRACE_H
+
+#include <Box2D/Common/b2Settings.h>
+
+/// Scoped tracing of the simulation pipeline. Define B2_ENABLE_TRACE to 1
+/// when building the library to record a timeline of the step stages;
+/// otherwise the trace macros expand to nothing.
+///
+/// Every thread records into its own fixed size ring buffer, so recording
+/// takes no locks and only the most recent events of each thread are kept.
+/// Call b2TraceDumpChromeJson() to write them in the Chrome trace event
+/// format, which can be loaded in chrome://tracing.
+#if !defined(B2_ENABLE_TRACE)
+#define B2_ENABLE_TRACE 0
+#endif
+
+/// Number of events kept per thread. Must be a power of two.
+#define b2_traceBufferCapacity 16384
+
+#if B2_ENABLE_TRACE
+
+#define B2_TRACE_CONCAT_INNER(a, b) a ## b
+#define B2_TRACE_CONCAT(a, b) B2_TRACE_CONCAT_INNER(a, b)
+
+/// Record the time spent between this statement and the end of the
+/// enclosing scope. 'name' must be a string literal or otherwise outlive
+/// the trace.
+#define B2_TRACE_SCOPE(name) \
+	b2TraceScope B2_TRACE_CONCAT(b2_traceScope, __LINE__)(name)
+
+/// Records an event when it goes out of scope.
+class b2TraceScope
+{
+public:
+	explicit b2TraceScope(const char* name);
+	~b2TraceScope();
+
+private:
+	const char* m_name;
+	float64 m_begin;
+};
+
+#else
+
+#define B2_TRACE_SCOPE(name)
+
+#endif // B2_ENABLE_TRACE
+
+/// Write the recorded events of all threads to a file in the Chrome trace
+/// event format. Events recorded while the dump is running may be left out.
+/// Returns false if the file could not be written.
+bool b2TraceDumpChromeJson(const char* fileName);
+
+/// Discard all recorded events.
+void b2TraceClear();
+
+#endif
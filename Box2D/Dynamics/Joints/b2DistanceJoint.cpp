@@ -19,6 +19,7 @@
 #include <Box2D/Dynamics/Joints/b2DistanceJoint.h>
 #include <Box2D/Dynamics/b2Body.h>
 #include <Box2D/Dynamics/b2TimeStep.h>
+#include <Box2D/Common/b2Snapshot.h>
 
 // 1-D constrained system
 // m (v2 - v1) = lambda
@@ -258,3 +259,23 @@ void b2DistanceJoint::Dump()
 	b2Log("  jd.dampingRatio = %.15lef;\n", m_dampingRatio);
 	b2Log("  joints[%d] = m_world->CreateJoint(&jd);\n", m_index);
 }
+
+void b2DistanceJoint::SaveState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_frequencyHz);
+	writer->Write(m_dampingRatio);
+	writer->Write(m_localAnchorA);
+	writer->Write(m_localAnchorB);
+	writer->Write(m_length);
+	writer->Write(m_impulse);
+}
+
+void b2DistanceJoint::RestoreState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_frequencyHz);
+	reader->Read(&m_dampingRatio);
+	reader->Read(&m_localAnchorA);
+	reader->Read(&m_localAnchorB);
+	reader->Read(&m_length);
+	reader->Read(&m_impulse);
+}
@@ -109,6 +109,8 @@ protected:
 	void InitVelocityConstraints(const b2SolverData& data);
 	void SolveVelocityConstraints(const b2SolverData& data);
 	bool SolvePositionConstraints(const b2SolverData& data);
+	void SaveState(b2SnapshotWriter* writer) const;
+	void RestoreState(b2SnapshotReader* reader);
 
 	float32 m_frequencyHz;
 	float32 m_dampingRatio;
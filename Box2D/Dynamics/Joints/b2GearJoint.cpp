@@ -21,6 +21,7 @@
 #include <Box2D/Dynamics/Joints/b2PrismaticJoint.h>
 #include <Box2D/Dynamics/b2Body.h>
 #include <Box2D/Dynamics/b2TimeStep.h>
+#include <Box2D/Common/b2Snapshot.h>
 
 // Gear Joint:
 // C0 = (coordinate1 + ratio * coordinate2)_initial
@@ -417,3 +418,33 @@ void b2GearJoint::Dump()
 	b2Log("  jd.ratio = %.15lef;\n", m_ratio);
 	b2Log("  joints[%d] = m_world->CreateJoint(&jd);\n", m_index);
 }
+
+void b2GearJoint::SaveState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_localAnchorA);
+	writer->Write(m_localAnchorB);
+	writer->Write(m_localAnchorC);
+	writer->Write(m_localAnchorD);
+	writer->Write(m_localAxisC);
+	writer->Write(m_localAxisD);
+	writer->Write(m_referenceAngleA);
+	writer->Write(m_referenceAngleB);
+	writer->Write(m_constant);
+	writer->Write(m_ratio);
+	writer->Write(m_impulse);
+}
+
+void b2GearJoint::RestoreState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_localAnchorA);
+	reader->Read(&m_localAnchorB);
+	reader->Read(&m_localAnchorC);
+	reader->Read(&m_localAnchorD);
+	reader->Read(&m_localAxisC);
+	reader->Read(&m_localAxisD);
+	reader->Read(&m_referenceAngleA);
+	reader->Read(&m_referenceAngleB);
+	reader->Read(&m_constant);
+	reader->Read(&m_ratio);
+	reader->Read(&m_impulse);
+}
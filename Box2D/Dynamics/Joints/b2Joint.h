@@ -25,6 +25,8 @@ class b2Body;
 class b2Joint;
 struct b2SolverData;
 class b2BlockAllocator;
+class b2SnapshotWriter;
+class b2SnapshotReader;
 
 enum b2JointType
 {
@@ -167,6 +169,11 @@ protected:
 	// This returns true if the position errors are within tolerance.
 	virtual bool SolvePositionConstraints(const b2SolverData& data) = 0;
 
+	// Write and read the joint parameters and the accumulated impulses for
+	// world snapshots. Solver temporaries are rebuilt by the next step.
+	virtual void SaveState(b2SnapshotWriter* writer) const = 0;
+	virtual void RestoreState(b2SnapshotReader* reader) = 0;
+
 	b2JointType m_type;
 	b2Joint* m_prev;
 	b2Joint* m_next;
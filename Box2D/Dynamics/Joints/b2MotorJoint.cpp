@@ -19,6 +19,7 @@
 #include <Box2D/Dynamics/Joints/b2MotorJoint.h>
 #include <Box2D/Dynamics/b2Body.h>
 #include <Box2D/Dynamics/b2TimeStep.h>
+#include <Box2D/Common/b2Snapshot.h>
 
 // Point-to-point constraint
 // Cdot = v2 - v1
@@ -302,3 +303,25 @@ void b2MotorJoint::Dump()
 	b2Log("  jd.correctionFactor = %.15lef;\n", m_correctionFactor);
 	b2Log("  joints[%d] = m_world->CreateJoint(&jd);\n", m_index);
 }
+
+void b2MotorJoint::SaveState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_linearOffset);
+	writer->Write(m_angularOffset);
+	writer->Write(m_linearImpulse);
+	writer->Write(m_angularImpulse);
+	writer->Write(m_maxForce);
+	writer->Write(m_maxTorque);
+	writer->Write(m_correctionFactor);
+}
+
+void b2MotorJoint::RestoreState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_linearOffset);
+	reader->Read(&m_angularOffset);
+	reader->Read(&m_linearImpulse);
+	reader->Read(&m_angularImpulse);
+	reader->Read(&m_maxForce);
+	reader->Read(&m_maxTorque);
+	reader->Read(&m_correctionFactor);
+}
@@ -19,6 +19,7 @@
 #include <Box2D/Dynamics/Joints/b2MouseJoint.h>
 #include <Box2D/Dynamics/b2Body.h>
 #include <Box2D/Dynamics/b2TimeStep.h>
+#include <Box2D/Common/b2Snapshot.h>
 
 // p = attached point, m = mouse point
 // C = p - m
@@ -220,3 +221,23 @@ void b2MouseJoint::ShiftOrigin(const b2Vec2& newOrigin)
 {
 	m_targetA -= newOrigin;
 }
+
+void b2MouseJoint::SaveState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_localAnchorB);
+	writer->Write(m_targetA);
+	writer->Write(m_frequencyHz);
+	writer->Write(m_dampingRatio);
+	writer->Write(m_impulse);
+	writer->Write(m_maxForce);
+}
+
+void b2MouseJoint::RestoreState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_localAnchorB);
+	reader->Read(&m_targetA);
+	reader->Read(&m_frequencyHz);
+	reader->Read(&m_dampingRatio);
+	reader->Read(&m_impulse);
+	reader->Read(&m_maxForce);
+}
@@ -19,6 +19,7 @@
 #include <Box2D/Dynamics/Joints/b2PrismaticJoint.h>
 #include <Box2D/Dynamics/b2Body.h>
 #include <Box2D/Dynamics/b2TimeStep.h>
+#include <Box2D/Common/b2Snapshot.h>
 
 // Linear constraint (point-to-line)
 // d = p2 - p1 = x2 + r2 - x1 - r1
@@ -624,3 +625,39 @@ void b2PrismaticJoint::Dump()
 	b2Log("  jd.maxMotorForce = %.15lef;\n", m_maxMotorForce);
 	b2Log("  joints[%d] = m_world->CreateJoint(&jd);\n", m_index);
 }
+
+void b2PrismaticJoint::SaveState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_localAnchorA);
+	writer->Write(m_localAnchorB);
+	writer->Write(m_localXAxisA);
+	writer->Write(m_localYAxisA);
+	writer->Write(m_referenceAngle);
+	writer->Write(m_impulse);
+	writer->Write(m_motorImpulse);
+	writer->Write(m_lowerTranslation);
+	writer->Write(m_upperTranslation);
+	writer->Write(m_maxMotorForce);
+	writer->Write(m_motorSpeed);
+	writer->Write(m_enableLimit);
+	writer->Write(m_enableMotor);
+	writer->Write(m_limitState);
+}
+
+void b2PrismaticJoint::RestoreState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_localAnchorA);
+	reader->Read(&m_localAnchorB);
+	reader->Read(&m_localXAxisA);
+	reader->Read(&m_localYAxisA);
+	reader->Read(&m_referenceAngle);
+	reader->Read(&m_impulse);
+	reader->Read(&m_motorImpulse);
+	reader->Read(&m_lowerTranslation);
+	reader->Read(&m_upperTranslation);
+	reader->Read(&m_maxMotorForce);
+	reader->Read(&m_motorSpeed);
+	reader->Read(&m_enableLimit);
+	reader->Read(&m_enableMotor);
+	reader->Read(&m_limitState);
+}
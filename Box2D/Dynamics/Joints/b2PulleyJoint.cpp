@@ -19,6 +19,7 @@
 #include <Box2D/Dynamics/Joints/b2PulleyJoint.h>
 #include <Box2D/Dynamics/b2Body.h>
 #include <Box2D/Dynamics/b2TimeStep.h>
+#include <Box2D/Common/b2Snapshot.h>
 
 // Pulley:
 // length1 = norm(p1 - s1)
@@ -346,3 +347,29 @@ void b2PulleyJoint::ShiftOrigin(const b2Vec2& newOrigin)
 	m_groundAnchorA -= newOrigin;
 	m_groundAnchorB -= newOrigin;
 }
+
+void b2PulleyJoint::SaveState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_groundAnchorA);
+	writer->Write(m_groundAnchorB);
+	writer->Write(m_lengthA);
+	writer->Write(m_lengthB);
+	writer->Write(m_localAnchorA);
+	writer->Write(m_localAnchorB);
+	writer->Write(m_constant);
+	writer->Write(m_ratio);
+	writer->Write(m_impulse);
+}
+
+void b2PulleyJoint::RestoreState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_groundAnchorA);
+	reader->Read(&m_groundAnchorB);
+	reader->Read(&m_lengthA);
+	reader->Read(&m_lengthB);
+	reader->Read(&m_localAnchorA);
+	reader->Read(&m_localAnchorB);
+	reader->Read(&m_constant);
+	reader->Read(&m_ratio);
+	reader->Read(&m_impulse);
+}
@@ -19,6 +19,7 @@
 #include <Box2D/Dynamics/Joints/b2RevoluteJoint.h>
 #include <Box2D/Dynamics/b2Body.h>
 #include <Box2D/Dynamics/b2TimeStep.h>
+#include <Box2D/Common/b2Snapshot.h>
 
 // Point-to-point constraint
 // C = p2 - p1
@@ -500,3 +501,35 @@ void b2RevoluteJoint::Dump()
 	b2Log("  jd.maxMotorTorque = %.15lef;\n", m_maxMotorTorque);
 	b2Log("  joints[%d] = m_world->CreateJoint(&jd);\n", m_index);
 }
+
+void b2RevoluteJoint::SaveState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_localAnchorA);
+	writer->Write(m_localAnchorB);
+	writer->Write(m_impulse);
+	writer->Write(m_motorImpulse);
+	writer->Write(m_enableMotor);
+	writer->Write(m_maxMotorTorque);
+	writer->Write(m_motorSpeed);
+	writer->Write(m_enableLimit);
+	writer->Write(m_referenceAngle);
+	writer->Write(m_lowerAngle);
+	writer->Write(m_upperAngle);
+	writer->Write(m_limitState);
+}
+
+void b2RevoluteJoint::RestoreState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_localAnchorA);
+	reader->Read(&m_localAnchorB);
+	reader->Read(&m_impulse);
+	reader->Read(&m_motorImpulse);
+	reader->Read(&m_enableMotor);
+	reader->Read(&m_maxMotorTorque);
+	reader->Read(&m_motorSpeed);
+	reader->Read(&m_enableLimit);
+	reader->Read(&m_referenceAngle);
+	reader->Read(&m_lowerAngle);
+	reader->Read(&m_upperAngle);
+	reader->Read(&m_limitState);
+}
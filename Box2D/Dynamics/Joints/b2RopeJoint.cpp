@@ -19,6 +19,7 @@
 #include <Box2D/Dynamics/Joints/b2RopeJoint.h>
 #include <Box2D/Dynamics/b2Body.h>
 #include <Box2D/Dynamics/b2TimeStep.h>
+#include <Box2D/Common/b2Snapshot.h>
 
 
 // Limit:
@@ -239,3 +240,23 @@ void b2RopeJoint::Dump()
 	b2Log("  jd.maxLength = %.15lef;\n", m_maxLength);
 	b2Log("  joints[%d] = m_world->CreateJoint(&jd);\n", m_index);
 }
+
+void b2RopeJoint::SaveState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_localAnchorA);
+	writer->Write(m_localAnchorB);
+	writer->Write(m_maxLength);
+	writer->Write(m_length);
+	writer->Write(m_impulse);
+	writer->Write(m_state);
+}
+
+void b2RopeJoint::RestoreState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_localAnchorA);
+	reader->Read(&m_localAnchorB);
+	reader->Read(&m_maxLength);
+	reader->Read(&m_length);
+	reader->Read(&m_impulse);
+	reader->Read(&m_state);
+}
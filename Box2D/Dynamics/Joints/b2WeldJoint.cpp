@@ -19,6 +19,7 @@
 #include <Box2D/Dynamics/Joints/b2WeldJoint.h>
 #include <Box2D/Dynamics/b2Body.h>
 #include <Box2D/Dynamics/b2TimeStep.h>
+#include <Box2D/Common/b2Snapshot.h>
 
 // Point-to-point constraint
 // C = p2 - p1
@@ -326,3 +327,23 @@ void b2WeldJoint::Dump()
 	b2Log("  jd.dampingRatio = %.15lef;\n", m_dampingRatio);
 	b2Log("  joints[%d] = m_world->CreateJoint(&jd);\n", m_index);
 }
+
+void b2WeldJoint::SaveState(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_frequencyHz);
+	writer->Write(m_dampingRatio);
+	writer->Write(m_localAnchorA);
+	writer->Write(m_localAnchorB);
+	writer->Write(m_referenceAngle);
+	writer->Write(m_impulse);
+}
+
+void b2WeldJoint::RestoreState(b2SnapshotReader* reader)
+{
+	reader->Read(&m_frequencyHz);
+	reader->Read(&m_dampingRatio);
+	reader->Read(&m_localAnchorA);
+	reader->Read(&m_localAnchorB);
+	reader->Read(&m_referenceAngle);
+	reader->Read(&m_impulse);
+}
@@ -85,6 +85,10 @@ b2Body::b2Body(const b2BodyDef* bd, b2World* world)
 
 	m_sleepTime = 0.0f;
 
+	m_targetPosition.SetZero();
+	m_targetAngle = 0.0f;
+	m_targetTime = 0.0f;
+
 	m_type = bd->type;
 
 	if (m_type == b2_dynamicBody)
@@ -125,7 +129,9 @@ void b2Body::SetType(b2BodyType type)
 		return;
 	}
 
+	bool wasStatic = m_type == b2_staticBody;
 	m_type = type;
+	m_flags &= ~e_targetFlag;
 
 	ResetMassData();
 
@@ -153,8 +159,20 @@ void b2Body::SetType(b2BodyType type)
 	}
 	m_contactList = NULL;
 
-	// Touch the proxies so that new contacts will be created (when appropriate)
 	b2BroadPhase* broadPhase = &m_world->m_contactManager.m_broadPhase;
+	if (wasStatic != (m_type == b2_staticBody) && (m_flags & e_activeFlag))
+	{
+		// Move the proxies between the static and the dynamic tree. New
+		// proxies are buffered, so new contacts will be created.
+		for (b2Fixture* f = m_fixtureList; f; f = f->m_next)
+		{
+			f->DestroyProxies(broadPhase);
+			f->CreateProxies(broadPhase, m_xf);
+		}
+		return;
+	}
+
+	// Touch the proxies so that new contacts will be created (when appropriate)
 	for (b2Fixture* f = m_fixtureList; f; f = f->m_next)
 	{
 		int32 proxyCount = f->m_proxyCount;
@@ -428,6 +446,8 @@ void b2Body::SetTransform(const b2Vec2& position, float32 angle)
 		return;
 	}
 
+	m_flags &= ~e_targetFlag;
+
 	m_xf.q.Set(angle);
 	m_xf.p = position;
 	m_xf0 = m_xf;
@@ -445,6 +465,68 @@ void b2Body::SetTransform(const b2Vec2& position, float32 angle)
 	}
 }
 
+void b2Body::SetTargetTransform(const b2Vec2& position, float32 angle,
+								float32 time)
+{
+	b2Assert(m_type == b2_kinematicBody);
+	if (m_type != b2_kinematicBody)
+	{
+		return;
+	}
+
+	// Leave a resting body asleep when it is already there.
+	if ((m_flags & e_targetFlag) == 0 &&
+		position == m_xf.p && angle == m_sweep.a &&
+		m_linearVelocity == b2Vec2_zero && m_angularVelocity == 0.0f)
+	{
+		return;
+	}
+
+	m_targetPosition = position;
+	m_targetAngle = angle;
+	m_targetTime = b2Max(time, 0.0f);
+	m_flags |= e_targetFlag;
+	SetAwake(true);
+}
+
+void b2Body::SteerToTarget(float32 dt)
+{
+	b2Assert(m_flags & e_targetFlag);
+	if (m_targetTime < 0.0f)
+	{
+		// The last step arrived: stop here.
+		m_linearVelocity.SetZero();
+		m_angularVelocity = 0.0f;
+		m_flags &= ~e_targetFlag;
+		return;
+	}
+
+	float32 t = b2Max(m_targetTime, dt);
+	b2Rot q(m_targetAngle);
+	b2Vec2 c = m_targetPosition + b2Mul(q, m_sweep.localCenter);
+	m_linearVelocity = (1.0f / t) * (c - m_sweep.c);
+	// Turn the short way round: targets may be any number of turns away.
+	float32 twoPi = 2.0f * b2_pi;
+	float32 angle = m_targetAngle - m_sweep.a;
+	angle -= twoPi * floorf((angle + b2_pi) / twoPi);
+	m_angularVelocity = angle / t;
+	// Negative once the arriving step is under way. Rounding may leave a
+	// sliver of time, which is not worth a step of its own.
+	m_targetTime -= dt;
+	if (m_targetTime <= 0.001f * dt)
+	{
+		// The solver limits how far a body moves in a step, so a long jump
+		// takes more steps.
+		b2Vec2 translation = dt * m_linearVelocity;
+		float32 rotation = dt * m_angularVelocity;
+		bool limited =
+			b2Dot(translation, translation) > b2_maxTranslationSquared ||
+			rotation * rotation > b2_maxRotationSquared;
+		m_targetTime = limited ? 0.0f : -1.0f;
+	}
+	SetAwake(true);
+}
+
 void b2Body::SynchronizeFixtures()
 {
 	b2Transform xf1;
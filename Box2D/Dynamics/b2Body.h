@@ -166,10 +166,29 @@ public:
 	/// @param angle the world rotation in radians.
 	void SetTransform(const b2Vec2& position, float32 angle);
 
+	/// Move a kinematic body to a new position and rotation over time.
+	/// Each step the world sets the velocity that reaches the target when
+	/// the time runs out, then stops the body. Unlike SetTransform, the body
+	/// pushes what it touches and its proxies move as usual. A target equal
+	/// to the current pose of a resting body does nothing. SetTransform and
+	/// SetType cancel the move.
+	/// @param position the world position of the body's local origin.
+	/// @param angle the world rotation in radians. The body turns the short
+	/// way, so its final angle may differ from angle by whole turns.
+	/// @param time the seconds to get there. With zero or less the body gets
+	/// there in as few steps as b2_maxTranslation and b2_maxRotation allow.
+	void SetTargetTransform(const b2Vec2& position, float32 angle,
+							float32 time);
+
 	/// Get the body transform for the body's origin.
 	/// @return the world transform of the body's origin.
 	const b2Transform& GetTransform() const;
 
+	/// Get the body transform before the last time step. It equals the
+	/// current transform after SetTransform. Useful to interpolate between
+	/// steps.
+	const b2Transform& GetPreviousTransform() const;
+
 	/// Get the world body origin position.
 	/// @return the world position of the body's origin.
 	const b2Vec2& GetPosition() const;
@@ -433,7 +452,8 @@ private:
 		e_bulletFlag		= 0x0008,
 		e_fixedRotationFlag	= 0x0010,
 		e_activeFlag		= 0x0020,
-		e_toiFlag			= 0x0040
+		e_toiFlag			= 0x0040,
+		e_targetFlag		= 0x0080
 	};
 
 	b2Body(const b2BodyDef* bd, b2World* world);
@@ -448,6 +468,9 @@ private:
 
 	void Advance(float32 t);
 
+	// Set the velocity that moves the body toward its target transform.
+	void SteerToTarget(float32 dt);
+
 	b2BodyType m_type;
 
 	uint16 m_flags;
@@ -485,6 +508,11 @@ private:
 
 	float32 m_sleepTime;
 
+	// The kinematic target, valid while e_targetFlag is set.
+	b2Vec2 m_targetPosition;
+	float32 m_targetAngle;
+	float32 m_targetTime;
+
 	void* m_userData;
 };
 
@@ -498,6 +526,11 @@ inline const b2Transform& b2Body::GetTransform() const
 	return m_xf;
 }
 
+inline const b2Transform& b2Body::GetPreviousTransform() const
+{
+	return m_xf0;
+}
+
 inline const b2Vec2& b2Body::GetPosition() const
 {
 	return m_xf.p;
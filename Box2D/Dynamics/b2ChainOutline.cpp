@@ -0,0 +1,336 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#include <Box2D/Dynamics/b2ChainOutline.h>
+#include <Box2D/Dynamics/b2Body.h>
+#include <Box2D/Dynamics/b2World.h>
+#include <Box2D/Collision/Shapes/b2ChainShape.h>
+#include <algorithm>
+#include <string.h>
+
+// Mix the bits of a float into an FNV-1a hash.
+static uint32 b2HashFloat(uint32 hash, float32 x)
+{
+	// -0 and 0 are the same position.
+	x += 0.0f;
+	uint32 bits;
+	memcpy(&bits, &x, sizeof(bits));
+	for (int32 i = 0; i < 4; ++i)
+	{
+		hash ^= (bits >> (8 * i)) & 0xff;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static uint32 b2HashVec2(uint32 hash, const b2Vec2& v)
+{
+	return b2HashFloat(b2HashFloat(hash, v.x), v.y);
+}
+
+static const uint32 b2_hashSeed = 2166136261u;
+
+// Whether a chain should end at a vertex. This only depends on the
+// position, so that the same vertices split the same way whatever comes
+// before them. About one vertex in chainLength is picked.
+static bool b2IsSplitVertex(const b2Vec2& v, int32 chainLength)
+{
+	uint32 hash = b2HashVec2(b2_hashSeed, v);
+	// Finalize so that the low bits depend on all the others.
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bu;
+	hash ^= hash >> 13;
+	return hash % uint32(chainLength) == 0;
+}
+
+static uint32 b2HashChain(const b2ChainShape& shape)
+{
+	uint32 hash = b2_hashSeed;
+	for (int32 i = 0; i < shape.m_count; ++i)
+	{
+		hash = b2HashVec2(hash, shape.m_vertices[i]);
+	}
+	if (shape.m_hasPrevVertex)
+	{
+		hash = b2HashVec2(hash ^ 1, shape.m_prevVertex);
+	}
+	if (shape.m_hasNextVertex)
+	{
+		hash = b2HashVec2(hash ^ 2, shape.m_nextVertex);
+	}
+	return hash;
+}
+
+static bool b2SameChain(const b2ChainShape& a, const b2ChainShape& b)
+{
+	if (a.m_count != b.m_count ||
+		a.m_hasPrevVertex != b.m_hasPrevVertex ||
+		a.m_hasNextVertex != b.m_hasNextVertex ||
+		(a.m_hasPrevVertex && !(a.m_prevVertex == b.m_prevVertex)) ||
+		(a.m_hasNextVertex && !(a.m_nextVertex == b.m_nextVertex)))
+	{
+		return false;
+	}
+	for (int32 i = 0; i < a.m_count; ++i)
+	{
+		if (!(a.m_vertices[i] == b.m_vertices[i]))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+b2ChainOutline::b2ChainOutline(const b2ChainOutlineDef& def)
+{
+	b2Assert(def.body != NULL && def.body->GetType() == b2_staticBody);
+	b2Assert(def.chainLength > 0);
+	m_def = def;
+	m_chains = NULL;
+	m_chainCount = 0;
+	m_chainCapacity = 0;
+	m_edgeCount = 0;
+	m_newChains = NULL;
+	m_newChainCount = 0;
+	m_newChainCapacity = 0;
+	m_reused = NULL;
+	m_points = NULL;
+	m_pointCapacity = 0;
+	m_createdCount = 0;
+	m_destroyedCount = 0;
+	m_batch = false;
+}
+
+b2ChainOutline::~b2ChainOutline()
+{
+	b2Free(m_chains);
+	b2Free(m_newChains);
+	b2Free(m_points);
+}
+
+int32 b2ChainOutline::SetPolylines(const b2Vec2* vertices,
+								   const int32* counts, const bool* loops,
+								   int32 polylineCount)
+{
+	b2Assert(!m_def.body->GetWorld()->IsLocked());
+	m_createdCount = 0;
+	m_destroyedCount = 0;
+	m_edgeCount = 0;
+	m_newChainCount = 0;
+	m_reused = (bool*)b2Alloc(sizeof(bool) * b2Max(m_chainCount, 1));
+	memset(m_reused, 0, sizeof(bool) * m_chainCount);
+
+	int32 offset = 0;
+	for (int32 i = 0; i < polylineCount; ++i)
+	{
+		AddPolyline(vertices + offset, counts[i], loops ? loops[i] : true);
+		offset += counts[i];
+	}
+
+	for (int32 i = 0; i < m_chainCount; ++i)
+	{
+		if (!m_reused[i])
+		{
+			BeginBatch();
+			m_def.body->DestroyFixture(m_chains[i].fixture);
+			++m_destroyedCount;
+		}
+	}
+	if (m_batch)
+	{
+		m_def.body->GetWorld()->EndStaticBatch();
+		m_batch = false;
+	}
+	b2Free(m_reused);
+	m_reused = NULL;
+
+	// The new chains become the current ones.
+	std::sort(m_newChains, m_newChains + m_newChainCount);
+	b2Swap(m_chains, m_newChains);
+	b2Swap(m_chainCapacity, m_newChainCapacity);
+	m_chainCount = m_newChainCount;
+	m_newChainCount = 0;
+	return m_createdCount;
+}
+
+void b2ChainOutline::Clear()
+{
+	SetPolylines(NULL, NULL, NULL, 0);
+}
+
+void b2ChainOutline::AddPolyline(const b2Vec2* vertices, int32 count,
+								 bool loop)
+{
+	// Loops are copied twice over so that the chains that wrap around
+	// are contiguous too.
+	int32 capacity = 2 * count + 1;
+	if (m_pointCapacity < capacity)
+	{
+		b2Free(m_points);
+		m_pointCapacity = b2Max(capacity, 2 * m_pointCapacity);
+		m_points = (b2Vec2*)b2Alloc(sizeof(b2Vec2) * m_pointCapacity);
+	}
+
+	// Drop the vertices that would make degenerate edges.
+	const float32 minDistanceSquared = b2_linearSlop * b2_linearSlop;
+	b2Vec2* points = m_points;
+	int32 n = 0;
+	for (int32 i = 0; i < count; ++i)
+	{
+		if (n == 0 ||
+			b2DistanceSquared(vertices[i], points[n - 1]) > minDistanceSquared)
+		{
+			points[n++] = vertices[i];
+		}
+	}
+	if (loop)
+	{
+		while (n > 1 &&
+			   b2DistanceSquared(points[n - 1], points[0]) <= minDistanceSquared)
+		{
+			--n;
+		}
+	}
+	if (n < (loop ? 3 : 2))
+	{
+		return;
+	}
+
+	const int32 chainLength = m_def.chainLength;
+	const int32 minEdges = b2Max(chainLength / 4, 1);
+	const int32 maxEdges = 4 * chainLength;
+	if (loop)
+	{
+		memcpy(points + n, points, sizeof(b2Vec2) * n);
+		points[2 * n] = points[0];
+
+		// Start at a split vertex so that the chains do not depend on
+		// which vertex of the loop comes first.
+		int32 start = 0;
+		for (int32 i = 0; i < n; ++i)
+		{
+			if (b2IsSplitVertex(points[i], chainLength))
+			{
+				start = i;
+				break;
+			}
+		}
+		int32 first = start;
+		for (int32 i = start + 1; i <= start + n; ++i)
+		{
+			int32 edges = i - first;
+			if (i == start + n || edges >= maxEdges ||
+				(edges >= minEdges && b2IsSplitVertex(points[i], chainLength)))
+			{
+				AddChain(points, first, i, n, true);
+				first = i;
+			}
+		}
+	}
+	else
+	{
+		int32 first = 0;
+		for (int32 i = 1; i < n; ++i)
+		{
+			int32 edges = i - first;
+			if (i == n - 1 || edges >= maxEdges ||
+				(edges >= minEdges && b2IsSplitVertex(points[i], chainLength)))
+			{
+				AddChain(points, first, i, n, false);
+				first = i;
+			}
+		}
+	}
+}
+
+void b2ChainOutline::AddChain(const b2Vec2* points, int32 first, int32 last,
+							  int32 count, bool loop)
+{
+	// Ghost vertices connect the chain to its neighbors, so that shapes
+	// slide smoothly across the split.
+	b2ChainShape shape;
+	shape.CreateChain(points + first, last - first + 1);
+	if (first > 0)
+	{
+		shape.SetPrevVertex(points[first - 1]);
+	}
+	else if (loop)
+	{
+		shape.SetPrevVertex(points[count - 1]);
+	}
+	if (loop || last < count - 1)
+	{
+		shape.SetNextVertex(points[last + 1]);
+	}
+
+	uint32 hash = b2HashChain(shape);
+	b2Fixture* fixture = FindChain(hash, shape);
+	if (!fixture)
+	{
+		BeginBatch();
+		b2FixtureDef fd;
+		fd.shape = &shape;
+		fd.userData = m_def.userData;
+		fd.friction = m_def.friction;
+		fd.restitution = m_def.restitution;
+		fd.filter = m_def.filter;
+		fixture = m_def.body->CreateFixture(&fd);
+		++m_createdCount;
+	}
+
+	if (m_newChainCount == m_newChainCapacity)
+	{
+		Chain* oldChains = m_newChains;
+		m_newChainCapacity = b2Max(2 * m_newChainCapacity, 16);
+		m_newChains = (Chain*)b2Alloc(sizeof(Chain) * m_newChainCapacity);
+		memcpy(m_newChains, oldChains, sizeof(Chain) * m_newChainCount);
+		b2Free(oldChains);
+	}
+	Chain& chain = m_newChains[m_newChainCount++];
+	chain.hash = hash;
+	chain.fixture = fixture;
+	m_edgeCount += shape.m_count - 1;
+}
+
+b2Fixture* b2ChainOutline::FindChain(uint32 hash, const b2ChainShape& shape)
+{
+	Chain key;
+	key.hash = hash;
+	Chain* end = m_chains + m_chainCount;
+	for (Chain* chain = std::lower_bound(m_chains, end, key);
+		 chain != end && chain->hash == hash; ++chain)
+	{
+		int32 index = int32(chain - m_chains);
+		const b2ChainShape& existing =
+			*(const b2ChainShape*)chain->fixture->GetShape();
+		if (!m_reused[index] && b2SameChain(existing, shape))
+		{
+			m_reused[index] = true;
+			return chain->fixture;
+		}
+	}
+	return NULL;
+}
+
+void b2ChainOutline::BeginBatch()
+{
+	if (!m_batch)
+	{
+		m_def.body->GetWorld()->BeginStaticBatch();
+		m_batch = true;
+	}
+}
@@ -0,0 +1,139 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#ifndef B2_CHAIN_OUTLINE_H
+#define B2_CHAIN_OUTLINE_H
+
+#include <Box2D/Dynamics/b2Fixture.h>
+
+class b2Body;
+class b2ChainShape;
+
+/// Where a b2ChainOutline puts its chains and how they collide.
+struct b2ChainOutlineDef
+{
+	b2ChainOutlineDef()
+	{
+		body = NULL;
+		userData = NULL;
+		friction = 0.2f;
+		restitution = 0.0f;
+		chainLength = 64;
+	}
+
+	/// The static body the chain fixtures are created on.
+	b2Body* body;
+
+	/// User data of the chain fixtures.
+	void* userData;
+
+	/// Friction and restitution of the chain fixtures.
+	float32 friction;
+	float32 restitution;
+
+	/// Collision filtering of the chain fixtures.
+	b2Filter filter;
+
+	/// The average number of edges in one chain fixture. Shorter chains
+	/// make an edit recreate less geometry, longer ones mean fewer
+	/// fixtures.
+	int32 chainLength;
+};
+
+/// Static geometry made of polylines that is replaced as a whole, e.g. an
+/// outline traced from an image every frame. The polylines are split into
+/// chain fixtures at vertices picked by their position alone, so that an
+/// edit moves the split points only around the vertices it changes. Each
+/// update then keeps the fixtures whose vertices are unchanged, and
+/// creates and destroys the others in a single static batch.
+/// @see b2World::BeginStaticBatch
+class b2ChainOutline
+{
+public:
+	explicit b2ChainOutline(const b2ChainOutlineDef& def);
+
+	/// The chain fixtures belong to the body and are left on it. Call
+	/// Clear() first to remove them.
+	~b2ChainOutline();
+
+	/// Replace the outline with a set of polylines.
+	/// @param vertices the vertices of all the polylines, one polyline
+	/// after the other. Vertices closer than b2_linearSlop to the previous
+	/// one are skipped.
+	/// @param counts the number of vertices in each polyline.
+	/// @param loops whether each polyline is closed, or NULL if all are.
+	/// @param polylineCount the number of polylines.
+	/// @return the number of chain fixtures created. The others were kept.
+	int32 SetPolylines(const b2Vec2* vertices, const int32* counts,
+					   const bool* loops, int32 polylineCount);
+
+	/// Destroy all the chain fixtures.
+	void Clear();
+
+	/// Get the number of chain fixtures.
+	int32 GetChainCount() const { return m_chainCount; }
+
+	/// Get the number of edges in all the chain fixtures.
+	int32 GetEdgeCount() const { return m_edgeCount; }
+
+	/// Get the number of chain fixtures the last update destroyed.
+	int32 GetDestroyedCount() const { return m_destroyedCount; }
+
+	/// Get the definition the outline was created with.
+	const b2ChainOutlineDef& GetDef() const { return m_def; }
+
+private:
+	struct Chain
+	{
+		uint32 hash;
+		b2Fixture* fixture;
+
+		bool operator<(const Chain& chain) const { return hash < chain.hash; }
+	};
+
+	b2ChainOutline(const b2ChainOutline&);
+	b2ChainOutline& operator=(const b2ChainOutline&);
+
+	void AddPolyline(const b2Vec2* vertices, int32 count, bool loop);
+	void AddChain(const b2Vec2* vertices, int32 first, int32 last,
+				  int32 count, bool loop);
+	b2Fixture* FindChain(uint32 hash, const b2ChainShape& shape);
+	void BeginBatch();
+
+	b2ChainOutlineDef m_def;
+
+	// Chain fixtures sorted by the hash of their shape.
+	Chain* m_chains;
+	int32 m_chainCount;
+	int32 m_chainCapacity;
+	int32 m_edgeCount;
+
+	// Scratch space of an update: the chains of the new outline, which
+	// old chains it reuses, and the vertices being split.
+	Chain* m_newChains;
+	int32 m_newChainCount;
+	int32 m_newChainCapacity;
+	bool* m_reused;
+	b2Vec2* m_points;
+	int32 m_pointCapacity;
+
+	int32 m_createdCount;
+	int32 m_destroyedCount;
+	bool m_batch;
+};
+
+#endif
@@ -22,6 +22,7 @@
 #include <Box2D/Dynamics/b2Fixture.h>
 #include <Box2D/Dynamics/b2WorldCallbacks.h>
 #include <Box2D/Dynamics/Contacts/b2Contact.h>
+#include <Box2D/Common/b2Trace.h>
 
 b2ContactFilter b2_defaultFilter;
 b2ContactListener b2_defaultListener;
@@ -105,6 +106,7 @@ void b2ContactManager::Destroy(b2Contact* c)
 // contact list.
 void b2ContactManager::Collide()
 {
+	B2_TRACE_SCOPE("b2ContactManager::Collide");
 	// Update awake contacts.
 	b2Contact* c = m_contactList;
 	while (c)
@@ -172,6 +174,7 @@ void b2ContactManager::Collide()
 
 void b2ContactManager::FindNewContacts()
 {
+	B2_TRACE_SCOPE("b2ContactManager::FindNewContacts");
 	m_broadPhase.UpdatePairs(this);
 }
 
@@ -236,18 +239,35 @@ void b2ContactManager::AddPair(void* proxyUserDataA, void* proxyUserDataB)
 		return;
 	}
 
+	b2Contact* c = CreateContact(fixtureA, indexA, fixtureB, indexB);
+	if (c == NULL)
+	{
+		return;
+	}
+
+	// Wake up the bodies
+	if (c->GetFixtureA()->IsSensor() == false && c->GetFixtureB()->IsSensor() == false)
+	{
+		c->GetFixtureA()->GetBody()->SetAwake(true);
+		c->GetFixtureB()->GetBody()->SetAwake(true);
+	}
+}
+
+b2Contact* b2ContactManager::CreateContact(b2Fixture* fixtureA, int32 indexA,
+										   b2Fixture* fixtureB, int32 indexB)
+{
 	// Call the factory.
 	b2Contact* c = b2Contact::Create(fixtureA, indexA, fixtureB, indexB, m_allocator);
 	if (c == NULL)
 	{
-		return;
+		return NULL;
 	}
 
 	// Contact creation may swap fixtures.
 	fixtureA = c->GetFixtureA();
 	fixtureB = c->GetFixtureB();
-	bodyA = fixtureA->GetBody();
-	bodyB = fixtureB->GetBody();
+	b2Body* bodyA = fixtureA->GetBody();
+	b2Body* bodyB = fixtureB->GetBody();
 
 	// Insert into the world.
 	c->m_prev = NULL;
@@ -284,12 +304,6 @@ void b2ContactManager::AddPair(void* proxyUserDataA, void* proxyUserDataB)
 	}
 	bodyB->m_contactList = &c->m_nodeB;
 
-	// Wake up the bodies
-	if (fixtureA->IsSensor() == false && fixtureB->IsSensor() == false)
-	{
-		bodyA->SetAwake(true);
-		bodyB->SetAwake(true);
-	}
-
 	++m_contactCount;
+	return c;
 }
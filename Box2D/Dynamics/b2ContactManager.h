@@ -22,6 +22,7 @@
 #include <Box2D/Collision/b2BroadPhase.h>
 
 class b2Contact;
+class b2Fixture;
 class b2ContactFilter;
 class b2ContactListener;
 class b2BlockAllocator;
@@ -38,6 +39,11 @@ public:
 	// Broad-phase callback.
 	void AddPair(void* proxyUserDataA, void* proxyUserDataB);
 
+	// Create a contact and link it into the world and the island graph,
+	// without checking for an existing contact or filtering.
+	b2Contact* CreateContact(b2Fixture* fixtureA, int32 indexA,
+							 b2Fixture* fixtureB, int32 indexB);
+
 	void FindNewContacts();
 
 	void Destroy(b2Contact* c);
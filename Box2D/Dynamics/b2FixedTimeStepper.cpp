@@ -0,0 +1,124 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#include <Box2D/Dynamics/b2FixedTimeStepper.h>
+#include <Box2D/Dynamics/b2Body.h>
+#include <Box2D/Dynamics/b2World.h>
+#include <Box2D/Particle/b2ParticleSystem.h>
+
+b2FixedTimeStepper::b2FixedTimeStepper(b2World* world,
+									   const b2FixedTimeStepperDef& def)
+{
+	m_world = world;
+	m_accumulator = 0.0f;
+	SetDef(def);
+}
+
+void b2FixedTimeStepper::SetDef(const b2FixedTimeStepperDef& def)
+{
+	b2Assert(def.timeStep > 0.0f);
+	b2Assert(def.maxSteps > 0);
+	m_def = def;
+}
+
+int32 b2FixedTimeStepper::Advance(float32 elapsed)
+{
+	b2Assert(elapsed >= 0.0f);
+	m_accumulator += elapsed;
+	int32 stepCount = (int32)(m_accumulator / m_def.timeStep);
+	if (stepCount > m_def.maxSteps)
+	{
+		stepCount = m_def.maxSteps;
+		m_accumulator = stepCount * m_def.timeStep;
+	}
+	if (stepCount == 0)
+	{
+		return 0;
+	}
+
+	// Particle systems only keep their previous positions once asked to.
+	for (b2ParticleSystem* system = m_world->GetParticleSystemList();
+		 system; system = system->GetNext())
+	{
+		system->GetPreviousPositionBuffer();
+	}
+
+	// Keep the forces for every step and clear them once at the end.
+	bool autoClearForces = m_world->GetAutoClearForces();
+	m_world->SetAutoClearForces(false);
+	for (int32 i = 0; i < stepCount; ++i)
+	{
+		m_world->Step(m_def.timeStep, m_def.velocityIterations,
+					  m_def.positionIterations, m_def.particleIterations);
+	}
+	m_world->SetAutoClearForces(autoClearForces);
+	if (autoClearForces)
+	{
+		m_world->ClearForces();
+	}
+
+	m_accumulator = b2Max(m_accumulator - stepCount * m_def.timeStep, 0.0f);
+	return stepCount;
+}
+
+void b2FixedTimeStepper::Reset()
+{
+	m_accumulator = 0.0f;
+}
+
+float32 b2FixedTimeStepper::GetAlpha() const
+{
+	return b2Min(m_accumulator / m_def.timeStep, 1.0f);
+}
+
+b2Transform b2FixedTimeStepper::GetInterpolatedTransform(
+	const b2Body* body) const
+{
+	float32 alpha = GetAlpha();
+	const b2Transform& xf0 = body->GetPreviousTransform();
+	const b2Transform& xf = body->GetTransform();
+	b2Transform out;
+	out.p = (1.0f - alpha) * xf0.p + alpha * xf.p;
+	// Blend the rotations and normalize, which is accurate enough for the
+	// small angles a body turns in one step.
+	float32 s = (1.0f - alpha) * xf0.q.s + alpha * xf.q.s;
+	float32 c = (1.0f - alpha) * xf0.q.c + alpha * xf.q.c;
+	float32 length = b2Sqrt(s * s + c * c);
+	if (length > b2_epsilon)
+	{
+		out.q.s = s / length;
+		out.q.c = c / length;
+	}
+	else
+	{
+		out.q = xf.q;
+	}
+	return out;
+}
+
+void b2FixedTimeStepper::GetInterpolatedPositions(b2ParticleSystem* system,
+												  b2Vec2* positions) const
+{
+	float32 alpha = GetAlpha();
+	int32 count = system->GetParticleCount();
+	const b2Vec2* previous = system->GetPreviousPositionBuffer();
+	const b2Vec2* current = system->GetPositionBuffer();
+	for (int32 i = 0; i < count; ++i)
+	{
+		positions[i] = previous[i] + alpha * (current[i] - previous[i]);
+	}
+}
@@ -0,0 +1,96 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#ifndef B2_FIXED_TIME_STEPPER_H
+#define B2_FIXED_TIME_STEPPER_H
+
+#include <Box2D/Common/b2Math.h>
+
+class b2Body;
+class b2ParticleSystem;
+class b2World;
+
+/// Settings of a b2FixedTimeStepper.
+struct b2FixedTimeStepperDef
+{
+	b2FixedTimeStepperDef()
+	{
+		timeStep = 1.0f / 60.0f;
+		velocityIterations = 8;
+		positionIterations = 3;
+		particleIterations = 1;
+		maxSteps = 4;
+	}
+
+	/// The time simulated by each step.
+	float32 timeStep;
+
+	/// Passed to b2World::Step.
+	int32 velocityIterations;
+	int32 positionIterations;
+	int32 particleIterations;
+
+	/// The most steps taken by one Advance call. Time beyond that is
+	/// dropped, so that a slow frame does not make the next one slower.
+	int32 maxSteps;
+};
+
+/// Steps a world at a fixed rate however often it is driven. Advance adds
+/// the elapsed wall time to an accumulator and takes as many fixed steps as
+/// it covers, possibly none. The state to display lies between the last two
+/// steps: the Get*Interpolated* functions blend the previous and current
+/// body transforms and particle positions by GetAlpha(). The output lags by
+/// up to one step but moves at the right speed and without judder,
+/// whatever the caller's frame rate.
+class b2FixedTimeStepper
+{
+public:
+	b2FixedTimeStepper(b2World* world, const b2FixedTimeStepperDef& def);
+
+	/// Add elapsed time and step the world for it.
+	/// Forces applied before the call act on every step it takes and are
+	/// cleared afterwards if the world clears forces automatically.
+	/// @return the number of steps taken.
+	int32 Advance(float32 elapsed);
+
+	/// Drop the accumulated time, e.g. after a pause.
+	void Reset();
+
+	/// Get how far the accumulated time is into the next step, in [0, 1).
+	float32 GetAlpha() const;
+
+	/// Get the body transform interpolated between the last two steps.
+	b2Transform GetInterpolatedTransform(const b2Body* body) const;
+
+	/// Write the particle positions interpolated between the last two
+	/// steps into an array of length GetParticleCount().
+	void GetInterpolatedPositions(b2ParticleSystem* system,
+								  b2Vec2* positions) const;
+
+	/// Get the settings.
+	const b2FixedTimeStepperDef& GetDef() const { return m_def; }
+
+	/// Change the settings. The accumulated time is kept.
+	void SetDef(const b2FixedTimeStepperDef& def);
+
+private:
+	b2World* m_world;
+	b2FixedTimeStepperDef m_def;
+	float32 m_accumulator;
+};
+
+#endif
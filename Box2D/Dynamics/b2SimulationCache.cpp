@@ -0,0 +1,767 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#include <Box2D/Dynamics/b2SimulationCache.h>
+#include <Box2D/Dynamics/b2Body.h>
+#include <Box2D/Dynamics/b2World.h>
+#include <Box2D/Particle/b2ParticleSystem.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A recording is a header, the frames back to back and the frame index.
+// The header is written last, so an unclosed recording has no magic.
+static const uint32 b2_simulationCacheMagic = 0x43533262; // "b2SC"
+static const uint32 b2_simulationCacheVersion = 1;
+
+struct b2SimulationCacheHeader
+{
+	uint32 magic;
+	uint32 version;
+	uint32 flags;
+	int32 frameCount;
+	uint64 indexOffset;
+	uint64 reserved;
+};
+
+struct b2SimulationCacheIndexEntry
+{
+	uint64 offset;
+	uint32 size;
+	float32 time;
+};
+
+// A frame is a b2SimulationCacheFrameHeader, a b2SimulationCacheSystemHeader
+// for each particle system, the body transforms and the particle arrays.
+// Offsets are relative to the start of the frame and 0 if not recorded.
+struct b2SimulationCacheFrameHeader
+{
+	int32 bodyCount;
+	int32 particleSystemCount;
+	uint32 bodyTransforms;
+	uint32 reserved;
+};
+
+struct b2SimulationCacheSystemHeader
+{
+	int32 count;
+	uint32 positions;
+	uint32 velocities;
+	uint32 colors;
+	b2Vec2 positionOffset;
+	b2Vec2 positionScale;
+	float32 velocityScale;
+	uint32 reserved[3];
+};
+
+// Arrays start on 16 byte boundaries so that they can be loaded with
+// aligned vector instructions.
+static inline uint32 b2CacheAlign(uint32 size)
+{
+	return (size + 15) & ~15u;
+}
+
+static const uint32 b2_simulationCacheHeaderSize =
+	b2CacheAlign(sizeof(b2SimulationCacheHeader));
+
+static uint32 b2PositionSize(uint32 flags, int32 count)
+{
+	if (!(flags & b2_cachePositions))
+	{
+		return 0;
+	}
+	return b2CacheAlign(count * (flags & b2_cacheQuantizePositions ?
+		2 * sizeof(uint16) : sizeof(b2Vec2)));
+}
+
+static uint32 b2VelocitySize(uint32 flags, int32 count)
+{
+	if (!(flags & b2_cacheVelocities))
+	{
+		return 0;
+	}
+	return b2CacheAlign(count * (flags & b2_cacheQuantizeVelocities ?
+		2 * sizeof(int16) : sizeof(b2Vec2)));
+}
+
+static uint32 b2ColorSize(uint32 flags, int32 count)
+{
+	if (!(flags & b2_cacheColors))
+	{
+		return 0;
+	}
+	return b2CacheAlign(count * sizeof(b2ParticleColor));
+}
+
+// The platform specific part: a file that can be resized and mapped at any
+// offset. Mappings are widened down to the allocation granularity.
+struct b2SimulationCacheFile
+{
+#if defined(_WIN32)
+	HANDLE handle;
+#else
+	int descriptor;
+#endif
+	uint64 granularity;
+	bool writable;
+};
+
+static b2SimulationCacheFile* b2OpenCacheFile(const char* fileName,
+											  bool writable)
+{
+#if defined(_WIN32)
+	HANDLE handle = CreateFileA(fileName,
+		writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+		FILE_SHARE_READ, NULL, writable ? CREATE_ALWAYS : OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		return NULL;
+	}
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	uint64 granularity = info.dwAllocationGranularity;
+#else
+	int descriptor = writable ?
+		open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644) :
+		open(fileName, O_RDONLY);
+	if (descriptor < 0)
+	{
+		return NULL;
+	}
+	uint64 granularity = (uint64)sysconf(_SC_PAGESIZE);
+#endif
+	b2SimulationCacheFile* file =
+		(b2SimulationCacheFile*)b2Alloc(sizeof(b2SimulationCacheFile));
+#if defined(_WIN32)
+	file->handle = handle;
+#else
+	file->descriptor = descriptor;
+#endif
+	file->granularity = granularity;
+	file->writable = writable;
+	return file;
+}
+
+static void b2CloseCacheFile(b2SimulationCacheFile* file)
+{
+#if defined(_WIN32)
+	CloseHandle(file->handle);
+#else
+	close(file->descriptor);
+#endif
+	b2Free(file);
+}
+
+static uint64 b2GetCacheFileSize(const b2SimulationCacheFile* file)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file->handle, &size))
+	{
+		return 0;
+	}
+	return (uint64)size.QuadPart;
+#else
+	struct stat status;
+	if (fstat(file->descriptor, &status) != 0)
+	{
+		return 0;
+	}
+	return (uint64)status.st_size;
+#endif
+}
+
+// The file must not be mapped while it is resized.
+static bool b2ResizeCacheFile(b2SimulationCacheFile* file, uint64 size)
+{
+#if defined(_WIN32)
+	LARGE_INTEGER position;
+	position.QuadPart = (LONGLONG)size;
+	return SetFilePointerEx(file->handle, position, NULL, FILE_BEGIN) &&
+		SetEndOfFile(file->handle);
+#else
+	return ftruncate(file->descriptor, (off_t)size) == 0;
+#endif
+}
+
+static void* b2MapCacheFile(b2SimulationCacheFile* file, uint64 offset,
+							uint64 size)
+{
+	uint64 slack = offset % file->granularity;
+	uint64 start = offset - slack;
+	size += slack;
+#if defined(_WIN32)
+	uint64 end = start + size;
+	HANDLE mapping = CreateFileMappingA(file->handle, NULL,
+		file->writable ? PAGE_READWRITE : PAGE_READONLY,
+		(DWORD)(end >> 32), (DWORD)end, NULL);
+	if (!mapping)
+	{
+		return NULL;
+	}
+	void* view = MapViewOfFile(mapping,
+		file->writable ? FILE_MAP_WRITE : FILE_MAP_READ,
+		(DWORD)(start >> 32), (DWORD)start, (SIZE_T)size);
+	// The view keeps the mapping alive.
+	CloseHandle(mapping);
+	if (!view)
+	{
+		return NULL;
+	}
+#else
+	void* view = mmap(NULL, (size_t)size,
+		file->writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+		file->descriptor, (off_t)start);
+	if (view == MAP_FAILED)
+	{
+		return NULL;
+	}
+#endif
+	return (uint8*)view + slack;
+}
+
+static void b2UnmapCacheFile(const b2SimulationCacheFile* file,
+							 const void* data, uint64 offset, uint64 size)
+{
+	uint64 slack = offset % file->granularity;
+	void* view = (uint8*)data - slack;
+#if defined(_WIN32)
+	B2_NOT_USED(size);
+	UnmapViewOfFile(view);
+#else
+	munmap(view, (size_t)(size + slack));
+#endif
+}
+
+b2Vec2 b2SimulationCacheParticles::GetPosition(int32 index) const
+{
+	b2Assert(0 <= index && index < count);
+	if (positions)
+	{
+		return positions[index];
+	}
+	b2Assert(quantizedPositions);
+	const uint16* q = quantizedPositions + 2 * index;
+	return b2Vec2(positionOffset.x + q[0] * positionScale.x,
+				  positionOffset.y + q[1] * positionScale.y);
+}
+
+b2Vec2 b2SimulationCacheParticles::GetVelocity(int32 index) const
+{
+	b2Assert(0 <= index && index < count);
+	if (velocities)
+	{
+		return velocities[index];
+	}
+	b2Assert(quantizedVelocities);
+	const int16* q = quantizedVelocities + 2 * index;
+	return velocityScale * b2Vec2(q[0], q[1]);
+}
+
+void b2SimulationCacheParticles::DecodePositions(b2Vec2* buffer) const
+{
+	if (positions)
+	{
+		memcpy(buffer, positions, sizeof(b2Vec2) * count);
+		return;
+	}
+	b2Assert(quantizedPositions);
+	for (int32 i = 0; i < count; i++)
+	{
+		const uint16* q = quantizedPositions + 2 * i;
+		buffer[i].Set(positionOffset.x + q[0] * positionScale.x,
+					  positionOffset.y + q[1] * positionScale.y);
+	}
+}
+
+void b2SimulationCacheParticles::DecodeVelocities(b2Vec2* buffer) const
+{
+	if (velocities)
+	{
+		memcpy(buffer, velocities, sizeof(b2Vec2) * count);
+		return;
+	}
+	b2Assert(quantizedVelocities);
+	for (int32 i = 0; i < count; i++)
+	{
+		const int16* q = quantizedVelocities + 2 * i;
+		buffer[i].Set(q[0] * velocityScale, q[1] * velocityScale);
+	}
+}
+
+static void b2QuantizePositions(const b2Vec2* positions, int32 count,
+								uint16* out,
+								b2SimulationCacheSystemHeader* header)
+{
+	b2Vec2 lower(b2_maxFloat, b2_maxFloat);
+	b2Vec2 upper(-b2_maxFloat, -b2_maxFloat);
+	for (int32 i = 0; i < count; i++)
+	{
+		lower = b2Min(lower, positions[i]);
+		upper = b2Max(upper, positions[i]);
+	}
+	if (count == 0)
+	{
+		lower.SetZero();
+		upper.SetZero();
+	}
+	b2Vec2 scale = (1.0f / 65535) * (upper - lower);
+	b2Vec2 inverse(scale.x > 0 ? 1 / scale.x : 0,
+				   scale.y > 0 ? 1 / scale.y : 0);
+	for (int32 i = 0; i < count; i++)
+	{
+		b2Vec2 q = positions[i] - lower;
+		out[2 * i] = (uint16)b2Min(q.x * inverse.x + 0.5f, 65535.0f);
+		out[2 * i + 1] = (uint16)b2Min(q.y * inverse.y + 0.5f, 65535.0f);
+	}
+	header->positionOffset = lower;
+	header->positionScale = scale;
+}
+
+static inline int16 b2QuantizeVelocity(float32 v)
+{
+	return (int16)(v < 0 ? v - 0.5f : v + 0.5f);
+}
+
+static void b2QuantizeVelocities(const b2Vec2* velocities, int32 count,
+								 int16* out,
+								 b2SimulationCacheSystemHeader* header)
+{
+	float32 largest = 0;
+	for (int32 i = 0; i < count; i++)
+	{
+		largest = b2Max(largest, b2Max(b2Abs(velocities[i].x),
+									   b2Abs(velocities[i].y)));
+	}
+	float32 scale = largest / 32767;
+	float32 inverse = largest > 0 ? 1 / scale : 0;
+	for (int32 i = 0; i < count; i++)
+	{
+		out[2 * i] = b2QuantizeVelocity(velocities[i].x * inverse);
+		out[2 * i + 1] = b2QuantizeVelocity(velocities[i].y * inverse);
+	}
+	header->velocityScale = scale;
+}
+
+b2SimulationCacheRecorder::b2SimulationCacheRecorder()
+{
+	m_file = NULL;
+	m_chunk = NULL;
+	m_chunkOffset = 0;
+	m_chunkSize = 0;
+	m_end = 0;
+	m_index = NULL;
+	m_frameCount = 0;
+	m_indexCapacity = 0;
+}
+
+b2SimulationCacheRecorder::~b2SimulationCacheRecorder()
+{
+	Close();
+}
+
+bool b2SimulationCacheRecorder::Open(const char* fileName,
+									 const b2SimulationCacheDef& def)
+{
+	Close();
+	b2Assert(def.chunkSize > 0);
+	m_file = b2OpenCacheFile(fileName, true);
+	if (!m_file)
+	{
+		return false;
+	}
+	m_def = def;
+	m_end = b2_simulationCacheHeaderSize;
+	m_frameCount = 0;
+	return true;
+}
+
+bool b2SimulationCacheRecorder::MapChunk(uint64 offset, uint64 size)
+{
+	b2Assert(!m_chunk);
+	if (!b2ResizeCacheFile(m_file, offset + size))
+	{
+		return false;
+	}
+	m_chunk = (uint8*)b2MapCacheFile(m_file, offset, size);
+	if (!m_chunk)
+	{
+		return false;
+	}
+	m_chunkOffset = offset;
+	m_chunkSize = size;
+	return true;
+}
+
+void b2SimulationCacheRecorder::UnmapChunk()
+{
+	if (m_chunk)
+	{
+		b2UnmapCacheFile(m_file, m_chunk, m_chunkOffset, m_chunkSize);
+		m_chunk = NULL;
+	}
+}
+
+bool b2SimulationCacheRecorder::RecordFrame(const b2World* world,
+											float32 time)
+{
+	b2Assert(m_file);
+	b2Assert(m_frameCount == 0 || m_index[m_frameCount - 1].time <= time);
+	uint32 flags = m_def.flags;
+
+	// Size the frame.
+	int32 bodyCount = flags & b2_cacheBodyTransforms ? world->GetBodyCount() : 0;
+	int32 systemCount = 0;
+	for (const b2ParticleSystem* system = world->GetParticleSystemList();
+		 system; system = system->GetNext())
+	{
+		systemCount++;
+	}
+	uint32 headerSize = b2CacheAlign(sizeof(b2SimulationCacheFrameHeader) +
+		systemCount * sizeof(b2SimulationCacheSystemHeader));
+	uint32 bodySize = b2CacheAlign(bodyCount * sizeof(b2Transform));
+	uint32 size = headerSize + bodySize;
+	for (const b2ParticleSystem* system = world->GetParticleSystemList();
+		 system; system = system->GetNext())
+	{
+		int32 count = system->GetParticleCount();
+		size += b2PositionSize(flags, count) + b2VelocitySize(flags, count) +
+			b2ColorSize(flags, count);
+	}
+
+	// Start a new chunk if the frame does not fit in the current one.
+	if (m_end + size > m_chunkOffset + m_chunkSize || !m_chunk)
+	{
+		UnmapChunk();
+		if (!MapChunk(m_end, b2Max((uint64)m_def.chunkSize, (uint64)size)))
+		{
+			return false;
+		}
+	}
+	if (m_frameCount == m_indexCapacity)
+	{
+		int32 capacity = m_indexCapacity ? 2 * m_indexCapacity : 256;
+		b2SimulationCacheIndexEntry* index = (b2SimulationCacheIndexEntry*)
+			b2Alloc(sizeof(b2SimulationCacheIndexEntry) * capacity);
+		if (m_index)
+		{
+			memcpy(index, m_index,
+				   sizeof(b2SimulationCacheIndexEntry) * m_frameCount);
+			b2Free(m_index);
+		}
+		m_index = index;
+		m_indexCapacity = capacity;
+	}
+
+	// Copy the frame.
+	uint8* frame = m_chunk + (m_end - m_chunkOffset);
+	b2SimulationCacheFrameHeader* frameHeader =
+		(b2SimulationCacheFrameHeader*)frame;
+	frameHeader->bodyCount = bodyCount;
+	frameHeader->particleSystemCount = systemCount;
+	frameHeader->bodyTransforms = bodyCount ? headerSize : 0;
+	frameHeader->reserved = 0;
+	if (bodyCount)
+	{
+		b2Transform* transforms = (b2Transform*)(frame + headerSize);
+		for (const b2Body* body = world->GetBodyList(); body;
+			 body = body->GetNext())
+		{
+			*transforms++ = body->GetTransform();
+		}
+	}
+	b2SimulationCacheSystemHeader* systemHeader =
+		(b2SimulationCacheSystemHeader*)(frameHeader + 1);
+	uint32 offset = headerSize + bodySize;
+	for (const b2ParticleSystem* system = world->GetParticleSystemList();
+		 system; system = system->GetNext(), systemHeader++)
+	{
+		int32 count = system->GetParticleCount();
+		*systemHeader = b2SimulationCacheSystemHeader();
+		systemHeader->count = count;
+		if (flags & b2_cachePositions)
+		{
+			systemHeader->positions = offset;
+			if (flags & b2_cacheQuantizePositions)
+			{
+				b2QuantizePositions(system->GetPositionBuffer(), count,
+									(uint16*)(frame + offset), systemHeader);
+			}
+			else
+			{
+				memcpy(frame + offset, system->GetPositionBuffer(),
+					   sizeof(b2Vec2) * count);
+			}
+			offset += b2PositionSize(flags, count);
+		}
+		if (flags & b2_cacheVelocities)
+		{
+			systemHeader->velocities = offset;
+			if (flags & b2_cacheQuantizeVelocities)
+			{
+				b2QuantizeVelocities(system->GetVelocityBuffer(), count,
+									 (int16*)(frame + offset), systemHeader);
+			}
+			else
+			{
+				memcpy(frame + offset, system->GetVelocityBuffer(),
+					   sizeof(b2Vec2) * count);
+			}
+			offset += b2VelocitySize(flags, count);
+		}
+		if (flags & b2_cacheColors)
+		{
+			systemHeader->colors = offset;
+			memcpy(frame + offset, system->GetColorBuffer(),
+				   sizeof(b2ParticleColor) * count);
+			offset += b2ColorSize(flags, count);
+		}
+	}
+	b2Assert(offset == size);
+
+	b2SimulationCacheIndexEntry& entry = m_index[m_frameCount++];
+	entry.offset = m_end;
+	entry.size = size;
+	entry.time = time;
+	m_end += size;
+	return true;
+}
+
+bool b2SimulationCacheRecorder::Close()
+{
+	if (!m_file)
+	{
+		return true;
+	}
+	UnmapChunk();
+
+	// Drop the unused part of the last chunk and append the index.
+	uint64 indexSize = sizeof(b2SimulationCacheIndexEntry) * m_frameCount;
+	bool ok = b2ResizeCacheFile(m_file, m_end + indexSize);
+	if (ok && indexSize)
+	{
+		void* index = b2MapCacheFile(m_file, m_end, indexSize);
+		ok = index != NULL;
+		if (ok)
+		{
+			memcpy(index, m_index, (size_t)indexSize);
+			b2UnmapCacheFile(m_file, index, m_end, indexSize);
+		}
+	}
+	if (ok)
+	{
+		b2SimulationCacheHeader* header = (b2SimulationCacheHeader*)
+			b2MapCacheFile(m_file, 0, sizeof(b2SimulationCacheHeader));
+		ok = header != NULL;
+		if (ok)
+		{
+			header->magic = b2_simulationCacheMagic;
+			header->version = b2_simulationCacheVersion;
+			header->flags = m_def.flags;
+			header->frameCount = m_frameCount;
+			header->indexOffset = m_end;
+			header->reserved = 0;
+			b2UnmapCacheFile(m_file, header, 0,
+							 sizeof(b2SimulationCacheHeader));
+		}
+	}
+
+	b2CloseCacheFile(m_file);
+	m_file = NULL;
+	b2Free(m_index);
+	m_index = NULL;
+	m_indexCapacity = 0;
+	m_chunkOffset = 0;
+	m_chunkSize = 0;
+	return ok;
+}
+
+b2SimulationCacheReader::b2SimulationCacheReader()
+{
+	m_file = NULL;
+	m_data = NULL;
+	m_size = 0;
+	m_flags = 0;
+	m_index = NULL;
+	m_frameCount = 0;
+}
+
+b2SimulationCacheReader::~b2SimulationCacheReader()
+{
+	Close();
+}
+
+bool b2SimulationCacheReader::Open(const char* fileName)
+{
+	Close();
+	m_file = b2OpenCacheFile(fileName, false);
+	if (!m_file)
+	{
+		return false;
+	}
+	m_size = b2GetCacheFileSize(m_file);
+	if (m_size >= b2_simulationCacheHeaderSize)
+	{
+		m_data = (const uint8*)b2MapCacheFile(m_file, 0, m_size);
+	}
+	if (!m_data)
+	{
+		Close();
+		return false;
+	}
+
+	const b2SimulationCacheHeader* header =
+		(const b2SimulationCacheHeader*)m_data;
+	uint64 indexSize =
+		sizeof(b2SimulationCacheIndexEntry) * (uint64)header->frameCount;
+	if (header->magic != b2_simulationCacheMagic ||
+		header->version != b2_simulationCacheVersion ||
+		header->frameCount < 0 ||
+		header->indexOffset < b2_simulationCacheHeaderSize ||
+		header->indexOffset + indexSize != m_size)
+	{
+		Close();
+		return false;
+	}
+	m_flags = header->flags;
+	m_frameCount = header->frameCount;
+	m_index = (const b2SimulationCacheIndexEntry*)
+		(m_data + header->indexOffset);
+	return true;
+}
+
+void b2SimulationCacheReader::Close()
+{
+	if (m_data)
+	{
+		b2UnmapCacheFile(m_file, m_data, 0, m_size);
+		m_data = NULL;
+	}
+	if (m_file)
+	{
+		b2CloseCacheFile(m_file);
+		m_file = NULL;
+	}
+	m_size = 0;
+	m_flags = 0;
+	m_index = NULL;
+	m_frameCount = 0;
+}
+
+float32 b2SimulationCacheReader::GetFrameTime(int32 frame) const
+{
+	b2Assert(0 <= frame && frame < m_frameCount);
+	return m_index[frame].time;
+}
+
+int32 b2SimulationCacheReader::FindFrame(float32 time) const
+{
+	// Find the first frame after the time.
+	int32 first = 0;
+	int32 count = m_frameCount;
+	while (count > 0)
+	{
+		int32 step = count / 2;
+		if (m_index[first + step].time <= time)
+		{
+			first += step + 1;
+			count -= step + 1;
+		}
+		else
+		{
+			count = step;
+		}
+	}
+	return m_frameCount ? b2Max(first - 1, 0) : -1;
+}
+
+const uint8* b2SimulationCacheReader::GetFrameData(int32 frame) const
+{
+	if (frame < 0 || frame >= m_frameCount)
+	{
+		return NULL;
+	}
+	return m_data + m_index[frame].offset;
+}
+
+bool b2SimulationCacheReader::GetFrame(int32 frame,
+									   b2SimulationCacheFrame* out) const
+{
+	const uint8* data = GetFrameData(frame);
+	if (!data)
+	{
+		return false;
+	}
+	const b2SimulationCacheFrameHeader* header =
+		(const b2SimulationCacheFrameHeader*)data;
+	out->time = m_index[frame].time;
+	out->bodyCount = header->bodyCount;
+	out->bodyTransforms = header->bodyTransforms ?
+		(const b2Transform*)(data + header->bodyTransforms) : NULL;
+	out->particleSystemCount = header->particleSystemCount;
+	return true;
+}
+
+bool b2SimulationCacheReader::GetParticles(
+	int32 frame, int32 particleSystem, b2SimulationCacheParticles* out) const
+{
+	const uint8* data = GetFrameData(frame);
+	if (!data)
+	{
+		return false;
+	}
+	const b2SimulationCacheFrameHeader* frameHeader =
+		(const b2SimulationCacheFrameHeader*)data;
+	if (particleSystem < 0 ||
+		particleSystem >= frameHeader->particleSystemCount)
+	{
+		return false;
+	}
+	const b2SimulationCacheSystemHeader* header =
+		(const b2SimulationCacheSystemHeader*)(frameHeader + 1) +
+		particleSystem;
+	bool quantizedPositions = (m_flags & b2_cacheQuantizePositions) != 0;
+	bool quantizedVelocities = (m_flags & b2_cacheQuantizeVelocities) != 0;
+	const uint8* positions =
+		header->positions ? data + header->positions : NULL;
+	const uint8* velocities =
+		header->velocities ? data + header->velocities : NULL;
+	out->count = header->count;
+	out->positions =
+		quantizedPositions ? NULL : (const b2Vec2*)positions;
+	out->quantizedPositions =
+		quantizedPositions ? (const uint16*)positions : NULL;
+	out->positionOffset = header->positionOffset;
+	out->positionScale = header->positionScale;
+	out->velocities =
+		quantizedVelocities ? NULL : (const b2Vec2*)velocities;
+	out->quantizedVelocities =
+		quantizedVelocities ? (const int16*)velocities : NULL;
+	out->velocityScale = header->velocityScale;
+	out->colors = header->colors ?
+		(const b2ParticleColor*)(data + header->colors) : NULL;
+	return true;
+}
@@ -0,0 +1,220 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#ifndef B2_SIMULATION_CACHE_H
+#define B2_SIMULATION_CACHE_H
+
+#include <Box2D/Common/b2Math.h>
+#include <Box2D/Particle/b2Particle.h>
+
+class b2World;
+struct b2SimulationCacheFile;
+struct b2SimulationCacheIndexEntry;
+
+/// What a b2SimulationCacheRecorder writes for each frame.
+enum b2SimulationCacheFlag
+{
+	/// Particle positions.
+	b2_cachePositions = 1 << 0,
+	/// Particle velocities.
+	b2_cacheVelocities = 1 << 1,
+	/// Particle colors.
+	b2_cacheColors = 1 << 2,
+	/// The transform of every body, in body list order.
+	b2_cacheBodyTransforms = 1 << 3,
+	/// Store positions as 16-bit values within the bounds of each particle
+	/// system in each frame.
+	b2_cacheQuantizePositions = 1 << 4,
+	/// Store velocities as 16-bit values scaled by the largest velocity
+	/// component of each particle system in each frame.
+	b2_cacheQuantizeVelocities = 1 << 5,
+};
+
+/// Settings of a recording.
+struct b2SimulationCacheDef
+{
+	b2SimulationCacheDef()
+	{
+		flags = b2_cachePositions | b2_cacheVelocities | b2_cacheColors |
+			b2_cacheBodyTransforms;
+		chunkSize = 64 * 1024 * 1024;
+	}
+
+	/// A combination of b2SimulationCacheFlag.
+	uint32 flags;
+
+	/// The number of bytes mapped at a time while recording. The file grows
+	/// by a chunk whenever a frame does not fit in the current one.
+	int32 chunkSize;
+};
+
+/// One frame of one particle system, pointing into the mapped file.
+/// Depending on the recording flags, each attribute is either stored as
+/// floats (positions, velocities), quantized (quantizedPositions,
+/// quantizedVelocities) or not at all, in which case both are NULL.
+struct b2SimulationCacheParticles
+{
+	int32 count;
+
+	const b2Vec2* positions;
+	/// Pairs of x and y. position = positionOffset + q * positionScale.
+	const uint16* quantizedPositions;
+	b2Vec2 positionOffset;
+	b2Vec2 positionScale;
+
+	const b2Vec2* velocities;
+	/// Pairs of x and y. velocity = q * velocityScale.
+	const int16* quantizedVelocities;
+	float32 velocityScale;
+
+	const b2ParticleColor* colors;
+
+	/// Get the position of a particle, dequantizing it if needed.
+	b2Vec2 GetPosition(int32 index) const;
+
+	/// Get the velocity of a particle, dequantizing it if needed.
+	b2Vec2 GetVelocity(int32 index) const;
+
+	/// Copy count positions into a buffer, dequantizing them if needed.
+	void DecodePositions(b2Vec2* buffer) const;
+
+	/// Copy count velocities into a buffer, dequantizing them if needed.
+	void DecodeVelocities(b2Vec2* buffer) const;
+};
+
+/// A recorded frame, pointing into the mapped file.
+struct b2SimulationCacheFrame
+{
+	/// The time passed to RecordFrame.
+	float32 time;
+
+	/// NULL if body transforms were not recorded.
+	const b2Transform* bodyTransforms;
+	int32 bodyCount;
+
+	/// Use b2SimulationCacheReader::GetParticles to get each system.
+	int32 particleSystemCount;
+};
+
+/// Streams the state of a world into a file, one frame per step, for
+/// playback without running the solver. Frames are copied straight from
+/// the particle buffers and body transforms into a memory-mapped chunk of
+/// the file. The frame index is written by Close, so a recording that is
+/// not closed cannot be read.
+///
+/// Files hold raw floats in native byte order and are meant to be played
+/// back on the machine type that recorded them.
+class b2SimulationCacheRecorder
+{
+public:
+	b2SimulationCacheRecorder();
+	~b2SimulationCacheRecorder();
+
+	/// Create or truncate a file and start a recording.
+	/// @return false if the file could not be created.
+	bool Open(const char* fileName, const b2SimulationCacheDef& def);
+
+	/// Append the current state of a world.
+	/// @param time the time of the frame, used by
+	///        b2SimulationCacheReader::FindFrame. Must not decrease.
+	/// @return false if the file could not be grown.
+	bool RecordFrame(const b2World* world, float32 time);
+
+	/// Write the frame index and close the file.
+	/// @return false if the index could not be written.
+	bool Close();
+
+	/// Whether a recording is in progress.
+	bool IsOpen() const { return m_file != NULL; }
+
+	/// Get the number of frames recorded so far.
+	int32 GetFrameCount() const { return m_frameCount; }
+
+private:
+	bool MapChunk(uint64 offset, uint64 size);
+	void UnmapChunk();
+
+	b2SimulationCacheFile* m_file;
+	b2SimulationCacheDef m_def;
+
+	// The mapped part of the file.
+	uint8* m_chunk;
+	uint64 m_chunkOffset;
+	uint64 m_chunkSize;
+	// End of the frames written so far.
+	uint64 m_end;
+
+	// The frame index, written by Close.
+	b2SimulationCacheIndexEntry* m_index;
+	int32 m_frameCount;
+	int32 m_indexCapacity;
+};
+
+/// Maps a recording made by b2SimulationCacheRecorder and returns any of
+/// its frames as views into the mapping. Nothing is copied, so seeking is
+/// as cheap as reading the frame index.
+class b2SimulationCacheReader
+{
+public:
+	b2SimulationCacheReader();
+	~b2SimulationCacheReader();
+
+	/// Map a recording.
+	/// @return false if the file could not be mapped or is not a closed
+	///         recording of this build.
+	bool Open(const char* fileName);
+
+	/// Unmap the recording. Views returned earlier become invalid.
+	void Close();
+
+	/// Whether a recording is mapped.
+	bool IsOpen() const { return m_data != NULL; }
+
+	/// Get the flags the recording was made with.
+	uint32 GetFlags() const { return m_flags; }
+
+	/// Get the number of frames.
+	int32 GetFrameCount() const { return m_frameCount; }
+
+	/// Get the time of a frame.
+	float32 GetFrameTime(int32 frame) const;
+
+	/// Find the last frame whose time is not after the given time. Returns
+	/// 0 for times before the first frame and -1 if there are no frames.
+	int32 FindFrame(float32 time) const;
+
+	/// Get a frame.
+	/// @return false if the frame is out of range.
+	bool GetFrame(int32 frame, b2SimulationCacheFrame* out) const;
+
+	/// Get one particle system of a frame, in world list order.
+	/// @return false if the frame or the system is out of range.
+	bool GetParticles(int32 frame, int32 particleSystem,
+					  b2SimulationCacheParticles* out) const;
+
+private:
+	const uint8* GetFrameData(int32 frame) const;
+
+	b2SimulationCacheFile* m_file;
+	const uint8* m_data;
+	uint64 m_size;
+	uint32 m_flags;
+	const b2SimulationCacheIndexEntry* m_index;
+	int32 m_frameCount;
+};
+
+#endif
@@ -0,0 +1,120 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include <Box2D/Dynamics/b2TOIQueue.h>
+#include <string.h>
+
+b2TOIQueue::b2TOIQueue()
+{
+	m_heap = NULL;
+	m_heapCount = 0;
+	m_heapCapacity = 0;
+
+	m_invalid = NULL;
+	m_invalidCount = 0;
+	m_invalidCapacity = 0;
+}
+
+b2TOIQueue::~b2TOIQueue()
+{
+	b2Free(m_heap);
+	b2Free(m_invalid);
+}
+
+void b2TOIQueue::Clear()
+{
+	m_heapCount = 0;
+	m_invalidCount = 0;
+}
+
+void b2TOIQueue::Push(b2Contact* contact, float32 alpha)
+{
+	if (m_heapCount == m_heapCapacity)
+	{
+		b2TOICandidate* oldHeap = m_heap;
+		m_heapCapacity = m_heapCapacity ? 2 * m_heapCapacity : 64;
+		m_heap = (b2TOICandidate*)b2Alloc(
+			m_heapCapacity * sizeof(b2TOICandidate));
+		if (oldHeap)
+		{
+			memcpy(m_heap, oldHeap, m_heapCount * sizeof(b2TOICandidate));
+			b2Free(oldHeap);
+		}
+	}
+
+	// Sift up.
+	int32 i = m_heapCount++;
+	while (i > 0)
+	{
+		int32 parent = (i - 1) >> 1;
+		if (m_heap[parent].alpha <= alpha)
+		{
+			break;
+		}
+		m_heap[i] = m_heap[parent];
+		i = parent;
+	}
+	m_heap[i].contact = contact;
+	m_heap[i].alpha = alpha;
+}
+
+void b2TOIQueue::Pop()
+{
+	b2Assert(m_heapCount > 0);
+	b2TOICandidate last = m_heap[--m_heapCount];
+
+	// Sift the last element down from the root.
+	int32 i = 0;
+	for (;;)
+	{
+		int32 child = 2 * i + 1;
+		if (child >= m_heapCount)
+		{
+			break;
+		}
+		if (child + 1 < m_heapCount &&
+			m_heap[child + 1].alpha < m_heap[child].alpha)
+		{
+			++child;
+		}
+		if (last.alpha <= m_heap[child].alpha)
+		{
+			break;
+		}
+		m_heap[i] = m_heap[child];
+		i = child;
+	}
+	m_heap[i] = last;
+}
+
+void b2TOIQueue::Invalidate(b2Contact* contact)
+{
+	if (m_invalidCount == m_invalidCapacity)
+	{
+		b2Contact** oldInvalid = m_invalid;
+		m_invalidCapacity = m_invalidCapacity ? 2 * m_invalidCapacity : 64;
+		m_invalid = (b2Contact**)b2Alloc(
+			m_invalidCapacity * sizeof(b2Contact*));
+		if (oldInvalid)
+		{
+			memcpy(m_invalid, oldInvalid, m_invalidCount * sizeof(b2Contact*));
+			b2Free(oldInvalid);
+		}
+	}
+	m_invalid[m_invalidCount++] = contact;
+}
@@ -0,0 +1,104 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+
+#ifndef B2_TOI_QUEUE_H
+#define B2_TOI_QUEUE_H
+
+#include <Box2D/Common/b2Settings.h>
+
+class b2Contact;
+
+/// A contact with a pending time of impact.
+struct b2TOICandidate
+{
+	b2Contact* contact;
+	float32 alpha;
+};
+
+/// Priority queue of TOI candidates used by the continuous phase. Holds a
+/// binary min-heap keyed on alpha and a list of contacts whose TOI has been
+/// invalidated and must be recomputed before the next pop. Entries are never
+/// removed when a contact changes; the caller discards stale entries when
+/// they reach the top. Storage is retained between steps.
+class b2TOIQueue
+{
+public:
+	b2TOIQueue();
+	~b2TOIQueue();
+
+	/// Remove all candidates and invalidated contacts.
+	void Clear();
+
+	/// Add a candidate.
+	void Push(b2Contact* contact, float32 alpha);
+
+	/// Get the candidate with the smallest alpha. The queue must not be empty.
+	const b2TOICandidate& Top() const;
+
+	/// Remove the candidate with the smallest alpha.
+	void Pop();
+
+	/// Is the queue empty?
+	bool IsEmpty() const;
+
+	/// Record a contact whose TOI must be recomputed.
+	void Invalidate(b2Contact* contact);
+
+	/// Get the contacts recorded with Invalidate since the last call to
+	/// ClearInvalid.
+	b2Contact** GetInvalid() const;
+	int32 GetInvalidCount() const;
+	void ClearInvalid();
+
+private:
+	b2TOICandidate* m_heap;
+	int32 m_heapCount;
+	int32 m_heapCapacity;
+
+	b2Contact** m_invalid;
+	int32 m_invalidCount;
+	int32 m_invalidCapacity;
+};
+
+inline const b2TOICandidate& b2TOIQueue::Top() const
+{
+	b2Assert(m_heapCount > 0);
+	return m_heap[0];
+}
+
+inline bool b2TOIQueue::IsEmpty() const
+{
+	return m_heapCount == 0;
+}
+
+inline b2Contact** b2TOIQueue::GetInvalid() const
+{
+	return m_invalid;
+}
+
+inline int32 b2TOIQueue::GetInvalidCount() const
+{
+	return m_invalidCount;
+}
+
+inline void b2TOIQueue::ClearInvalid()
+{
+	m_invalidCount = 0;
+}
+
+#endif
@@ -22,6 +22,52 @@
 
 #include <Box2D/Common/b2Math.h>
 
+/// Particle solver profiling data. Times are in milliseconds and counts are
+/// summed over all particle iterations of a step. Stages that did not run
+/// in the step are left at zero.
+struct b2ParticleProfile
+{
+	float32 solveLifetimes;
+	float32 solveZombie;
+	float32 updateProxies;
+	float32 sortProxies;
+	float32 findContacts;
+	float32 updateBodyContacts;
+	float32 computeWeight;
+	float32 computeDepth;
+	float32 updatePairsAndTriads;
+	float32 solveForce;
+	float32 solveViscous;
+	float32 solveRepulsive;
+	float32 solvePowder;
+	float32 solveTensile;
+	float32 solveSolid;
+	float32 solveColorMixing;
+	float32 solveGravity;
+	float32 solveStaticPressure;
+	float32 solvePressure;
+	float32 solveDamping;
+	float32 solveExtraDamping;
+	float32 solveElastic;
+	float32 solveSpring;
+	float32 limitVelocity;
+	float32 solveRigidDamping;
+	float32 solveBarrier;
+	float32 solveCollision;
+	float32 solveDistanceField;
+	float32 solveRigid;
+	float32 solveWall;
+	float32 integrate;
+	float32 total;
+
+	/// Number of candidate particle pairs tested in FindContacts.
+	int32 checkCount;
+	/// Number of particle-particle contacts found.
+	int32 contactCount;
+	/// Number of particle-body contacts found.
+	int32 bodyContactCount;
+};
+
 /// Profiling data. Times are in milliseconds.
 struct b2Profile
 {
@@ -33,6 +79,22 @@ struct b2Profile
 	float32 solvePosition;
 	float32 broadphase;
 	float32 solveTOI;
+	/// Sum of the profiles of all particle systems in the world.
+	b2ParticleProfile particle;
+};
+
+/// The solver settings of a step. With a step budget these can be lower
+/// than the ones requested. See b2World::SetStepBudget.
+struct b2StepQuality
+{
+	/// 0 when the step ran as requested. Each level cuts more work.
+	int32 level;
+	int32 velocityIterations;
+	int32 positionIterations;
+	int32 particleIterations;
+	/// Whether the optional particle stages ran.
+	bool colorMixing;
+	bool extraDamping;
 };
 
 /// This is an internal structure.
@@ -45,6 +107,8 @@ struct b2TimeStep
 	int32 positionIterations;
 	int32 particleIterations;
 	bool warmStarting;
+	bool colorMixing;	// false if the step budget skips color mixing.
+	bool extraDamping;	// false if the step budget skips extra damping.
 };
 
 /// This is an internal structure.
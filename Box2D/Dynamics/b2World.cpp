@@ -21,7 +21,17 @@
 #include <Box2D/Dynamics/b2Body.h>
 #include <Box2D/Dynamics/b2Fixture.h>
 #include <Box2D/Dynamics/b2Island.h>
+#include <Box2D/Dynamics/Joints/b2DistanceJoint.h>
+#include <Box2D/Dynamics/Joints/b2FrictionJoint.h>
+#include <Box2D/Dynamics/Joints/b2GearJoint.h>
+#include <Box2D/Dynamics/Joints/b2MotorJoint.h>
+#include <Box2D/Dynamics/Joints/b2MouseJoint.h>
+#include <Box2D/Dynamics/Joints/b2PrismaticJoint.h>
 #include <Box2D/Dynamics/Joints/b2PulleyJoint.h>
+#include <Box2D/Dynamics/Joints/b2RevoluteJoint.h>
+#include <Box2D/Dynamics/Joints/b2RopeJoint.h>
+#include <Box2D/Dynamics/Joints/b2WeldJoint.h>
+#include <Box2D/Dynamics/Joints/b2WheelJoint.h>
 #include <Box2D/Dynamics/Contacts/b2Contact.h>
 #include <Box2D/Dynamics/Contacts/b2ContactSolver.h>
 #include <Box2D/Collision/b2Collision.h>
@@ -32,14 +42,62 @@
 #include <Box2D/Collision/Shapes/b2PolygonShape.h>
 #include <Box2D/Collision/b2TimeOfImpact.h>
 #include <Box2D/Common/b2Draw.h>
+#include <Box2D/Common/b2Snapshot.h>
 #include <Box2D/Common/b2Timer.h>
+#include <Box2D/Common/b2Trace.h>
 #include <new>
 
+static void b2AccumulateParticleProfile(b2ParticleProfile* sum,
+										const b2ParticleProfile& profile)
+{
+	sum->solveLifetimes += profile.solveLifetimes;
+	sum->solveZombie += profile.solveZombie;
+	sum->updateProxies += profile.updateProxies;
+	sum->sortProxies += profile.sortProxies;
+	sum->findContacts += profile.findContacts;
+	sum->updateBodyContacts += profile.updateBodyContacts;
+	sum->computeWeight += profile.computeWeight;
+	sum->computeDepth += profile.computeDepth;
+	sum->updatePairsAndTriads += profile.updatePairsAndTriads;
+	sum->solveForce += profile.solveForce;
+	sum->solveViscous += profile.solveViscous;
+	sum->solveRepulsive += profile.solveRepulsive;
+	sum->solvePowder += profile.solvePowder;
+	sum->solveTensile += profile.solveTensile;
+	sum->solveSolid += profile.solveSolid;
+	sum->solveColorMixing += profile.solveColorMixing;
+	sum->solveGravity += profile.solveGravity;
+	sum->solveStaticPressure += profile.solveStaticPressure;
+	sum->solvePressure += profile.solvePressure;
+	sum->solveDamping += profile.solveDamping;
+	sum->solveExtraDamping += profile.solveExtraDamping;
+	sum->solveElastic += profile.solveElastic;
+	sum->solveSpring += profile.solveSpring;
+	sum->limitVelocity += profile.limitVelocity;
+	sum->solveRigidDamping += profile.solveRigidDamping;
+	sum->solveBarrier += profile.solveBarrier;
+	sum->solveCollision += profile.solveCollision;
+	sum->solveDistanceField += profile.solveDistanceField;
+	sum->solveRigid += profile.solveRigid;
+	sum->solveWall += profile.solveWall;
+	sum->integrate += profile.integrate;
+	sum->total += profile.total;
+	sum->checkCount += profile.checkCount;
+	sum->contactCount += profile.contactCount;
+	sum->bodyContactCount += profile.bodyContactCount;
+}
+
 b2World::b2World(const b2Vec2& gravity)
 {
 	Init(gravity);
 }
 
+b2World::b2World(const b2Vec2& gravity, bool threadSafeAllocator)
+{
+	Init(gravity);
+	m_blockAllocator.SetThreadSafe(threadSafeAllocator);
+}
+
 b2World::~b2World()
 {
 	// Some shapes allocate using b2Alloc.
@@ -90,6 +148,13 @@ void b2World::SetDebugDraw(b2Draw* debugDraw)
 	m_debugDraw = debugDraw;
 }
 
+void b2World::SetThreadPool(b2ThreadPool* threadPool)
+{
+	b2Assert(IsLocked() == false);
+	m_threadPool = threadPool;
+	m_contactManager.m_broadPhase.SetThreadPool(threadPool);
+}
+
 b2Body* b2World::CreateBody(const b2BodyDef* def)
 {
 	b2Assert(IsLocked() == false);
@@ -425,6 +490,7 @@ void b2World::Init(const b2Vec2& gravity)
 {
 	m_destructionListener = NULL;
 	m_debugDraw = NULL;
+	m_threadPool = NULL;
 
 	m_bodyList = NULL;
 	m_jointList = NULL;
@@ -452,11 +518,16 @@ void b2World::Init(const b2Vec2& gravity)
 	m_liquidFunVersionString = b2_liquidFunVersionString;
 
 	memset(&m_profile, 0, sizeof(b2Profile));
+
+	m_stepBudget = 0.0f;
+	memset(&m_stepCost, 0, sizeof(m_stepCost));
+	memset(&m_stepQuality, 0, sizeof(m_stepQuality));
 }
 
 // Find islands, integrate and solve constraints, solve position constraints
 void b2World::Solve(const b2TimeStep& step)
 {
+	B2_TRACE_SCOPE("b2World::Solve");
 	// update previous transforms
 	for (b2Body* b = m_bodyList; b; b = b->m_next)
 	{
@@ -652,8 +723,114 @@ void b2World::Solve(const b2TimeStep& step)
 }
 
 // Find TOI contacts and solve them.
+float32 b2World::ComputeTOI(b2Contact* c)
+{
+	// Is this contact disabled?
+	if (c->IsEnabled() == false)
+	{
+		return 1.0f;
+	}
+
+	// Prevent excessive sub-stepping.
+	if (c->m_toiCount > b2_maxSubSteps)
+	{
+		return 1.0f;
+	}
+
+	float32 alpha = 1.0f;
+	if (c->m_flags & b2Contact::e_toiFlag)
+	{
+		// This contact has a valid cached TOI.
+		alpha = c->m_toi;
+	}
+	else
+	{
+		b2Fixture* fA = c->GetFixtureA();
+		b2Fixture* fB = c->GetFixtureB();
+
+		// Is there a sensor?
+		if (fA->IsSensor() || fB->IsSensor())
+		{
+			return 1.0f;
+		}
+
+		b2Body* bA = fA->GetBody();
+		b2Body* bB = fB->GetBody();
+
+		b2BodyType typeA = bA->m_type;
+		b2BodyType typeB = bB->m_type;
+		b2Assert(typeA == b2_dynamicBody || typeB == b2_dynamicBody);
+
+		bool activeA = bA->IsAwake() && typeA != b2_staticBody;
+		bool activeB = bB->IsAwake() && typeB != b2_staticBody;
+
+		// Is at least one body active (awake and dynamic or kinematic)?
+		if (activeA == false && activeB == false)
+		{
+			return 1.0f;
+		}
+
+		bool collideA = bA->IsBullet() || typeA != b2_dynamicBody;
+		bool collideB = bB->IsBullet() || typeB != b2_dynamicBody;
+
+		// Are these two non-bullet dynamic bodies?
+		if (collideA == false && collideB == false)
+		{
+			return 1.0f;
+		}
+
+		// Compute the TOI for this contact.
+		// Put the sweeps onto the same time interval.
+		float32 alpha0 = bA->m_sweep.alpha0;
+
+		if (bA->m_sweep.alpha0 < bB->m_sweep.alpha0)
+		{
+			alpha0 = bB->m_sweep.alpha0;
+			bA->m_sweep.Advance(alpha0);
+		}
+		else if (bB->m_sweep.alpha0 < bA->m_sweep.alpha0)
+		{
+			alpha0 = bA->m_sweep.alpha0;
+			bB->m_sweep.Advance(alpha0);
+		}
+
+		b2Assert(alpha0 < 1.0f);
+
+		int32 indexA = c->GetChildIndexA();
+		int32 indexB = c->GetChildIndexB();
+
+		// Compute the time of impact in interval [0, minTOI]
+		b2TOIInput input;
+		input.proxyA.Set(fA->GetShape(), indexA);
+		input.proxyB.Set(fB->GetShape(), indexB);
+		input.sweepA = bA->m_sweep;
+		input.sweepB = bB->m_sweep;
+		input.tMax = 1.0f;
+
+		b2TOIOutput output;
+		b2TimeOfImpact(&output, &input);
+
+		// Beta is the fraction of the remaining portion of the .
+		float32 beta = output.t;
+		if (output.state == b2TOIOutput::e_touching)
+		{
+			alpha = b2Min(alpha0 + (1.0f - alpha0) * beta, 1.0f);
+		}
+		else
+		{
+			alpha = 1.0f;
+		}
+
+		c->m_toi = alpha;
+		c->m_flags |= b2Contact::e_toiFlag;
+	}
+
+	return alpha;
+}
+
 void b2World::SolveTOI(const b2TimeStep& step)
 {
+	B2_TRACE_SCOPE("b2World::SolveTOI");
 	b2Island island(2 * b2_maxTOIContacts, b2_maxTOIContacts, 0, &m_stackAllocator, m_contactManager.m_contactListener);
 
 	if (m_stepComplete)
@@ -673,120 +850,38 @@ void b2World::SolveTOI(const b2TimeStep& step)
 		}
 	}
 
+	// Gather the contacts that are eligible for continuous collision.
+	m_toiQueue.Clear();
+	for (b2Contact* c = m_contactManager.m_contactList; c; c = c->m_next)
+	{
+		float32 alpha = ComputeTOI(c);
+		if (alpha < 1.0f)
+		{
+			m_toiQueue.Push(c, alpha);
+		}
+	}
+
 	// Find TOI events and solve them.
 	for (;;)
 	{
-		// Find the first TOI.
+		// Find the first TOI. Entries left behind by contacts that have been
+		// invalidated or disabled since they were queued are discarded.
 		b2Contact* minContact = NULL;
 		float32 minAlpha = 1.0f;
 
-		for (b2Contact* c = m_contactManager.m_contactList; c; c = c->m_next)
+		while (m_toiQueue.IsEmpty() == false)
 		{
-			// Is this contact disabled?
-			if (c->IsEnabled() == false)
-			{
-				continue;
-			}
-
-			// Prevent excessive sub-stepping.
-			if (c->m_toiCount > b2_maxSubSteps)
-			{
-				continue;
-			}
-
-			float32 alpha = 1.0f;
-			if (c->m_flags & b2Contact::e_toiFlag)
-			{
-				// This contact has a valid cached TOI.
-				alpha = c->m_toi;
-			}
-			else
-			{
-				b2Fixture* fA = c->GetFixtureA();
-				b2Fixture* fB = c->GetFixtureB();
-
-				// Is there a sensor?
-				if (fA->IsSensor() || fB->IsSensor())
-				{
-					continue;
-				}
-
-				b2Body* bA = fA->GetBody();
-				b2Body* bB = fB->GetBody();
-
-				b2BodyType typeA = bA->m_type;
-				b2BodyType typeB = bB->m_type;
-				b2Assert(typeA == b2_dynamicBody || typeB == b2_dynamicBody);
-
-				bool activeA = bA->IsAwake() && typeA != b2_staticBody;
-				bool activeB = bB->IsAwake() && typeB != b2_staticBody;
-
-				// Is at least one body active (awake and dynamic or kinematic)?
-				if (activeA == false && activeB == false)
-				{
-					continue;
-				}
-
-				bool collideA = bA->IsBullet() || typeA != b2_dynamicBody;
-				bool collideB = bB->IsBullet() || typeB != b2_dynamicBody;
-
-				// Are these two non-bullet dynamic bodies?
-				if (collideA == false && collideB == false)
-				{
-					continue;
-				}
-
-				// Compute the TOI for this contact.
-				// Put the sweeps onto the same time interval.
-				float32 alpha0 = bA->m_sweep.alpha0;
-
-				if (bA->m_sweep.alpha0 < bB->m_sweep.alpha0)
-				{
-					alpha0 = bB->m_sweep.alpha0;
-					bA->m_sweep.Advance(alpha0);
-				}
-				else if (bB->m_sweep.alpha0 < bA->m_sweep.alpha0)
-				{
-					alpha0 = bA->m_sweep.alpha0;
-					bB->m_sweep.Advance(alpha0);
-				}
-
-				b2Assert(alpha0 < 1.0f);
-
-				int32 indexA = c->GetChildIndexA();
-				int32 indexB = c->GetChildIndexB();
-
-				// Compute the time of impact in interval [0, minTOI]
-				b2TOIInput input;
-				input.proxyA.Set(fA->GetShape(), indexA);
-				input.proxyB.Set(fB->GetShape(), indexB);
-				input.sweepA = bA->m_sweep;
-				input.sweepB = bB->m_sweep;
-				input.tMax = 1.0f;
-
-				b2TOIOutput output;
-				b2TimeOfImpact(&output, &input);
-
-				// Beta is the fraction of the remaining portion of the .
-				float32 beta = output.t;
-				if (output.state == b2TOIOutput::e_touching)
-				{
-					alpha = b2Min(alpha0 + (1.0f - alpha0) * beta, 1.0f);
-				}
-				else
-				{
-					alpha = 1.0f;
-				}
+			const b2TOICandidate& candidate = m_toiQueue.Top();
+			b2Contact* c = candidate.contact;
+			float32 alpha = candidate.alpha;
+			m_toiQueue.Pop();
 
-				c->m_toi = alpha;
-				c->m_flags |= b2Contact::e_toiFlag;
-			}
-
-			if (alpha < minAlpha)
+			if ((c->m_flags & b2Contact::e_toiFlag) && c->m_toi == alpha &&
+				c->IsEnabled() && c->m_toiCount <= b2_maxSubSteps)
 			{
-				// This is the minimum TOI found so far.
 				minContact = c;
 				minAlpha = alpha;
+				break;
 			}
 		}
 
@@ -939,6 +1034,8 @@ void b2World::SolveTOI(const b2TimeStep& step)
 		subStep.velocityIterations = step.velocityIterations;
 		subStep.particleIterations = step.particleIterations;
 		subStep.warmStarting = false;
+		subStep.colorMixing = step.colorMixing;
+		subStep.extraDamping = step.extraDamping;
 		island.SolveTOI(subStep, bA->m_islandIndex, bB->m_islandIndex);
 
 		// Reset island flags and synchronize broad-phase proxies.
@@ -949,6 +1046,15 @@ void b2World::SolveTOI(const b2TimeStep& step)
 
 			if (body->m_type != b2_dynamicBody)
 			{
+				// The body may have been woken up, so contacts that were
+				// skipped as inactive need another look.
+				for (b2ContactEdge* ce = body->m_contactList; ce; ce = ce->next)
+				{
+					if ((ce->contact->m_flags & b2Contact::e_toiFlag) == 0)
+					{
+						m_toiQueue.Invalidate(ce->contact);
+					}
+				}
 				continue;
 			}
 
@@ -958,13 +1064,44 @@ void b2World::SolveTOI(const b2TimeStep& step)
 			for (b2ContactEdge* ce = body->m_contactList; ce; ce = ce->next)
 			{
 				ce->contact->m_flags &= ~(b2Contact::e_toiFlag | b2Contact::e_islandFlag);
+				m_toiQueue.Invalidate(ce->contact);
 			}
 		}
 
 		// Commit fixture proxy movements to the broad-phase so that new contacts are created.
 		// Also, some contacts can be destroyed.
+		b2Contact* oldContactList = m_contactManager.m_contactList;
 		m_contactManager.FindNewContacts();
 
+		// Recompute the invalidated TOIs and queue the new contacts, which
+		// are inserted at the head of the contact list. A contact can be
+		// invalidated more than once, so skip those already recomputed.
+		b2Contact** invalid = m_toiQueue.GetInvalid();
+		int32 invalidCount = m_toiQueue.GetInvalidCount();
+		for (int32 i = 0; i < invalidCount; ++i)
+		{
+			b2Contact* c = invalid[i];
+			if (c->m_flags & b2Contact::e_toiFlag)
+			{
+				continue;
+			}
+			float32 alpha = ComputeTOI(c);
+			if (alpha < 1.0f)
+			{
+				m_toiQueue.Push(c, alpha);
+			}
+		}
+		m_toiQueue.ClearInvalid();
+
+		for (b2Contact* c = m_contactManager.m_contactList; c != oldContactList; c = c->m_next)
+		{
+			float32 alpha = ComputeTOI(c);
+			if (alpha < 1.0f)
+			{
+				m_toiQueue.Push(c, alpha);
+			}
+		}
+
 		if (m_subStepping)
 		{
 			m_stepComplete = false;
@@ -979,8 +1116,13 @@ void b2World::Step(
 	int32 positionIterations,
 	int32 particleIterations)
 {
+	B2_TRACE_SCOPE("b2World::Step");
 	b2Timer stepTimer;
 
+	// Start a new frame of scratch memory.
+	m_stackAllocator.Reset();
+	B2_DEBUG_STATEMENT(const uint32 allocCount = b2GetAllocCount());
+
 	// If new fixtures were added, we need to find the new contacts.
 	if (m_flags & e_newFixture)
 	{
@@ -990,11 +1132,24 @@ void b2World::Step(
 
 	m_flags |= e_locked;
 
+	m_stepQuality.level = 0;
+	m_stepQuality.velocityIterations = velocityIterations;
+	m_stepQuality.positionIterations = positionIterations;
+	m_stepQuality.particleIterations = particleIterations;
+	m_stepQuality.colorMixing = true;
+	m_stepQuality.extraDamping = true;
+	if (m_stepBudget > 0.0f)
+	{
+		ChooseStepQuality(&m_stepQuality);
+	}
+
 	b2TimeStep step;
 	step.dt = dt;
-	step.velocityIterations	= velocityIterations;
-	step.positionIterations = positionIterations;
-	step.particleIterations = particleIterations;
+	step.velocityIterations	= m_stepQuality.velocityIterations;
+	step.positionIterations = m_stepQuality.positionIterations;
+	step.particleIterations = m_stepQuality.particleIterations;
+	step.colorMixing = m_stepQuality.colorMixing;
+	step.extraDamping = m_stepQuality.extraDamping;
 	if (dt > 0.0f)
 	{
 		step.inv_dt = 1.0f / dt;
@@ -1016,12 +1171,23 @@ void b2World::Step(
 	}
 
 	// Integrate velocities, solve velocity constraints, and integrate positions.
+	memset(&m_profile.particle, 0, sizeof(m_profile.particle));
 	if (m_stepComplete && step.dt > 0.0f)
 	{
 		b2Timer timer;
+		// Kinematic bodies moving to a target get their velocity first, so
+		// that the particles see it too.
+		for (b2Body* b = m_bodyList; b; b = b->m_next)
+		{
+			if (b->m_flags & b2Body::e_targetFlag)
+			{
+				b->SteerToTarget(step.dt);
+			}
+		}
 		for (b2ParticleSystem* p = m_particleSystemList; p; p = p->GetNext())
 		{
 			p->Solve(step); // Particle Simulation
+			b2AccumulateParticleProfile(&m_profile.particle, p->GetProfile());
 		}
 		Solve(step);
 		m_profile.solve = timer.GetMilliseconds();
@@ -1047,7 +1213,127 @@ void b2World::Step(
 
 	m_flags &= ~e_locked;
 
+	b2Assert(!GetStepAllocationCheck() || b2GetAllocCount() == allocCount);
+
 	m_profile.step = stepTimer.GetMilliseconds();
+
+	if (m_stepBudget > 0.0f && step.dt > 0.0f)
+	{
+		UpdateStepCost(m_stepQuality);
+	}
+}
+
+// Weight of the latest step in the running estimate of the step cost.
+static const float32 k_stepCostSmoothing = 0.25f;
+
+// Cut the next piece of work from a step. Returns false if there is
+// nothing left to cut.
+static bool b2LowerStepQuality(b2StepQuality* quality)
+{
+	if (quality->colorMixing)
+	{
+		quality->colorMixing = false;
+	}
+	else if (quality->extraDamping)
+	{
+		quality->extraDamping = false;
+	}
+	else if (quality->particleIterations > 1)
+	{
+		quality->particleIterations--;
+	}
+	else if (quality->velocityIterations > 1 ||
+			 quality->positionIterations > 1)
+	{
+		quality->velocityIterations =
+			b2Max(quality->velocityIterations / 2, 1);
+		quality->positionIterations =
+			b2Max(quality->positionIterations / 2, 1);
+	}
+	else
+	{
+		return false;
+	}
+	quality->level++;
+	return true;
+}
+
+void b2World::ChooseStepQuality(b2StepQuality* quality) const
+{
+	const StepCost& cost = m_stepCost;
+	for (;;)
+	{
+		float32 particleIteration = cost.particleIteration;
+		if (quality->colorMixing)
+		{
+			particleIteration += cost.colorMixing;
+		}
+		if (quality->extraDamping)
+		{
+			particleIteration += cost.extraDamping;
+		}
+		const float32 estimate = cost.fixed +
+			cost.velocityIteration * quality->velocityIterations +
+			cost.positionIteration * quality->positionIterations +
+			particleIteration * quality->particleIterations;
+		if (estimate <= m_stepBudget || !b2LowerStepQuality(quality))
+		{
+			break;
+		}
+	}
+}
+
+void b2World::UpdateStepCost(const b2StepQuality& quality)
+{
+	const b2ParticleProfile& particle = m_profile.particle;
+	StepCost sample = m_stepCost;
+	float32 particleTotal = 0.0f;
+	if (quality.particleIterations > 0)
+	{
+		// Lifetimes and zombies are solved once per step.
+		particleTotal = particle.total - particle.solveLifetimes -
+			particle.solveZombie;
+		const float32 inverseIterations = 1.0f / quality.particleIterations;
+		float32 iterated = particleTotal;
+		if (quality.colorMixing)
+		{
+			sample.colorMixing = particle.solveColorMixing * inverseIterations;
+			iterated -= particle.solveColorMixing;
+		}
+		if (quality.extraDamping)
+		{
+			sample.extraDamping =
+				particle.solveExtraDamping * inverseIterations;
+			iterated -= particle.solveExtraDamping;
+		}
+		sample.particleIteration = b2Max(iterated, 0.0f) * inverseIterations;
+	}
+	if (quality.velocityIterations > 0)
+	{
+		sample.velocityIteration =
+			m_profile.solveVelocity / quality.velocityIterations;
+	}
+	if (quality.positionIterations > 0)
+	{
+		sample.positionIteration =
+			m_profile.solvePosition / quality.positionIterations;
+	}
+	sample.fixed = b2Max(m_profile.step - particleTotal -
+						 m_profile.solveVelocity - m_profile.solvePosition,
+						 0.0f);
+
+	StepCost& cost = m_stepCost;
+	cost.fixed += k_stepCostSmoothing * (sample.fixed - cost.fixed);
+	cost.velocityIteration += k_stepCostSmoothing *
+		(sample.velocityIteration - cost.velocityIteration);
+	cost.positionIteration += k_stepCostSmoothing *
+		(sample.positionIteration - cost.positionIteration);
+	cost.particleIteration += k_stepCostSmoothing *
+		(sample.particleIteration - cost.particleIteration);
+	cost.colorMixing += k_stepCostSmoothing *
+		(sample.colorMixing - cost.colorMixing);
+	cost.extraDamping += k_stepCostSmoothing *
+		(sample.extraDamping - cost.extraDamping);
 }
 
 void b2World::ClearForces()
@@ -1064,7 +1350,7 @@ struct b2WorldQueryWrapper
 	bool QueryCallback(int32 proxyId)
 	{
 		b2FixtureProxy* proxy = (b2FixtureProxy*)broadPhase->GetUserData(proxyId);
-		return callback->ReportFixture(proxy->fixture);
+		return callback->ReportFixtureChild(proxy->fixture, proxy->childIndex);
 	}
 
 	const b2BroadPhase* broadPhase;
@@ -1138,6 +1424,81 @@ void b2World::RayCast(b2RayCastCallback* callback, const b2Vec2& point1, const b
 	}
 }
 
+struct b2WorldRayCastBatchWrapper
+{
+	float32 RayCastCallback(const b2RayCastInput& input, int32 proxyId,
+							int32 rayIndex)
+	{
+		b2FixtureProxy* proxy = (b2FixtureProxy*)broadPhase->GetUserData(proxyId);
+		b2Fixture* fixture = proxy->fixture;
+		if (fixture->IsSensor())
+		{
+			return input.maxFraction;
+		}
+
+		b2RayCastOutput output;
+		if (fixture->RayCast(&output, input, proxy->childIndex) == false)
+		{
+			return input.maxFraction;
+		}
+
+		// The tree clips the ray, so this is the closest hit so far.
+		float32 fraction = output.fraction;
+		b2RayCastHit* hit = hits + rayIndex;
+		hit->fixture = fixture;
+		hit->particleSystem = NULL;
+		hit->index = proxy->childIndex;
+		hit->point = (1.0f - fraction) * input.p1 + fraction * input.p2;
+		hit->normal = output.normal;
+		hit->fraction = fraction;
+		return fraction;
+	}
+
+	const b2BroadPhase* broadPhase;
+	b2RayCastHit* hits;
+};
+
+void b2World::RayCastBatch(const b2Vec2* point1, const b2Vec2* point2,
+						   int32 count, b2RayCastHit* hits) const
+{
+	for (int32 i = 0; i < count; ++i)
+	{
+		hits[i].fixture = NULL;
+		hits[i].particleSystem = NULL;
+		hits[i].index = b2_invalidParticleIndex;
+		hits[i].point = point2[i];
+		hits[i].normal.SetZero();
+		hits[i].fraction = 1.0f;
+	}
+
+	b2WorldRayCastBatchWrapper wrapper;
+	wrapper.broadPhase = &m_contactManager.m_broadPhase;
+	b2RayCastInput inputs[b2DynamicTree::e_maxRayPacketSize];
+	for (int32 first = 0; first < count;
+		 first += b2DynamicTree::e_maxRayPacketSize)
+	{
+		int32 packetSize = b2Min(count - first,
+			(int32)b2DynamicTree::e_maxRayPacketSize);
+		for (int32 i = 0; i < packetSize; ++i)
+		{
+			inputs[i].p1 = point1[first + i];
+			inputs[i].p2 = point2[first + i];
+			inputs[i].maxFraction = 1.0f;
+		}
+		wrapper.hits = hits + first;
+		m_contactManager.m_broadPhase.RayCastPacket(&wrapper, inputs,
+													packetSize);
+	}
+
+	for (const b2ParticleSystem* p = m_particleSystemList; p; p = p->GetNext())
+	{
+		for (int32 i = 0; i < count; ++i)
+		{
+			p->RayCastClosest(point1[i], point2[i], hits + i);
+		}
+	}
+}
+
 void b2World::DrawShape(b2Fixture* fixture, const b2Transform& xf, const b2Color& color)
 {
 	switch (fixture->GetType())
@@ -1417,6 +1778,646 @@ float32 b2World::GetTreeQuality() const
 	return m_contactManager.m_broadPhase.GetTreeQuality();
 }
 
+void b2World::RebuildStaticTree()
+{
+	b2Assert(IsLocked() == false);
+	m_contactManager.m_broadPhase.RebuildStaticTree();
+}
+
+void b2World::RebuildBroadPhase()
+{
+	b2Assert(IsLocked() == false);
+	m_contactManager.m_broadPhase.RebuildTrees();
+}
+
+void b2World::BeginStaticBatch()
+{
+	b2Assert(IsLocked() == false);
+	m_contactManager.m_broadPhase.BeginStaticBatch();
+}
+
+void b2World::EndStaticBatch()
+{
+	b2Assert(IsLocked() == false);
+	m_contactManager.m_broadPhase.EndStaticBatch();
+}
+
+static void b2AddMemoryUsage(const b2MemoryUsage& usage, b2MemoryUsage* sum)
+{
+	sum->used += usage.used;
+	sum->reserved += usage.reserved;
+	sum->peak += usage.peak;
+}
+
+void b2World::GetMemoryReport(b2MemoryReport* report) const
+{
+	memset(report, 0, sizeof(*report));
+	report->blocks = m_blockAllocator.GetBlockUsage();
+	report->giants = m_blockAllocator.GetGiantUsage();
+	report->stack = m_stackAllocator.GetUsage();
+	report->broadPhase = m_contactManager.m_broadPhase.GetMemoryUsage();
+	for (const b2ParticleSystem* p = m_particleSystemList; p; p = p->GetNext())
+	{
+		b2AddMemoryUsage(p->GetBufferMemoryUsage(), &report->particleBuffers);
+		b2AddMemoryUsage(p->GetContactMemoryUsage(),
+						 &report->particleContacts);
+		b2AddMemoryUsage(p->GetHandleMemoryUsage(), &report->particleHandles);
+	}
+
+	// The peaks of the parts were reached at different times, so their sum
+	// is an upper bound of the peak of the total.
+	b2AddMemoryUsage(report->blocks, &report->total);
+	b2AddMemoryUsage(report->giants, &report->total);
+	b2AddMemoryUsage(report->stack, &report->total);
+	b2AddMemoryUsage(report->broadPhase, &report->total);
+	b2AddMemoryUsage(report->particleHandles, &report->total);
+}
+
+void b2World::Trim()
+{
+	b2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return;
+	}
+
+	for (b2ParticleSystem* p = m_particleSystemList; p; p = p->GetNext())
+	{
+		p->Trim();
+	}
+	m_blockAllocator.Trim();
+}
+
+// Identifies a snapshot, "b2SN" in memory on little-endian platforms.
+static const uint32 b2_snapshotMagic = 0x4E533262;
+static const int32 b2_snapshotVersion = 4;
+
+int32 b2World::SaveSnapshot(void* buffer, int32 capacity)
+{
+	b2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return 0;
+	}
+	B2_TRACE_SCOPE("b2World::SaveSnapshot");
+
+	b2SnapshotWriter writer(buffer, capacity);
+	writer.Write(b2_snapshotMagic);
+	writer.Write(b2_snapshotVersion);
+	writer.Write((int32)sizeof(void*));
+	// Patched with the total size once everything is written.
+	const int32 sizeOffset = writer.GetSize();
+	writer.Write((int32)0);
+
+	writer.Write(m_gravity);
+	writer.Write(m_flags & (e_newFixture | e_clearForces));
+	writer.Write(m_allowSleep);
+	writer.Write(m_warmStarting);
+	writer.Write(m_continuousPhysics);
+	writer.Write(m_subStepping);
+	writer.Write(m_stepComplete);
+	writer.Write(m_inv_dt0);
+
+	// Lists are written from the tail, since creating the objects in order
+	// pushes each of them to the front. Bodies and joints are referred to by
+	// their position in the snapshot, as in Dump.
+	b2Body* bodyTail = m_bodyList;
+	while (bodyTail && bodyTail->m_next)
+	{
+		bodyTail = bodyTail->m_next;
+	}
+	writer.Write(m_bodyCount);
+	int32 i = 0;
+	for (b2Body* b = bodyTail; b; b = b->m_prev)
+	{
+		b->m_islandIndex = i++;
+		SaveBody(&writer, b);
+	}
+
+	b2Joint* jointTail = m_jointList;
+	while (jointTail && jointTail->m_next)
+	{
+		jointTail = jointTail->m_next;
+	}
+	writer.Write(m_jointCount);
+	i = 0;
+	for (b2Joint* j = jointTail; j; j = j->m_prev)
+	{
+		j->m_index = i++;
+		SaveJoint(&writer, j);
+	}
+
+	// Contacts refer to their fixtures by proxy id, which the broad-phase
+	// keeps.
+	m_contactManager.m_broadPhase.SaveSnapshot(&writer);
+	b2Contact* contactTail = m_contactManager.m_contactList;
+	while (contactTail && contactTail->m_next)
+	{
+		contactTail = contactTail->m_next;
+	}
+	writer.Write(m_contactManager.m_contactCount);
+	for (b2Contact* c = contactTail; c; c = c->m_prev)
+	{
+		SaveContact(&writer, c);
+	}
+
+	b2ParticleSystem* systemTail = m_particleSystemList;
+	int32 systemCount = 0;
+	while (systemTail && systemTail->m_next)
+	{
+		systemTail = systemTail->m_next;
+		++systemCount;
+	}
+	writer.Write(systemTail ? systemCount + 1 : 0);
+	for (b2ParticleSystem* p = systemTail; p; p = p->m_prev)
+	{
+		writer.Write(p->m_def);
+		p->SaveSnapshot(&writer);
+	}
+
+	writer.Patch(sizeOffset, writer.GetSize());
+	return writer.GetSize();
+}
+
+bool b2World::RestoreSnapshot(const void* data, int32 size)
+{
+	b2Assert(IsLocked() == false);
+	if (IsLocked())
+	{
+		return false;
+	}
+	B2_TRACE_SCOPE("b2World::RestoreSnapshot");
+
+	b2SnapshotReader reader(data, size);
+	if (reader.Read<uint32>() != b2_snapshotMagic ||
+		reader.Read<int32>() != b2_snapshotVersion ||
+		reader.Read<int32>() != (int32)sizeof(void*) ||
+		reader.Read<int32>() != size)
+	{
+		return false;
+	}
+
+	while (m_particleSystemList)
+	{
+		DestroyParticleSystem(m_particleSystemList);
+	}
+	while (m_jointList)
+	{
+		DestroyJoint(m_jointList);
+	}
+	while (m_bodyList)
+	{
+		DestroyBody(m_bodyList);
+	}
+
+	reader.Read(&m_gravity);
+	m_flags &= ~(e_newFixture | e_clearForces);
+	m_flags |= reader.Read<int32>() & (e_newFixture | e_clearForces);
+	reader.Read(&m_allowSleep);
+	reader.Read(&m_warmStarting);
+	reader.Read(&m_continuousPhysics);
+	reader.Read(&m_subStepping);
+	reader.Read(&m_stepComplete);
+	reader.Read(&m_inv_dt0);
+
+	const int32 bodyCount = reader.Read<int32>();
+	if (bodyCount < 0 || bodyCount > reader.GetRemaining())
+	{
+		return false;
+	}
+	b2Body** bodies =
+		(b2Body**)m_stackAllocator.Allocate(bodyCount * sizeof(b2Body*));
+	for (int32 i = 0; i < bodyCount; ++i)
+	{
+		bodies[i] = RestoreBody(&reader);
+	}
+
+	const int32 jointCount = reader.Read<int32>();
+	bool valid = 0 <= jointCount && jointCount <= reader.GetRemaining();
+	b2Joint** joints = (b2Joint**)m_stackAllocator.Allocate(
+		valid ? jointCount * sizeof(b2Joint*) : 0);
+	for (int32 i = 0; valid && i < jointCount; ++i)
+	{
+		joints[i] = RestoreJoint(&reader, bodies, bodyCount, joints, i);
+		valid = joints[i] != NULL;
+	}
+	m_stackAllocator.Free(joints);
+	m_stackAllocator.Free(bodies);
+	if (!valid)
+	{
+		return false;
+	}
+
+	// The broad-phase comes back with the same proxy ids, so the fixtures
+	// only need to be attached to their proxies again.
+	b2BroadPhase* broadPhase = &m_contactManager.m_broadPhase;
+	broadPhase->RestoreSnapshot(&reader);
+	for (b2Body* b = m_bodyList; b; b = b->m_next)
+	{
+		for (b2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+		{
+			for (int32 i = 0; i < f->m_proxyCount; ++i)
+			{
+				b2FixtureProxy* proxy = f->m_proxies + i;
+				broadPhase->SetUserData(proxy->proxyId, proxy);
+			}
+		}
+	}
+
+	const int32 contactCount = reader.Read<int32>();
+	for (int32 i = 0; i < contactCount && reader.IsValid(); ++i)
+	{
+		RestoreContact(&reader);
+	}
+
+	const int32 systemCount = reader.Read<int32>();
+	for (int32 i = 0; i < systemCount && reader.IsValid(); ++i)
+	{
+		b2ParticleSystemDef def;
+		reader.Read(&def);
+		CreateParticleSystem(&def)->RestoreSnapshot(&reader);
+	}
+
+	return reader.IsValid();
+}
+
+void b2World::SaveBody(b2SnapshotWriter* writer, const b2Body* b)
+{
+	writer->Write(b->m_type);
+	writer->Write(b->m_flags);
+	writer->Write(b->m_xf);
+	writer->Write(b->m_xf0);
+	writer->Write(b->m_sweep);
+	writer->Write(b->m_linearVelocity);
+	writer->Write(b->m_angularVelocity);
+	writer->Write(b->m_force);
+	writer->Write(b->m_torque);
+	writer->Write(b->m_mass);
+	writer->Write(b->m_invMass);
+	writer->Write(b->m_I);
+	writer->Write(b->m_invI);
+	writer->Write(b->m_linearDamping);
+	writer->Write(b->m_angularDamping);
+	writer->Write(b->m_gravityScale);
+	writer->Write(b->m_sleepTime);
+	writer->Write(b->m_targetPosition);
+	writer->Write(b->m_targetAngle);
+	writer->Write(b->m_targetTime);
+	writer->Write(b->m_userData);
+
+	const b2Fixture** fixtures = (const b2Fixture**)m_stackAllocator.Allocate(
+		b->m_fixtureCount * sizeof(b2Fixture*));
+	int32 fixtureCount = 0;
+	for (const b2Fixture* f = b->m_fixtureList; f; f = f->m_next)
+	{
+		fixtures[fixtureCount++] = f;
+	}
+	writer->Write(fixtureCount);
+	for (int32 i = fixtureCount - 1; i >= 0; --i)
+	{
+		SaveFixture(writer, fixtures[i]);
+	}
+	m_stackAllocator.Free(fixtures);
+}
+
+b2Body* b2World::RestoreBody(b2SnapshotReader* reader)
+{
+	b2BodyDef bd;
+	reader->Read(&bd.type);
+	const uint16 flags = reader->Read<uint16>();
+	// Fixtures only get proxies on active bodies.
+	bd.active = (flags & b2Body::e_activeFlag) != 0;
+	b2Body* b = CreateBody(&bd);
+	b->m_flags = flags;
+	reader->Read(&b->m_xf);
+	reader->Read(&b->m_xf0);
+
+	// Creating the fixtures resets the mass data, which moves the center of
+	// mass and changes the velocity, so these are set afterwards.
+	const b2Sweep sweep = reader->Read<b2Sweep>();
+	const b2Vec2 linearVelocity = reader->Read<b2Vec2>();
+	const float32 angularVelocity = reader->Read<float32>();
+	reader->Read(&b->m_force);
+	reader->Read(&b->m_torque);
+	const float32 mass = reader->Read<float32>();
+	const float32 invMass = reader->Read<float32>();
+	const float32 I = reader->Read<float32>();
+	const float32 invI = reader->Read<float32>();
+	reader->Read(&b->m_linearDamping);
+	reader->Read(&b->m_angularDamping);
+	reader->Read(&b->m_gravityScale);
+	reader->Read(&b->m_sleepTime);
+	reader->Read(&b->m_targetPosition);
+	reader->Read(&b->m_targetAngle);
+	reader->Read(&b->m_targetTime);
+	reader->Read(&b->m_userData);
+
+	const int32 fixtureCount = reader->Read<int32>();
+	for (int32 i = 0; i < fixtureCount && reader->IsValid(); ++i)
+	{
+		RestoreFixture(reader, b);
+	}
+
+	b->m_sweep = sweep;
+	b->m_linearVelocity = linearVelocity;
+	b->m_angularVelocity = angularVelocity;
+	b->m_mass = mass;
+	b->m_invMass = invMass;
+	b->m_I = I;
+	b->m_invI = invI;
+	return b;
+}
+
+void b2World::SaveFixture(b2SnapshotWriter* writer, const b2Fixture* f)
+{
+	const b2Shape* shape = f->m_shape;
+	writer->Write(shape->m_type);
+	writer->Write(shape->m_radius);
+	switch (shape->m_type)
+	{
+	case b2Shape::e_circle:
+		{
+			const b2CircleShape* circle = (const b2CircleShape*)shape;
+			writer->Write(circle->m_p);
+		}
+		break;
+
+	case b2Shape::e_edge:
+		{
+			const b2EdgeShape* edge = (const b2EdgeShape*)shape;
+			writer->Write(edge->m_vertex0);
+			writer->Write(edge->m_vertex1);
+			writer->Write(edge->m_vertex2);
+			writer->Write(edge->m_vertex3);
+			writer->Write(edge->m_hasVertex0);
+			writer->Write(edge->m_hasVertex3);
+		}
+		break;
+
+	case b2Shape::e_polygon:
+		{
+			const b2PolygonShape* polygon = (const b2PolygonShape*)shape;
+			writer->Write(polygon->m_centroid);
+			writer->Write(polygon->m_count);
+			writer->WriteArray(polygon->m_vertices, polygon->m_count);
+			writer->WriteArray(polygon->m_normals, polygon->m_count);
+		}
+		break;
+
+	case b2Shape::e_chain:
+		{
+			const b2ChainShape* chain = (const b2ChainShape*)shape;
+			writer->Write(chain->m_count);
+			writer->WriteArray(chain->m_vertices, chain->m_count);
+			writer->Write(chain->m_prevVertex);
+			writer->Write(chain->m_nextVertex);
+			writer->Write(chain->m_hasPrevVertex);
+			writer->Write(chain->m_hasNextVertex);
+		}
+		break;
+
+	default:
+		b2Assert(false);
+		break;
+	}
+
+	writer->Write(f->m_density);
+	writer->Write(f->m_friction);
+	writer->Write(f->m_restitution);
+	writer->Write(f->m_filter);
+	writer->Write(f->m_isSensor);
+	writer->Write(f->m_userData);
+	writer->Write(f->m_proxyCount);
+	for (int32 i = 0; i < f->m_proxyCount; ++i)
+	{
+		writer->Write(f->m_proxies[i].aabb);
+		writer->Write(f->m_proxies[i].proxyId);
+	}
+}
+
+void b2World::RestoreFixture(b2SnapshotReader* reader, b2Body* b)
+{
+	b2CircleShape circle;
+	b2EdgeShape edge;
+	b2PolygonShape polygon;
+	b2ChainShape chain;
+
+	b2FixtureDef fd;
+	const b2Shape::Type type = reader->Read<b2Shape::Type>();
+	const float32 radius = reader->Read<float32>();
+	switch (type)
+	{
+	case b2Shape::e_circle:
+		reader->Read(&circle.m_p);
+		fd.shape = &circle;
+		break;
+
+	case b2Shape::e_edge:
+		reader->Read(&edge.m_vertex0);
+		reader->Read(&edge.m_vertex1);
+		reader->Read(&edge.m_vertex2);
+		reader->Read(&edge.m_vertex3);
+		reader->Read(&edge.m_hasVertex0);
+		reader->Read(&edge.m_hasVertex3);
+		fd.shape = &edge;
+		break;
+
+	case b2Shape::e_polygon:
+		reader->Read(&polygon.m_centroid);
+		polygon.m_count = b2Clamp(reader->Read<int32>(), 0,
+								  b2_maxPolygonVertices);
+		reader->ReadArray(polygon.m_vertices, polygon.m_count);
+		reader->ReadArray(polygon.m_normals, polygon.m_count);
+		fd.shape = &polygon;
+		break;
+
+	case b2Shape::e_chain:
+		chain.m_count = b2Max(reader->Read<int32>(), 0);
+		if (chain.m_count > reader->GetRemaining())
+		{
+			chain.m_count = 0;
+			reader->Invalidate();
+			return;
+		}
+		chain.m_vertices =
+			(b2Vec2*)b2Alloc(chain.m_count * sizeof(b2Vec2));
+		reader->ReadArray(chain.m_vertices, chain.m_count);
+		reader->Read(&chain.m_prevVertex);
+		reader->Read(&chain.m_nextVertex);
+		reader->Read(&chain.m_hasPrevVertex);
+		reader->Read(&chain.m_hasNextVertex);
+		fd.shape = &chain;
+		break;
+
+	default:
+		reader->Invalidate();
+		return;
+	}
+	((b2Shape*)fd.shape)->m_radius = radius;
+
+	reader->Read(&fd.density);
+	reader->Read(&fd.friction);
+	reader->Read(&fd.restitution);
+	reader->Read(&fd.filter);
+	reader->Read(&fd.isSensor);
+	reader->Read(&fd.userData);
+	b2Fixture* f = b->CreateFixture(&fd);
+
+	const int32 proxyCount = reader->Read<int32>();
+	for (int32 i = 0; i < proxyCount; ++i)
+	{
+		b2FixtureProxy proxy;
+		reader->Read(&proxy.aabb);
+		reader->Read(&proxy.proxyId);
+		if (i < f->m_proxyCount)
+		{
+			f->m_proxies[i].aabb = proxy.aabb;
+			f->m_proxies[i].proxyId = proxy.proxyId;
+		}
+	}
+}
+
+void b2World::SaveJoint(b2SnapshotWriter* writer, b2Joint* j)
+{
+	writer->Write(j->m_type);
+	writer->Write(j->m_bodyA->m_islandIndex);
+	writer->Write(j->m_bodyB->m_islandIndex);
+	writer->Write(j->m_collideConnected);
+	writer->Write(j->m_userData);
+	if (j->m_type == e_gearJoint)
+	{
+		b2GearJoint* gear = (b2GearJoint*)j;
+		writer->Write(gear->GetJoint1()->m_index);
+		writer->Write(gear->GetJoint2()->m_index);
+	}
+	j->SaveState(writer);
+}
+
+b2Joint* b2World::RestoreJoint(b2SnapshotReader* reader, b2Body** bodies,
+							   int32 bodyCount, b2Joint** joints,
+							   int32 jointCount)
+{
+	b2RevoluteJointDef revoluteDef;
+	b2PrismaticJointDef prismaticDef;
+	b2DistanceJointDef distanceDef;
+	b2PulleyJointDef pulleyDef;
+	b2MouseJointDef mouseDef;
+	b2GearJointDef gearDef;
+	b2WheelJointDef wheelDef;
+	b2WeldJointDef weldDef;
+	b2FrictionJointDef frictionDef;
+	b2RopeJointDef ropeDef;
+	b2MotorJointDef motorDef;
+
+	// The joint is created with default parameters, which RestoreState
+	// then overwrites.
+	b2JointDef* def;
+	switch (reader->Read<b2JointType>())
+	{
+	case e_revoluteJoint: def = &revoluteDef; break;
+	case e_prismaticJoint: def = &prismaticDef; break;
+	case e_distanceJoint: def = &distanceDef; break;
+	case e_pulleyJoint: def = &pulleyDef; break;
+	case e_mouseJoint: def = &mouseDef; break;
+	case e_gearJoint: def = &gearDef; break;
+	case e_wheelJoint: def = &wheelDef; break;
+	case e_weldJoint: def = &weldDef; break;
+	case e_frictionJoint: def = &frictionDef; break;
+	case e_ropeJoint: def = &ropeDef; break;
+	case e_motorJoint: def = &motorDef; break;
+	default: return NULL;
+	}
+
+	const int32 indexA = reader->Read<int32>();
+	const int32 indexB = reader->Read<int32>();
+	reader->Read(&def->collideConnected);
+	reader->Read(&def->userData);
+	if (indexA < 0 || indexA >= bodyCount || indexB < 0 || indexB >= bodyCount)
+	{
+		return NULL;
+	}
+	def->bodyA = bodies[indexA];
+	def->bodyB = bodies[indexB];
+
+	if (def == &gearDef)
+	{
+		// Gear joints are created after the joints they connect.
+		const int32 index1 = reader->Read<int32>();
+		const int32 index2 = reader->Read<int32>();
+		if (index1 < 0 || index1 >= jointCount ||
+			index2 < 0 || index2 >= jointCount)
+		{
+			return NULL;
+		}
+		gearDef.joint1 = joints[index1];
+		gearDef.joint2 = joints[index2];
+	}
+
+	b2Joint* j = CreateJoint(def);
+	j->RestoreState(reader);
+	return j;
+}
+
+void b2World::SaveContact(b2SnapshotWriter* writer, const b2Contact* c)
+{
+	writer->Write(c->m_fixtureA->m_proxies[c->m_indexA].proxyId);
+	writer->Write(c->m_fixtureB->m_proxies[c->m_indexB].proxyId);
+	writer->Write(c->m_flags);
+	writer->Write(c->m_manifold);
+	writer->Write(c->m_toiCount);
+	writer->Write(c->m_toi);
+	writer->Write(c->m_friction);
+	writer->Write(c->m_restitution);
+	writer->Write(c->m_tangentSpeed);
+}
+
+void b2World::RestoreContact(b2SnapshotReader* reader)
+{
+	const int32 proxyIdA = reader->Read<int32>();
+	const int32 proxyIdB = reader->Read<int32>();
+	if (!reader->IsValid())
+	{
+		return;
+	}
+	// Reject ids that a corrupt snapshot would otherwise turn into a crash.
+	const b2BroadPhase& broadPhase = m_contactManager.m_broadPhase;
+	if (!broadPhase.IsProxy(proxyIdA) || !broadPhase.IsProxy(proxyIdB))
+	{
+		reader->Invalidate();
+		return;
+	}
+	const b2FixtureProxy* proxyA =
+		(const b2FixtureProxy*)broadPhase.GetUserData(proxyIdA);
+	const b2FixtureProxy* proxyB =
+		(const b2FixtureProxy*)broadPhase.GetUserData(proxyIdB);
+	if (proxyA == NULL || proxyB == NULL ||
+		proxyA->childIndex >= proxyA->fixture->m_proxyCount ||
+		proxyB->childIndex >= proxyB->fixture->m_proxyCount ||
+		proxyA->fixture->m_body == proxyB->fixture->m_body)
+	{
+		reader->Invalidate();
+		return;
+	}
+
+	// Unlike b2ContactManager::AddPair this neither filters the pair nor
+	// wakes the bodies, since the contact existed when it was saved.
+	b2Contact* c = m_contactManager.CreateContact(
+		proxyA->fixture, proxyA->childIndex,
+		proxyB->fixture, proxyB->childIndex);
+	if (c == NULL)
+	{
+		reader->Invalidate();
+		return;
+	}
+	reader->Read(&c->m_flags);
+	reader->Read(&c->m_manifold);
+	reader->Read(&c->m_toiCount);
+	reader->Read(&c->m_toi);
+	reader->Read(&c->m_friction);
+	reader->Read(&c->m_restitution);
+	reader->Read(&c->m_tangentSpeed);
+}
+
 void b2World::ShiftOrigin(const b2Vec2& newOrigin)
 {
 	b2Assert((m_flags & e_locked) == 0);
@@ -26,6 +26,7 @@
 #include <Box2D/Dynamics/b2ContactManager.h>
 #include <Box2D/Dynamics/b2WorldCallbacks.h>
 #include <Box2D/Dynamics/b2TimeStep.h>
+#include <Box2D/Dynamics/b2TOIQueue.h>
 #include <Box2D/Particle/b2ParticleSystem.h>
 
 struct b2AABB;
@@ -37,6 +38,63 @@ class b2Draw;
 class b2Fixture;
 class b2Joint;
 class b2ParticleGroup;
+class b2SnapshotReader;
+class b2SnapshotWriter;
+class b2ThreadPool;
+
+/// The closest hit of one ray of a batched ray-cast.
+/// @see b2World::RayCastBatch, b2ParticleSystem::RayCastBatch
+struct b2RayCastHit
+{
+	/// The fixture that was hit, or NULL.
+	b2Fixture* fixture;
+
+	/// The particle system of the particle that was hit, or NULL.
+	const b2ParticleSystem* particleSystem;
+
+	/// The child index of the fixture or the index of the particle.
+	int32 index;
+
+	/// The point of the hit in world coordinates.
+	b2Vec2 point;
+
+	/// The normal of the surface at the hit point.
+	b2Vec2 normal;
+
+	/// The fraction along the ray of the hit, or 1 if nothing was hit.
+	float32 fraction;
+};
+
+/// Memory held by a world, broken down by owner.
+/// @see b2World::GetMemoryReport
+struct b2MemoryReport
+{
+	/// Small blocks handed out by the world's block allocator.
+	b2MemoryUsage blocks;
+
+	/// Requests too large for the block allocator's size classes.
+	b2MemoryUsage giants;
+
+	/// Per step scratch memory.
+	b2MemoryUsage stack;
+
+	/// Broad-phase trees and pair buffers.
+	b2MemoryUsage broadPhase;
+
+	/// Per-particle buffers of all particle systems. These are allocated
+	/// from the block allocator so they are part of blocks and giants.
+	b2MemoryUsage particleBuffers;
+
+	/// Particle contact, pair and triad buffers of all particle systems.
+	/// These are part of blocks and giants as well.
+	b2MemoryUsage particleContacts;
+
+	/// Particle handle slabs of all particle systems.
+	b2MemoryUsage particleHandles;
+
+	/// The sum of blocks, giants, stack, broadPhase and particleHandles.
+	b2MemoryUsage total;
+};
 
 /// The world class manages all physics entities, dynamic simulation,
 /// and asynchronous queries. The world also contains efficient memory
@@ -48,6 +106,16 @@ public:
 	/// @param gravity the world gravity vector.
 	b2World(const b2Vec2& gravity);
 
+	/// Construct a world object.
+	/// @param gravity the world gravity vector.
+	/// @param threadSafeAllocator when true, the world's block allocator,
+	/// which holds bodies, fixtures, contacts, joints and particle buffers,
+	/// may be used from several threads at once, e.g. by a parallel narrow
+	/// phase. This costs a little on every allocation. The world functions
+	/// themselves are still not thread-safe.
+	/// @see b2ConcurrentBlockAllocator
+	b2World(const b2Vec2& gravity, bool threadSafeAllocator);
+
 	/// Destruct the world. All physics entities are destroyed and all heap memory is released.
 	~b2World();
 
@@ -127,6 +195,19 @@ public:
 		Step(timeStep, velocityIterations, positionIterations, 1);
 	}
 
+	/// Set a time budget for Step, in milliseconds. To stay under it, Step
+	/// cuts work in this order as needed: color mixing, extra damping,
+	/// particle iterations and then velocity and position iterations. The
+	/// cost of each is a running estimate from the timings of previous
+	/// steps, so the first steps after a change of scene can overshoot.
+	/// Fewer particle iterations make fluids softer and less stable, see
+	/// Step. 0, the default, always steps as requested.
+	void SetStepBudget(float32 milliseconds);
+	float32 GetStepBudget() const;
+
+	/// Get the solver settings used by the last Step.
+	const b2StepQuality& GetStepQuality() const;
+
 	/// Recommend a value to be used in `Step` for `particleIterations`.
 	/// This calculation is necessarily a simplification and should only be
 	/// used as a starting point. Please see "Particle Iterations" in the
@@ -168,6 +249,17 @@ public:
 	/// @param point2 the ray ending point
 	void RayCast(b2RayCastCallback* callback, const b2Vec2& point1, const b2Vec2& point2) const;
 
+	/// Ray-cast many rays at once and return the closest hit of each, against
+	/// fixtures and particles. Rays are cast in packets that share a single
+	/// broad-phase traversal, so neighbouring rays should be stored next to
+	/// each other. Sensors are ignored.
+	/// @param point1 the ray starting points
+	/// @param point2 the ray ending points
+	/// @param count the number of rays
+	/// @param hits receives the closest hit of each ray
+	void RayCastBatch(const b2Vec2* point1, const b2Vec2* point2, int32 count,
+					  b2RayCastHit* hits) const;
+
 	/// Get the world body list. With the returned body, use b2Body::GetNext to get
 	/// the next body in the world list. A NULL body indicates the end of the list.
 	/// @return the head of the world body list.
@@ -211,6 +303,43 @@ public:
 	void SetSubStepping(bool flag) { m_subStepping = flag; }
 	bool GetSubStepping() const { return m_subStepping; }
 
+	/// Assert that Step makes no heap allocations. Only checked when
+	/// assertions are enabled. Enable this once the simulation has warmed
+	/// up, since steps that add contacts, particles or per step scratch
+	/// memory beyond the previous high-water mark still need to allocate.
+	/// The check uses b2GetAllocCount(), which counts the b2Alloc calls of
+	/// the whole process, so it also fails when another thread allocates,
+	/// e.g. while it steps a different world. Only enable it when this
+	/// world is the only thing using b2Alloc during its steps.
+	void SetStepAllocationCheck(bool flag);
+	bool GetStepAllocationCheck() const;
+
+	/// Get the most scratch memory, in bytes, that a step has used at once.
+	int32 GetStackAllocatorHighWaterMark() const;
+
+	/// Get the memory held by this world, in bytes.
+	void GetMemoryReport(b2MemoryReport* report) const;
+
+	/// Give memory that is no longer needed back to the system, e.g. after
+	/// many bodies or particles have been destroyed. This shrinks the
+	/// particle buffers and frees fully unused block allocator chunks. The
+	/// per step scratch memory is left alone since each step already
+	/// consolidates it to the high-water mark.
+	/// @warning This function is locked during callbacks.
+	void Trim();
+
+	/// Enable/disable hashed pair deduplication in the broad-phase. This
+	/// avoids sorting all new pairs when many proxies move in one step, but
+	/// new contacts are then created in the order they are found.
+	void SetPairHashing(bool flag) { m_contactManager.m_broadPhase.SetPairHashing(flag); }
+	bool GetPairHashing() const { return m_contactManager.m_broadPhase.GetPairHashing(); }
+
+	/// Set a thread pool used to split parallel work, such as the broad-phase
+	/// pair query, across cores. The pool is owned by you and must remain in
+	/// scope. Pass NULL to do all work on the stepping thread.
+	void SetThreadPool(b2ThreadPool* threadPool);
+	b2ThreadPool* GetThreadPool() const { return m_threadPool; }
+
 	/// Get the number of broad-phase proxies.
 	int32 GetProxyCount() const;
 
@@ -233,6 +362,24 @@ public:
 	/// The minimum is 1.
 	float32 GetTreeQuality() const;
 
+	/// Rebuild the broad-phase tree holding static fixtures with a binned
+	/// SAH build. Call this once after creating large static geometry, since
+	/// incremental insertion gives poor trees for big static sets.
+	void RebuildStaticTree();
+
+	/// Rebuild both broad-phase trees with a binned SAH build.
+	void RebuildBroadPhase();
+
+	/// Start a batch of static geometry changes. Fixtures created on static
+	/// bodies until EndStaticBatch are added to the broad-phase together:
+	/// when there are many, the static tree is built once instead of
+	/// inserting them one at a time. Do not step, query or ray-cast the
+	/// world during a batch.
+	void BeginStaticBatch();
+
+	/// Finish a batch of static geometry changes.
+	void EndStaticBatch();
+
 	/// Change the global gravity vector.
 	void SetGravity(const b2Vec2& gravity);
 
@@ -259,6 +406,32 @@ public:
 	/// Get the current profile.
 	const b2Profile& GetProfile() const;
 
+	/// Write the state of the world to a buffer: bodies, fixtures, joints,
+	/// contacts with their warm starting impulses, the broad-phase and the
+	/// particle systems with their groups, pairs and triads. A snapshot can
+	/// only be restored by the same build on the same platform, and user
+	/// data is stored as raw pointers. This is intentionally non-const, the
+	/// body and joint indices are used as scratch space as in Dump.
+	/// @param buffer receives the snapshot. May be NULL to get the size.
+	/// @param capacity the size of buffer in bytes.
+	/// @return the size of the snapshot in bytes. The buffer does not hold
+	/// a valid snapshot if this is larger than capacity.
+	/// @warning This function is locked during callbacks.
+	int32 SaveSnapshot(void* buffer, int32 capacity);
+
+	/// Replace the contents of the world with a snapshot from SaveSnapshot.
+	/// All bodies, joints and particle systems are destroyed first, as by
+	/// DestroyBody, DestroyJoint and DestroyParticleSystem. The particle
+	/// buffers are restored with bulk copies, so this is much faster than
+	/// recreating the particles. Stepping the restored world gives the same
+	/// results as stepping the world the snapshot was taken from. Listeners,
+	/// the debug draw and the thread pool are left as they are.
+	/// @return false if data is not a snapshot of this size written by this
+	/// build, in which case the world is left alone, or if the snapshot is
+	/// corrupt, in which case the world holds whatever was read before.
+	/// @warning This function is locked during callbacks.
+	bool RestoreSnapshot(const void* data, int32 size);
+
 	/// Dump the world into the log file.
 	/// @warning this should be called outside of a time step.
 	void Dump();
@@ -289,7 +462,8 @@ private:
 	{
 		e_newFixture	= 0x0001,
 		e_locked		= 0x0002,
-		e_clearForces	= 0x0004
+		e_clearForces	= 0x0004,
+		e_stepAllocationCheck	= 0x0008
 	};
 
 	friend class b2Body;
@@ -302,18 +476,32 @@ private:
 
 	void Solve(const b2TimeStep& step);
 	void SolveTOI(const b2TimeStep& step);
+	void ChooseStepQuality(b2StepQuality* quality) const;
+	void UpdateStepCost(const b2StepQuality& quality);
+	float32 ComputeTOI(b2Contact* contact);
 
 	void DrawJoint(b2Joint* joint);
 	void DrawShape(b2Fixture* shape, const b2Transform& xf, const b2Color& color);
 
 	void DrawParticleSystem(const b2ParticleSystem& system);
 
+	void SaveBody(b2SnapshotWriter* writer, const b2Body* b);
+	b2Body* RestoreBody(b2SnapshotReader* reader);
+	void SaveFixture(b2SnapshotWriter* writer, const b2Fixture* f);
+	void RestoreFixture(b2SnapshotReader* reader, b2Body* b);
+	void SaveJoint(b2SnapshotWriter* writer, b2Joint* j);
+	b2Joint* RestoreJoint(b2SnapshotReader* reader, b2Body** bodies,
+						  int32 bodyCount, b2Joint** joints, int32 jointCount);
+	void SaveContact(b2SnapshotWriter* writer, const b2Contact* c);
+	void RestoreContact(b2SnapshotReader* reader);
+
 	b2BlockAllocator m_blockAllocator;
 	b2StackAllocator m_stackAllocator;
 
 	int32 m_flags;
 
 	b2ContactManager m_contactManager;
+	b2TOIQueue m_toiQueue;
 
 	b2Body* m_bodyList;
 	b2Joint* m_jointList;
@@ -327,6 +515,7 @@ private:
 
 	b2DestructionListener* m_destructionListener;
 	b2Draw* m_debugDraw;
+	b2ThreadPool* m_threadPool;
 
 	// This is used to compute the time step ratio to
 	// support a variable time step.
@@ -341,6 +530,23 @@ private:
 
 	b2Profile m_profile;
 
+	// Running estimate of the cost of the parts of Step, in milliseconds.
+	// The iterated parts are per iteration, the particle stages per
+	// particle iteration.
+	struct StepCost
+	{
+		float32 fixed;
+		float32 velocityIteration;
+		float32 positionIteration;
+		float32 particleIteration;
+		float32 colorMixing;
+		float32 extraDamping;
+	};
+
+	float32 m_stepBudget;
+	StepCost m_stepCost;
+	b2StepQuality m_stepQuality;
+
 	/// Used to reference b2_LiquidFunVersion so that it's not stripped from
 	/// the static library.
 	const b2Version *m_liquidFunVersion;
@@ -440,11 +646,49 @@ inline const b2ContactManager& b2World::GetContactManager() const
 	return m_contactManager;
 }
 
+inline void b2World::SetStepAllocationCheck(bool flag)
+{
+	if (flag)
+	{
+		m_flags |= e_stepAllocationCheck;
+	}
+	else
+	{
+		m_flags &= ~e_stepAllocationCheck;
+	}
+}
+
+inline bool b2World::GetStepAllocationCheck() const
+{
+	return (m_flags & e_stepAllocationCheck) == e_stepAllocationCheck;
+}
+
+inline int32 b2World::GetStackAllocatorHighWaterMark() const
+{
+	return m_stackAllocator.GetMaxAllocation();
+}
+
 inline const b2Profile& b2World::GetProfile() const
 {
 	return m_profile;
 }
 
+inline void b2World::SetStepBudget(float32 milliseconds)
+{
+	b2Assert(milliseconds >= 0.0f);
+	m_stepBudget = milliseconds;
+}
+
+inline float32 b2World::GetStepBudget() const
+{
+	return m_stepBudget;
+}
+
+inline const b2StepQuality& b2World::GetStepQuality() const
+{
+	return m_stepQuality;
+}
+
 #if LIQUIDFUN_EXTERNAL_LANGUAGE_API
 inline b2World::b2World(float32 gravityX, float32 gravityY)
 {
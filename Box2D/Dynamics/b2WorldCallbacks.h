@@ -214,6 +214,16 @@ public:
 	/// @return false to terminate the query.
 	virtual bool ReportFixture(b2Fixture* fixture) = 0;
 
+	/// Called for each child of a fixture found in the query AABB, e.g.
+	/// each edge of a chain. By default this reports the fixture, so a
+	/// fixture is reported once for each of its children in the AABB.
+	/// @return false to terminate the query.
+	virtual bool ReportFixtureChild(b2Fixture* fixture, int32 childIndex)
+	{
+		B2_NOT_USED(childIndex);
+		return ReportFixture(fixture);
+	}
+
 	/// Called for each particle found in the query AABB.
 	/// @return false to terminate the query.
 	virtual bool ReportParticle(const b2ParticleSystem* particleSystem,
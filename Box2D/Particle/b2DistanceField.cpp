@@ -0,0 +1,264 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#include <Box2D/Particle/b2DistanceField.h>
+#include <string.h>
+
+// Stands for an infinite squared distance in the distance transform. It is
+// finite so that differences of it stay numbers.
+static const float32 k_farSquared = 1e20f;
+
+// Felzenszwalb and Huttenlocher's distance transform of a sampled function
+// along one line: d[q] = min over p of (q - p)^2 + f[p]. v needs n and z
+// n + 1 entries of scratch space.
+static void b2DistanceTransform(const float32* f, int32 n, float32* d,
+								int32* v, float32* z)
+{
+	int32 k = 0;
+	v[0] = 0;
+	z[0] = -k_farSquared;
+	z[1] = k_farSquared;
+	for (int32 q = 1; q < n; q++)
+	{
+		float32 s;
+		for (;;)
+		{
+			const int32 p = v[k];
+			s = ((f[q] + float32(q * q)) - (f[p] + float32(p * p))) /
+				float32(2 * (q - p));
+			if (s > z[k] || k == 0)
+			{
+				break;
+			}
+			k--;
+		}
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = k_farSquared;
+	}
+	k = 0;
+	for (int32 q = 0; q < n; q++)
+	{
+		while (z[k + 1] < float32(q))
+		{
+			k++;
+		}
+		const int32 p = v[k];
+		d[q] = float32((q - p) * (q - p)) + f[p];
+	}
+}
+
+// Squared distances, in cells, from each cell of a width * height window to
+// the nearest cell whose solidity is 'solid'. Transforms the columns and
+// then the rows.
+static void b2SquaredDistances(const uint8* cells, int32 stride, int32 width,
+							   int32 height, uint8 solid, float32* out,
+							   float32* line, float32* result, int32* v,
+							   float32* z)
+{
+	for (int32 x = 0; x < width; x++)
+	{
+		for (int32 y = 0; y < height; y++)
+		{
+			line[y] = cells[y * stride + x] == solid ? 0.0f : k_farSquared;
+		}
+		b2DistanceTransform(line, height, result, v, z);
+		for (int32 y = 0; y < height; y++)
+		{
+			out[y * width + x] = result[y];
+		}
+	}
+	for (int32 y = 0; y < height; y++)
+	{
+		float32* row = out + y * width;
+		memcpy(line, row, sizeof(float32) * width);
+		b2DistanceTransform(line, width, row, v, z);
+	}
+}
+
+b2DistanceField::b2DistanceField(const b2DistanceFieldDef& def)
+{
+	b2Assert(def.width >= 2 && def.height >= 2);
+	b2Assert(def.cellSize > 0.0f && def.maxDistance > 0.0f);
+	m_def = def;
+	m_inverseCellSize = 1.0f / def.cellSize;
+	const int32 count = def.width * def.height;
+	m_distances = (float32*)b2Alloc(sizeof(float32) * count);
+	m_solid = (uint8*)b2Alloc(count);
+	for (int32 i = 0; i < count; i++)
+	{
+		m_distances[i] = def.maxDistance;
+	}
+	memset(m_solid, 0, count);
+}
+
+b2DistanceField::~b2DistanceField()
+{
+	b2Free(m_distances);
+	b2Free(m_solid);
+}
+
+int32 b2DistanceField::SetMask(const uint8* mask, int32 stride,
+							   uint8 threshold)
+{
+	// Find the bounds of the cells that changed.
+	int32 changed = 0;
+	int32 lowerX = m_def.width, lowerY = m_def.height;
+	int32 upperX = 0, upperY = 0;
+	for (int32 y = 0; y < m_def.height; y++)
+	{
+		const uint8* source = mask + y * stride;
+		uint8* solid = m_solid + y * m_def.width;
+		for (int32 x = 0; x < m_def.width; x++)
+		{
+			const uint8 s = source[x] >= threshold;
+			if (s != solid[x])
+			{
+				solid[x] = s;
+				changed++;
+				lowerX = b2Min(lowerX, x);
+				lowerY = b2Min(lowerY, y);
+				upperX = b2Max(upperX, x + 1);
+				upperY = b2Max(upperY, y + 1);
+			}
+		}
+	}
+	if (changed)
+	{
+		// Distances up to maxDistance away can depend on a changed cell.
+		const int32 band = int32(m_def.maxDistance * m_inverseCellSize) + 1;
+		UpdateRegion(lowerX - band, lowerY - band, upperX + band,
+					 upperY + band);
+	}
+	return changed;
+}
+
+void b2DistanceField::UpdateRegion(int32 lowerX, int32 lowerY, int32 upperX,
+								   int32 upperY)
+{
+	const int32 band = int32(m_def.maxDistance * m_inverseCellSize) + 1;
+	lowerX = b2Max(lowerX, 0);
+	lowerY = b2Max(lowerY, 0);
+	upperX = b2Min(upperX, m_def.width);
+	upperY = b2Min(upperY, m_def.height);
+
+	// The nearest cell that matters for the region is at most a band away.
+	const int32 windowLowerX = b2Max(lowerX - band, 0);
+	const int32 windowLowerY = b2Max(lowerY - band, 0);
+	const int32 windowWidth = b2Min(upperX + band, m_def.width) - windowLowerX;
+	const int32 windowHeight =
+		b2Min(upperY + band, m_def.height) - windowLowerY;
+	const int32 windowCount = windowWidth * windowHeight;
+	const int32 lineLength = b2Max(windowWidth, windowHeight);
+
+	float32* toSolid = (float32*)b2Alloc(sizeof(float32) * windowCount);
+	float32* toEmpty = (float32*)b2Alloc(sizeof(float32) * windowCount);
+	float32* line = (float32*)b2Alloc(sizeof(float32) * lineLength);
+	float32* result = (float32*)b2Alloc(sizeof(float32) * lineLength);
+	float32* z = (float32*)b2Alloc(sizeof(float32) * (lineLength + 1));
+	int32* v = (int32*)b2Alloc(sizeof(int32) * lineLength);
+
+	const uint8* cells =
+		m_solid + windowLowerY * m_def.width + windowLowerX;
+	b2SquaredDistances(cells, m_def.width, windowWidth, windowHeight, 1,
+					   toSolid, line, result, v, z);
+	b2SquaredDistances(cells, m_def.width, windowWidth, windowHeight, 0,
+					   toEmpty, line, result, v, z);
+
+	// The surface lies halfway between a solid and an empty cell.
+	for (int32 y = lowerY; y < upperY; y++)
+	{
+		for (int32 x = lowerX; x < upperX; x++)
+		{
+			const int32 w =
+				(y - windowLowerY) * windowWidth + (x - windowLowerX);
+			float32 distance;
+			if (m_solid[y * m_def.width + x])
+			{
+				distance = 0.5f - b2Sqrt(toEmpty[w]);
+			}
+			else
+			{
+				distance = b2Sqrt(toSolid[w]) - 0.5f;
+			}
+			m_distances[y * m_def.width + x] = b2Clamp(
+				distance * m_def.cellSize, -m_def.maxDistance,
+				m_def.maxDistance);
+		}
+	}
+
+	b2Free(v);
+	b2Free(z);
+	b2Free(result);
+	b2Free(line);
+	b2Free(toEmpty);
+	b2Free(toSolid);
+}
+
+void b2DistanceField::SetDistances(int32 x, int32 y, int32 width,
+								   int32 height, const float32* distances,
+								   int32 stride)
+{
+	b2Assert(x >= 0 && y >= 0);
+	b2Assert(x + width <= m_def.width && y + height <= m_def.height);
+	for (int32 j = 0; j < height; j++)
+	{
+		const float32* source = distances + j * stride;
+		float32* target = m_distances + (y + j) * m_def.width + x;
+		for (int32 i = 0; i < width; i++)
+		{
+			target[i] = b2Clamp(source[i], -m_def.maxDistance,
+								m_def.maxDistance);
+		}
+	}
+}
+
+float32 b2DistanceField::GetDistance(const b2Vec2& point) const
+{
+	b2Vec2 gradient;
+	return GetDistance(point, &gradient);
+}
+
+float32 b2DistanceField::GetDistance(const b2Vec2& point,
+									 b2Vec2* gradient) const
+{
+	const b2Vec2 local = m_inverseCellSize * (point - m_def.origin);
+	// The negated comparisons also reject NaN.
+	if (!(local.x >= 0.0f && local.y >= 0.0f &&
+		  local.x < float32(m_def.width - 1) &&
+		  local.y < float32(m_def.height - 1)))
+	{
+		gradient->SetZero();
+		return m_def.maxDistance;
+	}
+	const int32 x = int32(local.x);
+	const int32 y = int32(local.y);
+	const float32 tx = local.x - float32(x);
+	const float32 ty = local.y - float32(y);
+	const float32* sample = m_distances + y * m_def.width + x;
+	const float32 d00 = sample[0];
+	const float32 d10 = sample[1];
+	const float32 d01 = sample[m_def.width];
+	const float32 d11 = sample[m_def.width + 1];
+	const float32 bottom = d00 + tx * (d10 - d00);
+	const float32 top = d01 + tx * (d11 - d01);
+	gradient->x = m_inverseCellSize *
+		((d10 - d00) + ty * ((d11 - d01) - (d10 - d00)));
+	gradient->y = m_inverseCellSize * (top - bottom);
+	return bottom + ty * (top - bottom);
+}
@@ -0,0 +1,114 @@
+/*
+* Copyright (c) 2014 Google, Inc.
+*
+* This software is provided 'as-is', without any express or implied
+* warranty.  In no event will the authors be held liable for any damages
+* arising from the use of this software.
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+* 1. The origin of this software must not be misrepresented; you must not
+* claim that you wrote the original software. If you use this software
+* in a product, an acknowledgment in the product documentation would be
+* appreciated but is not required.
+* 2. Altered source versions must be plainly marked as such, and must not be
+* misrepresented as being the original software.
+* 3. This notice may not be removed or altered from any source distribution.
+*/
+#ifndef B2_DISTANCE_FIELD_H
+#define B2_DISTANCE_FIELD_H
+
+#include <Box2D/Common/b2Math.h>
+
+/// Placement and resolution of a b2DistanceField.
+struct b2DistanceFieldDef
+{
+	b2DistanceFieldDef()
+	{
+		width = 0;
+		height = 0;
+		origin.SetZero();
+		cellSize = 1.0f;
+		maxDistance = 1.0f;
+	}
+
+	/// Number of samples along x and y.
+	int32 width;
+	int32 height;
+
+	/// World position of sample (0, 0). Sample (i, j) lies at
+	/// origin + cellSize * (i, j).
+	b2Vec2 origin;
+
+	/// Distance between neighboring samples.
+	float32 cellSize;
+
+	/// Distances are clamped to [-maxDistance, maxDistance]. Only a band of
+	/// this width around the surface matters for collisions, and the
+	/// smaller it is the less of the field a change of the mask
+	/// recomputes. It should be well above the distance particles move in
+	/// a step.
+	float32 maxDistance;
+};
+
+/// A static obstacle for particles given by a signed distance field sampled
+/// on a grid: negative inside the obstacle, positive outside, in world
+/// units. Particles collide with it through one bilinear lookup each,
+/// however complex the outline, instead of the broad-phase queries and
+/// shape distances that fixtures need. Outside the grid there is no
+/// obstacle.
+/// The distances either come from a mask of solid cells, e.g. an image,
+/// or are set directly.
+/// @see b2ParticleSystem::SetDistanceField
+class b2DistanceField
+{
+public:
+	/// Create a field with no obstacle.
+	explicit b2DistanceField(const b2DistanceFieldDef& def);
+	~b2DistanceField();
+
+	/// Build the distances from a mask of width * height bytes: a cell is
+	/// solid when its byte is at least threshold. Rows are stride bytes
+	/// apart and row 0 is at the origin. Only the distances within
+	/// maxDistance of the cells whose solidity changed since the last call
+	/// are recomputed, so a mask that changes in a few places is cheap.
+	/// @return the number of cells whose solidity changed.
+	int32 SetMask(const uint8* mask, int32 stride, uint8 threshold);
+
+	/// Set the distances of a rectangle of samples directly, e.g. from a
+	/// field computed elsewhere. Rows of the source are stride floats
+	/// apart. Do not mix this with SetMask(), which only recomputes around
+	/// the cells it sees change.
+	void SetDistances(int32 x, int32 y, int32 width, int32 height,
+					  const float32* distances, int32 stride);
+
+	/// Get the distance at a point, interpolated between the four nearest
+	/// samples.
+	float32 GetDistance(const b2Vec2& point) const;
+
+	/// Get the distance at a point and its gradient, which points away
+	/// from the obstacle and is zero where the distance is clamped.
+	float32 GetDistance(const b2Vec2& point, b2Vec2* gradient) const;
+
+	/// Get the placement and resolution.
+	const b2DistanceFieldDef& GetDef() const { return m_def; }
+
+	/// Get the samples, width * height floats in rows starting at the
+	/// origin.
+	const float32* GetDistanceBuffer() const { return m_distances; }
+
+private:
+	b2DistanceField(const b2DistanceField&);
+	b2DistanceField& operator=(const b2DistanceField&);
+
+	void UpdateRegion(int32 lowerX, int32 lowerY, int32 upperX,
+					  int32 upperY);
+
+	b2DistanceFieldDef m_def;
+	float32 m_inverseCellSize;
+	float32* m_distances;
+	// Solidity of each cell as of the last SetMask().
+	uint8* m_solid;
+};
+
+#endif
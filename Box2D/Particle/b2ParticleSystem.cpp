@@ -17,9 +17,14 @@
 */
 #include <Box2D/Particle/b2ParticleSystem.h>
 #include <Box2D/Particle/b2ParticleGroup.h>
+#include <Box2D/Particle/b2DistanceField.h>
 #include <Box2D/Particle/b2VoronoiDiagram.h>
 #include <Box2D/Particle/b2ParticleAssembly.h>
 #include <Box2D/Common/b2BlockAllocator.h>
+#include <Box2D/Common/b2Snapshot.h>
+#include <Box2D/Common/b2ThreadPool.h>
+#include <Box2D/Common/b2Timer.h>
+#include <Box2D/Common/b2Trace.h>
 #include <Box2D/Dynamics/b2World.h>
 #include <Box2D/Dynamics/b2WorldCallbacks.h>
 #include <Box2D/Dynamics/b2Body.h>
@@ -396,12 +401,15 @@ b2ParticleSystem::b2ParticleSystem(const b2ParticleSystemDef* def,
 	b2Assert(def);
 	m_paused = false;
 	m_timestamp = 0;
+	memset(&m_profile, 0, sizeof(m_profile));
 	m_allParticleFlags = 0;
 	m_needsUpdateAllParticleFlags = false;
 	m_allGroupFlags = 0;
 	m_needsUpdateAllGroupFlags = false;
 	m_hasForce = false;
 	m_iterationIndex = 0;
+	m_distanceField = NULL;
+	m_count = 0;
 
 	SetStrictContactCheck(def->strictContactCheck);
 	SetDensity(def->density);
@@ -409,14 +417,22 @@ b2ParticleSystem::b2ParticleSystem(const b2ParticleSystemDef* def,
 	SetRadius(def->radius);
 	SetMaxParticleCount(def->maxCount);
 
-	m_count = 0;
 	m_internalAllocatedCapacity = 0;
+	m_peakBufferBytes = 0;
+	m_peakContactBytes = 0;
+	m_peakHandleBytes = 0;
 	m_forceBuffer = NULL;
 	m_weightBuffer = NULL;
 	m_staticPressureBuffer = NULL;
 	m_accumulationBuffer = NULL;
 	m_accumulation2Buffer = NULL;
 	m_depthBuffer = NULL;
+	m_previousPositionBuffer = NULL;
+	m_idBuffer = NULL;
+	m_idSlotBuffer = NULL;
+	m_idSlotCapacity = 0;
+	m_idSlotCount = 0;
+	m_freeIdSlot = b2_invalidParticleIndex;
 	m_groupBuffer = NULL;
 
 	m_groupCount = 0;
@@ -459,6 +475,9 @@ b2ParticleSystem::~b2ParticleSystem()
 	FreeBuffer(&m_accumulationBuffer, m_internalAllocatedCapacity);
 	FreeBuffer(&m_accumulation2Buffer, m_internalAllocatedCapacity);
 	FreeBuffer(&m_depthBuffer, m_internalAllocatedCapacity);
+	FreeBuffer(&m_previousPositionBuffer, m_internalAllocatedCapacity);
+	FreeBuffer(&m_idBuffer, m_internalAllocatedCapacity);
+	FreeBuffer(&m_idSlotBuffer, m_idSlotCapacity);
 	FreeBuffer(&m_groupBuffer, m_internalAllocatedCapacity);
 }
 
@@ -485,12 +504,13 @@ template <typename T> void b2ParticleSystem::FreeUserOverridableBuffer(
 template <typename T> T* b2ParticleSystem::ReallocateBuffer(
 	T* oldBuffer, int32 oldCapacity, int32 newCapacity)
 {
-	b2Assert(newCapacity > oldCapacity);
+	b2Assert(newCapacity != oldCapacity);
 	T* newBuffer = (T*) m_world->m_blockAllocator.Allocate(
 		sizeof(T) * newCapacity);
 	if (oldBuffer)
 	{
-		memcpy(newBuffer, oldBuffer, sizeof(T) * oldCapacity);
+		memcpy(newBuffer, oldBuffer,
+			   sizeof(T) * b2Min(oldCapacity, newCapacity));
 		m_world->m_blockAllocator.Free(oldBuffer, sizeof(T) * oldCapacity);
 	}
 	return newBuffer;
@@ -501,7 +521,7 @@ template <typename T> T* b2ParticleSystem::ReallocateBuffer(
 	T* buffer, int32 userSuppliedCapacity, int32 oldCapacity,
 	int32 newCapacity, bool deferred)
 {
-	b2Assert(newCapacity > oldCapacity);
+	b2Assert(newCapacity != oldCapacity);
 	// A 'deferred' buffer is reallocated only if it is not NULL.
 	// If 'userSuppliedCapacity' is not zero, buffer is user supplied and must
 	// be kept.
@@ -518,7 +538,7 @@ template <typename T> T* b2ParticleSystem::ReallocateBuffer(
 	UserOverridableBuffer<T>* buffer, int32 oldCapacity, int32 newCapacity,
 	bool deferred)
 {
-	b2Assert(newCapacity > oldCapacity);
+	b2Assert(newCapacity != oldCapacity);
 	return ReallocateBuffer(buffer->data, buffer->userSuppliedCapacity,
 							oldCapacity, newCapacity, deferred);
 }
@@ -527,15 +547,19 @@ template <typename T> T* b2ParticleSystem::ReallocateBuffer(
 /// pool for handle allocation.
 void b2ParticleSystem::ReallocateHandleBuffers(int32 newCapacity)
 {
-	b2Assert(newCapacity > m_internalAllocatedCapacity);
+	b2Assert(newCapacity != m_internalAllocatedCapacity);
 	// Reallocate a new handle / index map buffer, copying old handle pointers
 	// is fine since they're kept around.
 	m_handleIndexBuffer.data = ReallocateBuffer(
 		&m_handleIndexBuffer, m_internalAllocatedCapacity, newCapacity,
 		true);
-	// Set the size of the next handle allocation.
-	m_handleAllocator.SetItemsPerSlab(newCapacity -
-									  m_internalAllocatedCapacity);
+	// Set the size of the next handle allocation.  When shrinking, the
+	// existing slabs already hold a handle for every remaining particle.
+	if (newCapacity > m_internalAllocatedCapacity)
+	{
+		m_handleAllocator.SetItemsPerSlab(newCapacity -
+										  m_internalAllocatedCapacity);
+	}
 }
 
 template <typename T> T* b2ParticleSystem::RequestBuffer(T* buffer)
@@ -555,6 +579,17 @@ template <typename T> T* b2ParticleSystem::RequestBuffer(T* buffer)
 	return buffer;
 }
 
+const b2Vec2* b2ParticleSystem::GetPreviousPositionBuffer()
+{
+	if (!m_previousPositionBuffer)
+	{
+		m_previousPositionBuffer = RequestBuffer(m_previousPositionBuffer);
+		memcpy(m_previousPositionBuffer, m_positionBuffer.data,
+			   sizeof(b2Vec2) * m_count);
+	}
+	return m_previousPositionBuffer;
+}
+
 b2ParticleColor* b2ParticleSystem::GetColorBuffer()
 {
 	m_colorBuffer.data = RequestBuffer(m_colorBuffer.data);
@@ -567,6 +602,18 @@ void** b2ParticleSystem::GetUserDataBuffer()
 	return m_userDataBuffer.data;
 }
 
+// An id holds the slot of its entry in the id table in the low bits and
+// the generation of the entry above them.  Together they take 24 bits so
+// that every id is exactly representable as a float32, which is how ids
+// travel through channels.
+static const int32 b2_particleIdSlotBits = 18;
+static const int32 b2_particleIdSlotMask = (1 << b2_particleIdSlotBits) - 1;
+static const int32 b2_particleIdGenerationBits = 6;
+static const int32 b2_particleIdGenerationMask =
+	(1 << b2_particleIdGenerationBits) - 1;
+// The number of ids that can be in use at once.
+static const int32 b2_particleIdSlotCount = 1 << b2_particleIdSlotBits;
+
 static int32 LimitCapacity(int32 capacity, int32 maxCount)
 {
 	return maxCount && capacity > maxCount ? maxCount : capacity;
@@ -581,57 +628,458 @@ void b2ParticleSystem::ReallocateInternalAllocatedBuffers(int32 capacity)
 	capacity = LimitCapacity(capacity, m_velocityBuffer.userSuppliedCapacity);
 	capacity = LimitCapacity(capacity, m_colorBuffer.userSuppliedCapacity);
 	capacity = LimitCapacity(capacity, m_userDataBuffer.userSuppliedCapacity);
+	// Once ids are tracked, every new particle needs a free id.
+	if (m_idBuffer)
+	{
+		capacity = LimitCapacity(capacity, b2_particleIdSlotCount);
+	}
 	if (m_internalAllocatedCapacity < capacity)
 	{
-		ReallocateHandleBuffers(capacity);
-		m_flagsBuffer.data = ReallocateBuffer(
-			&m_flagsBuffer, m_internalAllocatedCapacity, capacity, false);
-
-		// Conditionally defer these as they are optional if the feature is
-		// not enabled.
-		const bool stuck = m_stuckThreshold > 0;
-		m_lastBodyContactStepBuffer.data = ReallocateBuffer(
-			&m_lastBodyContactStepBuffer, m_internalAllocatedCapacity,
-			capacity, stuck);
-		m_bodyContactCountBuffer.data = ReallocateBuffer(
-			&m_bodyContactCountBuffer, m_internalAllocatedCapacity, capacity,
-			stuck);
-		m_consecutiveContactStepsBuffer.data = ReallocateBuffer(
-			&m_consecutiveContactStepsBuffer, m_internalAllocatedCapacity,
-			capacity, stuck);
-		m_positionBuffer.data = ReallocateBuffer(
-			&m_positionBuffer, m_internalAllocatedCapacity, capacity, false);
-		m_velocityBuffer.data = ReallocateBuffer(
-			&m_velocityBuffer, m_internalAllocatedCapacity, capacity, false);
-		m_forceBuffer = ReallocateBuffer(
-			m_forceBuffer, 0, m_internalAllocatedCapacity, capacity, false);
-		m_weightBuffer = ReallocateBuffer(
-			m_weightBuffer, 0, m_internalAllocatedCapacity, capacity, false);
-		m_staticPressureBuffer = ReallocateBuffer(
-			m_staticPressureBuffer, 0, m_internalAllocatedCapacity, capacity,
-			true);
-		m_accumulationBuffer = ReallocateBuffer(
-			m_accumulationBuffer, 0, m_internalAllocatedCapacity, capacity,
-			false);
-		m_accumulation2Buffer = ReallocateBuffer(
-			m_accumulation2Buffer, 0, m_internalAllocatedCapacity, capacity,
-			true);
-		m_depthBuffer = ReallocateBuffer(
-			m_depthBuffer, 0, m_internalAllocatedCapacity, capacity, true);
-		m_colorBuffer.data = ReallocateBuffer(
-			&m_colorBuffer, m_internalAllocatedCapacity, capacity, true);
-		m_groupBuffer = ReallocateBuffer(
-			m_groupBuffer, 0, m_internalAllocatedCapacity, capacity, false);
-		m_userDataBuffer.data = ReallocateBuffer(
-			&m_userDataBuffer, m_internalAllocatedCapacity, capacity, true);
-		m_expirationTimeBuffer.data = ReallocateBuffer(
-			&m_expirationTimeBuffer, m_internalAllocatedCapacity, capacity,
-			true);
-		m_indexByExpirationTimeBuffer.data = ReallocateBuffer(
-			&m_indexByExpirationTimeBuffer, m_internalAllocatedCapacity,
-			capacity, true);
-		m_internalAllocatedCapacity = capacity;
+		ResizeInternalAllocatedBuffers(capacity);
+	}
+}
+
+void b2ParticleSystem::ResizeInternalAllocatedBuffers(int32 capacity)
+{
+	b2Assert(m_count <= capacity);
+	ReallocateHandleBuffers(capacity);
+	m_flagsBuffer.data = ReallocateBuffer(
+		&m_flagsBuffer, m_internalAllocatedCapacity, capacity, false);
+
+	// Conditionally defer these as they are optional if the feature is
+	// not enabled.
+	const bool stuck = m_stuckThreshold > 0;
+	m_lastBodyContactStepBuffer.data = ReallocateBuffer(
+		&m_lastBodyContactStepBuffer, m_internalAllocatedCapacity,
+		capacity, stuck);
+	m_bodyContactCountBuffer.data = ReallocateBuffer(
+		&m_bodyContactCountBuffer, m_internalAllocatedCapacity, capacity,
+		stuck);
+	m_consecutiveContactStepsBuffer.data = ReallocateBuffer(
+		&m_consecutiveContactStepsBuffer, m_internalAllocatedCapacity,
+		capacity, stuck);
+	m_positionBuffer.data = ReallocateBuffer(
+		&m_positionBuffer, m_internalAllocatedCapacity, capacity, false);
+	m_velocityBuffer.data = ReallocateBuffer(
+		&m_velocityBuffer, m_internalAllocatedCapacity, capacity, false);
+	m_forceBuffer = ReallocateBuffer(
+		m_forceBuffer, 0, m_internalAllocatedCapacity, capacity, false);
+	m_weightBuffer = ReallocateBuffer(
+		m_weightBuffer, 0, m_internalAllocatedCapacity, capacity, false);
+	m_staticPressureBuffer = ReallocateBuffer(
+		m_staticPressureBuffer, 0, m_internalAllocatedCapacity, capacity,
+		true);
+	m_accumulationBuffer = ReallocateBuffer(
+		m_accumulationBuffer, 0, m_internalAllocatedCapacity, capacity,
+		false);
+	m_accumulation2Buffer = ReallocateBuffer(
+		m_accumulation2Buffer, 0, m_internalAllocatedCapacity, capacity,
+		true);
+	m_depthBuffer = ReallocateBuffer(
+		m_depthBuffer, 0, m_internalAllocatedCapacity, capacity, true);
+	m_previousPositionBuffer = ReallocateBuffer(
+		m_previousPositionBuffer, 0, m_internalAllocatedCapacity, capacity,
+		true);
+	m_idBuffer = ReallocateBuffer(
+		m_idBuffer, 0, m_internalAllocatedCapacity, capacity, true);
+	// The id table only grows, a new particle may need a new slot.
+	if (m_idSlotBuffer && capacity > m_idSlotCapacity &&
+		m_idSlotCapacity < b2_particleIdSlotCount)
+	{
+		ResizeIdSlotBuffer(b2Min(capacity, b2_particleIdSlotCount));
+	}
+	m_colorBuffer.data = ReallocateBuffer(
+		&m_colorBuffer, m_internalAllocatedCapacity, capacity, true);
+	m_groupBuffer = ReallocateBuffer(
+		m_groupBuffer, 0, m_internalAllocatedCapacity, capacity, false);
+	m_userDataBuffer.data = ReallocateBuffer(
+		&m_userDataBuffer, m_internalAllocatedCapacity, capacity, true);
+	m_expirationTimeBuffer.data = ReallocateBuffer(
+		&m_expirationTimeBuffer, m_internalAllocatedCapacity, capacity,
+		true);
+	m_indexByExpirationTimeBuffer.data = ReallocateBuffer(
+		&m_indexByExpirationTimeBuffer, m_internalAllocatedCapacity,
+		capacity, true);
+	m_internalAllocatedCapacity = capacity;
+}
+
+void b2ParticleSystem::ResizeIdSlotBuffer(int32 capacity)
+{
+	b2Assert(m_idSlotCount <= capacity);
+	if (capacity != m_idSlotCapacity)
+	{
+		m_idSlotBuffer = ReallocateBuffer(
+			m_idSlotBuffer, m_idSlotCapacity, capacity);
+		m_idSlotCapacity = capacity;
+	}
+}
+
+template <typename T> static int32 b2InternalElementSize(const T* buffer)
+{
+	return buffer ? (int32)sizeof(T) : 0;
+}
+
+template <typename T> static int32 b2InternalElementSize(
+	const T* buffer, int32 userSuppliedCapacity)
+{
+	return userSuppliedCapacity ? 0 : b2InternalElementSize(buffer);
+}
+
+int32 b2ParticleSystem::GetInternalBytesPerParticle() const
+{
+	return
+		b2InternalElementSize(m_handleIndexBuffer.data,
+							  m_handleIndexBuffer.userSuppliedCapacity) +
+		b2InternalElementSize(m_flagsBuffer.data,
+							  m_flagsBuffer.userSuppliedCapacity) +
+		b2InternalElementSize(m_lastBodyContactStepBuffer.data,
+							  m_lastBodyContactStepBuffer.userSuppliedCapacity) +
+		b2InternalElementSize(m_bodyContactCountBuffer.data,
+							  m_bodyContactCountBuffer.userSuppliedCapacity) +
+		b2InternalElementSize(
+			m_consecutiveContactStepsBuffer.data,
+			m_consecutiveContactStepsBuffer.userSuppliedCapacity) +
+		b2InternalElementSize(m_positionBuffer.data,
+							  m_positionBuffer.userSuppliedCapacity) +
+		b2InternalElementSize(m_velocityBuffer.data,
+							  m_velocityBuffer.userSuppliedCapacity) +
+		b2InternalElementSize(m_forceBuffer) +
+		b2InternalElementSize(m_weightBuffer) +
+		b2InternalElementSize(m_staticPressureBuffer) +
+		b2InternalElementSize(m_accumulationBuffer) +
+		b2InternalElementSize(m_accumulation2Buffer) +
+		b2InternalElementSize(m_depthBuffer) +
+		b2InternalElementSize(m_previousPositionBuffer) +
+		b2InternalElementSize(m_idBuffer) +
+		b2InternalElementSize(m_colorBuffer.data,
+							  m_colorBuffer.userSuppliedCapacity) +
+		b2InternalElementSize(m_groupBuffer) +
+		b2InternalElementSize(m_userDataBuffer.data,
+							  m_userDataBuffer.userSuppliedCapacity) +
+		b2InternalElementSize(m_expirationTimeBuffer.data,
+							  m_expirationTimeBuffer.userSuppliedCapacity) +
+		b2InternalElementSize(
+			m_indexByExpirationTimeBuffer.data,
+			m_indexByExpirationTimeBuffer.userSuppliedCapacity);
+}
+
+b2MemoryUsage b2ParticleSystem::GetBufferMemoryUsage() const
+{
+	const int32 bytesPerParticle = GetInternalBytesPerParticle();
+	b2MemoryUsage usage;
+	usage.used = bytesPerParticle * m_count;
+	usage.reserved = bytesPerParticle * m_internalAllocatedCapacity;
+	if (m_idSlotBuffer)
+	{
+		usage.used += (int32)sizeof(IdSlot) * m_idSlotCount;
+		usage.reserved += (int32)sizeof(IdSlot) * m_idSlotCapacity;
+	}
+	usage.peak = b2Max(m_peakBufferBytes, usage.reserved);
+	return usage;
+}
+
+template <typename T> static void b2AddGrowableBufferUsage(
+	const b2GrowableBuffer<T>& buffer, b2MemoryUsage* usage)
+{
+	usage->used += buffer.GetCount() * (int32)sizeof(T);
+	usage->reserved += buffer.GetCapacity() * (int32)sizeof(T);
+}
+
+b2MemoryUsage b2ParticleSystem::GetContactMemoryUsage() const
+{
+	b2MemoryUsage usage;
+	usage.used = 0;
+	usage.reserved = 0;
+	b2AddGrowableBufferUsage(m_proxyBuffer, &usage);
+	b2AddGrowableBufferUsage(m_contactBuffer, &usage);
+	b2AddGrowableBufferUsage(m_bodyContactBuffer, &usage);
+	b2AddGrowableBufferUsage(m_pairBuffer, &usage);
+	b2AddGrowableBufferUsage(m_triadBuffer, &usage);
+	b2AddGrowableBufferUsage(m_stuckParticleBuffer, &usage);
+	usage.peak = b2Max(m_peakContactBytes, usage.reserved);
+	return usage;
+}
+
+b2MemoryUsage b2ParticleSystem::GetHandleMemoryUsage() const
+{
+	b2MemoryUsage usage = m_handleAllocator.GetMemoryUsage();
+	usage.peak = b2Max(m_peakHandleBytes, usage.reserved);
+	return usage;
+}
+
+void b2ParticleSystem::Trim()
+{
+	b2Assert(m_world->IsLocked() == false);
+	if (m_world->IsLocked())
+	{
+		return;
+	}
+
+	// Remember the high-water marks before giving the memory back.
+	m_peakBufferBytes = GetBufferMemoryUsage().peak;
+	m_peakContactBytes = GetContactMemoryUsage().peak;
+	m_peakHandleBytes = GetHandleMemoryUsage().peak;
+
+	const int32 capacity = b2Max(m_count, b2_minParticleSystemBufferCapacity);
+	if (m_internalAllocatedCapacity > capacity)
+	{
+		ResizeInternalAllocatedBuffers(capacity);
+	}
+	// The id table keeps every slot handed out so far. Every particle has
+	// a slot, so this is never below the particle capacity unless that is
+	// above the number of ids.
+	if (m_idSlotBuffer)
+	{
+		ResizeIdSlotBuffer(
+			b2Max(m_idSlotCount, b2_minParticleSystemBufferCapacity));
+	}
+
+	m_proxyBuffer.Shrink();
+	m_contactBuffer.Shrink();
+	m_bodyContactBuffer.Shrink();
+	m_pairBuffer.Shrink();
+	m_triadBuffer.Shrink();
+	m_stuckParticleBuffer.Shrink();
+
+	m_handleAllocator.FreeEmptySlabs();
+}
+
+template <typename T> static void b2SaveParticleBuffer(
+	b2SnapshotWriter* writer, const T* buffer, int32 count)
+{
+	writer->Write(buffer != NULL);
+	if (buffer)
+	{
+		writer->WriteArray(buffer, count);
+	}
+}
+
+template <typename T> T* b2ParticleSystem::RestoreBuffer(
+	b2SnapshotReader* reader, T* buffer)
+{
+	if (reader->Read<bool>())
+	{
+		buffer = RequestBuffer(buffer);
+		reader->ReadArray(buffer, m_count);
+	}
+	return buffer;
+}
+
+template <typename T> static void b2SaveGrowableBuffer(
+	b2SnapshotWriter* writer, const b2GrowableBuffer<T>& buffer)
+{
+	writer->Write(buffer.GetCount());
+	writer->WriteArray(buffer.Data(), buffer.GetCount());
+}
+
+template <typename T> static void b2RestoreGrowableBuffer(
+	b2SnapshotReader* reader, b2GrowableBuffer<T>* buffer)
+{
+	int32 count = reader->Read<int32>();
+	buffer->Reserve(count);
+	buffer->SetCount(count);
+	reader->ReadArray(buffer->Data(), count);
+}
+
+void b2ParticleSystem::SaveSnapshot(b2SnapshotWriter* writer) const
+{
+	writer->Write(m_paused);
+	writer->Write(m_timestamp);
+	writer->Write(m_allParticleFlags);
+	writer->Write(m_allGroupFlags);
+	writer->Write(m_hasForce);
+	writer->Write(m_iterationIndex);
+	writer->Write(GetRadius());
+	writer->Write(m_stuckThreshold);
+	writer->Write(m_timeElapsed);
+	writer->Write(m_expirationTimeBufferRequiresSorting);
+	writer->Write(m_count);
+
+	// Groups are written from the tail of the list, so creating them in
+	// order rebuilds the list as it was. Each group owns a contiguous range
+	// of particles, which restores the group buffer.
+	writer->Write(m_groupCount);
+	const b2ParticleGroup* tail = m_groupList;
+	while (tail && tail->m_next)
+	{
+		tail = tail->m_next;
+	}
+	for (const b2ParticleGroup* group = tail; group; group = group->m_prev)
+	{
+		writer->Write(group->m_firstIndex);
+		writer->Write(group->m_lastIndex);
+		writer->Write(group->m_groupFlags);
+		writer->Write(group->m_strength);
+		writer->Write(group->m_timestamp);
+		writer->Write(group->m_mass);
+		writer->Write(group->m_inertia);
+		writer->Write(group->m_center);
+		writer->Write(group->m_linearVelocity);
+		writer->Write(group->m_angularVelocity);
+		writer->Write(group->m_transform);
+		writer->Write(group->m_userData);
+	}
+
+	b2SaveParticleBuffer(writer, m_flagsBuffer.data, m_count);
+	b2SaveParticleBuffer(writer, m_positionBuffer.data, m_count);
+	b2SaveParticleBuffer(writer, m_velocityBuffer.data, m_count);
+	b2SaveParticleBuffer(writer, m_forceBuffer, m_count);
+	b2SaveParticleBuffer(writer, m_staticPressureBuffer, m_count);
+	b2SaveParticleBuffer(writer, m_accumulation2Buffer, m_count);
+	b2SaveParticleBuffer(writer, m_depthBuffer, m_count);
+	b2SaveParticleBuffer(writer, m_previousPositionBuffer, m_count);
+	b2SaveParticleBuffer(writer, m_colorBuffer.data, m_count);
+	b2SaveParticleBuffer(writer, m_userDataBuffer.data, m_count);
+	b2SaveParticleBuffer(writer, m_lastBodyContactStepBuffer.data, m_count);
+	b2SaveParticleBuffer(writer, m_bodyContactCountBuffer.data, m_count);
+	b2SaveParticleBuffer(writer, m_consecutiveContactStepsBuffer.data,
+						 m_count);
+	b2SaveParticleBuffer(writer, m_expirationTimeBuffer.data, m_count);
+	b2SaveParticleBuffer(writer, m_indexByExpirationTimeBuffer.data,
+						 m_count);
+
+	// Handles are recreated for the particles that had one.
+	int32 handleCount = 0;
+	if (m_handleIndexBuffer.data)
+	{
+		for (int32 i = 0; i < m_count; i++)
+		{
+			handleCount += m_handleIndexBuffer.data[i] != NULL;
+		}
+	}
+	writer->Write(handleCount);
+	for (int32 i = 0; handleCount && i < m_count; i++)
+	{
+		if (m_handleIndexBuffer.data[i])
+		{
+			writer->Write(i);
+		}
+	}
+
+	writer->Write(m_idSlotCount);
+	writer->Write(m_freeIdSlot);
+	b2SaveParticleBuffer(writer, m_idBuffer, m_count);
+	if (m_idBuffer)
+	{
+		writer->WriteArray(m_idSlotBuffer, m_idSlotCount);
 	}
+
+	// Body contacts refer to fixtures by address and are found again by
+	// the next step, as are the particle contacts. The contacts are kept
+	// anyway since GetContacts reports them between steps.
+	b2SaveGrowableBuffer(writer, m_proxyBuffer);
+	b2SaveGrowableBuffer(writer, m_contactBuffer);
+	b2SaveGrowableBuffer(writer, m_pairBuffer);
+	b2SaveGrowableBuffer(writer, m_triadBuffer);
+}
+
+void b2ParticleSystem::RestoreSnapshot(b2SnapshotReader* reader)
+{
+	b2Assert(m_count == 0 && m_groupList == NULL);
+	reader->Read(&m_paused);
+	reader->Read(&m_timestamp);
+	reader->Read(&m_allParticleFlags);
+	reader->Read(&m_allGroupFlags);
+	reader->Read(&m_hasForce);
+	reader->Read(&m_iterationIndex);
+	SetRadius(reader->Read<float32>());
+	reader->Read(&m_stuckThreshold);
+	reader->Read(&m_timeElapsed);
+	reader->Read(&m_expirationTimeBufferRequiresSorting);
+	const int32 count = reader->Read<int32>();
+	if (count > m_internalAllocatedCapacity)
+	{
+		ReallocateInternalAllocatedBuffers(
+			b2Max(count, b2_minParticleSystemBufferCapacity));
+	}
+	b2Assert(count <= m_internalAllocatedCapacity);
+	m_count = count;
+
+	if (m_count > 0)
+	{
+		memset(m_groupBuffer, 0, sizeof(*m_groupBuffer) * m_count);
+	}
+	const int32 groupCount = reader->Read<int32>();
+	for (int32 i = 0; i < groupCount; i++)
+	{
+		void* mem = m_world->m_blockAllocator.Allocate(
+			sizeof(b2ParticleGroup));
+		b2ParticleGroup* group = new (mem) b2ParticleGroup();
+		group->m_system = this;
+		reader->Read(&group->m_firstIndex);
+		reader->Read(&group->m_lastIndex);
+		reader->Read(&group->m_groupFlags);
+		reader->Read(&group->m_strength);
+		reader->Read(&group->m_timestamp);
+		reader->Read(&group->m_mass);
+		reader->Read(&group->m_inertia);
+		reader->Read(&group->m_center);
+		reader->Read(&group->m_linearVelocity);
+		reader->Read(&group->m_angularVelocity);
+		reader->Read(&group->m_transform);
+		reader->Read(&group->m_userData);
+		group->m_next = m_groupList;
+		if (m_groupList)
+		{
+			m_groupList->m_prev = group;
+		}
+		m_groupList = group;
+		++m_groupCount;
+		const int32 lastIndex = b2Min(group->m_lastIndex, m_count);
+		for (int32 j = b2Max(group->m_firstIndex, 0); j < lastIndex; j++)
+		{
+			m_groupBuffer[j] = group;
+		}
+	}
+
+	m_flagsBuffer.data = RestoreBuffer(reader, m_flagsBuffer.data);
+	m_positionBuffer.data = RestoreBuffer(reader, m_positionBuffer.data);
+	m_velocityBuffer.data = RestoreBuffer(reader, m_velocityBuffer.data);
+	m_forceBuffer = RestoreBuffer(reader, m_forceBuffer);
+	m_staticPressureBuffer = RestoreBuffer(reader, m_staticPressureBuffer);
+	m_accumulation2Buffer = RestoreBuffer(reader, m_accumulation2Buffer);
+	m_depthBuffer = RestoreBuffer(reader, m_depthBuffer);
+	m_previousPositionBuffer = RestoreBuffer(reader, m_previousPositionBuffer);
+	m_colorBuffer.data = RestoreBuffer(reader, m_colorBuffer.data);
+	m_userDataBuffer.data = RestoreBuffer(reader, m_userDataBuffer.data);
+	m_lastBodyContactStepBuffer.data = RestoreBuffer(
+		reader, m_lastBodyContactStepBuffer.data);
+	m_bodyContactCountBuffer.data = RestoreBuffer(
+		reader, m_bodyContactCountBuffer.data);
+	m_consecutiveContactStepsBuffer.data = RestoreBuffer(
+		reader, m_consecutiveContactStepsBuffer.data);
+	m_expirationTimeBuffer.data = RestoreBuffer(
+		reader, m_expirationTimeBuffer.data);
+	m_indexByExpirationTimeBuffer.data = RestoreBuffer(
+		reader, m_indexByExpirationTimeBuffer.data);
+
+	const int32 handleCount = reader->Read<int32>();
+	for (int32 i = 0; i < handleCount; i++)
+	{
+		const int32 index = reader->Read<int32>();
+		if (0 <= index && index < m_count)
+		{
+			GetParticleHandleFromIndex(index);
+		}
+	}
+
+	reader->Read(&m_idSlotCount);
+	reader->Read(&m_freeIdSlot);
+	m_idBuffer = RestoreBuffer(reader, m_idBuffer);
+	if (m_idBuffer)
+	{
+		ResizeIdSlotBuffer(b2Max(m_idSlotCount, b2Min(
+			m_internalAllocatedCapacity, b2_particleIdSlotCount)));
+		reader->ReadArray(m_idSlotBuffer, m_idSlotCount);
+	}
+
+	b2RestoreGrowableBuffer(reader, &m_proxyBuffer);
+	b2RestoreGrowableBuffer(reader, &m_contactBuffer);
+	b2RestoreGrowableBuffer(reader, &m_pairBuffer);
+	b2RestoreGrowableBuffer(reader, &m_triadBuffer);
+
+	m_needsUpdateAllParticleFlags = true;
+	m_needsUpdateAllGroupFlags = true;
 }
 
 int32 b2ParticleSystem::CreateParticle(const b2ParticleDef& def)
@@ -690,6 +1138,10 @@ int32 b2ParticleSystem::CreateParticle(const b2ParticleDef& def)
 	{
 		m_depthBuffer[index] = 0;
 	}
+	if (m_previousPositionBuffer)
+	{
+		m_previousPositionBuffer[index] = def.position;
+	}
 	if (m_colorBuffer.data || !def.color.IsZero())
 	{
 		m_colorBuffer.data = RequestBuffer(m_colorBuffer.data);
@@ -704,6 +1156,10 @@ int32 b2ParticleSystem::CreateParticle(const b2ParticleDef& def)
 	{
 		m_handleIndexBuffer.data[index] = NULL;
 	}
+	if (m_idBuffer)
+	{
+		AllocateParticleId(index);
+	}
 	Proxy& proxy = m_proxyBuffer.Append();
 
 	// If particle lifetimes are enabled or the lifetime is set in the particle
@@ -744,6 +1200,174 @@ int32 b2ParticleSystem::CreateParticle(const b2ParticleDef& def)
 	return index;
 }
 
+int32 b2ParticleSystem::CreateParticles(
+	const b2ParticleDef& def, const b2Vec2* positions,
+	const b2Vec2* velocities, void* const* userData, int32 count)
+{
+	b2Assert(m_world->IsLocked() == false);
+	if (m_world->IsLocked() || count <= 0)
+	{
+		return 0;
+	}
+
+	if (m_count + count > m_internalAllocatedCapacity)
+	{
+		// Grow once for the whole batch, at least doubling the capacity.
+		int32 capacity = b2Max(m_count + count, b2Max(
+			2 * m_count, b2_minParticleSystemBufferCapacity));
+		ReallocateInternalAllocatedBuffers(capacity);
+	}
+	if (m_count + count > m_internalAllocatedCapacity && m_def.destroyByAge)
+	{
+		// Making room destroys the oldest particles one at a time.
+		b2ParticleDef particleDef = def;
+		for (int32 i = 0; i < count; i++)
+		{
+			particleDef.position = positions[i];
+			if (velocities)
+			{
+				particleDef.velocity = velocities[i];
+			}
+			if (userData)
+			{
+				particleDef.userData = userData[i];
+			}
+			CreateParticle(particleDef);
+		}
+		return count;
+	}
+	count = b2Min(count, m_internalAllocatedCapacity - m_count);
+	if (count <= 0)
+	{
+		return 0;
+	}
+
+	const int32 first = m_count;
+	const int32 end = first + count;
+	m_count = end;
+
+	std::fill(m_flagsBuffer.data + first, m_flagsBuffer.data + end, 0u);
+	SetParticleFlags(first, def.flags);
+	std::fill(m_flagsBuffer.data + first, m_flagsBuffer.data + end,
+			  def.flags);
+	if (m_lastBodyContactStepBuffer.data)
+	{
+		std::fill(m_lastBodyContactStepBuffer.data + first,
+				  m_lastBodyContactStepBuffer.data + end, 0);
+	}
+	if (m_bodyContactCountBuffer.data)
+	{
+		std::fill(m_bodyContactCountBuffer.data + first,
+				  m_bodyContactCountBuffer.data + end, 0);
+	}
+	if (m_consecutiveContactStepsBuffer.data)
+	{
+		std::fill(m_consecutiveContactStepsBuffer.data + first,
+				  m_consecutiveContactStepsBuffer.data + end, 0);
+	}
+	memcpy(m_positionBuffer.data + first, positions, sizeof(b2Vec2) * count);
+	if (velocities)
+	{
+		memcpy(m_velocityBuffer.data + first, velocities,
+			   sizeof(b2Vec2) * count);
+	}
+	else
+	{
+		std::fill(m_velocityBuffer.data + first, m_velocityBuffer.data + end,
+				  def.velocity);
+	}
+	std::fill(m_weightBuffer + first, m_weightBuffer + end, 0.0f);
+	std::fill(m_forceBuffer + first, m_forceBuffer + end, b2Vec2_zero);
+	if (m_staticPressureBuffer)
+	{
+		std::fill(m_staticPressureBuffer + first,
+				  m_staticPressureBuffer + end, 0.0f);
+	}
+	if (m_depthBuffer)
+	{
+		std::fill(m_depthBuffer + first, m_depthBuffer + end, 0.0f);
+	}
+	if (m_previousPositionBuffer)
+	{
+		memcpy(m_previousPositionBuffer + first, positions,
+			   sizeof(b2Vec2) * count);
+	}
+	if (m_colorBuffer.data || !def.color.IsZero())
+	{
+		m_colorBuffer.data = RequestBuffer(m_colorBuffer.data);
+		std::fill(m_colorBuffer.data + first, m_colorBuffer.data + end,
+				  def.color);
+	}
+	if (m_userDataBuffer.data || userData || def.userData)
+	{
+		m_userDataBuffer.data = RequestBuffer(m_userDataBuffer.data);
+		if (userData)
+		{
+			memcpy(m_userDataBuffer.data + first, userData,
+				   sizeof(void*) * count);
+		}
+		else
+		{
+			std::fill(m_userDataBuffer.data + first,
+					  m_userDataBuffer.data + end, def.userData);
+		}
+	}
+	if (m_handleIndexBuffer.data)
+	{
+		std::fill(m_handleIndexBuffer.data + first,
+				  m_handleIndexBuffer.data + end,
+				  (b2ParticleHandle*)NULL);
+	}
+	if (m_idBuffer)
+	{
+		for (int32 i = first; i < end; i++)
+		{
+			AllocateParticleId(i);
+		}
+	}
+	const int32 proxyCount = m_proxyBuffer.GetCount() + count;
+	if (proxyCount > m_proxyBuffer.GetCapacity())
+	{
+		m_proxyBuffer.Reserve(b2Max(proxyCount,
+									2 * m_proxyBuffer.GetCapacity()));
+	}
+	for (int32 i = first; i < end; i++)
+	{
+		m_proxyBuffer.Append().index = i;
+	}
+
+	const bool finiteLifetime = def.lifetime > 0;
+	if (m_expirationTimeBuffer.data || finiteLifetime)
+	{
+		const float32 lifetime = finiteLifetime ? def.lifetime :
+			ExpirationTimeToLifetime(-GetQuantizedTimeElapsed());
+		for (int32 i = first; i < end; i++)
+		{
+			SetParticleLifetime(i, lifetime);
+			m_indexByExpirationTimeBuffer.data[i] = i;
+		}
+	}
+
+	// Move the whole batch next to its group with a single rotation.
+	b2ParticleGroup* group = def.group;
+	std::fill(m_groupBuffer + first, m_groupBuffer + end, group);
+	if (group)
+	{
+		if (group->m_firstIndex < group->m_lastIndex)
+		{
+			RotateBuffer(group->m_firstIndex, group->m_lastIndex, first);
+			b2Assert(group->m_lastIndex == first);
+			group->m_lastIndex = end;
+		}
+		else
+		{
+			group->m_firstIndex = first;
+			group->m_lastIndex = end;
+		}
+	}
+	return count;
+}
+
 /// Retrieve a handle to the particle at the specified index.
 const b2ParticleHandle* b2ParticleSystem::GetParticleHandleFromIndex(
 	const int32 index)
@@ -764,6 +1388,153 @@ const b2ParticleHandle* b2ParticleSystem::GetParticleHandleFromIndex(
 	return handle;
 }
 
+void b2ParticleSystem::AllocateParticleId(int32 index)
+{
+	int32 slot = m_freeIdSlot;
+	if (slot != b2_invalidParticleIndex)
+	{
+		m_freeIdSlot = m_idSlotBuffer[slot].index;
+	}
+	else if (m_idSlotCount < b2_particleIdSlotCount)
+	{
+		slot = m_idSlotCount++;
+		b2Assert(slot < m_idSlotCapacity);
+		m_idSlotBuffer[slot].generation = 0;
+	}
+	else
+	{
+		// Every id is in use. This only happens when ids start being
+		// tracked with more particles than ids, as the particle capacity
+		// is limited to the number of ids from then on.
+		m_idBuffer[index] = b2_invalidParticleIndex;
+		return;
+	}
+	m_idSlotBuffer[slot].index = index;
+	m_idBuffer[index] =
+		(m_idSlotBuffer[slot].generation << b2_particleIdSlotBits) | slot;
+	b2Assert(m_idBuffer[index] < (1 << 24));
+}
+
+void b2ParticleSystem::FreeParticleId(int32 index)
+{
+	if (m_idBuffer[index] == b2_invalidParticleIndex)
+	{
+		return;
+	}
+	const int32 slot = m_idBuffer[index] & b2_particleIdSlotMask;
+	IdSlot& entry = m_idSlotBuffer[slot];
+	entry.generation = (entry.generation + 1) & b2_particleIdGenerationMask;
+	entry.index = m_freeIdSlot;
+	m_freeIdSlot = slot;
+}
+
+void b2ParticleSystem::SetIdSlotIndex(int32 id, int32 index)
+{
+	if (id != b2_invalidParticleIndex)
+	{
+		m_idSlotBuffer[id & b2_particleIdSlotMask].index = index;
+	}
+}
+
+int32 b2ParticleSystem::GetParticleId(const int32 index)
+{
+	b2Assert(index >= 0 && index < GetParticleCount());
+	return GetIdBuffer()[index];
+}
+
+const int32* b2ParticleSystem::GetIdBuffer()
+{
+	if (!m_idBuffer)
+	{
+		// Limit the capacity to the number of ids, see
+		// ReallocateInternalAllocatedBuffers().
+		if (m_internalAllocatedCapacity > b2_particleIdSlotCount &&
+			m_count <= b2_particleIdSlotCount)
+		{
+			ResizeInternalAllocatedBuffers(b2_particleIdSlotCount);
+		}
+		m_idBuffer = RequestBuffer(m_idBuffer);
+		m_idSlotCount = 0;
+		ResizeIdSlotBuffer(
+			b2Min(m_internalAllocatedCapacity, b2_particleIdSlotCount));
+		m_freeIdSlot = b2_invalidParticleIndex;
+		for (int32 i = 0; i < m_count; i++)
+		{
+			AllocateParticleId(i);
+		}
+	}
+	return m_idBuffer;
+}
+
+int32 b2ParticleSystem::GetParticleIndexFromId(const int32 id) const
+{
+	if (!m_idBuffer || id < 0)
+	{
+		return b2_invalidParticleIndex;
+	}
+	const int32 slot = id & b2_particleIdSlotMask;
+	if (slot >= m_idSlotCount)
+	{
+		return b2_invalidParticleIndex;
+	}
+	// The generation only has a few bits, so the index is checked as well
+	// in case it wrapped around since the id was handed out.
+	const int32 index = m_idSlotBuffer[slot].index;
+	if (index < 0 || index >= m_count || m_idBuffer[index] != id)
+	{
+		return b2_invalidParticleIndex;
+	}
+	return index;
+}
+
+int32 b2ParticleSystem::SetParticlePositionsById(
+	const int32* ids, const b2Vec2* positions, int32 count)
+{
+	int32 updated = 0;
+	for (int32 i = 0; i < count; i++)
+	{
+		const int32 index = GetParticleIndexFromId(ids[i]);
+		if (index != b2_invalidParticleIndex)
+		{
+			m_positionBuffer.data[index] = positions[i];
+			++updated;
+		}
+	}
+	return updated;
+}
+
+int32 b2ParticleSystem::SetParticleVelocitiesById(
+	const int32* ids, const b2Vec2* velocities, int32 count)
+{
+	int32 updated = 0;
+	for (int32 i = 0; i < count; i++)
+	{
+		const int32 index = GetParticleIndexFromId(ids[i]);
+		if (index != b2_invalidParticleIndex)
+		{
+			m_velocityBuffer.data[index] = velocities[i];
+			++updated;
+		}
+	}
+	return updated;
+}
+
+int32 b2ParticleSystem::SetParticleFlagsById(
+	const int32* ids, const uint32* flags, int32 count)
+{
+	int32 updated = 0;
+	for (int32 i = 0; i < count; i++)
+	{
+		const int32 index = GetParticleIndexFromId(ids[i]);
+		if (index != b2_invalidParticleIndex)
+		{
+			SetParticleFlags(index, flags[i]);
+			++updated;
+		}
+	}
+	return updated;
+}
+
 
 void b2ParticleSystem::DestroyParticle(
 	int32 index, bool callDestructionListener)
@@ -1042,13 +1813,51 @@ void b2ParticleSystem::CreateParticlesWithShapesForGroup(
 
 b2ParticleGroup* b2ParticleSystem::CreateParticleGroup(
 	const b2ParticleGroupDef& groupDef)
+{
+	b2ParticleGroup* group = NULL;
+	CreateParticleGroups(&groupDef, 1, &group);
+	return group;
+}
+
+void b2ParticleSystem::CreateParticleGroups(
+	const b2ParticleGroupDef* defs, int32 count, b2ParticleGroup** groups)
 {
 	b2Assert(m_world->IsLocked() == false);
 	if (m_world->IsLocked())
 	{
-		return 0;
+		return;
 	}
 
+	b2ParticleGroup** created =
+		(b2ParticleGroup**) m_world->m_stackAllocator.Allocate(
+			sizeof(b2ParticleGroup*) * count);
+	for (int32 i = 0; i < count; i++)
+	{
+		created[i] = CreateUnconnectedParticleGroup(defs[i]);
+	}
+
+	// Create pairs and triads between particles in each group.
+	ConnectParticleGroups(created, count);
+
+	for (int32 i = 0; i < count; i++)
+	{
+		b2ParticleGroup* group = created[i];
+		if (defs[i].group)
+		{
+			JoinParticleGroups(defs[i].group, group);
+			group = defs[i].group;
+		}
+		if (groups)
+		{
+			groups[i] = group;
+		}
+	}
+	m_world->m_stackAllocator.Free(created);
+}
+
+b2ParticleGroup* b2ParticleSystem::CreateUnconnectedParticleGroup(
+	const b2ParticleGroupDef& groupDef)
+{
 	b2Transform transform;
 	transform.Set(groupDef.position, groupDef.angle);
 	int32 firstIndex = m_count;
@@ -1093,19 +1902,82 @@ b2ParticleGroup* b2ParticleSystem::CreateParticleGroup(
 		m_groupBuffer[i] = group;
 	}
 	SetGroupFlags(group, groupDef.groupFlags);
+	return group;
+}
 
-	// Create pairs and triads between particles in the group.
-	ConnectionFilter filter;
-	UpdateContacts(true);
-	UpdatePairsAndTriads(firstIndex, lastIndex, filter);
+// Orders contacts by the lower of their two particle indices, so that the
+// contacts within a range of particles follow each other.
+class b2ParticleContactLowerIndexCompare
+{
+public:
+	bool operator()(const b2ParticleContact& a,
+					const b2ParticleContact& b) const
+	{
+		return LowerIndex(a) < LowerIndex(b);
+	}
+	bool operator()(const b2ParticleContact& a, int32 index) const
+	{
+		return LowerIndex(a) < index;
+	}
 
-	if (groupDef.group)
+private:
+	static int32 LowerIndex(const b2ParticleContact& contact)
 	{
-		JoinParticleGroups(groupDef.group, group);
-		group = groupDef.group;
+		return b2Min(contact.GetIndexA(), contact.GetIndexB());
 	}
+};
 
-	return group;
+void b2ParticleSystem::ConnectParticleGroups(
+	b2ParticleGroup* const* groups, int32 count)
+{
+	// The groups were created one after the other, so their particles are
+	// one range, which has the contacts of all of them.
+	int32 firstIndex = m_count;
+	int32 lastIndex = 0;
+	for (int32 i = 0; i < count; i++)
+	{
+		if (groups[i]->m_firstIndex < groups[i]->m_lastIndex)
+		{
+			firstIndex = b2Min(firstIndex, groups[i]->m_firstIndex);
+			lastIndex = b2Max(lastIndex, groups[i]->m_lastIndex);
+		}
+	}
+	if (firstIndex >= lastIndex)
+	{
+		return;
+	}
+
+	b2GrowableBuffer<b2ParticleContact> contacts(m_world->m_blockAllocator);
+	FindContactsInRange(firstIndex, lastIndex, contacts);
+	b2ParticleContactLowerIndexCompare compare;
+	if (count > 1)
+	{
+		std::sort(contacts.Begin(), contacts.End(), compare);
+	}
+
+	// The pairs and triads of all groups are sorted together at the end.
+	int32 oldPairCount = m_pairBuffer.GetCount();
+	int32 oldTriadCount = m_triadBuffer.GetCount();
+	ConnectionFilter filter;
+	for (int32 i = 0; i < count; i++)
+	{
+		const b2ParticleGroup* group = groups[i];
+		if (group->m_firstIndex == group->m_lastIndex)
+		{
+			continue;
+		}
+		const b2ParticleContact* begin = contacts.Begin();
+		const b2ParticleContact* end = contacts.End();
+		if (count > 1)
+		{
+			begin = std::lower_bound(begin, end, group->m_firstIndex,
+									 compare);
+			end = std::lower_bound(begin, end, group->m_lastIndex, compare);
+		}
+		AppendPairsAndTriads(group->m_firstIndex, group->m_lastIndex, filter,
+							 begin, int32(end - begin));
+	}
+	SortPairsAndTriads(oldPairCount, oldTriadCount);
 }
 
 void b2ParticleSystem::JoinParticleGroups(b2ParticleGroup* groupA,
@@ -1146,8 +2018,10 @@ void b2ParticleSystem::JoinParticleGroups(b2ParticleGroup* groupA,
 			m_threshold = threshold;
 		}
 	} filter(groupB->m_firstIndex);
-	UpdateContacts(true);
-	UpdatePairsAndTriads(groupA->m_firstIndex, groupB->m_lastIndex, filter);
+	b2GrowableBuffer<b2ParticleContact> contacts(m_world->m_blockAllocator);
+	FindContactsInRange(groupA->m_firstIndex, groupB->m_lastIndex, contacts);
+	UpdatePairsAndTriads(groupA->m_firstIndex, groupB->m_lastIndex, filter,
+						 contacts.Begin(), contacts.GetCount());
 
 	for (int32 i = groupB->m_firstIndex; i < groupB->m_lastIndex; i++)
 	{
@@ -1162,7 +2036,8 @@ void b2ParticleSystem::JoinParticleGroups(b2ParticleGroup* groupA,
 
 void b2ParticleSystem::SplitParticleGroup(b2ParticleGroup* group)
 {
-	UpdateContacts(true);
+	b2GrowableBuffer<b2ParticleContact> contacts(m_world->m_blockAllocator);
+	FindContactsInRange(group->m_firstIndex, group->m_lastIndex, contacts);
 	int32 particleCount = group->GetParticleCount();
 	// We create several linked lists. Each list represents a set of connected
 	// particles.
@@ -1170,7 +2045,7 @@ void b2ParticleSystem::SplitParticleGroup(b2ParticleGroup* group)
 		(ParticleListNode*) m_world->m_stackAllocator.Allocate(
 									sizeof(ParticleListNode) * particleCount);
 	InitializeParticleLists(group, nodeBuffer);
-	MergeParticleListsInContact(group, nodeBuffer);
+	MergeParticleListsInContact(group, nodeBuffer, contacts);
 	ParticleListNode* survivingList =
 									FindLongestParticleList(group, nodeBuffer);
 	MergeZombieParticleListNodes(group, nodeBuffer, survivingList);
@@ -1195,12 +2070,13 @@ void b2ParticleSystem::InitializeParticleLists(
 }
 
 void b2ParticleSystem::MergeParticleListsInContact(
-	const b2ParticleGroup* group, ParticleListNode* nodeBuffer) const
+	const b2ParticleGroup* group, ParticleListNode* nodeBuffer,
+	const b2GrowableBuffer<b2ParticleContact>& contacts)
 {
 	int32 bufferIndex = group->GetBufferIndex();
-	for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+	for (int32 k = 0; k < contacts.GetCount(); k++)
 	{
-		const b2ParticleContact& contact = m_contactBuffer[k];
+		const b2ParticleContact& contact = contacts[k];
 		int32 a = contact.GetIndexA();
 		int32 b = contact.GetIndexB();
 		if (!group->ContainsParticle(a) || !group->ContainsParticle(b)) {
@@ -1397,6 +2273,16 @@ int32 b2ParticleSystem::CloneParticle(int32 oldIndex, b2ParticleGroup* group)
 		m_handleIndexBuffer.data[newIndex] = handle;
 		m_handleIndexBuffer.data[oldIndex] = NULL;
 	}
+	if (m_idBuffer)
+	{
+		// The clone takes over the id, the original is about to be destroyed.
+		const int32 oldId = m_idBuffer[oldIndex];
+		const int32 newId = m_idBuffer[newIndex];
+		m_idBuffer[newIndex] = oldId;
+		m_idBuffer[oldIndex] = newId;
+		SetIdSlotIndex(oldId, newIndex);
+		SetIdSlotIndex(newId, oldIndex);
+	}
 	if (m_lastBodyContactStepBuffer.data)
 	{
 		m_lastBodyContactStepBuffer.data[newIndex] =
@@ -1424,6 +2310,11 @@ int32 b2ParticleSystem::CloneParticle(int32 oldIndex, b2ParticleGroup* group)
 	{
 		m_depthBuffer[newIndex] = m_depthBuffer[oldIndex];
 	}
+	if (m_previousPositionBuffer)
+	{
+		m_previousPositionBuffer[newIndex] =
+			m_previousPositionBuffer[oldIndex];
+	}
 	if (m_expirationTimeBuffer.data)
 	{
 		m_expirationTimeBuffer.data[newIndex] =
@@ -1464,8 +2355,64 @@ static bool ParticleCanBeConnected(
 		(group && group->GetGroupFlags() & b2_rigidParticleGroup);
 }
 
+// Sort a buffer whose elements before middle are usually sorted already,
+// e.g. pairs or triads after appending new ones. The result is the same
+// as sorting all of it.
+template <typename T, typename Compare>
+static void b2SortAppended(T* begin, T* middle, T* end, Compare compare)
+{
+	if (!std::is_sorted(begin, middle, compare))
+	{
+		std::stable_sort(begin, end, compare);
+		return;
+	}
+	std::stable_sort(middle, end, compare);
+	if (begin < middle && middle < end && compare(*middle, *(middle - 1)))
+	{
+		std::inplace_merge(begin, middle, end, compare);
+	}
+}
+
 void b2ParticleSystem::UpdatePairsAndTriads(
 	int32 firstIndex, int32 lastIndex, const ConnectionFilter& filter)
+{
+	UpdatePairsAndTriads(firstIndex, lastIndex, filter,
+						 m_contactBuffer.Begin(), m_contactBuffer.GetCount());
+}
+
+void b2ParticleSystem::UpdatePairsAndTriads(
+	int32 firstIndex, int32 lastIndex, const ConnectionFilter& filter,
+	const b2ParticleContact* contacts, int32 contactCount)
+{
+	int32 oldPairCount = m_pairBuffer.GetCount();
+	int32 oldTriadCount = m_triadBuffer.GetCount();
+	AppendPairsAndTriads(firstIndex, lastIndex, filter, contacts,
+						 contactCount);
+	SortPairsAndTriads(oldPairCount, oldTriadCount);
+}
+
+void b2ParticleSystem::SortPairsAndTriads(
+	int32 oldPairCount, int32 oldTriadCount)
+{
+	if (m_allParticleFlags & k_pairFlags)
+	{
+		b2SortAppended(m_pairBuffer.Begin(),
+					   m_pairBuffer.Begin() + oldPairCount,
+					   m_pairBuffer.End(), ComparePairIndices);
+		m_pairBuffer.Unique(MatchPairIndices);
+	}
+	if (m_allParticleFlags & k_triadFlags)
+	{
+		b2SortAppended(m_triadBuffer.Begin(),
+					   m_triadBuffer.Begin() + oldTriadCount,
+					   m_triadBuffer.End(), CompareTriadIndices);
+		m_triadBuffer.Unique(MatchTriadIndices);
+	}
+}
+
+void b2ParticleSystem::AppendPairsAndTriads(
+	int32 firstIndex, int32 lastIndex, const ConnectionFilter& filter,
+	const b2ParticleContact* contacts, int32 contactCount)
 {
 	// Create pairs or triads.
 	// All particles in each pair/triad should satisfy the following:
@@ -1484,9 +2431,9 @@ void b2ParticleSystem::UpdatePairsAndTriads(
 	}
 	if (particleFlags & k_pairFlags)
 	{
-		for (int32 k = 0; k < m_contactBuffer.GetCount(); k++)
+		for (int32 k = 0; k < contactCount; k++)
 		{
-			const b2ParticleContact& contact = m_contactBuffer[k];
+			const b2ParticleContact& contact = contacts[k];
 			int32 a = contact.GetIndexA();
 			int32 b = contact.GetIndexB();
 			uint32 af = m_flagsBuffer.data[a];
@@ -1502,9 +2449,12 @@ void b2ParticleSystem::UpdatePairsAndTriads(
 				ParticleCanBeConnected(bf, groupB) &&
 				filter.ShouldCreatePair(a, b))
 			{
+				// Contacts are oriented by proxy order. Pairs put the lower
+				// index first, so that they sort and match the same way
+				// whichever search found them.
 				b2ParticlePair& pair = m_pairBuffer.Append();
-				pair.indexA = a;
-				pair.indexB = b;
+				pair.indexA = b2Min(a, b);
+				pair.indexB = b2Max(a, b);
 				pair.flags = contact.GetFlags();
 				pair.strength = b2Min(
 					groupA ? groupA->m_strength : 1,
@@ -1513,9 +2463,6 @@ void b2ParticleSystem::UpdatePairsAndTriads(
 										   m_positionBuffer.data[b]);
 			}
 		}
-		std::stable_sort(
-			m_pairBuffer.Begin(), m_pairBuffer.End(), ComparePairIndices);
-		m_pairBuffer.Unique(MatchPairIndices);
 	}
 	if (particleFlags & k_triadFlags)
 	{
@@ -1591,9 +2538,6 @@ void b2ParticleSystem::UpdatePairsAndTriads(
 			}
 		} callback(this, &filter);
 		diagram.GetNodes(callback);
-		std::stable_sort(
-			m_triadBuffer.Begin(), m_triadBuffer.End(), CompareTriadIndices);
-		m_triadBuffer.Unique(MatchTriadIndices);
 	}
 }
 
@@ -1824,12 +2768,18 @@ inline void b2ParticleSystem::AddContact(int32 a, int32 b,
 	}
 }
 
-void b2ParticleSystem::FindContacts_Reference(
+int32 b2ParticleSystem::FindContacts_Reference(
 	b2GrowableBuffer<b2ParticleContact>& contacts) const
 {
-	const Proxy* beginProxy = m_proxyBuffer.Begin();
-	const Proxy* endProxy = m_proxyBuffer.End();
+	return FindContactsBetweenProxies(m_proxyBuffer.Begin(),
+									  m_proxyBuffer.End(), contacts);
+}
 
+int32 b2ParticleSystem::FindContactsBetweenProxies(
+	const Proxy* beginProxy, const Proxy* endProxy,
+	b2GrowableBuffer<b2ParticleContact>& contacts) const
+{
+	int32 checkCount = 0;
 	contacts.SetCount(0);
 	for (const Proxy *a = beginProxy, *c = beginProxy; a < endProxy; a++)
 	{
@@ -1838,6 +2788,7 @@ void b2ParticleSystem::FindContacts_Reference(
 		{
 			if (rightTag < b->tag) break;
 			AddContact(a->index, b->index, contacts);
+			++checkCount;
 		}
 		uint32 bottomLeftTag = computeRelativeTag(a->tag, -1, 1);
 		for (; c < endProxy; c++)
@@ -1849,8 +2800,10 @@ void b2ParticleSystem::FindContacts_Reference(
 		{
 			if (bottomRightTag < b->tag) break;
 			AddContact(a->index, b->index, contacts);
+			++checkCount;
 		}
 	}
+	return checkCount;
 }
 
 // Put the positions and indices in proxy-order. This allows us to process
@@ -1948,7 +2901,7 @@ void b2ParticleSystem::GatherChecks(
 }
 
 #if defined(LIQUIDFUN_SIMD_NEON)
-void b2ParticleSystem::FindContacts_Simd(
+int32 b2ParticleSystem::FindContacts_Simd(
 	b2GrowableBuffer<b2ParticleContact>& contacts) const
 {
 	contacts.SetCount(0);
@@ -1978,17 +2931,20 @@ void b2ParticleSystem::FindContacts_Simd(
 								m_flagsBuffer.data, contacts);
 
 	m_world->m_stackAllocator.Free(reordered);
+
+	// Each check compares a particle against NUM_V32_SLOTS others.
+	return checks.GetCount() * NUM_V32_SLOTS;
 }
 #endif // defined(LIQUIDFUN_SIMD_NEON)
 
 LIQUIDFUN_SIMD_INLINE
-void b2ParticleSystem::FindContacts(
+int32 b2ParticleSystem::FindContacts(
 	b2GrowableBuffer<b2ParticleContact>& contacts) const
 {
 	#if defined(LIQUIDFUN_SIMD_NEON)
-		FindContacts_Simd(contacts);
+		const int32 checkCount = FindContacts_Simd(contacts);
 	#else
-		FindContacts_Reference(contacts);
+		const int32 checkCount = FindContacts_Reference(contacts);
 	#endif
 
 	#if defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
@@ -2002,6 +2958,8 @@ void b2ParticleSystem::FindContacts(
 			b2Assert(contacts[i].ApproximatelyEqual(reference[i]));
 		}
 	#endif // defined(LIQUIDFUN_SIMD_TEST_VS_REFERENCE)
+
+	return checkCount;
 }
 
 static inline bool b2ParticleContactIsZombie(const b2ParticleContact& contact)
@@ -2258,13 +3216,25 @@ void b2ParticleSystem::NotifyContactListenerPostContact(
 
 void b2ParticleSystem::UpdateContacts(bool exceptZombie)
 {
-	UpdateProxies(m_proxyBuffer);
-	SortProxies(m_proxyBuffer);
+	{
+		B2_TRACE_SCOPE("b2ParticleSystem::UpdateProxies");
+		b2Timer timer;
+		UpdateProxies(m_proxyBuffer);
+		m_profile.updateProxies += timer.GetMilliseconds();
+	}
+	{
+		B2_TRACE_SCOPE("b2ParticleSystem::SortProxies");
+		b2Timer timer;
+		SortProxies(m_proxyBuffer);
+		m_profile.sortProxies += timer.GetMilliseconds();
+	}
 
+	B2_TRACE_SCOPE("b2ParticleSystem::FindContacts");
+	b2Timer timer;
 	b2ParticlePairSet particlePairs(&m_world->m_stackAllocator);
 	NotifyContactListenerPreContact(&particlePairs);
 
-	FindContacts(m_contactBuffer);
+	m_profile.checkCount += FindContacts(m_contactBuffer);
 	FilterContacts(m_contactBuffer);
 
 	NotifyContactListenerPostContact(particlePairs);
@@ -2273,6 +3243,79 @@ void b2ParticleSystem::UpdateContacts(bool exceptZombie)
 	{
 		m_contactBuffer.RemoveIf(b2ParticleContactIsZombie);
 	}
+	m_profile.contactCount += m_contactBuffer.GetCount();
+	m_profile.findContacts += timer.GetMilliseconds();
+}
+
+// Find the contacts between the particles in [firstIndex, lastIndex),
+// leaving out zombies, without searching the rest of the system. The
+// contacts of the last step stay as they are.
+void b2ParticleSystem::FindContactsInRange(
+	int32 firstIndex, int32 lastIndex,
+	b2GrowableBuffer<b2ParticleContact>& contacts)
+{
+	b2Assert(0 <= firstIndex && firstIndex <= lastIndex &&
+			 lastIndex <= m_count);
+	const int32 rangeCount = lastIndex - firstIndex;
+	Proxy* beginProxy = m_proxyBuffer.Begin();
+	Proxy* endProxy = m_proxyBuffer.End();
+	Proxy* tailProxy = endProxy - rangeCount;
+	bool isTail = lastIndex == m_count;
+	for (int32 i = 0; isTail && i < rangeCount; i++)
+	{
+		isTail = tailProxy[i].index == firstIndex + i;
+	}
+
+	if (isTail)
+	{
+		// Particles created since the last step have their proxies at the
+		// end of the buffer, in order. Tagging and sorting them finds their
+		// contacts, and merging them into the others lets queries find the
+		// new particles before the next step.
+		for (Proxy* proxy = tailProxy; proxy < endProxy; ++proxy)
+		{
+			const b2Vec2& p = m_positionBuffer.data[proxy->index];
+			proxy->tag = computeTag(m_inverseDiameter * p.x,
+									m_inverseDiameter * p.y);
+		}
+		std::sort(tailProxy, endProxy);
+		FindContactsBetweenProxies(tailProxy, endProxy, contacts);
+		contacts.RemoveIf(b2ParticleContactIsZombie);
+		if (!std::is_sorted(beginProxy, tailProxy))
+		{
+			// Proxies appended by CreateParticle have no tags yet.
+			UpdateProxies(m_proxyBuffer);
+			SortProxies(m_proxyBuffer);
+		}
+		else if (beginProxy < tailProxy && tailProxy < endProxy &&
+				 *tailProxy < *(tailProxy - 1))
+		{
+			std::inplace_merge(beginProxy, tailProxy, endProxy);
+		}
+	}
+	else
+	{
+		// Particles elsewhere in the buffers get proxies of their own.
+		Proxy* proxies = (Proxy*) m_world->m_stackAllocator.Allocate(
+			sizeof(Proxy) * rangeCount);
+		int32 proxyCount = 0;
+		for (int32 i = firstIndex; i < lastIndex; i++)
+		{
+			if (m_flagsBuffer.data[i] & b2_zombieParticle)
+			{
+				continue;
+			}
+			const b2Vec2& p = m_positionBuffer.data[i];
+			Proxy& proxy = proxies[proxyCount++];
+			proxy.index = i;
+			proxy.tag = computeTag(m_inverseDiameter * p.x,
+								   m_inverseDiameter * p.y);
+		}
+		std::sort(proxies, proxies + proxyCount);
+		FindContactsBetweenProxies(proxies, proxies + proxyCount, contacts);
+		m_world->m_stackAllocator.Free(proxies);
+	}
+	FilterContacts(contacts);
 }
 
 void b2ParticleSystem::DetectStuckParticle(int32 particle)
@@ -2515,23 +3558,31 @@ private:
 	// Receive a fixture and call ReportFixtureAndParticle() for each particle
 	// inside aabb of the fixture.
 	bool ReportFixture(b2Fixture* fixture)
+	{
+		int32 childCount = fixture->GetShape()->GetChildCount();
+		for (int32 childIndex = 0; childIndex < childCount; childIndex++)
+		{
+			ReportFixtureChild(fixture, childIndex);
+		}
+		return true;
+	}
+
+	// Receive a child of a fixture and call ReportFixtureAndParticle() for
+	// each particle inside its aabb. The world reports every child in the
+	// query on its own, so a chain is not visited once per edge.
+	bool ReportFixtureChild(b2Fixture* fixture, int32 childIndex)
 	{
 		if (fixture->IsSensor())
 		{
 			return true;
 		}
-		const b2Shape* shape = fixture->GetShape();
-		int32 childCount = shape->GetChildCount();
-		for (int32 childIndex = 0; childIndex < childCount; childIndex++)
+		b2AABB aabb = fixture->GetAABB(childIndex);
+		b2ParticleSystem::InsideBoundsEnumerator enumerator =
+							m_system->GetInsideBoundsEnumerator(aabb);
+		int32 index;
+		while ((index = enumerator.GetNext()) >= 0)
 		{
-			b2AABB aabb = fixture->GetAABB(childIndex);
-			b2ParticleSystem::InsideBoundsEnumerator enumerator =
-								m_system->GetInsideBoundsEnumerator(aabb);
-			int32 index;
-			while ((index = enumerator.GetNext()) >= 0)
-			{
-				ReportFixtureAndParticle(fixture, childIndex, index);
-			}
+			ReportFixtureAndParticle(fixture, childIndex, index);
 		}
 		return true;
 	}
@@ -2832,6 +3883,64 @@ void b2ParticleSystem::SolveCollision(const b2TimeStep& step)
 	m_world->QueryAABB(&callback, aabb);
 }
 
+// What SolveDistanceFieldTask needs of SolveDistanceField.
+struct b2DistanceFieldSolveContext
+{
+	b2ParticleSystem* system;
+	b2TimeStep step;
+};
+
+void b2ParticleSystem::SolveDistanceField(const b2TimeStep& step)
+{
+	// Small systems are not worth waking the workers for.
+	static const int32 k_minParticlesPerRange = 256;
+
+	// Each particle only reads the field and writes its own velocity, so
+	// the particles can be split across threads freely.
+	b2DistanceFieldSolveContext context;
+	context.system = this;
+	context.step = step;
+	b2ThreadPool* threadPool = m_world->GetThreadPool();
+	if (threadPool)
+	{
+		threadPool->ParallelFor(m_count, k_minParticlesPerRange,
+								SolveDistanceFieldTask, &context);
+	}
+	else
+	{
+		SolveDistanceFieldTask(0, m_count, 0, &context);
+	}
+}
+
+void b2ParticleSystem::SolveDistanceFieldTask(
+	int32 begin, int32 end, int32 rangeIndex, void* context)
+{
+	B2_NOT_USED(rangeIndex);
+	const b2DistanceFieldSolveContext* solve =
+		(const b2DistanceFieldSolveContext*)context;
+	const b2TimeStep& step = solve->step;
+	// Like SolveCollision, but against the distance field: particles that
+	// would end up inside the obstacle are moved to just in front of its
+	// surface instead, by one Newton step along the gradient. Particles
+	// deep inside it, where the distance is clamped and has no gradient,
+	// move freely until they reach the band around the surface.
+	const b2DistanceField* field = solve->system->m_distanceField;
+	const b2Vec2* positions = solve->system->m_positionBuffer.data;
+	b2Vec2* velocities = solve->system->m_velocityBuffer.data;
+	for (int32 i = begin; i < end; i++)
+	{
+		b2Vec2 p = positions[i] + step.dt * velocities[i];
+		b2Vec2 gradient;
+		const float32 distance = field->GetDistance(p, &gradient);
+		const float32 length2 = gradient.LengthSquared();
+		if (distance < b2_linearSlop && length2 > b2_epsilon)
+		{
+			p += ((b2_linearSlop - distance) / length2) * gradient;
+			velocities[i] = step.inv_dt * (p - positions[i]);
+		}
+	}
+}
+
 void b2ParticleSystem::SolveBarrier(const b2TimeStep& step)
 {
 	// If a particle is passing between paired barrier particles,
@@ -2953,18 +4062,27 @@ void b2ParticleSystem::SolveBarrier(const b2TimeStep& step)
 
 void b2ParticleSystem::Solve(const b2TimeStep& step)
 {
+	memset(&m_profile, 0, sizeof(m_profile));
 	if (m_count == 0)
 	{
 		return;
 	}
+	B2_TRACE_SCOPE("b2ParticleSystem::Solve");
+	b2Timer totalTimer;
 	// If particle lifetimes are enabled, destroy particles that are too old.
 	if (m_expirationTimeBuffer.data)
 	{
+		B2_TRACE_SCOPE("b2ParticleSystem::SolveLifetimes");
+		b2Timer timer;
 		SolveLifetimes(step);
+		m_profile.solveLifetimes += timer.GetMilliseconds();
 	}
 	if (m_allParticleFlags & b2_zombieParticle)
 	{
+		B2_TRACE_SCOPE("b2ParticleSystem::SolveZombie");
+		b2Timer timer;
 		SolveZombie();
+		m_profile.solveZombie += timer.GetMilliseconds();
 	}
 	if (m_needsUpdateAllParticleFlags)
 	{
@@ -2974,8 +4092,14 @@ void b2ParticleSystem::Solve(const b2TimeStep& step)
 	{
 		UpdateAllGroupFlags();
 	}
+	if (m_previousPositionBuffer)
+	{
+		memcpy(m_previousPositionBuffer, m_positionBuffer.data,
+			   sizeof(b2Vec2) * m_count);
+	}
 	if (m_paused)
 	{
+		m_profile.total = totalTimer.GetMilliseconds();
 		return;
 	}
 	for (m_iterationIndex = 0;
@@ -2987,92 +4111,190 @@ void b2ParticleSystem::Solve(const b2TimeStep& step)
 		subStep.dt /= step.particleIterations;
 		subStep.inv_dt *= step.particleIterations;
 		UpdateContacts(false);
-		UpdateBodyContacts();
-		ComputeWeight();
+		{
+			B2_TRACE_SCOPE("b2ParticleSystem::UpdateBodyContacts");
+			b2Timer timer;
+			UpdateBodyContacts();
+			m_profile.updateBodyContacts += timer.GetMilliseconds();
+			m_profile.bodyContactCount += m_bodyContactBuffer.GetCount();
+		}
+		{
+			B2_TRACE_SCOPE("b2ParticleSystem::ComputeWeight");
+			b2Timer timer;
+			ComputeWeight();
+			m_profile.computeWeight += timer.GetMilliseconds();
+		}
 		if (m_allGroupFlags & b2_particleGroupNeedsUpdateDepth)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::ComputeDepth");
+			b2Timer timer;
 			ComputeDepth();
+			m_profile.computeDepth += timer.GetMilliseconds();
 		}
 		if (m_allParticleFlags & b2_reactiveParticle)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::UpdatePairsAndTriadsWithReactiveParticles");
+			b2Timer timer;
 			UpdatePairsAndTriadsWithReactiveParticles();
+			m_profile.updatePairsAndTriads += timer.GetMilliseconds();
 		}
 		if (m_hasForce)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveForce");
+			b2Timer timer;
 			SolveForce(subStep);
+			m_profile.solveForce += timer.GetMilliseconds();
 		}
 		if (m_allParticleFlags & b2_viscousParticle)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveViscous");
+			b2Timer timer;
 			SolveViscous();
+			m_profile.solveViscous += timer.GetMilliseconds();
 		}
 		if (m_allParticleFlags & b2_repulsiveParticle)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveRepulsive");
+			b2Timer timer;
 			SolveRepulsive(subStep);
+			m_profile.solveRepulsive += timer.GetMilliseconds();
 		}
 		if (m_allParticleFlags & b2_powderParticle)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolvePowder");
+			b2Timer timer;
 			SolvePowder(subStep);
+			m_profile.solvePowder += timer.GetMilliseconds();
 		}
 		if (m_allParticleFlags & b2_tensileParticle)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveTensile");
+			b2Timer timer;
 			SolveTensile(subStep);
+			m_profile.solveTensile += timer.GetMilliseconds();
 		}
 		if (m_allGroupFlags & b2_solidParticleGroup)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveSolid");
+			b2Timer timer;
 			SolveSolid(subStep);
+			m_profile.solveSolid += timer.GetMilliseconds();
 		}
-		if (m_allParticleFlags & b2_colorMixingParticle)
+		if ((m_allParticleFlags & b2_colorMixingParticle) && step.colorMixing)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveColorMixing");
+			b2Timer timer;
 			SolveColorMixing();
+			m_profile.solveColorMixing += timer.GetMilliseconds();
+		}
+		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveGravity");
+			b2Timer timer;
+			SolveGravity(subStep);
+			m_profile.solveGravity += timer.GetMilliseconds();
 		}
-		SolveGravity(subStep);
 		if (m_allParticleFlags & b2_staticPressureParticle)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveStaticPressure");
+			b2Timer timer;
 			SolveStaticPressure(subStep);
+			m_profile.solveStaticPressure += timer.GetMilliseconds();
+		}
+		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolvePressure");
+			b2Timer timer;
+			SolvePressure(subStep);
+			m_profile.solvePressure += timer.GetMilliseconds();
 		}
-		SolvePressure(subStep);
-		SolveDamping(subStep);
-		if (m_allParticleFlags & k_extraDampingFlags)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveDamping");
+			b2Timer timer;
+			SolveDamping(subStep);
+			m_profile.solveDamping += timer.GetMilliseconds();
+		}
+		if ((m_allParticleFlags & k_extraDampingFlags) && step.extraDamping)
+		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveExtraDamping");
+			b2Timer timer;
 			SolveExtraDamping();
+			m_profile.solveExtraDamping += timer.GetMilliseconds();
 		}
 		// SolveElastic and SolveSpring refer the current velocities for
 		// numerical stability, they should be called as late as possible.
 		if (m_allParticleFlags & b2_elasticParticle)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveElastic");
+			b2Timer timer;
 			SolveElastic(subStep);
+			m_profile.solveElastic += timer.GetMilliseconds();
 		}
 		if (m_allParticleFlags & b2_springParticle)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveSpring");
+			b2Timer timer;
 			SolveSpring(subStep);
+			m_profile.solveSpring += timer.GetMilliseconds();
+		}
+		{
+			B2_TRACE_SCOPE("b2ParticleSystem::LimitVelocity");
+			b2Timer timer;
+			LimitVelocity(subStep);
+			m_profile.limitVelocity += timer.GetMilliseconds();
 		}
-		LimitVelocity(subStep);
 		if (m_allGroupFlags & b2_rigidParticleGroup)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveRigidDamping");
+			b2Timer timer;
 			SolveRigidDamping();
+			m_profile.solveRigidDamping += timer.GetMilliseconds();
 		}
 		if (m_allParticleFlags & b2_barrierParticle)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveBarrier");
+			b2Timer timer;
 			SolveBarrier(subStep);
+			m_profile.solveBarrier += timer.GetMilliseconds();
 		}
 		// SolveCollision, SolveRigid and SolveWall should be called after
 		// other force functions because they may require particles to have
 		// specific velocities.
-		SolveCollision(subStep);
+		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveCollision");
+			b2Timer timer;
+			SolveCollision(subStep);
+			m_profile.solveCollision += timer.GetMilliseconds();
+		}
+		if (m_distanceField)
+		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveDistanceField");
+			b2Timer timer;
+			SolveDistanceField(subStep);
+			m_profile.solveDistanceField += timer.GetMilliseconds();
+		}
 		if (m_allGroupFlags & b2_rigidParticleGroup)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveRigid");
+			b2Timer timer;
 			SolveRigid(subStep);
+			m_profile.solveRigid += timer.GetMilliseconds();
 		}
 		if (m_allParticleFlags & b2_wallParticle)
 		{
+			B2_TRACE_SCOPE("b2ParticleSystem::SolveWall");
+			b2Timer timer;
 			SolveWall();
+			m_profile.solveWall += timer.GetMilliseconds();
 		}
 		// The particle positions can be updated only at the end of substep.
+		B2_TRACE_SCOPE("b2ParticleSystem::Integrate");
+		b2Timer timer;
 		for (int32 i = 0; i < m_count; i++)
 		{
 			m_positionBuffer.data[i] += subStep.dt * m_velocityBuffer.data[i];
 		}
+		m_profile.integrate += timer.GetMilliseconds();
 	}
+	m_profile.total = totalTimer.GetMilliseconds();
 }
 
 void b2ParticleSystem::UpdateAllParticleFlags()
@@ -3806,6 +5028,10 @@ void b2ParticleSystem::SolveZombie()
 					m_handleAllocator.Free(handle);
 				}
 			}
+			if (m_idBuffer)
+			{
+				FreeParticleId(i);
+			}
 			newIndices[i] = b2_invalidParticleIndex;
 		}
 		else
@@ -3821,6 +5047,12 @@ void b2ParticleSystem::SolveZombie()
 					if (handle) handle->SetIndex(newCount);
 					m_handleIndexBuffer.data[newCount] = handle;
 				}
+				if (m_idBuffer)
+				{
+					const int32 id = m_idBuffer[i];
+					m_idBuffer[newCount] = id;
+					SetIdSlotIndex(id, newCount);
+				}
 				m_flagsBuffer.data[newCount] = m_flagsBuffer.data[i];
 				if (m_lastBodyContactStepBuffer.data)
 				{
@@ -3853,6 +5085,11 @@ void b2ParticleSystem::SolveZombie()
 				{
 					m_depthBuffer[newCount] = m_depthBuffer[i];
 				}
+				if (m_previousPositionBuffer)
+				{
+					m_previousPositionBuffer[newCount] =
+						m_previousPositionBuffer[i];
+				}
 				if (m_colorBuffer.data)
 				{
 					m_colorBuffer.data[newCount] = m_colorBuffer.data[i];
@@ -4133,6 +5370,12 @@ void b2ParticleSystem::RotateBuffer(int32 start, int32 mid, int32 end)
 		std::rotate(m_depthBuffer + start, m_depthBuffer + mid,
 					m_depthBuffer + end);
 	}
+	if (m_previousPositionBuffer)
+	{
+		std::rotate(m_previousPositionBuffer + start,
+					m_previousPositionBuffer + mid,
+					m_previousPositionBuffer + end);
+	}
 	if (m_colorBuffer.data)
 	{
 		std::rotate(m_colorBuffer.data + start,
@@ -4157,6 +5400,16 @@ void b2ParticleSystem::RotateBuffer(int32 start, int32 mid, int32 end)
 		}
 	}
 
+	// Update id table indices.
+	if (m_idBuffer)
+	{
+		std::rotate(m_idBuffer + start, m_idBuffer + mid, m_idBuffer + end);
+		for (int32 i = start; i < end; ++i)
+		{
+			SetIdSlotIndex(m_idBuffer[i], i);
+		}
+	}
+
 	if (m_expirationTimeBuffer.data)
 	{
 		std::rotate(m_expirationTimeBuffer.data + start,
@@ -4528,6 +5781,40 @@ void b2ParticleSystem::QueryShapeAABB(b2QueryCallback* callback,
 	QueryAABB(callback, aabb);
 }
 
+// Find the fraction t in [0, maxFraction] of the first intersection of a
+// ray with a particle by solving the following equation:
+// ((1-t)*point1+t*point2-position)^2=diameter^2
+// p is point1 - position and v is point2 - point1.
+static inline bool b2RayCastParticle(const b2Vec2& p, const b2Vec2& v,
+									 float32 v2, float32 squaredDiameter,
+									 float32 maxFraction, float32* fraction)
+{
+	float32 pv = b2Dot(p, v);
+	float32 p2 = b2Dot(p, p);
+	float32 determinant = pv * pv - v2 * (p2 - squaredDiameter);
+	if (determinant < 0)
+	{
+		return false;
+	}
+	float32 sqrtDeterminant = b2Sqrt(determinant);
+	// find a solution between 0 and fraction
+	float32 t = (-pv - sqrtDeterminant) / v2;
+	if (t > maxFraction)
+	{
+		return false;
+	}
+	if (t < 0)
+	{
+		t = (-pv + sqrtDeterminant) / v2;
+		if (t < 0 || t > maxFraction)
+		{
+			return false;
+		}
+	}
+	*fraction = t;
+	return true;
+}
+
 void b2ParticleSystem::RayCast(b2RayCastCallback* callback,
 							   const b2Vec2& point1,
 							   const b2Vec2& point2) const
@@ -4540,9 +5827,6 @@ void b2ParticleSystem::RayCast(b2RayCastCallback* callback,
 	aabb.lowerBound = b2Min(point1, point2);
 	aabb.upperBound = b2Max(point1, point2);
 	float32 fraction = 1;
-	// solving the following equation:
-	// ((1-t)*point1+t*point2-position)^2=diameter^2
-	// where t is a potential fraction
 	b2Vec2 v = point2 - point1;
 	float32 v2 = b2Dot(v, v);
 	InsideBoundsEnumerator enumerator = GetInsideBoundsEnumerator(aabb);
@@ -4550,26 +5834,9 @@ void b2ParticleSystem::RayCast(b2RayCastCallback* callback,
 	while ((i = enumerator.GetNext()) >= 0)
 	{
 		b2Vec2 p = point1 - m_positionBuffer.data[i];
-		float32 pv = b2Dot(p, v);
-		float32 p2 = b2Dot(p, p);
-		float32 determinant = pv * pv - v2 * (p2 - m_squaredDiameter);
-		if (determinant >= 0)
-		{
-			float32 sqrtDeterminant = b2Sqrt(determinant);
-			// find a solution between 0 and fraction
-			float32 t = (-pv - sqrtDeterminant) / v2;
-			if (t > fraction)
-			{
-				continue;
-			}
-			if (t < 0)
-			{
-				t = (-pv + sqrtDeterminant) / v2;
-				if (t < 0 || t > fraction)
-				{
-					continue;
-				}
-			}
+		float32 t;
+		if (b2RayCastParticle(p, v, v2, m_squaredDiameter, fraction, &t))
+		{
 			b2Vec2 n = p + t * v;
 			n.Normalize();
 			float32 f = callback->ReportParticle(this, i, point1 + t * v, n, t);
@@ -4582,6 +5849,106 @@ void b2ParticleSystem::RayCast(b2RayCastCallback* callback,
 	}
 }
 
+void b2ParticleSystem::RayCastBatch(const b2Vec2* point1,
+									const b2Vec2* point2, int32 count,
+									b2RayCastHit* hits) const
+{
+	for (int32 i = 0; i < count; ++i)
+	{
+		b2RayCastHit* hit = hits + i;
+		hit->fixture = NULL;
+		hit->particleSystem = NULL;
+		hit->index = b2_invalidParticleIndex;
+		hit->point = point2[i];
+		hit->normal.SetZero();
+		hit->fraction = 1.0f;
+		RayCastClosest(point1[i], point2[i], hit);
+	}
+}
+
+void b2ParticleSystem::RayCastClosest(const b2Vec2& point1,
+									  const b2Vec2& point2,
+									  b2RayCastHit* hit) const
+{
+	if (m_proxyBuffer.GetCount() == 0)
+	{
+		return;
+	}
+	b2Vec2 v = point2 - point1;
+	float32 v2 = b2Dot(v, v);
+	if (v2 <= 0)
+	{
+		return;
+	}
+
+	// The limits of the proxy grid in cells, from the tag layout.
+	const float32 minCell = -(float32)(1 << (xTruncBits - 1));
+	const float32 maxCell = (float32)(1 << (xTruncBits - 1)) - 1;
+
+	// Work in grid cells. A particle can be hit from its own row or from
+	// either neighbouring row, so each row is searched over the part of
+	// the ray within one cell of it.
+	b2Vec2 c1 = m_inverseDiameter * point1;
+	b2Vec2 cv = m_inverseDiameter * v;
+	float32 fraction = hit->fraction;
+	float32 y2 = c1.y + fraction * cv.y;
+	int32 step = cv.y >= 0 ? 1 : -1;
+	int32 firstRow = (int32)b2Clamp(floorf(c1.y) - step, minCell, maxCell);
+	int32 lastRow = (int32)b2Clamp(floorf(y2) + step, minCell, maxCell);
+	const Proxy* beginProxy = m_proxyBuffer.Begin();
+	const Proxy* endProxy = m_proxyBuffer.End();
+	for (int32 row = firstRow; row != lastRow + step; row += step)
+	{
+		// The part of the ray within reach of this row.
+		float32 tEnter = 0;
+		float32 tExit = fraction;
+		if (cv.y != 0)
+		{
+			float32 ta = (row - 1 - c1.y) / cv.y;
+			float32 tb = (row + 2 - c1.y) / cv.y;
+			tEnter = b2Max(b2Min(ta, tb), 0.0f);
+			tExit = b2Min(b2Max(ta, tb), fraction);
+		}
+		if (tEnter > fraction)
+		{
+			// Rows are visited in ray order, so no later row can do better.
+			break;
+		}
+		if (tEnter > tExit)
+		{
+			continue;
+		}
+
+		float32 xa = c1.x + tEnter * cv.x;
+		float32 xb = c1.x + tExit * cv.x;
+		float32 xLower = b2Clamp(b2Min(xa, xb) - 1, minCell, maxCell);
+		float32 xUpper = b2Clamp(b2Max(xa, xb) + 1, minCell, maxCell);
+		const Proxy* firstProxy = std::lower_bound(
+			beginProxy, endProxy, computeTag(xLower, (float32)row));
+		const Proxy* lastProxy = std::upper_bound(
+			firstProxy, endProxy, computeTag(xUpper, (float32)row));
+		for (const Proxy* proxy = firstProxy; proxy < lastProxy; ++proxy)
+		{
+			int32 i = proxy->index;
+			b2Vec2 p = point1 - m_positionBuffer.data[i];
+			float32 t;
+			if (b2RayCastParticle(p, v, v2, m_squaredDiameter, fraction, &t) &&
+				t < fraction)
+			{
+				fraction = t;
+				b2Vec2 n = p + t * v;
+				n.Normalize();
+				hit->fixture = NULL;
+				hit->particleSystem = this;
+				hit->index = i;
+				hit->point = point1 + t * v;
+				hit->normal = n;
+				hit->fraction = t;
+			}
+		}
+	}
+}
+
 float32 b2ParticleSystem::ComputeCollisionEnergy() const
 {
 	float32 sum_v2 = 0;
@@ -36,6 +36,7 @@ class b2Body;
 class b2Shape;
 class b2ParticleGroup;
 class b2BlockAllocator;
+class b2DistanceField;
 class b2StackAllocator;
 class b2QueryCallback;
 class b2RayCastCallback;
@@ -43,12 +44,15 @@ class b2Fixture;
 class b2ContactFilter;
 class b2ContactListener;
 class b2ParticlePairSet;
+class b2SnapshotWriter;
+class b2SnapshotReader;
 class FixtureParticleSet;
 struct b2ParticleGroupDef;
 struct b2Vec2;
 struct b2AABB;
 struct FindContactInput;
 struct FindContactCheck;
+struct b2RayCastHit;
 
 struct b2ParticleContact
 {
@@ -290,10 +294,68 @@ public:
 	/// @return the index of the particle.
 	int32 CreateParticle(const b2ParticleDef& def);
 
+	/// Create count particles at once. They share the properties of def,
+	/// other than those given per particle by positions and, when not NULL,
+	/// velocities and userData. This grows the buffers once and fills them
+	/// in bulk, so it is much cheaper than as many calls to CreateParticle().
+	/// The new particles are contiguous: they end the range of def.group if
+	/// set, or the particle buffers otherwise.
+	/// @warning This function is locked during callbacks.
+	/// @return the number of particles created, which is less than count if
+	/// the maximum particle count is reached.
+	int32 CreateParticles(const b2ParticleDef& def, const b2Vec2* positions,
+						  const b2Vec2* velocities, void* const* userData,
+						  int32 count);
+
 	/// Retrieve a handle to the particle at the specified index.
 	/// Please see #b2ParticleHandle for why you might want a handle.
 	const b2ParticleHandle* GetParticleHandleFromIndex(const int32 index);
 
+	/// Get the persistent id of the particle at the specified index.
+	/// Unlike its index, the id of a particle does not change while the
+	/// particle exists, and unlike a handle it fits in a channel or a
+	/// message. Ids are below 2^24, so they survive a round trip through a
+	/// float32. The first call starts tracking ids, giving one to every
+	/// existing particle.
+	/// At most 2^18 ids are in use at once. While ids are tracked, the
+	/// particle capacity is limited to 2^18 as if by maxCount: once that
+	/// many particles exist, creating more destroys the oldest ones or,
+	/// without destruction by age, CreateParticle() returns
+	/// b2_invalidParticleIndex and CreateParticles() creates fewer
+	/// particles. Only if ids start being tracked with more particles than
+	/// that can particles be left without an id, and they get
+	/// b2_invalidParticleIndex as their id.
+	int32 GetParticleId(const int32 index);
+
+	/// Get the array of particle ids indexed by particle index.
+	/// GetParticleCount() items are in the returned array.
+	/// The first call starts tracking ids, see GetParticleId().
+	const int32* GetIdBuffer();
+
+	/// Get the current index of the particle with the specified id in
+	/// constant time.
+	/// @return the index or b2_invalidParticleIndex if the particle was
+	/// destroyed or ids are not tracked.
+	int32 GetParticleIndexFromId(const int32 id) const;
+
+	/// Set the position of each particle in ids to the matching item of
+	/// positions. Ids of destroyed particles are skipped.
+	/// @return the number of particles that were updated.
+	int32 SetParticlePositionsById(const int32* ids, const b2Vec2* positions,
+								   int32 count);
+
+	/// Set the velocity of each particle in ids to the matching item of
+	/// velocities. Ids of destroyed particles are skipped.
+	/// @return the number of particles that were updated.
+	int32 SetParticleVelocitiesById(const int32* ids,
+									const b2Vec2* velocities, int32 count);
+
+	/// Set the flags of each particle in ids to the matching item of flags,
+	/// as SetParticleFlags() does. Ids of destroyed particles are skipped.
+	/// @return the number of particles that were updated.
+	int32 SetParticleFlagsById(const int32* ids, const uint32* flags,
+							   int32 count);
+
 	/// Destroy a particle.
 	/// The particle is removed after the next simulation step (see
 	/// b2World::Step()).
@@ -352,6 +414,18 @@ public:
 	/// @warning This function is locked during callbacks.
 	b2ParticleGroup* CreateParticleGroup(const b2ParticleGroupDef& def);
 
+	/// Create several particle groups at once. The contacts that connect
+	/// their particles are found in one pass over the new particles, rather
+	/// than one pass over the whole system per group, which makes building
+	/// a scene from many small groups much faster. Groups whose definition
+	/// names a group are joined to it, as with CreateParticleGroup.
+	/// @param defs the group definitions. No reference is retained.
+	/// @param count the number of definitions.
+	/// @param groups receives the group of each definition, or may be NULL.
+	/// @warning This function is locked during callbacks.
+	void CreateParticleGroups(const b2ParticleGroupDef* defs, int32 count,
+							  b2ParticleGroup** groups);
+
 	/// Join two particle groups.
 	/// @param the first group. Expands to encompass the second group.
 	/// @param the second group. It is destroyed.
@@ -379,6 +453,10 @@ public:
 	/// Get the maximum number of particles.
 	int32 GetMaxParticleCount() const;
 
+	/// Get the number of particles the buffers have room for. Creating
+	/// more particles than this reallocates the buffers.
+	int32 GetParticleCapacity() const;
+
 	/// Set the maximum number of particles.
 	/// A value of 0 means there is no maximum. The particle buffers can
 	/// continue to grow while b2World's block allocator still has memory.
@@ -463,6 +541,14 @@ public:
 	b2Vec2* GetVelocityBuffer();
 	const b2Vec2* GetVelocityBuffer() const;
 
+	/// Get the position of each particle before the last step, for
+	/// interpolating between steps. The buffer is allocated by the first
+	/// call and holds the current positions until the next step. Particles
+	/// created since the last step have their current position.
+	/// Array is length GetParticleCount()
+	/// @return the pointer to the head of the previous positions array.
+	const b2Vec2* GetPreviousPositionBuffer();
+
 	/// Get the color of each particle
 	/// Array is length GetParticleCount()
 	/// @return the pointer to the head of the particle colors array.
@@ -576,6 +662,36 @@ public:
 	/// Compute the kinetic energy that can be lost by damping force
 	float32 ComputeCollisionEnergy() const;
 
+	/// Make the particles collide with the obstacle of a signed distance
+	/// field as well as with fixtures, or with none if the field is NULL.
+	/// The field is not copied and may be changed between steps. It is not
+	/// part of snapshots, set it again after restoring one.
+	void SetDistanceField(const b2DistanceField* field);
+
+	/// Get the field the particles collide with, or NULL.
+	const b2DistanceField* GetDistanceField() const;
+
+	/// Get the per-stage timings and counts of the last step.
+	const b2ParticleProfile& GetProfile() const;
+
+	/// Get the memory held by the per-particle buffers this system
+	/// allocated from the world's block allocator.  Buffers supplied by the
+	/// user through the Set*Buffer() functions are not included.
+	b2MemoryUsage GetBufferMemoryUsage() const;
+
+	/// Get the memory held by the proxy, contact, pair, triad and stuck
+	/// particle buffers.
+	b2MemoryUsage GetContactMemoryUsage() const;
+
+	/// Get the memory held by the particle handle slabs.
+	b2MemoryUsage GetHandleMemoryUsage() const;
+
+	/// Shrink the particle, contact and handle buffers to what the current
+	/// particles need, e.g. after a burst of particles has been destroyed.
+	/// Buffers grow again on demand.  This must not be called during a
+	/// step.
+	void Trim();
+
 	/// Set strict Particle/Body contact check.
 	/// This is an option that will help ensure correct behavior if there are
 	/// corners in the world model where Particle/Body contact is ambiguous.
@@ -691,6 +807,16 @@ public:
 	void RayCast(b2RayCastCallback* callback, const b2Vec2& point1,
 				 const b2Vec2& point2) const;
 
+	/// Ray-cast many rays at once and return the closest particle hit of
+	/// each. Each ray walks the rows of the particle proxy grid it crosses,
+	/// nearest first, and stops once no closer hit is possible.
+	/// @param point1 the ray starting points
+	/// @param point2 the ray ending points
+	/// @param count the number of rays
+	/// @param hits receives the closest hit of each ray
+	void RayCastBatch(const b2Vec2* point1, const b2Vec2* point2, int32 count,
+					  b2RayCastHit* hits) const;
+
 	/// Compute the axis-aligned bounding box for all particles contained
 	/// within this particle system.
 	/// @param aabb Returns the axis-aligned bounding box of the system.
@@ -760,6 +886,14 @@ private:
 		int32 userSuppliedCapacity;
 	};
 
+	/// Entry of the id table. While the id is in use, index is the index of
+	/// its particle, otherwise it links to the next free entry.
+	struct IdSlot
+	{
+		int32 index;
+		int32 generation;
+	};
+
 	/// Used for detecting particle contacts
 	struct Proxy
 	{
@@ -879,7 +1013,32 @@ private:
 	/// pool for handle allocation.
 	void ReallocateHandleBuffers(int32 newCapacity);
 
+	/// Give the particle at index a new id.
+	void AllocateParticleId(int32 index);
+	/// Release the id of the particle at index so that its slot may be
+	/// reused.
+	void FreeParticleId(int32 index);
+
 	void ReallocateInternalAllocatedBuffers(int32 capacity);
+	/// Reallocate the internally allocated per-particle buffers to exactly
+	/// capacity elements, which may be smaller than the current capacity.
+	void ResizeInternalAllocatedBuffers(int32 capacity);
+	/// Reallocate the id table to exactly capacity entries.
+	void ResizeIdSlotBuffer(int32 capacity);
+	/// Point the id table entry of id at index, unless the particle has no
+	/// id.
+	void SetIdSlotIndex(int32 id, int32 index);
+	/// Get the size of one element across all allocated per-particle
+	/// buffers that are not user supplied.
+	int32 GetInternalBytesPerParticle() const;
+	/// Write the particles, groups, pairs and triads to a world snapshot.
+	void SaveSnapshot(b2SnapshotWriter* writer) const;
+	/// Read the state written by SaveSnapshot into this empty system.
+	void RestoreSnapshot(b2SnapshotReader* reader);
+	/// Read a buffer written by SaveSnapshot, allocating it if the saved
+	/// system had it.
+	template <typename T> T* RestoreBuffer(b2SnapshotReader* reader,
+										   T* buffer);
 	int32 CreateParticleForGroup(
 		const b2ParticleGroupDef& groupDef,
 		const b2Transform& xf, const b2Vec2& position);
@@ -897,9 +1056,19 @@ private:
 		const b2ParticleGroupDef& groupDef, const b2Transform& xf);
 	int32 CloneParticle(int32 index, b2ParticleGroup* group);
 	void DestroyParticleGroup(b2ParticleGroup* group);
+	b2ParticleGroup* CreateUnconnectedParticleGroup(
+		const b2ParticleGroupDef& groupDef);
+	void ConnectParticleGroups(b2ParticleGroup* const* groups, int32 count);
 
 	void UpdatePairsAndTriads(
 		int32 firstIndex, int32 lastIndex, const ConnectionFilter& filter);
+	void UpdatePairsAndTriads(
+		int32 firstIndex, int32 lastIndex, const ConnectionFilter& filter,
+		const b2ParticleContact* contacts, int32 contactCount);
+	void AppendPairsAndTriads(
+		int32 firstIndex, int32 lastIndex, const ConnectionFilter& filter,
+		const b2ParticleContact* contacts, int32 contactCount);
+	void SortPairsAndTriads(int32 oldPairCount, int32 oldTriadCount);
 	void UpdatePairsAndTriadsWithReactiveParticles();
 	static bool ComparePairIndices(const b2ParticlePair& a, const b2ParticlePair& b);
 	static bool MatchPairIndices(const b2ParticlePair& a, const b2ParticlePair& b);
@@ -908,8 +1077,9 @@ private:
 
 	static void InitializeParticleLists(
 		const b2ParticleGroup* group, ParticleListNode* nodeBuffer);
-	void MergeParticleListsInContact(
-		const b2ParticleGroup* group, ParticleListNode* nodeBuffer) const;
+	static void MergeParticleListsInContact(
+		const b2ParticleGroup* group, ParticleListNode* nodeBuffer,
+		const b2GrowableBuffer<b2ParticleContact>& contacts);
 	static void MergeParticleLists(
 		ParticleListNode* listA, ParticleListNode* listB);
 	static ParticleListNode* FindLongestParticleList(
@@ -929,12 +1099,23 @@ private:
 
 	InsideBoundsEnumerator GetInsideBoundsEnumerator(const b2AABB& aabb) const;
 
+	/// Replace hit with the closest particle hit of the ray if one is closer
+	/// than hit->fraction.
+	void RayCastClosest(const b2Vec2& point1, const b2Vec2& point2,
+						b2RayCastHit* hit) const;
+
 	void UpdateAllParticleFlags();
 	void UpdateAllGroupFlags();
 	void AddContact(int32 a, int32 b,
 		b2GrowableBuffer<b2ParticleContact>& contacts) const;
-	void FindContacts_Reference(
+	int32 FindContacts_Reference(
+		b2GrowableBuffer<b2ParticleContact>& contacts) const;
+	int32 FindContactsBetweenProxies(
+		const Proxy* beginProxy, const Proxy* endProxy,
 		b2GrowableBuffer<b2ParticleContact>& contacts) const;
+	void FindContactsInRange(
+		int32 firstIndex, int32 lastIndex,
+		b2GrowableBuffer<b2ParticleContact>& contacts);
 	void ReorderForFindContact(FindContactInput* reordered,
 		                       int alignedCount) const;
 	void GatherChecksOneParticle(
@@ -944,9 +1125,9 @@ private:
 		int* nextUncheckedIndex,
 		b2GrowableBuffer<FindContactCheck>& checks) const;
 	void GatherChecks(b2GrowableBuffer<FindContactCheck>& checks) const;
-	void FindContacts_Simd(
+	int32 FindContacts_Simd(
 		b2GrowableBuffer<b2ParticleContact>& contacts) const;
-	void FindContacts(
+	int32 FindContacts(
 		b2GrowableBuffer<b2ParticleContact>& contacts) const;
 	static void UpdateProxyTags(
 		const uint32* const tags,
@@ -973,6 +1154,9 @@ private:
 
 	void Solve(const b2TimeStep& step);
 	void SolveCollision(const b2TimeStep& step);
+	void SolveDistanceField(const b2TimeStep& step);
+	static void SolveDistanceFieldTask(int32 begin, int32 end,
+									   int32 rangeIndex, void* context);
 	void LimitVelocity(const b2TimeStep& step);
 	void SolveGravity(const b2TimeStep& step);
 	void SolveBarrier(const b2TimeStep& step);
@@ -1073,6 +1257,8 @@ private:
 	bool m_needsUpdateAllGroupFlags;
 	bool m_hasForce;
 	int32 m_iterationIndex;
+	b2ParticleProfile m_profile;
+	const b2DistanceField* m_distanceField;
 	float32 m_inverseDensity;
 	float32 m_particleDiameter;
 	float32 m_inverseDiameter;
@@ -1080,6 +1266,10 @@ private:
 
 	int32 m_count;
 	int32 m_internalAllocatedCapacity;
+	/// Largest reserved sizes seen before the buffers were last trimmed.
+	int32 m_peakBufferBytes;
+	int32 m_peakContactBytes;
+	int32 m_peakHandleBytes;
 	/// Allocator for b2ParticleHandle instances.
 	b2SlabAllocator<b2ParticleHandle> m_handleAllocator;
 	/// Maps particle indicies to  handles.
@@ -1109,6 +1299,21 @@ private:
 	/// used in SolveSolid(). It will be reallocated on subsequent
 	/// CreateParticle() calls.
 	float32* m_depthBuffer;
+	/// m_previousPositionBuffer is first allocated by
+	/// GetPreviousPositionBuffer() and filled at the start of each Solve().
+	b2Vec2* m_previousPositionBuffer;
+	/// m_idBuffer is first allocated by GetIdBuffer() and maps particle
+	/// indices to ids. m_idSlotBuffer maps the slot part of an id back to
+	/// the index. Slots are reused, their generation telling apart the ids
+	/// of destroyed particles. m_idBuffer is sized by the particle
+	/// capacity. m_idSlotBuffer has m_idSlotCapacity entries, at least the
+	/// particle capacity and the number of slots handed out so far, since
+	/// the table keeps every slot when particles are destroyed.
+	int32* m_idBuffer;
+	IdSlot* m_idSlotBuffer;
+	int32 m_idSlotCapacity;
+	int32 m_idSlotCount;
+	int32 m_freeIdSlot;
 	UserOverridableBuffer<b2ParticleColor> m_colorBuffer;
 	b2ParticleGroup** m_groupBuffer;
 	UserOverridableBuffer<void*> m_userDataBuffer;
@@ -1260,6 +1465,11 @@ inline const b2ParticleSystem* b2ParticleSystem::GetNext() const
 	return m_next;
 }
 
+inline const b2ParticleProfile& b2ParticleSystem::GetProfile() const
+{
+	return m_profile;
+}
+
 inline const int32* b2ParticleSystem::GetStuckCandidates() const
 {
 	return m_stuckParticleBuffer.Data();
@@ -1388,6 +1598,21 @@ inline int32 b2ParticleSystem::GetMaxParticleCount() const
 	return m_def.maxCount;
 }
 
+inline int32 b2ParticleSystem::GetParticleCapacity() const
+{
+	return m_internalAllocatedCapacity;
+}
+
+inline void b2ParticleSystem::SetDistanceField(const b2DistanceField* field)
+{
+	m_distanceField = field;
+}
+
+inline const b2DistanceField* b2ParticleSystem::GetDistanceField() const
+{
+	return m_distanceField;
+}
+
 inline void b2ParticleSystem::SetMaxParticleCount(int32 count)
 {
 	b2Assert(m_count <= count);
@@ -17,6 +17,11 @@
 
 #include <Box2D/Box2D.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <stdint.h>
+#include <stddef.h>
 
 // These functions are basic C function, which the DLL loader can find
 // much easier than finding a C++ Class.
@@ -54,10 +59,62 @@ extern "C"
 
 };
 
-CPlusPlusCHOPExample::CPlusPlusCHOPExample(const OP_NodeInfo* info) : myNodeInfo(info)
+// The output channel groups in output order. The groups of the original
+// fixed layout come first and are on by default, so that their channel
+// indices do not change.
+struct OutputChannelGroup
+{
+	unsigned	flag;
+	const char*	parameter;
+	const char*	label;
+	bool		enabled;
+	int			channelCount;
+	const char*	names[4];
+};
+
+static const OutputChannelGroup k_outputChannelGroups[] =
+{
+	{ k_outputId, "Outid", "Id", true, 1, { "id" } },
+	{ k_outputPosition, "Outposition", "Position", true, 2, { "tx", "ty" } },
+	{ k_outputVelocity, "Outvelocity", "Velocity", true, 2, { "vx", "vy" } },
+	{ k_outputRadius, "Outradius", "Radius", true, 1, { "radius" } },
+	{ k_outputCount, "Outcount", "Count", true, 1, { "count" } },
+	{ k_outputColor, "Outcolor", "Color", false, 4, { "r", "g", "b", "a" } },
+	{ k_outputWeight, "Outweight", "Weight", false, 1, { "weight" } },
+	{ k_outputGroup, "Outgroup", "Group Index", false, 1, { "group" } },
+	{ k_outputLife, "Outlife", "Lifetime", false, 1, { "life" } },
+	{ k_outputContacts, "Outcontacts", "Body Contacts", false, 1,
+	  { "contacts" } },
+	{ k_outputParticleId, "Outpid", "Particle Id", false, 1, { "pid" } },
+};
+
+static const int k_outputChannelGroupCount =
+	int(sizeof(k_outputChannelGroups) / sizeof(k_outputChannelGroups[0]));
+
+static unsigned
+getDefaultOutputMask()
+{
+	unsigned mask = 0;
+	for (int i = 0; i < k_outputChannelGroupCount; i++)
+	{
+		if (k_outputChannelGroups[i].enabled)
+		{
+			mask |= k_outputChannelGroups[i].flag;
+		}
+	}
+	return mask;
+}
+
+CPlusPlusCHOPExample::CPlusPlusCHOPExample(const OP_NodeInfo* info) :
+	myNodeInfo(info),
+	// Define the gravity vector of 0 (no gravity to start)
+	world(b2Vec2(0.0f, 0.0f)),
+	stepper(&world, b2FixedTimeStepperDef()),
+	exportPool(int32(std::max(1u, std::min(4u,
+		std::thread::hardware_concurrency()))))
 {
 	myExecuteCount = 0;
-	myOffset = 0.0;
+	cooked = false;
 
 	reset = 0;
 	spawn = 0;
@@ -78,11 +135,56 @@ CPlusPlusCHOPExample::CPlusPlusCHOPExample(const OP_NodeInfo* info) : myNodeInfo
 	particleSize = 1.0f;
 
 	inNumParts = 0;
+
+	groundBody = NULL;
+	m_particleSystem = NULL;
+	m_pointCount = 0;
+
+	m_outputMask = getDefaultOutputMask();
+	publishMask = m_outputMask;
+
+	// Prepare for simulation. Typically we use a time step of 1/60 of a
+	// second (60Hz) and 10 iterations. This provides a high quality simulation
+	// in most game scenarios.
+	timeStep = 1.0f / 60.0f;
+	velocityIterations = 6;
+	positionIterations = 2;
+	particleIterations = 2;
+
+	distanceField = NULL;
+	colliderConnected = false;
+
+	outlineBody = NULL;
+	chainOutline = NULL;
+	outlinePolylines = NULL;
+	outlineCreated = 0;
+	outlineSent.closed = true;
+
+	wallBodies[0] = NULL;
+	wallBodies[1] = NULL;
+	wallsPlaced = false;
+	wallsSentValid = false;
+
+	stepBudget = 0.0f;
+	stepCount = 0;
+	resetSpawnCount = 0;
+	memset(&stats, 0, sizeof(stats));
+	cookSteps = 0;
+	cookSpawned = 0;
+	cookDestroyed = 0;
+
+	simRunning = false;
+	sharedFrame = 0;
+	backFrame = 1;
+	frontFrame = 2;
 }
 
 CPlusPlusCHOPExample::~CPlusPlusCHOPExample()
 {
-
+	m_stopSimThread();
+	delete distanceField;
+	delete chainOutline;
+	delete outlinePolylines;
 }
 
 void
@@ -100,10 +202,35 @@ bool
 CPlusPlusCHOPExample::getOutputInfo(CHOP_OutputInfo* info)
 {
 	// Specify our own output info
-	info->numChannels = 7;
+	m_outputMask = 0;
+	m_outputNames.clear();
+	for (int i = 0; i < k_outputChannelGroupCount; i++)
+	{
+		const OutputChannelGroup& group = k_outputChannelGroups[i];
+		if (info->opInputs->getParInt(group.parameter))
+		{
+			m_outputMask |= group.flag;
+			m_outputNames.insert(m_outputNames.end(), group.names,
+								 group.names + group.channelCount);
+		}
+	}
+	publishMask.store(m_outputMask, std::memory_order_relaxed);
+	info->numChannels = int(m_outputNames.size());
+
+	// Cook here rather than in execute(), so that the number of samples
+	// announced is the number of particles execute() outputs.
+	m_cook(info->opInputs);
+	cooked = true;
 
 	// Since we are not outputting a timeslice, the system will not dictate
 	// the numSamples and startIndex of the CHOP data, so we have to specify
+	// In async mode pick up the latest frame here, so that execute()
+	// outputs the same number of samples as announced.
+	if (simThread.joinable())
+	{
+		m_acquireFrame();
+		pCount = frames[frontFrame].count;
+	}
 	info->numSamples = pCount; // this might need to change <<<<<<<<<<<<<<
 	info->startIndex = 0;
 
@@ -117,36 +244,28 @@ CPlusPlusCHOPExample::getOutputInfo(CHOP_OutputInfo* info)
 const char*
 CPlusPlusCHOPExample::getChannelName(int32_t index, void* reserved)
 {
-	return "chan1";
+	return m_outputNames[index];
 }
 
 ///////////////////////////////////////////////////////////////////////////
 // %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 // particle stuff initialization
 
-// Define the gravity vector of 0 (no gravity to start)
-b2Vec2 gravity(0.0f, 0.0f);
-// Construct a world object, which will hold and simulate the rigid bodies.
-b2World world(gravity);
-
-
-// Define the ground body.
-b2BodyDef groundBodyDef;
-
-// Call the body factory which allocates memory for the ground body
-// from a pool and creates the ground box shape (also from a pool).
-// The body is also added to the world.
-b2Body* groundBody;
-
-// Define the ground box shape.
-b2PolygonShape groundBox;
-
 void
 CPlusPlusCHOPExample::m_generateGroundPlane()
 {
+	// Define the ground body.
+	b2BodyDef groundBodyDef;
 	groundBodyDef.position.Set(0.0f, -10.0f);
+
+	// Call the body factory which allocates memory for the ground body
+	// from a pool and creates the ground box shape (also from a pool).
+	// The body is also added to the world.
 	groundBody = world.CreateBody(&groundBodyDef);
 
+	// Define the ground box shape.
+	b2PolygonShape groundBox;
+
 	// The extents are the half-widths of the box.
 	groundBox.SetAsBox(200.0f, 10.0f);
 
@@ -154,103 +273,1123 @@ CPlusPlusCHOPExample::m_generateGroundPlane()
 	groundBody->CreateFixture(&groundBox, 0.0f);
 }
 
+// Mark the outline body and the walls, to find them again after a reset.
+static char s_outlineBodyTag;
+static char s_wallBodyTags[2];
+
+void
+CPlusPlusCHOPExample::m_createOutline()
+{
+	// The chains on the body are gone or were never there, so the old
+	// outline has nothing to keep.
+	delete chainOutline;
+	b2ChainOutlineDef outlineDef;
+	outlineDef.body = outlineBody;
+	chainOutline = new b2ChainOutline(outlineDef);
+	m_setOutline(outlinePolylines);
+}
+
+void
+CPlusPlusCHOPExample::m_generateStaticBox(b2Vec2 pos, b2Vec2 size)
+{
+	b2BodyDef bodyDef;
+	b2Body* body;
+	// Define another box shape for our dynamic body.
+	b2PolygonShape staticBox;
+
+	bodyDef.type = b2_staticBody;
+	bodyDef.position.Set(pos.x, pos.y);
+	body = world.CreateBody(&bodyDef);
+	// The extents are the half-widths of the box.
+	staticBox.SetAsBox(size.x, size.y);
+	// Add the box fixture to the box body.
+	body->CreateFixture(&staticBox, 0.0f);
+}
+
+b2Body*
+CPlusPlusCHOPExample::m_generateKinematicBox(b2Vec2 pos, float32 angle,
+											 b2Vec2 size)
+{
+	b2BodyDef bodyDef;
+	bodyDef.type = b2_kinematicBody;
+	bodyDef.position = pos;
+	bodyDef.angle = angle;
+	b2Body* body = world.CreateBody(&bodyDef);
+	// The extents are the half-widths of the box.
+	b2PolygonShape kinematicBox;
+	kinematicBox.SetAsBox(size.x, size.y);
+	body->CreateFixture(&kinematicBox, 0.0f);
+	return body;
+}
+
+void
+CPlusPlusCHOPExample::m_generateDynamicCircle(int eID, b2Vec2 pos, b2Vec2 vel, float size)
+{
+	// Define the dynamic body. We set its position and call the body factory.
+	b2BodyDef bodyDef;
+	bodyDef.type = b2_dynamicBody;
+	bodyDef.position.Set(pos.x, pos.y);
+	bodyDef.linearVelocity.Set(vel.x, vel.y);
+	b2Body* body = world.CreateBody(&bodyDef);
+
+	// Define a circle shape for our dynamic body.
+	b2CircleShape dynamicCircle;
+	dynamicCircle.m_radius = size;
+
+	// Define the dynamic body fixture.
+	b2FixtureDef fixtureDef;
+	fixtureDef.shape = &dynamicCircle;
+
+	// Set the box density to be non-zero, so it will be dynamic.
+	fixtureDef.density = 1.0f;
+
+	// Override the default friction <<< UPDATE???
+	// fixtureDef.friction = 0.3f;
+
+	// The id is stored by value, the command it came with does not last.
+	body->SetUserData((void*)intptr_t(eID));
+
+	// Add the shape to the body.
+	body->CreateFixture(&fixtureDef);
+}
+
+// Samples whose size is within this of the default size of 1 spawn
+// particles, the others spawn circle bodies of that size.
+static const float k_particleSizeTolerance = 1e-3f;
+
+// The channel of a CHOP input, or NULL if the input has fewer channels.
+static const float*
+getInputChannel(const OP_CHOPInput* input, int index)
+{
+	return index < input->numChannels ? input->getChannelData(index) : NULL;
+}
+
+void
+CPlusPlusCHOPExample::m_readSpawnBatch(const OP_CHOPInput* input,
+									   SpawnBatch* batch)
+{
+	// Channels: id, x, y, and optionally vx, vy and size.
+	const float* ids = getInputChannel(input, 0);
+	const float* x = getInputChannel(input, 1);
+	const float* y = getInputChannel(input, 2);
+	const float* vx = getInputChannel(input, 3);
+	const float* vy = getInputChannel(input, 4);
+	const float* sizes = getInputChannel(input, 5);
+	int count = input->numSamples;
+	if (!y || count <= 0)
+	{
+		return;
+	}
+
+	std::vector<b2Vec2>& positions = batch->particlePositions;
+	std::vector<b2Vec2>& velocities = batch->particleVelocities;
+	std::vector<void*>& userData = batch->particleUserData;
+	positions.resize(count);
+	velocities.resize(count);
+	userData.resize(count);
+	b2Interleave(x, y, count, &positions[0]);
+	if (vy)
+	{
+		b2Interleave(vx, vy, count, &velocities[0]);
+	}
+	else
+	{
+		std::fill(velocities.begin(), velocities.end(), b2Vec2_zero);
+	}
+
+	// Move the bodies out, compacting the particles in place. When every
+	// sample is a particle nothing moves.
+	int particleCount = 0;
+	for (int j = 0; j < count; j++)
+	{
+		int id = int(ids[j]);
+		if (sizes && std::abs(sizes[j] - 1.0f) > k_particleSizeTolerance)
+		{
+			batch->bodyPositions.push_back(positions[j]);
+			batch->bodyVelocities.push_back(velocities[j]);
+			batch->bodySizes.push_back(sizes[j]);
+			batch->bodyIds.push_back(id);
+			continue;
+		}
+		if (particleCount != j)
+		{
+			positions[particleCount] = positions[j];
+			velocities[particleCount] = velocities[j];
+		}
+		userData[particleCount] = (void*)intptr_t(id);
+		++particleCount;
+	}
+	positions.resize(particleCount);
+	velocities.resize(particleCount);
+	userData.resize(particleCount);
+}
+
+void
+CPlusPlusCHOPExample::m_spawnBatch(const SpawnBatch& batch)
+{
+	if (!batch.particlePositions.empty())
+	{
+		b2ParticleDef pd;
+		pd.flags = b2_elasticParticle;
+		pd.color.Set(0, 0, 255, 255);
+		m_pointCount += m_particleSystem->CreateParticles(
+			pd, &batch.particlePositions[0], &batch.particleVelocities[0],
+			&batch.particleUserData[0],
+			int32(batch.particlePositions.size()));
+	}
+	for (size_t i = 0; i < batch.bodyPositions.size(); i++)
+	{
+		m_generateDynamicCircle(batch.bodyIds[i], batch.bodyPositions[i],
+								batch.bodyVelocities[i], batch.bodySizes[i]);
+	}
+}
+
+void
+CPlusPlusCHOPExample::m_applyCommand(SimCommand& command)
+{
+	switch (command.type)
+	{
+	case SimCommand::e_setWalls:
+		// Steering gives the walls the velocity of the move, which the
+		// particles they hit pick up. The first placement jumps there.
+		wallTargets[0] = command.a;
+		wallTargets[1] = command.b;
+		for (int i = 0; i < 2; i++)
+		{
+			if (wallsPlaced && command.time > 0.0f)
+			{
+				wallBodies[i]->SetTargetTransform(wallTargets[i], 0.0f,
+												  command.time);
+			}
+			else
+			{
+				wallBodies[i]->SetTransform(wallTargets[i], 0.0f);
+			}
+		}
+		wallsPlaced = true;
+		break;
+
+	case SimCommand::e_spawn:
+		m_spawnBatch(*command.batch);
+		delete command.batch;
+		command.batch = NULL;
+		break;
+
+	case SimCommand::e_reset:
+		// Go back to the scene saved after the first cook. This replaces
+		// every body and particle system, so the pointers are fetched again.
+		resetSpawnCount += m_pointCount;
+		world.RestoreSnapshot(&resetSnapshot[0], int32(resetSnapshot.size()));
+		m_particleSystem = world.GetParticleSystemList();
+		m_pointCount = m_particleSystem->GetParticleCount();
+		m_particleSystem->SetDistanceField(distanceField);
+		// The snapshot predates the outline, which goes back on the
+		// restored body.
+		for (b2Body* body = world.GetBodyList(); body; body = body->GetNext())
+		{
+			if (body->GetUserData() == &s_outlineBodyTag)
+			{
+				outlineBody = body;
+			}
+			for (int i = 0; i < 2; i++)
+			{
+				if (body->GetUserData() == &s_wallBodyTags[i])
+				{
+					wallBodies[i] = body;
+				}
+			}
+		}
+		m_createOutline();
+		// So do the kinematic boxes, and the walls go where they were.
+		if (wallsPlaced)
+		{
+			for (int i = 0; i < 2; i++)
+			{
+				wallBodies[i]->SetTransform(wallTargets[i], 0.0f);
+			}
+		}
+		m_createKinematic();
+		stepper.Reset();
+		break;
+
+	case SimCommand::e_steer:
+		// Ids of particles that are gone are skipped.
+		m_particleSystem->SetParticleVelocitiesById(
+			&command.steer->ids[0], &command.steer->velocities[0],
+			int32(command.steer->ids.size()));
+		delete command.steer;
+		command.steer = NULL;
+		break;
+
+	case SimCommand::e_setCollider:
+		m_setCollider(command.collider);
+		delete command.collider;
+		command.collider = NULL;
+		break;
+
+	case SimCommand::e_setOutline:
+		m_setOutline(command.outline);
+		command.outline = NULL;
+		break;
+
+	case SimCommand::e_moveKinematic:
+		m_moveKinematic(*command.kinematic);
+		delete command.kinematic;
+		command.kinematic = NULL;
+		break;
+	}
+}
+
+static bool
+sameDistanceFieldDef(const b2DistanceFieldDef& a, const b2DistanceFieldDef& b)
+{
+	return a.width == b.width && a.height == b.height &&
+		a.origin == b.origin && a.cellSize == b.cellSize &&
+		a.maxDistance == b.maxDistance;
+}
+
+void
+CPlusPlusCHOPExample::m_readCollider(OP_Inputs* inputs)
+{
+	const OP_TOPInput* top = inputs->getParTOP("Collidertop");
+	if (!top)
+	{
+		if (colliderConnected)
+		{
+			SimCommand command;
+			command.type = SimCommand::e_setCollider;
+			command.collider = NULL;
+			m_submitCommand(command);
+			colliderConnected = false;
+			colliderImage.mask.clear();
+		}
+		return;
+	}
+
+	// The download is delayed by a frame to avoid stalling the GPU, so
+	// the first cook after connecting has no pixels yet.
+	OP_TOPInputDownloadOptions options;
+	options.cpuMemPixelType = OP_CPUMemPixelType::R8Fixed;
+	const unsigned char* pixels = static_cast<const unsigned char*>(
+		inputs->getTOPDataInCPUMemory(top, &options));
+	if (!pixels || top->width < 2 || top->height < 2)
+	{
+		return;
+	}
+
+	// The TOP spans Collider Width world units from Collider Origin, at
+	// its bottom left. Distances further than a few pixels from the
+	// obstacles do not matter to particles.
+	ColliderImage image;
+	double originX, originY;
+	inputs->getParDouble2("Colliderorigin", originX, originY);
+	image.def.width = top->width;
+	image.def.height = top->height;
+	image.def.origin.Set(float32(originX), float32(originY));
+	image.def.cellSize = std::max(
+		float32(inputs->getParDouble("Colliderwidth")), b2_linearSlop) /
+		float32(top->width);
+	image.def.maxDistance = 8.0f * image.def.cellSize;
+	image.threshold = uint8(b2Clamp(
+		inputs->getParDouble("Colliderthreshold") * 255.0 + 0.5, 0.0,
+		255.0));
+
+	const size_t size = size_t(top->width) * size_t(top->height);
+	if (colliderConnected &&
+		sameDistanceFieldDef(image.def, colliderImage.def) &&
+		image.threshold == colliderImage.threshold &&
+		!memcmp(pixels, &colliderImage.mask[0], size))
+	{
+		return;
+	}
+	image.mask.assign(pixels, pixels + size);
+	colliderImage = image;
+	colliderConnected = true;
+
+	SimCommand command;
+	command.type = SimCommand::e_setCollider;
+	command.collider = new ColliderImage(image);
+	m_submitCommand(command);
+}
+
+void
+CPlusPlusCHOPExample::m_setCollider(const ColliderImage* image)
+{
+	if (!image)
+	{
+		m_particleSystem->SetDistanceField(NULL);
+		delete distanceField;
+		distanceField = NULL;
+		return;
+	}
+	// Only a new size or placement needs a new field, a new image only
+	// recomputes the distances around the pixels that changed.
+	if (!distanceField ||
+		!sameDistanceFieldDef(distanceField->GetDef(), image->def))
+	{
+		delete distanceField;
+		distanceField = new b2DistanceField(image->def);
+	}
+	distanceField->SetMask(&image->mask[0], image->def.width,
+						   image->threshold);
+	m_particleSystem->SetDistanceField(distanceField);
+}
+
+static bool
+sameOutline(const OutlinePolylines& a, const OutlinePolylines& b)
+{
+	return a.counts == b.counts && a.vertices == b.vertices &&
+		(a.counts.empty() || a.closed == b.closed);
+}
+
+static void
+appendOutlineVertex(OutlinePolylines* outline, float x, float y,
+					bool newPolyline)
+{
+	if (newPolyline || outline->counts.empty())
+	{
+		outline->counts.push_back(0);
+	}
+	outline->vertices.push_back(b2Vec2(x, y));
+	outline->counts.back()++;
+}
+
+static bool
+parseOutlineCell(const char* cell, float* value)
+{
+	char* end;
+	*value = float(strtod(cell, &end));
+	return end != cell;
+}
+
+void
+CPlusPlusCHOPExample::m_readOutline(OP_Inputs* inputs)
+{
+	// Each sample of the outline CHOP, or row of the outline DAT, is a
+	// vertex: x, y and optionally the polyline it belongs to. A new
+	// polyline starts wherever the third value changes.
+	OutlinePolylines outline;
+	outline.closed = inputs->getParInt("Outlineclosed") != 0;
+	const OP_CHOPInput* chop = inputs->getParCHOP("Outlinechop");
+	const OP_DATInput* dat = inputs->getParDAT("Outlinedat");
+	if (chop && chop->numChannels >= 2)
+	{
+		const float* x = chop->getChannelData(0);
+		const float* y = chop->getChannelData(1);
+		const float* polyline =
+			chop->numChannels >= 3 ? chop->getChannelData(2) : NULL;
+		for (int j = 0; j < chop->numSamples; j++)
+		{
+			appendOutlineVertex(&outline, x[j], y[j],
+								polyline && j > 0 &&
+								polyline[j] != polyline[j - 1]);
+		}
+	}
+	else if (dat && dat->numCols >= 2)
+	{
+		// Rows that do not start with numbers, e.g. a header, are skipped.
+		float previous = 0.0f;
+		for (int j = 0; j < dat->numRows; j++)
+		{
+			float x, y, polyline = 0.0f;
+			if (!parseOutlineCell(dat->getCell(j, 0), &x) ||
+				!parseOutlineCell(dat->getCell(j, 1), &y))
+			{
+				continue;
+			}
+			if (dat->numCols >= 3)
+			{
+				parseOutlineCell(dat->getCell(j, 2), &polyline);
+			}
+			appendOutlineVertex(&outline, x, y,
+								!outline.counts.empty() &&
+								polyline != previous);
+			previous = polyline;
+		}
+	}
+
+	// Most cooks see the same outline, which is not sent again. The
+	// simulation only rebuilds the chains that changed otherwise.
+	if (sameOutline(outline, outlineSent))
+	{
+		return;
+	}
+	outlineSent = outline;
+
+	SimCommand command;
+	command.type = SimCommand::e_setOutline;
+	command.outline =
+		outline.counts.empty() ? NULL : new OutlinePolylines(outline);
+	m_submitCommand(command);
+}
+
+void
+CPlusPlusCHOPExample::m_readWalls(OP_Inputs* inputs, float32 moveTime)
+{
+	b2Vec2 walls[2];
+	walls[0].Set(float32(inputs->getParDouble("Walls", 0)),
+				 float32(inputs->getParDouble("Walls", 1)));
+	walls[1].Set(float32(inputs->getParDouble("Walls", 2)),
+				 float32(inputs->getParDouble("Walls", 3)));
+	// Walls that stay put are left alone, so they come to rest and keep
+	// their proxies where they are.
+	if (wallsSentValid && walls[0] == wallsSent[0] &&
+		walls[1] == wallsSent[1])
+	{
+		return;
+	}
+
+	SimCommand command;
+	command.type = SimCommand::e_setWalls;
+	command.a = walls[0];
+	command.b = walls[1];
+	command.time = wallsSentValid ? moveTime : 0.0f;
+	m_submitCommand(command);
+	wallsSent[0] = walls[0];
+	wallsSent[1] = walls[1];
+	wallsSentValid = true;
+}
+
+static bool
+sameKinematicBoxes(const std::vector<KinematicBox>& a,
+				   const std::vector<KinematicBox>& b)
+{
+	if (a.size() != b.size())
+	{
+		return false;
+	}
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		if (!(a[i].position == b[i].position) || a[i].angle != b[i].angle ||
+			!(a[i].size == b[i].size))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void
+CPlusPlusCHOPExample::m_readKinematic(OP_Inputs* inputs, float32 moveTime)
+{
+	// Each sample of the kinematic CHOP is a box: tx and ty of its
+	// center, and optionally rz in degrees and its size sx and sy, 1 by
+	// default.
+	std::vector<KinematicBox> boxes;
+	const OP_CHOPInput* chop = inputs->getParCHOP("Kinematicchop");
+	if (chop && chop->numChannels >= 2)
+	{
+		const float* x = chop->getChannelData(0);
+		const float* y = chop->getChannelData(1);
+		const float* rz =
+			chop->numChannels >= 3 ? chop->getChannelData(2) : NULL;
+		const float* sx =
+			chop->numChannels >= 4 ? chop->getChannelData(3) : NULL;
+		const float* sy =
+			chop->numChannels >= 5 ? chop->getChannelData(4) : NULL;
+		boxes.resize(chop->numSamples);
+		for (int j = 0; j < chop->numSamples; j++)
+		{
+			KinematicBox& box = boxes[j];
+			box.position.Set(x[j], y[j]);
+			box.angle = rz ? rz[j] * (b2_pi / 180.0f) : 0.0f;
+			box.size.Set(std::max(sx ? sx[j] : 1.0f, 2.0f * b2_linearSlop),
+						 std::max(sy ? sy[j] : 1.0f, 2.0f * b2_linearSlop));
+		}
+	}
+
+	// Boxes at rest are not sent again, the simulation stops them once
+	// they arrive.
+	if (sameKinematicBoxes(boxes, kinematicSent))
+	{
+		return;
+	}
+	kinematicSent = boxes;
+
+	SimCommand command;
+	command.type = SimCommand::e_moveKinematic;
+	command.kinematic = new KinematicTargets;
+	command.kinematic->boxes.swap(boxes);
+	command.kinematic->time = moveTime;
+	m_submitCommand(command);
+}
+
+void
+CPlusPlusCHOPExample::m_moveKinematic(const KinematicTargets& targets)
+{
+	const std::vector<KinematicBox>& boxes = targets.boxes;
+	while (kinematicBodies.size() > boxes.size())
+	{
+		world.DestroyBody(kinematicBodies.back());
+		kinematicBodies.pop_back();
+	}
+	for (size_t i = 0; i < boxes.size(); i++)
+	{
+		const KinematicBox& box = boxes[i];
+		if (i == kinematicBodies.size())
+		{
+			// New boxes start at their target.
+			kinematicBodies.push_back(m_generateKinematicBox(
+				box.position, box.angle, 0.5f * box.size));
+			continue;
+		}
+		b2Body* body = kinematicBodies[i];
+		if (!(box.size == kinematicBoxes[i].size))
+		{
+			body->DestroyFixture(body->GetFixtureList());
+			b2PolygonShape kinematicBox;
+			kinematicBox.SetAsBox(0.5f * box.size.x, 0.5f * box.size.y);
+			body->CreateFixture(&kinematicBox, 0.0f);
+		}
+		body->SetTargetTransform(box.position, box.angle, targets.time);
+	}
+	kinematicBoxes = boxes;
+}
+
+void
+CPlusPlusCHOPExample::m_createKinematic()
+{
+	// The bodies are gone or were never there.
+	kinematicBodies.clear();
+	for (size_t i = 0; i < kinematicBoxes.size(); i++)
+	{
+		const KinematicBox& box = kinematicBoxes[i];
+		kinematicBodies.push_back(m_generateKinematicBox(
+			box.position, box.angle, 0.5f * box.size));
+	}
+}
+
+void
+CPlusPlusCHOPExample::m_setOutline(OutlinePolylines* outline)
+{
+	if (outline != outlinePolylines)
+	{
+		delete outlinePolylines;
+		outlinePolylines = outline;
+	}
+	if (!outline)
+	{
+		chainOutline->Clear();
+		outlineCreated = 0;
+		return;
+	}
+
+	const int32 polylineCount = int32(outline->counts.size());
+	std::unique_ptr<bool[]> loops;
+	if (!outline->closed)
+	{
+		loops.reset(new bool[polylineCount]());
+	}
+	outlineCreated = chainOutline->SetPolylines(
+		&outline->vertices[0], &outline->counts[0], loops.get(),
+		polylineCount);
+}
+
+void
+CPlusPlusCHOPExample::m_submitCommand(const SimCommand& command)
+{
+	if (simThread.joinable())
+	{
+		// The simulation thread drains the queue at least once per step.
+		while (!commandQueue.push(command))
+		{
+			std::this_thread::yield();
+		}
+	}
+	else
+	{
+		SimCommand inlineCommand = command;
+		m_applyCommand(inlineCommand);
+	}
+}
+
+// Copy count items of a particle buffer into a frame.
+template <typename T>
+static void
+copyBuffer(const T* buffer, int count, std::vector<T>* copy)
+{
+	copy->assign(buffer, buffer + count);
+}
+
+// The data of a frame buffer, or NULL if it was not filled in.
+template <typename T>
+static const T*
+getBufferData(const std::vector<T>& buffer, bool selected)
+{
+	return selected && !buffer.empty() ? &buffer[0] : NULL;
+}
+
+void
+CPlusPlusCHOPExample::m_computeChannels(unsigned mask, SimFrame* frame)
+{
+	int32 count = m_particleSystem->GetParticleCount();
+
+	if (mask & k_outputGroup)
+	{
+		// The particles of a group are contiguous in the buffers.
+		frame->groups.assign(count, -1.0f);
+		int index = 0;
+		for (const b2ParticleGroup* group =
+				m_particleSystem->GetParticleGroupList();
+			 group; group = group->GetNext(), index++)
+		{
+			std::vector<float>::iterator first =
+				frame->groups.begin() + group->GetBufferIndex();
+			std::fill(first, first + group->GetParticleCount(), float(index));
+		}
+	}
+
+	if (mask & k_outputLife)
+	{
+		// This starts tracking lifetimes if nothing set one yet.
+		const int32* expirationTimes =
+			m_particleSystem->GetExpirationTimeBuffer();
+		frame->lives.resize(count);
+		for (int32 i = 0; i < count; i++)
+		{
+			frame->lives[i] =
+				m_particleSystem->ExpirationTimeToLifetime(expirationTimes[i]);
+		}
+	}
+
+	if (mask & k_outputContacts)
+	{
+		frame->contacts.assign(count, 0.0f);
+		const b2ParticleBodyContact* contacts =
+			m_particleSystem->GetBodyContacts();
+		int32 contactCount = m_particleSystem->GetBodyContactCount();
+		for (int32 i = 0; i < contactCount; i++)
+		{
+			frame->contacts[contacts[i].index] += 1.0f;
+		}
+	}
+}
+
+// Times of b2Profile reported on the Info CHOP and DAT, in milliseconds.
+struct ProfileField
+{
+	const char*	name;
+	size_t		offset;
+};
+
+static const ProfileField k_profileFields[] =
+{
+	{ "step_ms", offsetof(b2Profile, step) },
+	{ "collide_ms", offsetof(b2Profile, collide) },
+	{ "solve_ms", offsetof(b2Profile, solve) },
+	{ "solveInit_ms", offsetof(b2Profile, solveInit) },
+	{ "solveVelocity_ms", offsetof(b2Profile, solveVelocity) },
+	{ "solvePosition_ms", offsetof(b2Profile, solvePosition) },
+	{ "broadphase_ms", offsetof(b2Profile, broadphase) },
+	{ "solveTOI_ms", offsetof(b2Profile, solveTOI) },
+	{ "particle_ms", offsetof(b2Profile, particle.total) },
+	{ "particleLifetimes_ms", offsetof(b2Profile, particle.solveLifetimes) },
+	{ "particleZombie_ms", offsetof(b2Profile, particle.solveZombie) },
+	{ "updateProxies_ms", offsetof(b2Profile, particle.updateProxies) },
+	{ "sortProxies_ms", offsetof(b2Profile, particle.sortProxies) },
+	{ "findContacts_ms", offsetof(b2Profile, particle.findContacts) },
+	{ "updateBodyContacts_ms",
+	  offsetof(b2Profile, particle.updateBodyContacts) },
+	{ "computeWeight_ms", offsetof(b2Profile, particle.computeWeight) },
+	{ "computeDepth_ms", offsetof(b2Profile, particle.computeDepth) },
+	{ "updatePairsAndTriads_ms",
+	  offsetof(b2Profile, particle.updatePairsAndTriads) },
+	{ "solveForce_ms", offsetof(b2Profile, particle.solveForce) },
+	{ "solveViscous_ms", offsetof(b2Profile, particle.solveViscous) },
+	{ "solveRepulsive_ms", offsetof(b2Profile, particle.solveRepulsive) },
+	{ "solvePowder_ms", offsetof(b2Profile, particle.solvePowder) },
+	{ "solveTensile_ms", offsetof(b2Profile, particle.solveTensile) },
+	{ "solveSolid_ms", offsetof(b2Profile, particle.solveSolid) },
+	{ "solveColorMixing_ms",
+	  offsetof(b2Profile, particle.solveColorMixing) },
+	{ "solveGravity_ms", offsetof(b2Profile, particle.solveGravity) },
+	{ "solveStaticPressure_ms",
+	  offsetof(b2Profile, particle.solveStaticPressure) },
+	{ "solvePressure_ms", offsetof(b2Profile, particle.solvePressure) },
+	{ "solveDamping_ms", offsetof(b2Profile, particle.solveDamping) },
+	{ "solveExtraDamping_ms",
+	  offsetof(b2Profile, particle.solveExtraDamping) },
+	{ "solveElastic_ms", offsetof(b2Profile, particle.solveElastic) },
+	{ "solveSpring_ms", offsetof(b2Profile, particle.solveSpring) },
+	{ "limitVelocity_ms", offsetof(b2Profile, particle.limitVelocity) },
+	{ "solveRigidDamping_ms",
+	  offsetof(b2Profile, particle.solveRigidDamping) },
+	{ "solveBarrier_ms", offsetof(b2Profile, particle.solveBarrier) },
+	{ "solveCollision_ms", offsetof(b2Profile, particle.solveCollision) },
+	{ "solveDistanceField_ms",
+	  offsetof(b2Profile, particle.solveDistanceField) },
+	{ "solveRigid_ms", offsetof(b2Profile, particle.solveRigid) },
+	{ "solveWall_ms", offsetof(b2Profile, particle.solveWall) },
+	{ "integrate_ms", offsetof(b2Profile, particle.integrate) },
+};
+
+static const int k_profileFieldCount =
+	sizeof(k_profileFields) / sizeof(k_profileFields[0]);
+
+void
+CPlusPlusCHOPExample::m_captureStats(SimStats* stats)
+{
+	stats->profile = world.GetProfile();
+	stats->quality = world.GetStepQuality();
+	world.GetMemoryReport(&stats->memory);
+	stats->particleCount = m_particleSystem->GetParticleCount();
+	stats->particleCapacity = m_particleSystem->GetParticleCapacity();
+	stats->groupCount = m_particleSystem->GetParticleGroupCount();
+	stats->bodyCount = world.GetBodyCount();
+	stats->contactCount = world.GetContactCount();
+	stats->particleContactCount = m_particleSystem->GetContactCount();
+	stats->bodyContactCount = m_particleSystem->GetBodyContactCount();
+	stats->outlineChains = chainOutline->GetChainCount();
+	stats->outlineEdges = chainOutline->GetEdgeCount();
+	stats->outlineCreated = outlineCreated;
+	stats->steps = stepCount;
+	// Particles that are gone were destroyed, whether by their lifetime,
+	// by the particle limit or by a reset.
+	stats->spawned = resetSpawnCount + m_pointCount;
+	stats->destroyed = stats->spawned - stats->particleCount;
+}
+
+void
+CPlusPlusCHOPExample::m_reportStats(const SimStats& current)
+{
+	cookSteps = current.steps - stats.steps;
+	cookSpawned = current.spawned - stats.spawned;
+	cookDestroyed = current.destroyed - stats.destroyed;
+	stats = current;
+	m_updateInfo();
+}
+
+static void
+addInfo(std::vector<InfoValue>* values, const char* name, float value)
+{
+	InfoValue info;
+	info.name = name;
+	info.value = value;
+	values->push_back(info);
+}
+
+void
+CPlusPlusCHOPExample::m_updateInfo()
+{
+	infoValues.clear();
+	addInfo(&infoValues, "executeCount", myExecuteCount);
+	addInfo(&infoValues, "steps", cookSteps);
+	addInfo(&infoValues, "spawned", cookSpawned);
+	addInfo(&infoValues, "destroyed", cookDestroyed);
+	addInfo(&infoValues, "particles", stats.particleCount);
+	addInfo(&infoValues, "particleCapacity", stats.particleCapacity);
+	addInfo(&infoValues, "groups", stats.groupCount);
+	addInfo(&infoValues, "bodies", stats.bodyCount);
+	addInfo(&infoValues, "contacts", stats.contactCount);
+	addInfo(&infoValues, "particleContacts", stats.particleContactCount);
+	addInfo(&infoValues, "bodyContacts", stats.bodyContactCount);
+	addInfo(&infoValues, "particleChecks", stats.profile.particle.checkCount);
+	// Chain fixtures of the outline, and how many its last change rebuilt.
+	addInfo(&infoValues, "outlineChains", stats.outlineChains);
+	addInfo(&infoValues, "outlineEdges", stats.outlineEdges);
+	addInfo(&infoValues, "outlineRebuilt", stats.outlineCreated);
+	// The solver settings the step budget left, see b2StepQuality.
+	addInfo(&infoValues, "quality", stats.quality.level);
+	addInfo(&infoValues, "velocityIterations", stats.quality.velocityIterations);
+	addInfo(&infoValues, "positionIterations", stats.quality.positionIterations);
+	addInfo(&infoValues, "particleIterations", stats.quality.particleIterations);
+	addInfo(&infoValues, "memoryUsed", stats.memory.total.used);
+	addInfo(&infoValues, "memoryReserved", stats.memory.total.reserved);
+	addInfo(&infoValues, "memoryPeak", stats.memory.total.peak);
+	addInfo(&infoValues, "particleBufferBytes",
+			stats.memory.particleBuffers.reserved);
+	addInfo(&infoValues, "particleContactBytes",
+			stats.memory.particleContacts.reserved);
+	for (int i = 0; i < k_profileFieldCount; i++)
+	{
+		const char* profile = reinterpret_cast<const char*>(&stats.profile);
+		addInfo(&infoValues, k_profileFields[i].name,
+				*reinterpret_cast<const float32*>(
+					profile + k_profileFields[i].offset));
+	}
+}
+
+void
+CPlusPlusCHOPExample::m_publishFrame(int index)
+{
+	SimFrame& frame = frames[index];
+	unsigned mask = publishMask.load(std::memory_order_relaxed);
+	int32 count = m_particleSystem->GetParticleCount();
+	frame.mask = mask;
+	frame.count = count;
+	if (mask & k_outputPosition)
+	{
+		copyBuffer(m_particleSystem->GetPositionBuffer(), count,
+				   &frame.positions);
+	}
+	if (mask & k_outputVelocity)
+	{
+		copyBuffer(m_particleSystem->GetVelocityBuffer(), count,
+				   &frame.velocities);
+	}
+	if (mask & k_outputId)
+	{
+		copyBuffer(m_particleSystem->GetUserDataBuffer(), count,
+				   &frame.userData);
+	}
+	if (mask & k_outputParticleId)
+	{
+		copyBuffer(m_particleSystem->GetIdBuffer(), count, &frame.ids);
+	}
+	if (mask & k_outputColor)
+	{
+		copyBuffer(m_particleSystem->GetColorBuffer(), count, &frame.colors);
+	}
+	if (mask & k_outputWeight)
+	{
+		copyBuffer(m_particleSystem->GetWeightBuffer(), count,
+				   &frame.weights);
+	}
+	m_computeChannels(mask, &frame);
+	frame.radius = m_particleSystem->GetRadius();
+	m_captureStats(&frame.stats);
+
+	// Hand the frame over and take the one the cook thread let go of.
+	backFrame = sharedFrame.exchange(index | k_newFrame,
+									 std::memory_order_acq_rel) & ~k_newFrame;
+}
+
+bool
+CPlusPlusCHOPExample::m_acquireFrame()
+{
+	if (!(sharedFrame.load(std::memory_order_acquire) & k_newFrame))
+	{
+		return false;
+	}
+	frontFrame = sharedFrame.exchange(frontFrame,
+									  std::memory_order_acq_rel) & ~k_newFrame;
+	return true;
+}
+
+void
+CPlusPlusCHOPExample::m_simulate()
+{
+	b2Timer timer;
+	while (simRunning.load(std::memory_order_acquire))
+	{
+		// Wall and kinematic moves alone do not change the published particles.
+		bool changed = false;
+		SimCommand command;
+		while (commandQueue.pop(&command))
+		{
+			m_applyCommand(command);
+			changed |= command.type != SimCommand::e_setWalls &&
+					   command.type != SimCommand::e_steer &&
+					   command.type != SimCommand::e_moveKinematic;
+		}
+
+		float32 elapsed = timer.GetMilliseconds() * 0.001f;
+		timer.Reset();
+		world.SetStepBudget(stepBudget.load(std::memory_order_relaxed));
+		int32 steps = stepper.Advance(elapsed);
+		stepCount += steps;
+		if (steps > 0 || changed)
+		{
+			m_publishFrame(backFrame);
+		}
+		else
+		{
+			// Sleep until the next step is due.
+			float32 wait = (1.0f - stepper.GetAlpha()) * timeStep;
+			std::this_thread::sleep_for(
+				std::chrono::microseconds(int(wait * 1e6f)));
+		}
+	}
+}
+
 void
-CPlusPlusCHOPExample::m_generateStaticBox(b2Vec2 pos, b2Vec2 size)
+CPlusPlusCHOPExample::m_startSimThread()
 {
-	b2BodyDef bodyDef;
-	b2Body* body;
-	// Define another box shape for our dynamic body.
-	b2PolygonShape staticBox;
-
-	bodyDef.type = b2_staticBody;
-	bodyDef.position.Set(pos.x, pos.y);
-	body = world.CreateBody(&bodyDef);
-	// The extents are the half-widths of the box.
-	staticBox.SetAsBox(size.x, size.y);
-	// Add the box fixture to the box body.
-	body->CreateFixture(&staticBox, 0.0f);
+	// Publish the current state so that the next cook has a frame.
+	m_publishFrame(backFrame);
+	simRunning.store(true, std::memory_order_release);
+	simThread = std::thread(&CPlusPlusCHOPExample::m_simulate, this);
 }
 
 void
-CPlusPlusCHOPExample::m_generateDynamicCircle(int* eID, b2Vec2 pos, b2Vec2 vel, float size)
+CPlusPlusCHOPExample::m_stopSimThread()
 {
-	// Define the dynamic body. We set its position and call the body factory.
-	b2BodyDef bodyDef;
-	bodyDef.type = b2_dynamicBody;
-	bodyDef.position.Set(pos.x, pos.y);
-	bodyDef.linearVelocity.Set(vel.x, vel.y);
-	b2Body* body = world.CreateBody(&bodyDef);
-
-	// Define a circle shape for our dynamic body.
-	b2CircleShape dynamicCircle;
-	dynamicCircle.m_radius = size;
-
-	// Define the dynamic body fixture.
-	b2FixtureDef fixtureDef;
-	fixtureDef.shape = &dynamicCircle;
+	if (!simThread.joinable())
+	{
+		return;
+	}
+	simRunning.store(false, std::memory_order_release);
+	simThread.join();
 
-	// Set the box density to be non-zero, so it will be dynamic.
-	fixtureDef.density = 1.0f;
+	// Apply what the thread did not get to and step inline from now on.
+	SimCommand command;
+	while (commandQueue.pop(&command))
+	{
+		m_applyCommand(command);
+	}
+	cookTimer.Reset();
+}
 
-	// Override the default friction <<< UPDATE???
-	// fixtureDef.friction = 0.3f;
+// Particle counts from which the output is split across exportPool, and
+// the least number of particles per thread.
+static const int32 k_parallelExportCount = 32768;
+static const int32 k_minExportRange = 8192;
 
-	body->SetUserData(eID);
+// What exportChannels() needs to fill the output channels.
+struct ExportContext
+{
+	float* const*			channels;
+	unsigned				mask;
+	const ChannelSource*	source;
+};
 
-	// Add the shape to the body.
-	body->CreateFixture(&fixtureDef);
+static void
+exportVectors(const b2Vec2* vectors, int32 begin, int32 end,
+			  float* x, float* y)
+{
+	if (vectors)
+	{
+		b2Deinterleave(vectors + begin, end - begin, x + begin, y + begin);
+	}
+	else
+	{
+		std::fill(x + begin, x + end, 0.0f);
+		std::fill(y + begin, y + end, 0.0f);
+	}
 }
 
-// declare particle system
-const b2ParticleSystemDef particleSystemDef;
-b2ParticleSystem* m_particleSystem;
+static void
+exportFloats(const float* values, int32 begin, int32 end, float* channel)
+{
+	if (values)
+	{
+		std::copy(values + begin, values + end, channel + begin);
+	}
+	else
+	{
+		std::fill(channel + begin, channel + end, 0.0f);
+	}
+}
 
-// declare point count tracker
-int32 m_pointCount;
+// Fill the selected output channels for the particles in [begin, end).
+static void
+exportChannels(int32 begin, int32 end, int32 rangeIndex, void* data)
+{
+	B2_NOT_USED(rangeIndex);
+	const ExportContext* context = (const ExportContext*)data;
+	const ChannelSource& source = *context->source;
+	unsigned mask = context->mask;
+	float* const* channels = context->channels;
+	if (mask & k_outputId)
+	{
+		float* id = *channels++;
+		for (int32 j = begin; j < end; j++)
+		{
+			id[j] = source.userData ?
+				float(int(intptr_t(source.userData[j]))) : 0.0f;
+		}
+	}
+	if (mask & k_outputPosition)
+	{
+		exportVectors(source.positions, begin, end, channels[0], channels[1]);
+		channels += 2;
+	}
+	if (mask & k_outputVelocity)
+	{
+		exportVectors(source.velocities, begin, end, channels[0],
+					  channels[1]);
+		channels += 2;
+	}
+	if (mask & k_outputRadius)
+	{
+		float* radius = *channels++;
+		std::fill(radius + begin, radius + end, source.radius);
+	}
+	if (mask & k_outputCount)
+	{
+		float* count = *channels++;
+		std::fill(count + begin, count + end, float(source.count));
+	}
+	if (mask & k_outputColor)
+	{
+		const float scale = 1.0f / 255.0f;
+		for (int32 j = begin; j < end; j++)
+		{
+			b2ParticleColor color = source.colors ?
+				source.colors[j] : b2ParticleColor(0, 0, 0, 0);
+			channels[0][j] = color.r * scale;
+			channels[1][j] = color.g * scale;
+			channels[2][j] = color.b * scale;
+			channels[3][j] = color.a * scale;
+		}
+		channels += 4;
+	}
+	if (mask & k_outputWeight)
+	{
+		exportFloats(source.weights, begin, end, *channels++);
+	}
+	if (mask & k_outputGroup)
+	{
+		exportFloats(source.groups, begin, end, *channels++);
+	}
+	if (mask & k_outputLife)
+	{
+		exportFloats(source.lives, begin, end, *channels++);
+	}
+	if (mask & k_outputContacts)
+	{
+		exportFloats(source.contacts, begin, end, *channels++);
+	}
+	if (mask & k_outputParticleId)
+	{
+		float* pid = *channels++;
+		for (int32 j = begin; j < end; j++)
+		{
+			pid[j] = source.ids ? float(source.ids[j]) : -1.0f;
+		}
+	}
+}
 
 void
-CPlusPlusCHOPExample::m_spawnParticle(int* eID, b2Vec2 pos, b2Vec2 vel)
+CPlusPlusCHOPExample::m_exportChannels(const CHOP_Output* output,
+									   const ChannelSource& source)
 {
-	b2ParticleDef pd;
-	pd.flags = b2_elasticParticle;
-	pd.color.Set(0, 0, 255, 255);
-	pd.position.Set(pos.x, pos.y);
-	pd.velocity.Set(vel.x, vel.y);
-	pd.userData = eID;
-	int tempIndex = m_particleSystem->CreateParticle(pd);
-
-	++m_pointCount;
+	// Never write more samples than announced in getOutputInfo().
+	int count = std::min(source.count, output->numSamples);
+
+	ExportContext context;
+	context.channels = output->channels;
+	context.mask = m_outputMask;
+	context.source = &source;
+	if (count >= k_parallelExportCount)
+	{
+		exportPool.ParallelFor(count, k_minExportRange, exportChannels,
+							   &context);
+	}
+	else
+	{
+		exportChannels(0, count, 0, &context);
+	}
 }
 
-// Prepare for simulation. Typically we use a time step of 1/60 of a
-// second (60Hz) and 10 iterations. This provides a high quality simulation
-// in most game scenarios.
-float32 timeStep = 1.0f / 60.0f;
-int32 velocityIterations = 6;
-int32 positionIterations = 2;
-int32 particleIterations = 2;
-
 // end particle stuff initialization
 // %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 ///////////////////////////////////////////////////////////////////////////
 
 void
-CPlusPlusCHOPExample::execute(const CHOP_Output* output,
-	OP_Inputs* inputs,
-	void* reserved)
+CPlusPlusCHOPExample::m_cook(OP_Inputs* inputs)
 {
 	myExecuteCount++;
 
-	double body1x = inputs->getParDouble("Walls", 0);
-	double body1y = inputs->getParDouble("Walls", 1);
-	double body2x = inputs->getParDouble("Walls", 2);
-	double body2y = inputs->getParDouble("Walls", 3);
+	// Kinematic bodies take as long to get to the positions of this cook
+	// as it took since the last one, within what the stepper catches up.
+	float32 moveTime = b2Clamp(moveTimer.GetMilliseconds() * 0.001f,
+							   timeStep,
+							   float32(stepper.GetDef().maxSteps) * timeStep);
+	moveTimer.Reset();
 
 	if (myExecuteCount > 2) {
-		b2Body* tempBody = world.GetBodyList();
-		tempBody = tempBody->GetNext();
-		tempBody->SetTransform(b2Vec2(body1x, body1y), 0.0);
-		tempBody->GetNext()->SetTransform(b2Vec2(body2x, body2y), 0.0);
+		m_readWalls(inputs, moveTime);
 	}
 	else if (myExecuteCount < 2) {
 
@@ -258,27 +1397,54 @@ CPlusPlusCHOPExample::execute(const CHOP_Output* output,
 		// generate ground plane
 		m_generateGroundPlane();
 
-		m_generateStaticBox(wallLeftPos, wallLeftSize);
-		m_generateStaticBox(wallRightPos, wallRightSize);
+		// The outline gets a body of its own.
+		b2BodyDef outlineBodyDef;
+		outlineBodyDef.userData = &s_outlineBodyTag;
+		outlineBody = world.CreateBody(&outlineBodyDef);
+		m_createOutline();
+
+		// The walls that move are kinematic.
+		wallBodies[0] = m_generateKinematicBox(wallLeftPos, 0.0f,
+											   wallLeftSize);
+		wallBodies[0]->SetUserData(&s_wallBodyTags[0]);
+		wallBodies[1] = m_generateKinematicBox(wallRightPos, 0.0f,
+											   wallRightSize);
+		wallBodies[1]->SetUserData(&s_wallBodyTags[1]);
 		m_generateStaticBox(wallTopPos, wallTopSize);
 
 		m_pointCount = 0;
 
+		const b2ParticleSystemDef particleSystemDef;
 		m_particleSystem = world.CreateParticleSystem(&particleSystemDef);
+		// Track persistent ids so that the steering input can address
+		// particles whatever their index.
+		m_particleSystem->GetIdBuffer();
 
 		// spawn initial particles
 		
 		for (int i = 0; i < 10; i++) {
-			int* x = &i;
 			b2ParticleDef pd;
 			pd.flags = b2_elasticParticle;
 			pd.color.Set(0, 0, 255, 255);
 			pd.position.Set((i%10)*2 - 10 + float(i)/1000, int(i/10)*2 + 5);
-			pd.userData = x;
+			pd.userData = (void*)intptr_t(i);
 			int tempIndex = m_particleSystem->CreateParticle(pd);
 
 			++m_pointCount;
 		}
+
+		b2FixedTimeStepperDef stepperDef;
+		stepperDef.timeStep = timeStep;
+		stepperDef.velocityIterations = velocityIterations;
+		stepperDef.positionIterations = positionIterations;
+		stepperDef.particleIterations = particleIterations;
+		stepper.SetDef(stepperDef);
+		stepper.Reset();
+		cookTimer.Reset();
+
+		// Save the initial scene so that reset can restore it in one go.
+		resetSnapshot.resize(world.SaveSnapshot(NULL, 0));
+		world.SaveSnapshot(&resetSnapshot[0], int32(resetSnapshot.size()));
 		
 
 		/*
@@ -329,27 +1495,28 @@ CPlusPlusCHOPExample::execute(const CHOP_Output* output,
 
 	}
 
-	if (reset == 1)
+	// Async mode moves stepping off the cook thread. Cooks then only send
+	// commands and copy the latest frame, at the cost of a frame of latency.
+	bool async = inputs->getParInt("Async") != 0;
+	// A budget trades simulation quality for a steady step time.
+	stepBudget.store(std::max(float(inputs->getParDouble("Budget")), 0.0f),
+					 std::memory_order_relaxed);
+	if (async && !simThread.joinable())
 	{
-		// DELETE WORLD ...
-		delete &world;
-
-		// NEED TO REMAKE WORLDDDDDDDDDD
-
-		// REMAKE WORLD
-		// generate ground plane
-		m_generateGroundPlane();
+		m_startSimThread();
+	}
+	else if (!async && simThread.joinable())
+	{
+		m_stopSimThread();
+	}
 
-		m_generateStaticBox(wallLeftPos, wallLeftSize);
-		m_generateStaticBox(wallRightPos, wallRightSize);
-		m_generateStaticBox(wallTopPos, wallTopSize);
+	if (reset == 1)
+	{
+		SimCommand command;
+		command.type = SimCommand::e_reset;
+		m_submitCommand(command);
 
-		pCount = 0;
 		spawn = 0;
-		m_pointCount = 0;
-
-		m_particleSystem = world.CreateParticleSystem(&particleSystemDef);
-
 		reset = 0;
 	}
 
@@ -357,8 +1524,10 @@ CPlusPlusCHOPExample::execute(const CHOP_Output* output,
 	//b2Vec2 position = body->GetPosition();
 	//float32 angle = body->GetAngle();
 
-	// If the input is present, read info and spawn/alter system accordingly
-	if (inputs->getNumInputs() > 0 && spawn == 1)
+	// If the input is present, read info and spawn/alter system accordingly.
+	// In continuous mode the input is spawned on every cook.
+	bool continuous = inputs->getParInt("Continuous") != 0;
+	if (inputs->getNumInputs() > 0 && (spawn == 1 || continuous))
 	{
 		/*
 		int ind = 0;
@@ -378,53 +1547,159 @@ CPlusPlusCHOPExample::execute(const CHOP_Output* output,
 
 		const OP_CHOPInput	*cinput = inputs->getInputCHOP(0);
 
-		for (int j = 0; j < cinput->numSamples; j++)
-		{
-			int eID = int(cinput->getChannelData(0)[j]);
-			float x = float(cinput->getChannelData(1)[j]);
-			float y = float(cinput->getChannelData(2)[j]);
-			float vX = float(cinput->getChannelData(3)[j]);
-			float vY = float(cinput->getChannelData(4)[j]);
-			float size = float(cinput->getChannelData(5)[j]);
+		// The whole input goes to the simulation as one batch.
+		SimCommand command;
+		command.type = SimCommand::e_spawn;
+		command.batch = new SpawnBatch;
+		m_readSpawnBatch(cinput, command.batch);
+		m_submitCommand(command);
 
-			// change 1.0 to default size
-			if (size == float(1.0))
-			{
-				// spawn as particle with default size
-				m_spawnParticle(&eID, b2Vec2(x, y), b2Vec2(vX, vY));
-			}
-			else
+		spawn = 0;
+
+	}
+
+	// Bright pixels of the collider TOP are obstacles for the particles.
+	m_readCollider(inputs);
+
+	// Polylines of the outline CHOP or DAT are static chains.
+	m_readOutline(inputs);
+
+	// Samples of the kinematic CHOP are boxes that push the fluid.
+	m_readKinematic(inputs, moveTime);
+
+	// The second input steers particles: the velocity channels of each
+	// sample are applied to the particle whose persistent id (the pid
+	// output channel) is in the first channel.
+	if (inputs->getNumInputs() > 1)
+	{
+		const OP_CHOPInput	*steerInput = inputs->getInputCHOP(1);
+		if (steerInput && steerInput->numChannels >= 3 &&
+			steerInput->numSamples > 0)
+		{
+			// All samples go in one command so that large inputs do not
+			// fill the command queue.
+			SimCommand command;
+			command.type = SimCommand::e_steer;
+			command.steer = new SteerBatch;
+			command.steer->ids.resize(steerInput->numSamples);
+			command.steer->velocities.resize(steerInput->numSamples);
+			const float *pid = steerInput->getChannelData(0);
+			const float *vx = steerInput->getChannelData(1);
+			const float *vy = steerInput->getChannelData(2);
+			for (int j = 0; j < steerInput->numSamples; j++)
 			{
-				// spawn as body with custom size
-				m_generateDynamicCircle(&eID, b2Vec2(x, y), b2Vec2(vX, vY), size);
+				command.steer->ids[j] = int32(pid[j]);
+				command.steer->velocities[j].Set(vx[j], vy[j]);
 			}
+			m_submitCommand(command);
 		}
+	}
 
-		spawn = 0;
+	if (!simThread.joinable())
+	{
+		// Simulate the wall time since the last cook in fixed steps, so that
+		// dropped or extra cooks do not change the speed of the simulation.
+		// The output is interpolated between the last two steps.
+		float32 elapsed = cookTimer.GetMilliseconds() * 0.001f;
+		cookTimer.Reset();
+		world.SetStepBudget(stepBudget.load(std::memory_order_relaxed));
+		stepCount += stepper.Advance(elapsed);
+		SimStats current;
+		m_captureStats(&current);
+		m_reportStats(current);
+
+		pCount = m_particleSystem->GetParticleCount();
+	}
+}
 
+void
+CPlusPlusCHOPExample::execute(const CHOP_Output* output,
+	OP_Inputs* inputs,
+	void* reserved)
+{
+	// The cook normally happened in getOutputInfo() already.
+	if (!cooked)
+	{
+		m_cook(inputs);
 	}
+	cooked = false;
 
-	// Instruct the world to perform a single step of simulation.
-	// It is generally best to keep the time step and iterations fixed.
-	world.Step(timeStep, velocityIterations, positionIterations, particleIterations);
-	world.ClearForces();
-	
-	pCount = m_particleSystem->GetParticleCount();
+	if (simThread.joinable())
+	{
+		// Output the frame picked up by getOutputInfo().
+		// Channels selected after the frame was published are zero.
+		const SimFrame& frame = frames[frontFrame];
+		ChannelSource source;
+		source.positions = getBufferData(frame.positions,
+										 (frame.mask & k_outputPosition) != 0);
+		source.velocities = getBufferData(frame.velocities,
+										  (frame.mask & k_outputVelocity) != 0);
+		source.userData = getBufferData(frame.userData,
+										(frame.mask & k_outputId) != 0);
+		source.ids = getBufferData(frame.ids,
+								   (frame.mask & k_outputParticleId) != 0);
+		source.colors = getBufferData(frame.colors,
+									  (frame.mask & k_outputColor) != 0);
+		source.weights = getBufferData(frame.weights,
+									   (frame.mask & k_outputWeight) != 0);
+		source.groups = getBufferData(frame.groups,
+									  (frame.mask & k_outputGroup) != 0);
+		source.lives = getBufferData(frame.lives,
+									 (frame.mask & k_outputLife) != 0);
+		source.contacts = getBufferData(frame.contacts,
+										(frame.mask & k_outputContacts) != 0);
+		source.radius = frame.radius;
+		source.count = frame.count;
+		m_reportStats(frame.stats);
+		if (source.count > 0)
+		{
+			m_exportChannels(output, source);
+		}
+		return;
+	}
 
-	// output positions
+	// output the selected channels, computing only what they need
 	if (pCount > 0)
 	{
-		//for (int j = 0; j < output->numSamples; j++)
-		for (int j = 0; j < pCount; j++)
+		unsigned mask = m_outputMask;
+		ChannelSource source;
+		if (mask & k_outputPosition)
+		{
+			interpolatedPositions.resize(pCount);
+			stepper.GetInterpolatedPositions(m_particleSystem,
+											 &interpolatedPositions[0]);
+			source.positions = &interpolatedPositions[0];
+		}
+		if (mask & k_outputVelocity)
+		{
+			source.velocities = m_particleSystem->GetVelocityBuffer();
+		}
+		if (mask & k_outputId)
+		{
+			source.userData = m_particleSystem->GetUserDataBuffer();
+		}
+		if (mask & k_outputParticleId)
+		{
+			source.ids = m_particleSystem->GetIdBuffer();
+		}
+		if (mask & k_outputColor)
+		{
+			source.colors = m_particleSystem->GetColorBuffer();
+		}
+		if (mask & k_outputWeight)
 		{
-			output->channels[0][j] = int(m_particleSystem->GetUserDataBuffer()[j]);
-			output->channels[1][j] = float(m_particleSystem->GetPositionBuffer()[j].x);
-			output->channels[2][j] = float(m_particleSystem->GetPositionBuffer()[j].y);
-			output->channels[3][j] = float(m_particleSystem->GetVelocityBuffer()[j].x);
-			output->channels[4][j] = float(m_particleSystem->GetVelocityBuffer()[j].y);
-			output->channels[5][j] = float(m_particleSystem->GetRadius());
-			output->channels[6][j] = pCount;
+			source.weights = m_particleSystem->GetWeightBuffer();
 		}
+		m_computeChannels(mask, &syncChannels);
+		source.groups = getBufferData(syncChannels.groups,
+									  (mask & k_outputGroup) != 0);
+		source.lives = getBufferData(syncChannels.lives,
+									 (mask & k_outputLife) != 0);
+		source.contacts = getBufferData(syncChannels.contacts,
+										(mask & k_outputContacts) != 0);
+		source.radius = m_particleSystem->GetRadius();
+		source.count = pCount;
+		m_exportChannels(output, source);
 	}
 
 	/*
@@ -449,8 +1724,8 @@ int32_t
 CPlusPlusCHOPExample::getNumInfoCHOPChans()
 {
 	// We return the number of channel we want to output to any Info CHOP
-	// connected to the CHOP. In this example we are just going to send one channel.
-	return 2;
+	// connected to the CHOP: the telemetry of the last cook.
+	return int32_t(infoValues.size());
 }
 
 void
@@ -458,25 +1733,14 @@ CPlusPlusCHOPExample::getInfoCHOPChan(int32_t index,
 										OP_InfoCHOPChan* chan)
 {
 	// This function will be called once for each channel we said we'd want to return
-	// In this example it'll only be called once.
-
-	if (index == 0)
-	{
-		chan->name = "executeCount";
-		chan->value = (float)myExecuteCount;
-	}
-
-	if (index == 1)
-	{
-		chan->name = "offset";
-		chan->value = (float)myOffset;
-	}
+	chan->name = infoValues[index].name;
+	chan->value = infoValues[index].value;
 }
 
 bool		
 CPlusPlusCHOPExample::getInfoDATSize(OP_InfoDATSize* infoSize)
 {
-	infoSize->rows = 2;
+	infoSize->rows = int32_t(infoValues.size());
 	infoSize->cols = 2;
 	// Setting this to false means we'll be assigning values to the table
 	// one row at a time. True means we'll do it one column at a time.
@@ -495,43 +1759,21 @@ CPlusPlusCHOPExample::getInfoDATEntries(int32_t index,
 	static char tempBuffer1[4096];
 	static char tempBuffer2[4096];
 
-	if (index == 0)
-	{
-		// Set the value for the first column
-#ifdef WIN32
-		strcpy_s(tempBuffer1, "executeCount");
-#else // macOS
-        strlcpy(tempBuffer1, "executeCount", sizeof(tempBuffer1));
-#endif
-		entries->values[0] = tempBuffer1;
-
-		// Set the value for the second column
-#ifdef WIN32
-		sprintf_s(tempBuffer2, "%d", myExecuteCount);
-#else // macOS
-        snprintf(tempBuffer2, sizeof(tempBuffer2), "%d", myExecuteCount);
-#endif
-		entries->values[1] = tempBuffer2;
-	}
-
-	if (index == 1)
-	{
-		// Set the value for the first column
+	// Set the value for the first column
 #ifdef WIN32
-        strcpy_s(tempBuffer1, "offset");
-#else // macOS
-        strlcpy(tempBuffer1, "offset", sizeof(tempBuffer1));
+	strcpy_s(tempBuffer1, infoValues[index].name);
+#else // macOS and Linux
+	snprintf(tempBuffer1, sizeof(tempBuffer1), "%s", infoValues[index].name);
 #endif
-		entries->values[0] = tempBuffer1;
+	entries->values[0] = tempBuffer1;
 
-		// Set the value for the second column
+	// Set the value for the second column
 #ifdef WIN32
-        sprintf_s(tempBuffer2, "%g", myOffset);
-#else // macOS
-        snprintf(tempBuffer2, sizeof(tempBuffer2), "%g", myOffset);
+	sprintf_s(tempBuffer2, "%g", infoValues[index].value);
+#else // macOS and Linux
+	snprintf(tempBuffer2, sizeof(tempBuffer2), "%g", infoValues[index].value);
 #endif
-		entries->values[1] = tempBuffer2;
-	}
+	entries->values[1] = tempBuffer2;
 }
 
 void
@@ -598,6 +1840,159 @@ CPlusPlusCHOPExample::setupParameters(OP_ParameterManager* manager)
 	}
 	*/
 
+	// run the simulation on a background thread
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Async";
+		np.label = "Async";
+		np.defaultValues[0] = 0.0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// step time budget, 0 for none
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Budget";
+		np.label = "Step Budget (ms)";
+		np.defaultValues[0] = 0.0;
+		np.minValues[0] = 0.0;
+		np.clampMins[0] = true;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 16.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// obstacles from a TOP, collided with through a distance field
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Collidertop";
+		sp.label = "Collider TOP";
+		sp.page = "Collider";
+
+		OP_ParAppendResult res = manager->appendTOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Colliderorigin";
+		np.label = "Collider Origin";
+		np.page = "Collider";
+		np.defaultValues[0] = -20.0;
+		np.defaultValues[1] = 0.0;
+
+		OP_ParAppendResult res = manager->appendXY(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Colliderwidth";
+		np.label = "Collider Width";
+		np.page = "Collider";
+		np.defaultValues[0] = 40.0;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 100.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Colliderthreshold";
+		np.label = "Collider Threshold";
+		np.page = "Collider";
+		np.defaultValues[0] = 0.5;
+		np.minSliders[0] = 0.0;
+		np.maxSliders[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendFloat(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Outlinechop";
+		sp.label = "Outline CHOP";
+		sp.page = "Outline";
+
+		OP_ParAppendResult res = manager->appendCHOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Outlinedat";
+		sp.label = "Outline DAT";
+		sp.page = "Outline";
+
+		OP_ParAppendResult res = manager->appendDAT(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	{
+		OP_StringParameter	sp;
+
+		sp.name = "Kinematicchop";
+		sp.label = "Kinematic CHOP";
+		sp.page = "Kinematic";
+
+		OP_ParAppendResult res = manager->appendCHOP(sp);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Outlineclosed";
+		np.label = "Closed Outline";
+		np.page = "Outline";
+		np.defaultValues[0] = 1.0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// output channel selection
+	for (int i = 0; i < k_outputChannelGroupCount; i++)
+	{
+		const OutputChannelGroup& group = k_outputChannelGroups[i];
+		OP_NumericParameter	np;
+
+		np.name = group.parameter;
+		np.label = group.label;
+		np.page = "Channels";
+		np.defaultValues[0] = group.enabled ? 1.0 : 0.0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
+	// spawn the input on every cook instead of on the Spawn pulse
+	{
+		OP_NumericParameter	np;
+
+		np.name = "Continuous";
+		np.label = "Continuous Spawn";
+		np.defaultValues[0] = 0.0;
+
+		OP_ParAppendResult res = manager->appendToggle(np);
+		assert(res == OP_ParAppendResult::Success);
+	}
+
 	// pulse spawn
 	{
 		OP_NumericParameter	np;
@@ -10,6 +10,9 @@
 
 #include "CHOP_CPlusPlusBase.h"
 #include <Box2D/Box2D.h>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 /*
 
@@ -27,6 +30,232 @@ If no input is connected then the node will output a smooth sine wave at 120hz.
 */
 
 
+// The samples of the spawn input, split into particles and bodies.
+struct SpawnBatch
+{
+	std::vector<b2Vec2>	particlePositions;
+	std::vector<b2Vec2>	particleVelocities;
+	std::vector<void*>	particleUserData;
+	std::vector<b2Vec2>	bodyPositions;
+	std::vector<b2Vec2>	bodyVelocities;
+	std::vector<float>	bodySizes;
+	std::vector<int>	bodyIds;
+};
+
+// The obstacles of the collider TOP: its red channel, one byte per pixel,
+// and where the pixels lie in the world.
+struct ColliderImage
+{
+	b2DistanceFieldDef			def;
+	uint8						threshold;
+	std::vector<unsigned char>	mask;
+};
+
+// Static geometry from the outline CHOP or DAT: polylines stored one after
+// the other, either all closed or all open.
+struct OutlinePolylines
+{
+	std::vector<b2Vec2>	vertices;
+	std::vector<int32>	counts;
+	bool				closed;
+};
+
+// Velocities from the steering input and the persistent ids of the
+// particles they go to.
+struct SteerBatch
+{
+	std::vector<int32>	ids;
+	std::vector<b2Vec2>	velocities;
+};
+
+// A box of the kinematic CHOP: where its center goes and its full size.
+struct KinematicBox
+{
+	b2Vec2	position;
+	float32	angle;
+	b2Vec2	size;
+};
+
+// Where the kinematic boxes go, and the seconds they take to get there.
+struct KinematicTargets
+{
+	std::vector<KinematicBox>	boxes;
+	float32						time;
+};
+
+// A change to the world requested by a cook. In async mode commands are
+// handed to the simulation thread, otherwise they are applied right away.
+struct SimCommand
+{
+	enum Type
+	{
+		e_setWalls,
+		e_spawn,
+		e_reset,
+		e_steer,
+		e_setCollider,
+		e_setOutline,
+		e_moveKinematic
+	};
+
+	Type		type;
+	// e_setWalls: positions of the two movable walls
+	b2Vec2		a;
+	b2Vec2		b;
+	// e_setWalls: seconds the walls take to get there, 0 to place them
+	float32		time;
+	// e_spawn: what to create, deleted once applied
+	SpawnBatch*	batch;
+	// e_steer: the new velocities, deleted once applied
+	SteerBatch*	steer;
+	// e_setCollider: the new obstacles, deleted once applied, or NULL to
+	// remove them
+	ColliderImage*	collider;
+	// e_setOutline: the new static geometry, owned by the simulation once
+	// applied, or NULL to remove it
+	OutlinePolylines*	outline;
+	// e_moveKinematic: the new targets, deleted once applied
+	KinematicTargets*	kinematic;
+};
+
+// Lock-free queue between exactly one producer and one consumer thread.
+template <typename T, int N>
+class SpscQueue
+{
+public:
+	SpscQueue() : head(0), tail(0) {}
+
+	// Called by the producer. Returns false if the queue is full.
+	bool push(const T& item)
+	{
+		int t = tail.load(std::memory_order_relaxed);
+		int next = (t + 1) % N;
+		if (next == head.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		items[t] = item;
+		tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// Called by the consumer. Returns false if the queue is empty.
+	bool pop(T* item)
+	{
+		int h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		*item = items[h];
+		head.store((h + 1) % N, std::memory_order_release);
+		return true;
+	}
+
+private:
+	T					items[N];
+	std::atomic<int>	head;
+	std::atomic<int>	tail;
+};
+
+// Groups of output channels, picked with the toggles on the Channels page.
+// Only the selected groups are computed and copied on each cook.
+enum OutputChannelFlags
+{
+	k_outputId = 1 << 0,			// id
+	k_outputPosition = 1 << 1,		// tx, ty
+	k_outputVelocity = 1 << 2,		// vx, vy
+	k_outputRadius = 1 << 3,		// radius
+	k_outputCount = 1 << 4,			// count
+	k_outputColor = 1 << 5,			// r, g, b, a
+	k_outputWeight = 1 << 6,		// weight
+	k_outputGroup = 1 << 7,			// group
+	k_outputLife = 1 << 8,			// life
+	k_outputContacts = 1 << 9,		// contacts
+	k_outputParticleId = 1 << 10	// pid
+};
+
+// Where the output channels are read from. Buffers of unselected channels
+// may be NULL, as may selected ones that are not available yet, which are
+// then output as zeros.
+struct ChannelSource
+{
+	ChannelSource() :
+		positions(NULL), velocities(NULL), userData(NULL), ids(NULL),
+		colors(NULL),
+		weights(NULL), groups(NULL), lives(NULL), contacts(NULL),
+		radius(0.0f), count(0)
+	{
+	}
+
+	const b2Vec2*			positions;
+	const b2Vec2*			velocities;
+	void* const*			userData;
+	const int32*			ids;
+	const b2ParticleColor*	colors;
+	const float*			weights;
+	const float*			groups;
+	const float*			lives;
+	const float*			contacts;
+	float					radius;
+	int						count;
+};
+
+// Telemetry for the Info CHOP and DAT, captured after stepping by the
+// thread that owns the world. steps, spawned and destroyed are running
+// totals, cooks report how much they grew.
+struct SimStats
+{
+	// Of the last step.
+	b2Profile		profile;
+	b2StepQuality	quality;
+	b2MemoryReport	memory;
+	int32			particleCount;
+	int32			particleCapacity;
+	int32			groupCount;
+	int32			bodyCount;
+	int32			contactCount;
+	int32			particleContactCount;
+	int32			bodyContactCount;
+	int32			outlineChains;
+	int32			outlineEdges;
+	int32			outlineCreated;
+	int32			steps;
+	int32			spawned;
+	int32			destroyed;
+};
+
+// A row of the Info CHOP and DAT.
+struct InfoValue
+{
+	const char*	name;
+	float		value;
+};
+
+// The particle state the simulation thread publishes after each step.
+// Only the channels in mask are filled in.
+struct SimFrame
+{
+	SimFrame() : mask(0), count(0), radius(0.0f), stats() {}
+
+	unsigned						mask;
+	int								count;
+	std::vector<b2Vec2>				positions;
+	std::vector<b2Vec2>				velocities;
+	std::vector<void*>				userData;
+	std::vector<int32>				ids;
+	std::vector<b2ParticleColor>	colors;
+	std::vector<float>				weights;
+	// Index of the particle's group in the group list, or -1.
+	std::vector<float>				groups;
+	// Remaining lifetime in seconds, <= 0 for particles that live forever.
+	std::vector<float>				lives;
+	// Number of fixtures the particle touches.
+	std::vector<float>				contacts;
+	float							radius;
+	SimStats						stats;
+};
+
 // To get more help about these functions, look at CHOP_CPlusPlusBase.h
 class CPlusPlusCHOPExample : public CHOP_CPlusPlusBase
 {
@@ -41,8 +270,30 @@ public:
 	// LiquidFun funtions
 	virtual void		m_generateGroundPlane();
 	virtual void		m_generateStaticBox(b2Vec2 pos, b2Vec2 size);
-	virtual void		m_generateDynamicCircle(int* eID, b2Vec2 pos, b2Vec2 vel, float size);
-	virtual void		m_spawnParticle(int* eID, b2Vec2 pos, b2Vec2 vel);
+	virtual b2Body*		m_generateKinematicBox(b2Vec2 pos, float32 angle,
+											   b2Vec2 size);
+	virtual void		m_generateDynamicCircle(int eID, b2Vec2 pos, b2Vec2 vel, float size);
+	virtual void		m_readSpawnBatch(const OP_CHOPInput* input,
+										 SpawnBatch* batch);
+	virtual void		m_spawnBatch(const SpawnBatch& batch);
+	virtual void		m_applyCommand(SimCommand& command);
+	virtual void		m_submitCommand(const SimCommand& command);
+	virtual void		m_readCollider(OP_Inputs* inputs);
+	virtual void		m_setCollider(const ColliderImage* image);
+	virtual void		m_readOutline(OP_Inputs* inputs);
+	virtual void		m_setOutline(OutlinePolylines* outline);
+	virtual void		m_createOutline();
+	virtual void		m_readWalls(OP_Inputs* inputs, float32 moveTime);
+	virtual void		m_readKinematic(OP_Inputs* inputs, float32 moveTime);
+	virtual void		m_moveKinematic(const KinematicTargets& targets);
+	virtual void		m_createKinematic();
+	virtual void		m_computeChannels(unsigned mask, SimFrame* frame);
+	virtual void		m_exportChannels(const CHOP_Output* output,
+										 const ChannelSource& source);
+	virtual void		m_captureStats(SimStats* stats);
+	virtual void		m_reportStats(const SimStats& stats);
+	virtual void		m_updateInfo();
+	virtual void		m_cook(OP_Inputs* inputs);
 
 	virtual void		execute(const CHOP_Output*,
 								OP_Inputs*,
@@ -68,20 +319,128 @@ private:
 	// this instance of the class (like its name).
 	const OP_NodeInfo		*myNodeInfo;
 
-	// In this example this value will be incremented each time the execute()
-	// function is called, then passes back to the CHOP 
+	// In this example this value will be incremented each time the CHOP cooks,
+	// then passes back to the CHOP
 	int32_t					 myExecuteCount;
-	double					 myOffset;
+
+	// Set when getOutputInfo() has cooked, so that execute() only outputs.
+	bool					 cooked;
 
 	///////////////////////////////////////////////////////////////////////////
 	// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 	// particle stuff
 
+	// Every instance simulates its own world, so several CHOPs in one
+	// process do not share state and may be stepped on separate threads.
+	// Construct a world object, which will hold and simulate the rigid bodies.
+	b2World					world;
+	// Steps the world at timeStep whatever the cook rate. The time between
+	// cooks is measured with cookTimer.
+	b2FixedTimeStepper		stepper;
+	b2Timer					cookTimer;
+	// Time between cooks, which kinematic bodies take to reach the
+	// positions of a cook.
+	b2Timer					moveTimer;
+
+	float32					timeStep;
+	int32					velocityIterations;
+	int32					positionIterations;
+	int32					particleIterations;
+
+	// Obstacles from the collider TOP as a distance field, owned by the
+	// thread that steps the world. The cook thread keeps the last image it
+	// sent, to send only changes.
+	b2DistanceField*		distanceField;
+	ColliderImage			colliderImage;
+	bool					colliderConnected;
+
+	// Static geometry from the outline CHOP or DAT, as chain fixtures on
+	// their own static body. The thread that steps the world owns the
+	// outline and the polylines it was last set to, which a reset applies
+	// again. The cook thread keeps the polylines it last sent.
+	b2Body*					outlineBody;
+	b2ChainOutline*			chainOutline;
+	OutlinePolylines*		outlinePolylines;
+	int32					outlineCreated;
+	OutlinePolylines		outlineSent;
+	bool					outlineConnected;
+
+	// The movable walls and the boxes of the kinematic CHOP are kinematic
+	// bodies, steered to their targets so that they push the fluid. The
+	// thread that steps the world owns the bodies and their last targets,
+	// which a reset puts back. The cook thread keeps the targets it last
+	// sent, to send only changes.
+	b2Body*					wallBodies[2];
+	b2Vec2					wallTargets[2];
+	bool					wallsPlaced;
+	b2Vec2					wallsSent[2];
+	bool					wallsSentValid;
+	std::vector<b2Body*>	kinematicBodies;
+	std::vector<KinematicBox>	kinematicBoxes;
+	std::vector<KinematicBox>	kinematicSent;
+
+	// Step time budget in milliseconds from the Budget parameter, 0 for
+	// none.
+	std::atomic<float>		stepBudget;
+
+	// Counted by the thread that owns the world: steps taken, and particles
+	// spawned before the last reset (m_pointCount counts since).
+	int32					stepCount;
+	int32					resetSpawnCount;
+	// Telemetry of the step the output comes from, what the totals in it
+	// grew by since the previous cook, and the rows built from them.
+	SimStats				stats;
+	int32					cookSteps;
+	int32					cookSpawned;
+	int32					cookDestroyed;
+	std::vector<InfoValue>	infoValues;
+
+	// Splits the output of large particle counts across cores.
+	b2ThreadPool			exportPool;
+
+	b2Body*					groundBody;
+	b2ParticleSystem*		m_particleSystem;
+	// point count tracker
+	int32					m_pointCount;
+
+	// Output channels selected at the last getOutputInfo(), their names,
+	// and a copy for the simulation thread in async mode.
+	unsigned				m_outputMask;
+	std::vector<const char*>	m_outputNames;
+	std::atomic<unsigned>	publishMask;
+	// Channels computed from the particle buffers on the cook thread.
+	SimFrame				syncChannels;
+
+	// Async mode: the world is stepped on simThread, which owns it while it
+	// runs. Cooks send it commands and read the frames it publishes through
+	// a triple buffer: the thread fills frames[backFrame], then swaps it
+	// with sharedFrame; cooks swap frames[frontFrame] with sharedFrame when
+	// sharedFrame holds a newer frame, flagged by k_newFrame.
+	void					m_startSimThread();
+	void					m_stopSimThread();
+	void					m_simulate();
+	void					m_publishFrame(int index);
+	bool					m_acquireFrame();
+
+	static const int		k_newFrame = 4;
+
+	std::thread				simThread;
+	std::atomic<bool>		simRunning;
+	SpscQueue<SimCommand, 16384>	commandQueue;
+	SimFrame				frames[3];
+	std::atomic<int>		sharedFrame;
+	int						backFrame;
+	int						frontFrame;
+
 	// reset flag
 	int						reset;
+	// world saved after the first cook, restored by reset
+	std::vector<unsigned char>	resetSnapshot;
 	// spawn flag
 	int						spawn;
 	int						pCount;
+	// particle positions interpolated between the last two steps
+	std::vector<b2Vec2>		interpolatedPositions;
 
 	b2Vec2					wallLeftPos;
 	b2Vec2					wallLeftSize;
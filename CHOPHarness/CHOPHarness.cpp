@@ -0,0 +1,871 @@
+// Runs CPlusPlusCHOPExample outside TouchDesigner, e.g. to profile it or
+// to check it on Linux.
+//
+// The harness stands in for the host: it records the parameters the CHOP
+// declares, feeds it scripted parameter values and input channels, and
+// cooks it the way TouchDesigner does (getOutputInfo(), getChannelName(),
+// execute() and the Info CHOP calls). It reports the percentiles of the
+// time each cook takes, a checksum of the last output and the Info CHOP
+// channels of the last cook.
+//
+// Build with CHOPHarness/CMakeLists.txt, or by hand with the library built
+// from Box2D/CMakeLists.txt:
+//   g++ -O2 -std=c++11 -I. -ICHOP -ICHOPHarness
+//       CHOPHarness/CHOPHarness.cpp CHOP/CPlusPlusCHOPExample.cpp
+//       <build>/libliquidfun.a -lpthread -o CHOPHarness
+//
+// Usage: CHOPHarness [script]
+//
+// Without a script a default scenario runs. Each script line is one of:
+//   fps <hz>               pace cooks at hz, 0 cooks back to back
+//   par <name> <values>    set a parameter
+//   pulse <name>           press a pulse parameter
+//   spawn <count>          connect input 0 with a grid of count samples
+//                          (id, x, y, vx, vy, size), 0 disconnects it
+//   steer <count> <vx> <vy>
+//                          connect input 1, steering the particles with
+//                          persistent ids 0 to count - 1, 0 disconnects it
+//   collider <width> <height>
+//                          set the collider TOP to an image with a disc in
+//                          the middle, 0 disconnects it
+//   outline <count> <radius> [speed]
+//                          connect the outline CHOP with a closed circle of
+//                          count vertices standing on the ground, with a
+//                          dent that moves speed vertices along it each
+//                          cook, 0 disconnects it
+//   kinematic <count> <radius> [speed]
+//                          connect the kinematic CHOP with count paddles on
+//                          a circle of radius above the ground, turning
+//                          speed degrees each cook, 0 disconnects it
+//   cook <count>           cook count times
+//   report <label>         print the latency of the cooks since the last
+//                          report
+// Text after a # is ignored.
+
+#include "CPlusPlusCHOPExample.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C"
+{
+	int32_t GetCHOPAPIVersion(void);
+	CHOP_CPlusPlusBase* CreateCHOPInstance(const OP_NodeInfo* info);
+	void DestroyCHOPInstance(CHOP_CPlusPlusBase* instance);
+}
+
+static const char* k_defaultScript[] =
+{
+	"fps 60",
+	"cook 30",
+	"report idle",
+	"spawn 100",
+	"par Continuous 1",
+	"cook 120",
+	"report spawning 100 per cook",
+	"par Continuous 0",
+	"steer 1000 0 20",
+	"cook 120",
+	"report steering 1000",
+	"par Outcolor 1",
+	"par Outcontacts 1",
+	"cook 120",
+	"report more channels",
+	"par Async 1",
+	"cook 120",
+	"report async",
+	"par Async 0",
+	"pulse Reset",
+	"cook 30",
+	"report after reset",
+};
+
+// A CHOP input owning its channels.
+class MockCHOPInput : public OP_CHOPInput
+{
+public:
+	MockCHOPInput(const char* path, int32_t channelCount)
+	{
+		memset(static_cast<OP_CHOPInput*>(this), 0, sizeof(OP_CHOPInput));
+		opPath = path;
+		numChannels = channelCount;
+		sampleRate = 60.0;
+		data.resize(channelCount);
+		pointers.resize(channelCount);
+		names.resize(channelCount, "chan");
+		nameData = &names[0];
+	}
+
+	void resize(int32_t sampleCount)
+	{
+		numSamples = sampleCount;
+		for (int32_t i = 0; i < numChannels; i++)
+		{
+			data[i].resize(sampleCount);
+			pointers[i] = sampleCount ? &data[i][0] : NULL;
+		}
+		channelData = &pointers[0];
+	}
+
+	float* channel(int32_t i)
+	{
+		return &data[i][0];
+	}
+
+private:
+	std::vector<std::vector<float> >	data;
+	std::vector<const float*>			pointers;
+	std::vector<const char*>			names;
+};
+
+// Parameter values by name. The CHOP declares them with their defaults.
+class MockParameters : public OP_ParameterManager
+{
+public:
+	void set(const std::string& name, const std::vector<double>& values)
+	{
+		std::vector<double>& par = values_[name];
+		par.resize(std::max(par.size(), values.size()));
+		std::copy(values.begin(), values.end(), par.begin());
+	}
+
+	double get(const char* name, int32_t index) const
+	{
+		std::map<std::string, std::vector<double> >::const_iterator it =
+			values_.find(name);
+		if (it == values_.end() || index >= int32_t(it->second.size()))
+		{
+			fprintf(stderr, "unknown parameter %s[%d]\n", name, index);
+			return 0.0;
+		}
+		return it->second[index];
+	}
+
+	bool has(const std::string& name) const
+	{
+		return values_.count(name) != 0;
+	}
+
+	virtual OP_ParAppendResult appendFloat(const OP_NumericParameter &np,
+										   int32_t size)
+	{
+		return append(np, size);
+	}
+	virtual OP_ParAppendResult appendInt(const OP_NumericParameter &np,
+										 int32_t size)
+	{
+		return append(np, size);
+	}
+	virtual OP_ParAppendResult appendXY(const OP_NumericParameter &np)
+	{
+		return append(np, 2);
+	}
+	virtual OP_ParAppendResult appendXYZ(const OP_NumericParameter &np)
+	{
+		return append(np, 3);
+	}
+	virtual OP_ParAppendResult appendUV(const OP_NumericParameter &np)
+	{
+		return append(np, 2);
+	}
+	virtual OP_ParAppendResult appendUVW(const OP_NumericParameter &np)
+	{
+		return append(np, 3);
+	}
+	virtual OP_ParAppendResult appendRGB(const OP_NumericParameter &np)
+	{
+		return append(np, 3);
+	}
+	virtual OP_ParAppendResult appendRGBA(const OP_NumericParameter &np)
+	{
+		return append(np, 4);
+	}
+	virtual OP_ParAppendResult appendToggle(const OP_NumericParameter &np)
+	{
+		return append(np, 1);
+	}
+	virtual OP_ParAppendResult appendPulse(const OP_NumericParameter &np)
+	{
+		return append(np, 1);
+	}
+	virtual OP_ParAppendResult appendString(const OP_StringParameter &sp)
+	{
+		return appendString(sp.name);
+	}
+	virtual OP_ParAppendResult appendFile(const OP_StringParameter &sp)
+	{
+		return appendString(sp.name);
+	}
+	virtual OP_ParAppendResult appendFolder(const OP_StringParameter &sp)
+	{
+		return appendString(sp.name);
+	}
+	virtual OP_ParAppendResult appendDAT(const OP_StringParameter &sp)
+	{
+		return appendString(sp.name);
+	}
+	virtual OP_ParAppendResult appendCHOP(const OP_StringParameter &sp)
+	{
+		return appendString(sp.name);
+	}
+	virtual OP_ParAppendResult appendTOP(const OP_StringParameter &sp)
+	{
+		return appendString(sp.name);
+	}
+	virtual OP_ParAppendResult appendObject(const OP_StringParameter &sp)
+	{
+		return appendString(sp.name);
+	}
+	virtual OP_ParAppendResult appendMenu(const OP_StringParameter &sp,
+										  int32_t nitems, const char **names,
+										  const char **labels)
+	{
+		return appendString(sp.name);
+	}
+	virtual OP_ParAppendResult appendStringMenu(
+		const OP_StringParameter &sp, int32_t nitems, const char **names,
+		const char **labels)
+	{
+		return appendString(sp.name);
+	}
+
+private:
+	OP_ParAppendResult append(const OP_NumericParameter &np, int32_t size)
+	{
+		if (has(np.name))
+		{
+			return OP_ParAppendResult::InvalidName;
+		}
+		values_[np.name].assign(np.defaultValues, np.defaultValues + size);
+		return OP_ParAppendResult::Success;
+	}
+
+	OP_ParAppendResult appendString(const char* name)
+	{
+		// String parameters are not scripted, they read as 0.
+		values_[name].assign(1, 0.0);
+		return OP_ParAppendResult::Success;
+	}
+
+	std::map<std::string, std::vector<double> >	values_;
+};
+
+// What execute() sees of the host.
+class MockInputs : public OP_Inputs
+{
+public:
+	MockInputs(const MockParameters* parameters) :
+		parameters(parameters), spawnInput("spawn", 6),
+		steerInput("steer", 3), spawnConnected(false),
+		steerConnected(false), colliderConnected(false),
+		colliderDownloaded(false), outlineInput("outline", 2),
+		outlineConnected(false), outlineRadius(0.0f), outlineSpeed(0),
+		outlineDent(0), kinematicInput("kinematic", 5),
+		kinematicConnected(false), kinematicRadius(0.0f),
+		kinematicSpeed(0.0f), kinematicAngle(0.0f)
+	{
+		memset(&colliderTop, 0, sizeof(colliderTop));
+		colliderTop.opPath = "collider";
+	}
+
+	virtual int32_t getNumInputs()
+	{
+		// Inputs are positional, connecting input 1 implies input 0.
+		return steerConnected ? 2 : spawnConnected ? 1 : 0;
+	}
+	virtual const OP_TOPInput* getInputTOP(int32_t index)
+	{
+		return NULL;
+	}
+	virtual const OP_CHOPInput* getInputCHOP(int32_t index)
+	{
+		return index == 0 ? &spawnInput : index == 1 ? &steerInput : NULL;
+	}
+	virtual const OP_DATInput* getParDAT(const char *name)
+	{
+		return NULL;
+	}
+	virtual const OP_TOPInput* getParTOP(const char *name)
+	{
+		return colliderConnected ? &colliderTop : NULL;
+	}
+	virtual const OP_CHOPInput* getParCHOP(const char *name)
+	{
+		if (outlineConnected && !strcmp(name, "Outlinechop"))
+		{
+			return &outlineInput;
+		}
+		return kinematicConnected && !strcmp(name, "Kinematicchop") ?
+			&kinematicInput : NULL;
+	}
+	virtual const OP_ObjectInput* getParObject(const char *name)
+	{
+		return NULL;
+	}
+	virtual double getParDouble(const char* name, int32_t index)
+	{
+		return parameters->get(name, index);
+	}
+	virtual bool getParDouble2(const char* name, double &v0, double &v1)
+	{
+		v0 = getParDouble(name, 0);
+		v1 = getParDouble(name, 1);
+		return true;
+	}
+	virtual bool getParDouble3(const char* name, double &v0, double &v1,
+							   double &v2)
+	{
+		getParDouble2(name, v0, v1);
+		v2 = getParDouble(name, 2);
+		return true;
+	}
+	virtual bool getParDouble4(const char* name, double &v0, double &v1,
+							   double &v2, double &v3)
+	{
+		getParDouble3(name, v0, v1, v2);
+		v3 = getParDouble(name, 3);
+		return true;
+	}
+	virtual int32_t getParInt(const char* name, int32_t index)
+	{
+		return int32_t(parameters->get(name, index));
+	}
+	virtual bool getParInt2(const char* name, int32_t &v0, int32_t &v1)
+	{
+		v0 = getParInt(name, 0);
+		v1 = getParInt(name, 1);
+		return true;
+	}
+	virtual bool getParInt3(const char* name, int32_t &v0, int32_t &v1,
+							int32_t &v2)
+	{
+		getParInt2(name, v0, v1);
+		v2 = getParInt(name, 2);
+		return true;
+	}
+	virtual bool getParInt4(const char* name, int32_t &v0, int32_t &v1,
+							int32_t &v2, int32_t &v3)
+	{
+		getParInt3(name, v0, v1, v2);
+		v3 = getParInt(name, 3);
+		return true;
+	}
+	virtual const char* getParString(const char* name)
+	{
+		return "";
+	}
+	virtual const char* getParFilePath(const char* name)
+	{
+		return "";
+	}
+	virtual bool getRelativeTransform(const char* from_name,
+									  const char* to_name,
+									  double matrix[4][4])
+	{
+		return false;
+	}
+	virtual void enablePar(const char* name, bool onoff)
+	{
+	}
+	virtual const OP_DATInput* getDAT(const char *path)
+	{
+		return NULL;
+	}
+	virtual const OP_TOPInput* getTOP(const char *path)
+	{
+		return NULL;
+	}
+	virtual const OP_CHOPInput* getCHOP(const char *path)
+	{
+		return NULL;
+	}
+	virtual const OP_ObjectInput* getObject(const char *path)
+	{
+		return NULL;
+	}
+	virtual void* getTOPDataInCPUMemory(
+		const OP_TOPInput *top, const OP_TOPInputDownloadOptions *options)
+	{
+		// Like a delayed download, the first call only starts it.
+		if (top != &colliderTop ||
+			options->cpuMemPixelType != OP_CPUMemPixelType::R8Fixed ||
+			!colliderDownloaded)
+		{
+			colliderDownloaded = top == &colliderTop;
+			return NULL;
+		}
+		return &colliderPixels[0];
+	}
+
+	const MockParameters*	parameters;
+	MockCHOPInput			spawnInput;
+	MockCHOPInput			steerInput;
+	bool					spawnConnected;
+	bool					steerConnected;
+	OP_TOPInput				colliderTop;
+	std::vector<unsigned char>	colliderPixels;
+	bool					colliderConnected;
+	bool					colliderDownloaded;
+	MockCHOPInput			outlineInput;
+	bool					outlineConnected;
+	float					outlineRadius;
+	int32_t					outlineSpeed;
+	int32_t					outlineDent;
+	MockCHOPInput			kinematicInput;
+	bool					kinematicConnected;
+	float					kinematicRadius;
+	float					kinematicSpeed;
+	float					kinematicAngle;
+};
+
+// Spawn particles on a grid above the ground, spaced like a particle
+// group of the default radius, with ids counting up.
+static void
+fillSpawnInput(MockCHOPInput* input, int32_t count)
+{
+	input->resize(count);
+	const int32_t columns = 50;
+	const float spacing = 1.5f;
+	for (int32_t j = 0; j < count; j++)
+	{
+		input->channel(0)[j] = float(j);
+		input->channel(1)[j] = spacing * float(j % columns - columns / 2);
+		input->channel(2)[j] = 20.0f + spacing * float(j / columns);
+		input->channel(3)[j] = 0.0f;
+		input->channel(4)[j] = 0.0f;
+		input->channel(5)[j] = 1.0f;
+	}
+}
+
+static void
+fillSteerInput(MockCHOPInput* input, int32_t count, float vx, float vy)
+{
+	input->resize(count);
+	for (int32_t j = 0; j < count; j++)
+	{
+		input->channel(0)[j] = float(j);
+		input->channel(1)[j] = vx;
+		input->channel(2)[j] = vy;
+	}
+}
+
+// A collider image: a disc a quarter of the height across, in the middle.
+static void
+fillColliderTop(MockInputs* inputs, int32_t width, int32_t height)
+{
+	inputs->colliderTop.width = width;
+	inputs->colliderTop.height = height;
+	inputs->colliderPixels.resize(size_t(width) * size_t(height));
+	const float radius = 0.125f * float(height);
+	for (int32_t y = 0; y < height; y++)
+	{
+		for (int32_t x = 0; x < width; x++)
+		{
+			const float dx = float(x) - 0.5f * float(width);
+			const float dy = float(y) - 0.5f * float(height);
+			inputs->colliderPixels[y * width + x] =
+				dx * dx + dy * dy < radius * radius ? 255 : 0;
+		}
+	}
+	inputs->colliderDownloaded = false;
+	inputs->colliderConnected = width > 0 && height > 0;
+}
+
+// The outline: a circle with a dent a tenth of the radius deep over a
+// hundredth of the vertices. Only the vertices of the dent differ from the
+// circle, so moving it changes a small part of the outline.
+static void
+fillOutlineInput(MockInputs* inputs)
+{
+	MockCHOPInput* input = &inputs->outlineInput;
+	const int32_t count = input->numSamples;
+	const int32_t width = std::max(count / 100, 1);
+	const float radius = inputs->outlineRadius;
+	for (int32_t j = 0; j < count; j++)
+	{
+		int32_t offset = (j - inputs->outlineDent) % count;
+		offset = std::min((offset + count) % count, (count - offset) % count);
+		float r = radius;
+		if (offset < width)
+		{
+			r -= 0.05f * radius *
+				(1.0f + cosf(3.14159265f * float(offset) / float(width)));
+		}
+		const float angle = 6.28318531f * float(j) / float(count);
+		input->channel(0)[j] = r * cosf(angle);
+		input->channel(1)[j] = radius + r * sinf(angle);
+	}
+}
+
+// The kinematic paddles: boxes 4 by 0.5 spread over a circle centered
+// above the ground, facing its center, turned by kinematicAngle degrees.
+static void
+fillKinematicInput(MockInputs* inputs)
+{
+	MockCHOPInput* input = &inputs->kinematicInput;
+	const int32_t count = input->numSamples;
+	const float radius = inputs->kinematicRadius;
+	for (int32_t j = 0; j < count; j++)
+	{
+		const float degrees =
+			inputs->kinematicAngle + 360.0f * float(j) / float(count);
+		const float angle = 0.0174532925f * degrees;
+		input->channel(0)[j] = radius * cosf(angle);
+		input->channel(1)[j] = 20.0f + radius * sinf(angle);
+		input->channel(2)[j] = degrees;
+		input->channel(3)[j] = 4.0f;
+		input->channel(4)[j] = 0.5f;
+	}
+}
+
+// Cooks a CHOP instance like TouchDesigner does and times each cook.
+class Host
+{
+public:
+	Host() : inputs(&parameters), chop(NULL), fps(60.0),
+		checksum(0.0), sampleCount(0)
+	{
+		memset(&nodeInfo, 0, sizeof(nodeInfo));
+		nodeInfo.opPath = "/harness/cplusplus1";
+		chop = CreateCHOPInstance(&nodeInfo);
+		chop->setupParameters(&parameters);
+		nextCook = std::chrono::steady_clock::now();
+	}
+
+	~Host()
+	{
+		DestroyCHOPInstance(chop);
+	}
+
+	void cook()
+	{
+		if (fps > 0.0)
+		{
+			nextCook += std::chrono::microseconds(int64_t(1e6 / fps));
+			std::this_thread::sleep_until(nextCook);
+		}
+		else
+		{
+			nextCook = std::chrono::steady_clock::now();
+		}
+
+		if (inputs.outlineConnected && inputs.outlineSpeed != 0)
+		{
+			inputs.outlineDent += inputs.outlineSpeed;
+			fillOutlineInput(&inputs);
+		}
+		if (inputs.kinematicConnected && inputs.kinematicSpeed != 0.0f)
+		{
+			inputs.kinematicAngle += inputs.kinematicSpeed;
+			fillKinematicInput(&inputs);
+		}
+
+		// The host allocates the output between getOutputInfo() and
+		// execute(), which is left out of the measured time.
+		std::chrono::steady_clock::time_point start =
+			std::chrono::steady_clock::now();
+		CHOP_GeneralInfo generalInfo;
+		memset(&generalInfo, 0, sizeof(generalInfo));
+		chop->getGeneralInfo(&generalInfo);
+		CHOP_OutputInfo outputInfo;
+		memset(&outputInfo, 0, sizeof(outputInfo));
+		outputInfo.opInputs = &inputs;
+		chop->getOutputInfo(&outputInfo);
+		names.resize(outputInfo.numChannels);
+		for (int32_t i = 0; i < outputInfo.numChannels; i++)
+		{
+			names[i] = chop->getChannelName(i, NULL);
+		}
+		std::chrono::steady_clock::duration setup =
+			std::chrono::steady_clock::now() - start;
+
+		allocateOutput(outputInfo.numChannels, outputInfo.numSamples);
+		CHOP_Output output(outputInfo.numChannels, outputInfo.numSamples,
+						   outputInfo.sampleRate, outputInfo.startIndex);
+		output.names = names.empty() ? NULL : &names[0];
+		output.channels = channelPointers.empty() ? NULL :
+			&channelPointers[0];
+
+		start = std::chrono::steady_clock::now();
+		chop->execute(&output, &inputs, NULL);
+		int32_t infoCount = chop->getNumInfoCHOPChans();
+		info.resize(infoCount);
+		for (int32_t i = 0; i < infoCount; i++)
+		{
+			chop->getInfoCHOPChan(i, &info[i]);
+		}
+		std::chrono::steady_clock::duration run =
+			std::chrono::steady_clock::now() - start;
+		latencies.push_back(
+			std::chrono::duration<double, std::milli>(setup + run).count());
+
+		sampleCount = outputInfo.numSamples;
+		checksum = 0.0;
+		for (int32_t i = 0; i < outputInfo.numChannels; i++)
+		{
+			for (int32_t j = 0; j < outputInfo.numSamples; j++)
+			{
+				checksum += channels[i][j];
+			}
+		}
+	}
+
+	void report(const char* label)
+	{
+		if (latencies.empty())
+		{
+			return;
+		}
+		std::vector<double> sorted = latencies;
+		std::sort(sorted.begin(), sorted.end());
+		double total = 0.0;
+		for (size_t i = 0; i < sorted.size(); i++)
+		{
+			total += sorted[i];
+		}
+		printf("%-28s cooks %4d  mean %7.3f  p50 %7.3f  p90 %7.3f  "
+			   "p99 %7.3f  max %7.3f ms  samples %d  checksum %.6g\n",
+			   label, int(sorted.size()), total / sorted.size(),
+			   percentile(sorted, 0.5), percentile(sorted, 0.9),
+			   percentile(sorted, 0.99), sorted.back(), sampleCount,
+			   checksum);
+		// The Info CHOP channels of the last cook.
+		for (size_t i = 0; i < info.size(); i++)
+		{
+			printf("%s%s %g", i % 6 ? "  " : "    ", info[i].name,
+				   info[i].value);
+			if (i % 6 == 5 || i + 1 == info.size())
+			{
+				printf("\n");
+			}
+		}
+		fflush(stdout);
+		latencies.clear();
+	}
+
+	MockParameters			parameters;
+	MockInputs				inputs;
+	CHOP_CPlusPlusBase*		chop;
+	double					fps;
+
+private:
+	static double percentile(const std::vector<double>& sorted, double p)
+	{
+		size_t index = size_t(p * (sorted.size() - 1) + 0.5);
+		return sorted[std::min(index, sorted.size() - 1)];
+	}
+
+	void allocateOutput(int32_t channelCount, int32_t sampleCount)
+	{
+		channels.resize(channelCount);
+		channelPointers.resize(channelCount);
+		for (int32_t i = 0; i < channelCount; i++)
+		{
+			channels[i].assign(std::max(sampleCount, 1), 0.0f);
+			channelPointers[i] = &channels[i][0];
+		}
+	}
+
+	OP_NodeInfo							nodeInfo;
+	std::vector<const char*>			names;
+	std::vector<std::vector<float> >	channels;
+	std::vector<float*>					channelPointers;
+	std::vector<double>					latencies;
+	std::vector<OP_InfoCHOPChan>		info;
+	std::chrono::steady_clock::time_point	nextCook;
+	double								checksum;
+	int32_t								sampleCount;
+};
+
+// Run one script line. Returns false if it is not understood.
+static bool
+runLine(Host* host, const std::string& line)
+{
+	std::string text = line.substr(0, line.find('#'));
+	char command[64];
+	char name[256];
+	int count = 0;
+	if (sscanf(text.c_str(), "%63s", command) != 1)
+	{
+		return true;
+	}
+	if (!strcmp(command, "fps"))
+	{
+		return sscanf(text.c_str(), "%*s %lf", &host->fps) == 1;
+	}
+	if (!strcmp(command, "par"))
+	{
+		int offset = 0;
+		if (sscanf(text.c_str(), "%*s %255s%n", name, &offset) != 1 ||
+			!host->parameters.has(name))
+		{
+			return false;
+		}
+		std::vector<double> values;
+		const char* p = text.c_str() + offset;
+		char* end;
+		for (double v = strtod(p, &end); end != p; v = strtod(p, &end))
+		{
+			values.push_back(v);
+			p = end;
+		}
+		host->parameters.set(name, values);
+		return !values.empty();
+	}
+	if (!strcmp(command, "pulse"))
+	{
+		if (sscanf(text.c_str(), "%*s %255s", name) != 1)
+		{
+			return false;
+		}
+		host->chop->pulsePressed(name);
+		return true;
+	}
+	if (!strcmp(command, "spawn"))
+	{
+		if (sscanf(text.c_str(), "%*s %d", &count) != 1)
+		{
+			return false;
+		}
+		fillSpawnInput(&host->inputs.spawnInput, count);
+		host->inputs.spawnConnected = count > 0;
+		return true;
+	}
+	if (!strcmp(command, "steer"))
+	{
+		float vx = 0.0f, vy = 0.0f;
+		if (sscanf(text.c_str(), "%*s %d %f %f", &count, &vx, &vy) < 1)
+		{
+			return false;
+		}
+		fillSteerInput(&host->inputs.steerInput, count, vx, vy);
+		host->inputs.steerConnected = count > 0;
+		return true;
+	}
+	if (!strcmp(command, "collider"))
+	{
+		int width = 0, height = 0;
+		if (sscanf(text.c_str(), "%*s %d %d", &width, &height) < 1)
+		{
+			return false;
+		}
+		fillColliderTop(&host->inputs, width, height);
+		return true;
+	}
+	if (!strcmp(command, "outline"))
+	{
+		float radius = 10.0f;
+		int speed = 0;
+		if (sscanf(text.c_str(), "%*s %d %f %d", &count, &radius,
+				   &speed) < 1)
+		{
+			return false;
+		}
+		MockInputs* inputs = &host->inputs;
+		inputs->outlineInput.resize(count);
+		inputs->outlineRadius = radius;
+		inputs->outlineSpeed = speed;
+		inputs->outlineDent = 0;
+		inputs->outlineConnected = count > 0;
+		if (count > 0)
+		{
+			fillOutlineInput(inputs);
+		}
+		return true;
+	}
+	if (!strcmp(command, "kinematic"))
+	{
+		float radius = 10.0f;
+		float speed = 0.0f;
+		if (sscanf(text.c_str(), "%*s %d %f %f", &count, &radius,
+				   &speed) < 1)
+		{
+			return false;
+		}
+		MockInputs* inputs = &host->inputs;
+		inputs->kinematicInput.resize(count);
+		inputs->kinematicRadius = radius;
+		inputs->kinematicSpeed = speed;
+		inputs->kinematicAngle = 0.0f;
+		inputs->kinematicConnected = count > 0;
+		if (count > 0)
+		{
+			fillKinematicInput(inputs);
+		}
+		return true;
+	}
+	if (!strcmp(command, "cook"))
+	{
+		if (sscanf(text.c_str(), "%*s %d", &count) != 1)
+		{
+			return false;
+		}
+		for (int i = 0; i < count; i++)
+		{
+			host->cook();
+		}
+		return true;
+	}
+	if (!strcmp(command, "report"))
+	{
+		std::string label = text.substr(text.find("report") + 6);
+		label.erase(0, label.find_first_not_of(" \t"));
+		label.erase(label.find_last_not_of(" \t\r\n") + 1);
+		host->report(label.c_str());
+		return true;
+	}
+	return false;
+}
+
+int
+main(int argc, char** argv)
+{
+	if (GetCHOPAPIVersion() != CHOP_CPLUSPLUS_API_VERSION)
+	{
+		fprintf(stderr, "CHOP API version mismatch\n");
+		return 1;
+	}
+
+	std::vector<std::string> script;
+	if (argc > 1)
+	{
+		FILE* file = fopen(argv[1], "r");
+		if (!file)
+		{
+			fprintf(stderr, "cannot open %s\n", argv[1]);
+			return 1;
+		}
+		char line[1024];
+		while (fgets(line, sizeof(line), file))
+		{
+			script.push_back(line);
+		}
+		fclose(file);
+	}
+	else
+	{
+		script.assign(k_defaultScript, k_defaultScript +
+					  sizeof(k_defaultScript) / sizeof(k_defaultScript[0]));
+	}
+
+	Host host;
+	for (size_t i = 0; i < script.size(); i++)
+	{
+		if (!runLine(&host, script[i]))
+		{
+			fprintf(stderr, "line %d: cannot run: %s\n", int(i + 1),
+					script[i].c_str());
+			return 1;
+		}
+	}
+	host.report("end");
+	return 0;
+}
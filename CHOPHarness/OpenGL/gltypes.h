@@ -0,0 +1,21 @@
+// Stand-in for the macOS <OpenGL/gltypes.h> that CPlusPlus_Common.h
+// includes on every platform but Windows. It declares the few GL types the
+// CHOP API headers use, so that the CHOP builds on Linux without OpenGL.
+
+#ifndef CHOP_HARNESS_GLTYPES_H
+#define CHOP_HARNESS_GLTYPES_H
+
+#include <stdint.h>
+
+typedef unsigned int	GLuint;
+typedef int				GLint;
+typedef unsigned int	GLenum;
+typedef float			GLfloat;
+
+// CHOP_CPlusPlusBase.h declares its entry points __cdecl, which GCC on
+// x86-64 does not know.
+#if !defined(_MSC_VER) && !defined(__cdecl)
+#define __cdecl
+#endif
+
+#endif
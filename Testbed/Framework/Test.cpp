@@ -21,6 +21,48 @@
 #include "Main.h"
 #include <stdio.h>
 
+// Particle solver stages shown in the profile overlay.
+struct ParticleProfileStage
+{
+	const char* name;
+	float32 b2ParticleProfile::*time;
+};
+
+static const ParticleProfileStage k_particleProfileStages[] = {
+	{"particle total", &b2ParticleProfile::total},
+	{"  lifetimes", &b2ParticleProfile::solveLifetimes},
+	{"  zombie", &b2ParticleProfile::solveZombie},
+	{"  update proxies", &b2ParticleProfile::updateProxies},
+	{"  sort proxies", &b2ParticleProfile::sortProxies},
+	{"  find contacts", &b2ParticleProfile::findContacts},
+	{"  body contacts", &b2ParticleProfile::updateBodyContacts},
+	{"  weight", &b2ParticleProfile::computeWeight},
+	{"  depth", &b2ParticleProfile::computeDepth},
+	{"  reactive pairs/triads", &b2ParticleProfile::updatePairsAndTriads},
+	{"  force", &b2ParticleProfile::solveForce},
+	{"  viscous", &b2ParticleProfile::solveViscous},
+	{"  repulsive", &b2ParticleProfile::solveRepulsive},
+	{"  powder", &b2ParticleProfile::solvePowder},
+	{"  tensile", &b2ParticleProfile::solveTensile},
+	{"  solid", &b2ParticleProfile::solveSolid},
+	{"  color mixing", &b2ParticleProfile::solveColorMixing},
+	{"  gravity", &b2ParticleProfile::solveGravity},
+	{"  static pressure", &b2ParticleProfile::solveStaticPressure},
+	{"  pressure", &b2ParticleProfile::solvePressure},
+	{"  damping", &b2ParticleProfile::solveDamping},
+	{"  extra damping", &b2ParticleProfile::solveExtraDamping},
+	{"  elastic", &b2ParticleProfile::solveElastic},
+	{"  spring", &b2ParticleProfile::solveSpring},
+	{"  limit velocity", &b2ParticleProfile::limitVelocity},
+	{"  rigid damping", &b2ParticleProfile::solveRigidDamping},
+	{"  barrier", &b2ParticleProfile::solveBarrier},
+	{"  collision", &b2ParticleProfile::solveCollision},
+	{"  distance field", &b2ParticleProfile::solveDistanceField},
+	{"  rigid", &b2ParticleProfile::solveRigid},
+	{"  wall", &b2ParticleProfile::solveWall},
+	{"  integrate", &b2ParticleProfile::integrate},
+};
+
 void DestructionListener::SayGoodbye(b2Joint* joint)
 {
 	if (test->m_mouseJoint == joint)
@@ -432,6 +474,13 @@ void Test::Step(Settings* settings)
 		m_totalProfile.solvePosition += p.solvePosition;
 		m_totalProfile.solveTOI += p.solveTOI;
 		m_totalProfile.broadphase += p.broadphase;
+
+		for (uint32 i = 0; i < B2_ARRAY_SIZE(k_particleProfileStages); ++i)
+		{
+			float32 b2ParticleProfile::*time = k_particleProfileStages[i].time;
+			m_maxProfile.particle.*time = b2Max(m_maxProfile.particle.*time, p.particle.*time);
+			m_totalProfile.particle.*time += p.particle.*time;
+		}
 	}
 
 	if (settings->drawProfile)
@@ -469,6 +518,21 @@ void Test::Step(Settings* settings)
 		m_textLine += DRAW_STRING_NEW_LINE;
 		m_debugDraw.DrawString(5, m_textLine, "broad-phase [ave] (max) = %5.2f [%6.2f] (%6.2f)", p.broadphase, aveProfile.broadphase, m_maxProfile.broadphase);
 		m_textLine += DRAW_STRING_NEW_LINE;
+
+		// Only list the particle stages that have run.
+		for (uint32 i = 0; i < B2_ARRAY_SIZE(k_particleProfileStages); ++i)
+		{
+			const ParticleProfileStage& stage = k_particleProfileStages[i];
+			if (m_maxProfile.particle.*stage.time <= 0.0f)
+			{
+				continue;
+			}
+			float32 ave = m_stepCount > 0 ? m_totalProfile.particle.*stage.time / m_stepCount : 0.0f;
+			m_debugDraw.DrawString(5, m_textLine, "%s [ave] (max) = %5.2f [%6.2f] (%6.2f)", stage.name, p.particle.*stage.time, ave, m_maxProfile.particle.*stage.time);
+			m_textLine += DRAW_STRING_NEW_LINE;
+		}
+		m_debugDraw.DrawString(5, m_textLine, "particle checks/contacts/body contacts = %d/%d/%d", p.particle.checkCount, p.particle.contactCount, p.particle.bodyContactCount);
+		m_textLine += DRAW_STRING_NEW_LINE;
 	}
 
 	if (m_mouseTracing && !m_mouseJoint)
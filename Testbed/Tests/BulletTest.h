@@ -76,9 +76,9 @@ public:
 		m_bullet->SetLinearVelocity(b2Vec2(0.0f, -50.0f));
 		m_bullet->SetAngularVelocity(0.0f);
 
-		extern int32 b2_gjkCalls, b2_gjkIters, b2_gjkMaxIters;
-		extern int32 b2_toiCalls, b2_toiIters, b2_toiMaxIters;
-		extern int32 b2_toiRootIters, b2_toiMaxRootIters;
+		extern thread_local int32 b2_gjkCalls, b2_gjkIters, b2_gjkMaxIters;
+		extern thread_local int32 b2_toiCalls, b2_toiIters, b2_toiMaxIters;
+		extern thread_local int32 b2_toiRootIters, b2_toiMaxRootIters;
 
 		b2_gjkCalls = 0;
 		b2_gjkIters = 0;
@@ -95,9 +95,9 @@ public:
 	{
 		Test::Step(settings);
 
-		extern int32 b2_gjkCalls, b2_gjkIters, b2_gjkMaxIters;
-		extern int32 b2_toiCalls, b2_toiIters;
-		extern int32 b2_toiRootIters, b2_toiMaxRootIters;
+		extern thread_local int32 b2_gjkCalls, b2_gjkIters, b2_gjkMaxIters;
+		extern thread_local int32 b2_toiCalls, b2_toiIters;
+		extern thread_local int32 b2_toiRootIters, b2_toiMaxRootIters;
 
 		if (b2_gjkCalls > 0)
 		{
@@ -68,7 +68,7 @@ public:
 		m_debugDraw.DrawString(5, m_textLine, "toi = %g", output.t);
 		m_textLine += DRAW_STRING_NEW_LINE;
 
-		extern int32 b2_toiMaxIters, b2_toiMaxRootIters;
+		extern thread_local int32 b2_toiMaxIters, b2_toiMaxRootIters;
 		m_debugDraw.DrawString(5, m_textLine, "max toi iters = %d, max root iters = %d", b2_toiMaxIters, b2_toiMaxRootIters);
 		m_textLine += DRAW_STRING_NEW_LINE;
 